@@ -307,6 +307,8 @@ void doMd_QISI()
 
 int main()
 {
+  // the exit status, for CI
+  int status = 1;
   try
   {
 
@@ -369,6 +371,7 @@ int main()
       std::cout << e << "\n";
     }
     std::cout << "unittest: " << log.testsFailed << "/" << log.testsRun << " failures" << std::endl;
+    status = log.testsFailed ? 1 : 0;
 
     //doMd();
     //doMd_QIS();
@@ -445,5 +448,6 @@ int main()
   catch(...)
   {
     std::cout << "unknown exception" << std::endl;
-  }  
+  }
+  return status;
 }
\ No newline at end of file
@@ -1,7 +1,18 @@
 
+// Benchmark suite. Runs each kernel over a sweep of dimensionality, category count, population and thread count using
+// synthetic (but reproducible) marginals, and writes the timings as JSON, e.g.
+//
+// ./humanleague_perf > perf.json
+// ./humanleague_perf --quick --reps 3 --filter qis
+//
+// For each case, every thread runs its own independent instance of the kernel (the solvers themselves are
+// single-threaded) so the thread sweep measures throughput scaling, e.g. for the async node.js API. Times are the
+// median wall time of a batch (one run per thread) over the repetitions.
+
 #include "src/IPF.h"
 #include "src/QIS.h"
-#include "src/QSIPF.h"
+#include "src/QISI.h"
+#include "src/QIWS.h"
 #include "src/Sobol.h"
 
 #include "src/NDArray.h"
@@ -10,96 +21,431 @@
 
 #include <map>
 #include <vector>
+#include <memory>
+#include <string>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdlib>
 
-// TODO integer marginals
-size_t n = 1000;
+namespace {
 
-void do2dIPF()
+struct Config
 {
-  // std::vector<std::vector<double>> m = {std::vector<double>{144., 150., 3., 2., 153., 345., 13., 11., 226., 304., 24., 18., 250., 336., 14., 21., 190., 176., 15., 14., 27., 10., 2., 3., 93., 135., 2., 6., 30., 465., 11., 28., 43., 463., 17., 76., 39., 458., 15., 88., 55., 316., 22., 50., 15., 25., 11., 17}, 
-  // std::vector<double>{18., 1., 1., 3., 6., 5., 1., 2., 1., 8., 2., 3., 4., 2., 4., 2., 2., 2., 4., 2., 4., 2., 2., 8., 10., 6., 2., 1., 2., 2., 2., 1., 1., 1., 5., 1., 2., 1., 1., 1., 3., 2., 1., 3., 3., 1., 1., 4., 4., 1., 1., 5., 4., 10., 1., 6., 2., 67., 1., 10., 7., 9., 4., 21., 19., 9., 131., 17., 9., 8., 14., 17., 13., 11., 3., 6., 2., 2., 3., 1., 12., 1., 1., 1., 2., 1., 1., 1., 2., 21., 1., 26., 97., 10., 47., 6., 2., 3., 2., 7., 2., 17., 2., 6., 3., 1., 1., 2., 18., 9., 59., 5., 399., 71., 100., 157., 74., 199., 154., 98., 22., 7., 13., 39., 19., 6., 43., 41., 24., 14., 30., 30., 105., 604., 15., 69., 33., 1., 122., 17., 20., 9., 77., 4., 9., 4., 56., 1., 32., 10., 9., 79., 4., 2., 30., 116., 3., 6., 14., 18., 2., 2., 9., 4., 11., 12., 5., 5., 2., 1., 1., 3., 9., 2., 7., 3., 1., 4., 1., 3., 2., 1., 7., 1., 7., 4., 17., 3., 5., 2., 6., 11., 2., 2., 3., 13., 3., 5., 1., 3., 2., 4., 2., 1., 16., 4., 1., 3., 7., 4., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 3., 1., 2., 2., 1., 1., 2., 1., 1., 1., 1., 2., 1., 1., 1., 1., 2., 6., 1., 1., 1., 2., 1., 1., 1., 2., 1., 1., 1., 1., 1., 1., 2., 1., 1., 1., 2., 1., 2., 1., 1., 1., 9., 1., 1., 2., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 2., 1., 1., 1., 1., 330., 28., 281., 12}};
+  bool quick = false;
+  size_t reps = 5;
+  size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  // substring match on the benchmark name
+  std::string filter;
+  std::string output;
+};
 
-  std::vector<NDArray<double>> m;
-  std::vector<double> m0{144., 150., 3., 2., 153., 345., 13., 11., 226., 304., 24., 18., 250., 336., 14., 21., 190., 176., 15., 14., 27., 10., 2., 3., 93., 135., 2., 6., 30., 465., 11., 28., 43., 463., 17., 76., 39., 458., 15., 88., 55., 316., 22., 50., 15., 25., 11., 17}; 
-  std::vector<double> m1{18., 1., 1., 3., 6., 5., 1., 2., 1., 8., 2., 3., 4., 2., 4., 2., 2., 2., 4., 2., 4., 2., 2., 8., 10., 6., 2., 1., 2., 2., 2., 1., 1., 1., 5., 1., 2., 1., 1., 1., 3., 2., 1., 3., 3., 1., 1., 4., 4., 1., 1., 5., 4., 10., 1., 6., 2., 67., 1., 10., 7., 9., 4., 21., 19., 9., 131., 17., 9., 8., 14., 17., 13., 11., 3., 6., 2., 2., 3., 1., 12., 1., 1., 1., 2., 1., 1., 1., 2., 21., 1., 26., 97., 10., 47., 6., 2., 3., 2., 7., 2., 17., 2., 6., 3., 1., 1., 2., 18., 9., 59., 5., 399., 71., 100., 157., 74., 199., 154., 98., 22., 7., 13., 39., 19., 6., 43., 41., 24., 14., 30., 30., 105., 604., 15., 69., 33., 1., 122., 17., 20., 9., 77., 4., 9., 4., 56., 1., 32., 10., 9., 79., 4., 2., 30., 116., 3., 6., 14., 18., 2., 2., 9., 4., 11., 12., 5., 5., 2., 1., 1., 3., 9., 2., 7., 3., 1., 4., 1., 3., 2., 1., 7., 1., 7., 4., 17., 3., 5., 2., 6., 11., 2., 2., 3., 13., 3., 5., 1., 3., 2., 4., 2., 1., 16., 4., 1., 3., 7., 4., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 3., 1., 2., 2., 1., 1., 2., 1., 1., 1., 1., 2., 1., 1., 1., 1., 2., 6., 1., 1., 1., 2., 1., 1., 1., 2., 1., 1., 1., 1., 1., 1., 2., 1., 1., 1., 2., 1., 2., 1., 1., 1., 9., 1., 1., 2., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 1., 2., 1., 1., 1., 1., 330., 28., 281., 12};
-  m.push_back(NDArray<double>({(int64_t)m0.size()}, m0.data()));
-  m.push_back(NDArray<double>({(int64_t)m1.size()}, m1.data()));
-  
-  std::vector<int64_t> size{ (int64_t)m0.size(), (int64_t)m1.size() };                                        
+struct Case
+{
+  std::string name;
+  size_t dims;
+  int64_t categories;
+  int64_t population;
+};
 
-  NDArray<double> s(size);
-  s.assign(1.0);
-  //Index index(s.sizes());
-  //s[index] = 0.5;
-  IPF<double>::index_list_t index{std::vector<int64_t>{0},std::vector<int64_t>{1}};
-  for (size_t i = 0; i < n; ++i)
+// what a single run of a kernel did, for throughput and convergence reporting
+struct Work
+{
+  double people;
+  double cells;
+  int64_t iterations;
+};
+
+struct Result
+{
+  Case c;
+  size_t threads;
+  std::vector<double> times;
+  Work work;
+};
+
+// population split across the categories with reproducible random weights, integerised so that every marginal sums
+// to the population exactly
+std::vector<int64_t> syntheticMarginal(int64_t categories, int64_t population, std::mt19937& rng)
+{
+  std::uniform_real_distribution<double> weight(1.0, 10.0);
+  std::vector<double> w(categories);
+  for (double& x: w)
+    x = weight(rng);
+  const double total = sum(w);
+
+  std::vector<int64_t> m(categories);
+  std::vector<std::pair<double, int64_t>> remainders;
+  int64_t allocated = 0;
+  for (int64_t i = 0; i < categories; ++i)
   {
-    IPF<double> ipf(index, m);
-    ipf.solve(s);
+    const double exact = population * w[i] / total;
+    m[i] = static_cast<int64_t>(exact);
+    allocated += m[i];
+    remainders.push_back(std::make_pair(exact - m[i], i));
   }
+  std::sort(remainders.rbegin(), remainders.rend());
+  for (int64_t i = 0; i < population - allocated; ++i)
+    ++m[remainders[i].second];
+  return m;
 }
 
-void do2dQIS()
+// one 1-d marginal per dimension
+struct Problem
 {
-  std::vector<NDArray<int64_t>> m;
-  std::vector<int64_t> m0{144, 150, 3, 2, 153, 345, 13, 11, 226, 304, 24, 18, 250, 336, 14, 21, 190, 176, 15, 14, 27, 10, 2, 3, 93, 135, 2, 6, 30, 465, 11, 28, 43, 463, 17, 76, 39, 458, 15, 88, 55, 316, 22, 50, 15, 25, 11, 17}; 
-  std::vector<int64_t> m1{18, 1, 1, 3, 6, 5, 1, 2, 1, 8, 2, 3, 4, 2, 4, 2, 2, 2, 4, 2, 4, 2, 2, 8, 10, 6, 2, 1, 2, 2, 2, 1, 1, 1, 5, 1, 2, 1, 1, 1, 3, 2, 1, 3, 3, 1, 1, 4, 4, 1, 1, 5, 4, 10, 1, 6, 2, 67, 1, 10, 7, 9, 4, 21, 19, 9, 131, 17, 9, 8, 14, 17, 13, 11, 3, 6, 2, 2, 3, 1, 12, 1, 1, 1, 2, 1, 1, 1, 2, 21, 1, 26, 97, 10, 47, 6, 2, 3, 2, 7, 2, 17, 2, 6, 3, 1, 1, 2, 18, 9, 59, 5, 399, 71, 100, 157, 74, 199, 154, 98, 22, 7, 13, 39, 19, 6, 43, 41, 24, 14, 30, 30, 105, 604, 15, 69, 33, 1, 122, 17, 20, 9, 77, 4, 9, 4, 56, 1, 32, 10, 9, 79, 4, 2, 30, 116, 3, 6, 14, 18, 2, 2, 9, 4, 11, 12, 5, 5, 2, 1, 1, 3, 9, 2, 7, 3, 1, 4, 1, 3, 2, 1, 7, 1, 7, 4, 17, 3, 5, 2, 6, 11, 2, 2, 3, 13, 3, 5, 1, 3, 2, 4, 2, 1, 16, 4, 1, 3, 7, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 1, 2, 2, 1, 1, 2, 1, 1, 1, 1, 2, 1, 1, 1, 1, 2, 6, 1, 1, 1, 2, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 2, 1, 2, 1, 1, 1, 9, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 330, 28, 281, 12};  
-  m.push_back(NDArray<int64_t>({(int64_t)m0.size()}, m0.data()));
-  m.push_back(NDArray<int64_t>({(int64_t)m1.size()}, m1.data()));
-  
-  std::vector<std::vector<int64_t>> index;
-  index.push_back(std::vector<int64_t>(1,0));
-  index.push_back(std::vector<int64_t>(1,1));
+  Problem(const Case& c) : indices(c.dims), sizes(c.dims, c.categories), marginals(c.dims)
+  {
+    // seeded from the case so that every run of the suite sees the same data
+    std::mt19937 rng(static_cast<uint32_t>(c.dims * 1000003 + c.categories * 1009 + c.population));
+    for (size_t k = 0; k < c.dims; ++k)
+    {
+      indices[k] = std::vector<int64_t>{static_cast<int64_t>(k)};
+      marginals[k] = syntheticMarginal(c.categories, c.population, rng);
+    }
+  }
 
-  for (size_t i = 0; i < n; ++i)
+  template<typename T>
+  std::vector<NDArray<T>> ndMarginals() const
   {
-    QIS qis(index, m);
-    qis.solve();
+    std::vector<NDArray<T>> m;
+    m.reserve(marginals.size());
+    for (const std::vector<int64_t>& v: marginals)
+    {
+      m.push_back(NDArray<T>(std::vector<int64_t>{static_cast<int64_t>(v.size())}));
+      std::copy(v.begin(), v.end(), const_cast<T*>(m.back().rawData()));
+    }
+    return m;
+  }
+
+  std::vector<QIWS::marginal_t> qiwsMarginals() const
+  {
+    std::vector<QIWS::marginal_t> m;
+    for (const std::vector<int64_t>& v: marginals)
+      m.push_back(QIWS::marginal_t(v.begin(), v.end()));
+    return m;
+  }
+
+  NDArray<double> seed() const
+  {
+    NDArray<double> s(sizes);
+    s.assign(1.0);
+    return s;
+  }
+
+  double cells() const
+  {
+    return static_cast<double>(product(sizes));
   }
+
+  std::vector<std::vector<int64_t>> indices;
+  std::vector<int64_t> sizes;
+  std::vector<std::vector<int64_t>> marginals;
+};
+
+// A kernel is constructed once per thread (setup is not timed) and returns a function that performs one timed run
+typedef std::function<Work()> run_t;
+typedef std::function<run_t(const Case&)> kernel_t;
+
+// T is the population type, e.g. float for single precision
+template<typename T>
+run_t ipfKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  std::shared_ptr<NDArray<double>> seed(new NDArray<double>(p->seed()));
+  return [p, seed]() {
+    std::vector<NDArray<double>> m = p->ndMarginals<double>();
+    IPF<double, T> ipf(p->indices, m);
+    ipf.solve(*seed);
+    if (!ipf.conv())
+      throw std::runtime_error("ipf did not converge");
+    return Work{static_cast<double>(ipf.population()), p->cells(), static_cast<int64_t>(ipf.iters())};
+  };
+}
+
+run_t qisKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  return [p]() {
+    // QIS consumes its marginals so they are regenerated each run (this is cheap relative to the solve)
+    std::vector<NDArray<int64_t>> m = p->ndMarginals<int64_t>();
+    QIS qis(p->indices, m);
+    qis.solve();
+    return Work{static_cast<double>(qis.population()), p->cells(), 0};
+  };
+}
+
+run_t qisiKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  std::shared_ptr<NDArray<double>> seed(new NDArray<double>(p->seed()));
+  return [p, seed]() {
+    std::vector<NDArray<int64_t>> m = p->ndMarginals<int64_t>();
+    QISI qisi(p->indices, m);
+    qisi.solve(*seed);
+    return Work{static_cast<double>(qisi.population()), p->cells(), 0};
+  };
+}
+
+run_t qiwsKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  return [p]() {
+    QIWS qiws(p->qiwsMarginals());
+    qiws.solve();
+    return Work{static_cast<double>(qiws.population()), p->cells(), 0};
+  };
+}
+
+// population is the sequence length, categories is unused. "cells" are the individual variates
+run_t sobolKernel(const Case& c)
+{
+  return [c]() {
+    Sobol sobol(c.dims);
+    uint32_t acc = 0;
+    for (int64_t i = 0; i < c.population; ++i)
+    {
+      const std::vector<uint32_t>& b = sobol.buf();
+      acc ^= b[0];
+    }
+    // stop the loop being optimised away
+    volatile uint32_t sink = acc;
+    (void)sink;
+    return Work{static_cast<double>(c.population), static_cast<double>(c.population * c.dims), 0};
+  };
+}
+
+// reduction of a population onto each of its dimensions
+run_t reduceKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  std::shared_ptr<NDArray<double>> a(new NDArray<double>(p->seed()));
+  return [p, a]() {
+    double acc = 0.0;
+    for (size_t k = 0; k < p->sizes.size(); ++k)
+      acc += reduce(*a, std::vector<int64_t>{static_cast<int64_t>(k)}).rawData()[0];
+    volatile double sink = acc;
+    (void)sink;
+    return Work{0.0, p->cells() * p->sizes.size(), 0};
+  };
+}
+
+// extraction of every slice along the first dimension
+run_t sliceKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  std::shared_ptr<NDArray<double>> a(new NDArray<double>(p->seed()));
+  return [p, a]() {
+    double acc = 0.0;
+    for (int64_t i = 0; i < p->sizes[0]; ++i)
+      acc += slice(*a, std::make_pair(int64_t(0), i)).rawData()[0];
+    volatile double sink = acc;
+    (void)sink;
+    return Work{0.0, p->cells(), 0};
+  };
+}
+
+// conversion of a (QIS-generated) population table into a list of individuals
+run_t listifyKernel(const Case& c)
+{
+  std::shared_ptr<Problem> p(new Problem(c));
+  std::vector<NDArray<int64_t>> m = p->ndMarginals<int64_t>();
+  QIS qis(p->indices, m);
+  std::shared_ptr<NDArray<int64_t>> pop(new NDArray<int64_t>(p->sizes));
+  NDArray<int64_t>::copy(qis.solve(), *pop);
+  return [c, p, pop]() {
+    std::vector<std::vector<int>> list = listify(c.population, *pop);
+    return Work{static_cast<double>(list[0].size()), p->cells(), 0};
+  };
 }
 
-void do3dIPF()
+std::vector<Case> sweep(const std::string& name, const std::vector<size_t>& dims, const std::vector<int64_t>& categories,
+                        const std::vector<int64_t>& populations, double maxWork)
 {
-  std::vector<std::vector<double>> m = {std::vector<double>{52, 48}, 
-                                        std::vector<double>{10, 77, 13},
-                                        std::vector<double>{20, 27, 30, 23}};
-  
-  std::vector<int64_t> size{ (int64_t)m[0].size(), (int64_t)m[1].size(), (int64_t)m[2].size() };                                        
+  std::vector<Case> cases;
+  for (size_t d: dims)
+    for (int64_t c: categories)
+      for (int64_t p: populations)
+      {
+        // skip cases that would take too long (sampling cost is roughly population x states)
+        double cells = 1.0;
+        for (size_t i = 0; i < d; ++i)
+          cells *= c;
+        if (cells * std::max<int64_t>(p, 1) <= maxWork)
+          cases.push_back(Case{name, d, c, p});
+      }
+  return cases;
+}
+
+double median(std::vector<double> x)
+{
+  std::sort(x.begin(), x.end());
+  const size_t n = x.size();
+  return n % 2 ? x[n/2] : 0.5 * (x[n/2-1] + x[n/2]);
+}
+
+Result run(const Case& c, kernel_t kernel, size_t threads, size_t reps)
+{
+  typedef std::chrono::steady_clock clock;
+
+  std::vector<run_t> runs;
+  for (size_t t = 0; t < threads; ++t)
+    runs.push_back(kernel(c));
+
+  Result result{c, threads, std::vector<double>(), Work{0.0, 0.0, 0}};
+  // the first batch is a warm-up and is not recorded
+  for (size_t r = 0; r <= reps; ++r)
+  {
+    std::vector<Work> work(threads);
+    std::vector<std::string> errors(threads);
+    clock::time_point start = clock::now();
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+      pool.push_back(std::thread([&, t]() {
+        try
+        {
+          work[t] = runs[t]();
+        }
+        catch(const std::exception& e)
+        {
+          errors[t] = e.what();
+        }
+      }));
+    }
+    for (std::thread& t: pool)
+      t.join();
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
 
-  NDArray<double> s(size);
-  s.assign(1.0);
-  //Index index(s.sizes());
-  //s[index] = 0.5;
+    for (const std::string& e: errors)
+      if (!e.empty())
+        throw std::runtime_error(c.name + ": " + e);
+    if (r > 0)
+      result.times.push_back(elapsed);
+    result.work = work[0];
+  }
+  return result;
+}
 
-  deprecated::IPF ipf(s, m);
+void writeJson(std::ostream& os, const Config& config, const std::vector<Result>& results)
+{
+  os << "{\n";
+  os << "  \"meta\": {\"compiler\": \"" << __VERSION__ << "\", \"cpus\": " << std::thread::hardware_concurrency()
+     << ", \"reps\": " << config.reps << ", \"quick\": " << (config.quick ? "true" : "false") << "},\n";
+  os << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    const Result& r = results[i];
+    const double t = median(r.times);
+    const double min = *std::min_element(r.times.begin(), r.times.end());
+    os << (i ? "," : "") << "\n    {\"name\": \"" << r.c.name << "\", \"dims\": " << r.c.dims
+       << ", \"categories\": " << r.c.categories << ", \"population\": " << r.c.population
+       << ", \"threads\": " << r.threads << ", \"time\": " << t << ", \"time_min\": " << min
+       << ", \"iterations\": " << r.work.iterations
+       << ", \"people_per_sec\": " << r.threads * r.work.people / t
+       << ", \"cells_per_sec\": " << r.threads * r.work.cells / t << "}";
+  }
+  os << "\n  ]\n}\n";
+}
 
-  auto e = ipf.errors();
-  print(e[0]);
-  print(e[1]);
-  print(e[2]);
-  std::cout << ipf.conv() << ":" << ipf.iters() << std::endl;
-  print(ipf.result().rawData(), ipf.result().storageSize(), m[1].size());
-  print(reduce(ipf.result(), 0));
-  print(reduce(ipf.result(), 1));
-  print(reduce(ipf.result(), 2));
+Config parseArgs(int argc, const char* argv[])
+{
+  Config config;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg(argv[i]);
+    if (arg == "--quick")
+      config.quick = true;
+    else if (arg == "--reps" && i + 1 < argc)
+      config.reps = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc)
+      config.maxThreads = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--filter" && i + 1 < argc)
+      config.filter = argv[++i];
+    else if (arg == "--output" && i + 1 < argc)
+      config.output = argv[++i];
+    else
+      throw std::runtime_error("usage: " + std::string(argv[0]) +
+                               " [--quick] [--reps n] [--threads max] [--filter name] [--output file.json]");
+  }
+  return config;
 }
 
+}
 
-int main()
+int main(int argc, const char* argv[])
 {
   try
   {
-    //do2dIPF();
-    do2dQIS();
-    //do3dIPF();
+    Config config = parseArgs(argc, argv);
+
+    // thread counts: powers of 2 up to the maximum, plus the maximum itself
+    std::vector<size_t> threads;
+    for (size_t t = 1; t < config.maxThreads; t *= 2)
+      threads.push_back(t);
+    threads.push_back(config.maxThreads);
+
+    const bool q = config.quick;
+    const std::vector<size_t> dims = q ? std::vector<size_t>{2, 3} : std::vector<size_t>{2, 3, 4, 5};
+    const std::vector<int64_t> cats = q ? std::vector<int64_t>{2, 10} : std::vector<int64_t>{2, 5, 10, 20};
+    const std::vector<int64_t> pops = q ? std::vector<int64_t>{1000, 10000} : std::vector<int64_t>{1000, 10000, 100000};
+    const double maxWork = q ? 1e7 : 1e8;
+
+    std::vector<std::pair<std::vector<Case>, kernel_t>> suite{
+      { sweep("ipf", dims, cats, std::vector<int64_t>{pops.back()}, 1e12), ipfKernel<double> },
+      { sweep("ipf32", dims, cats, std::vector<int64_t>{pops.back()}, 1e12), ipfKernel<float> },
+      { sweep("qis", dims, cats, pops, maxWork), qisKernel },
+      { sweep("qisi", dims, cats, pops, maxWork), qisiKernel },
+      { sweep("qiws", dims, cats, pops, maxWork), qiwsKernel },
+      { sweep("sobol", q ? std::vector<size_t>{2, 8} : std::vector<size_t>{2, 8, 32, 128}, std::vector<int64_t>{0},
+              std::vector<int64_t>{q ? 100000 : 1000000}, 1e12), sobolKernel },
+      { sweep("reduce", dims, cats, std::vector<int64_t>{0}, 1e12), reduceKernel },
+      { sweep("slice", dims, cats, std::vector<int64_t>{0}, 1e12), sliceKernel },
+      { sweep("listify", dims, cats, pops, 1e12), listifyKernel }
+    };
+
+    std::vector<Result> results;
+    for (const auto& s: suite)
+    {
+      for (const Case& c: s.first)
+      {
+        if (c.name.find(config.filter) == std::string::npos)
+          continue;
+        for (size_t t: threads)
+        {
+          // QIWS draws from a static Sobol sequence so instances cannot run concurrently
+          if (c.name == "qiws" && t > 1)
+            break;
+          results.push_back(run(c, s.second, t, config.reps));
+          std::cerr << c.name << " d=" << c.dims << " c=" << c.categories << " p=" << c.population << " t=" << t
+                    << ": " << median(results.back().times) << "s" << std::endl;
+        }
+      }
+    }
+
+    if (config.output.empty())
+    {
+      writeJson(std::cout, config, results);
+    }
+    else
+    {
+      std::ofstream file(config.output);
+      writeJson(file, config, results);
+    }
   }
   catch(const std::exception& e)
   {
-    std::cout << e.what() << std::endl;
+    std::cerr << e.what() << std::endl;
+    return 1;
   }
   catch(...)
   {
-    std::cout << "unknown exception" << std::endl;
-  }  
-}
\ No newline at end of file
+    std::cerr << "unknown exception" << std::endl;
+    return 1;
+  }
+}
@@ -1,6 +1,13 @@
+# Benchmark suite, e.g.
+# make -f perf.mk && ./humanleague_perf > perf.json
+# make -f perf.mk bench
+
 PROJECT:=humanleague_perf
 
-src = perf.cpp ../src/NDArrayUtils.cpp ../src/Index.cpp ../src/Sobol.cpp ../src/SobolImpl.cpp ../src/StatFuncs.cpp ../src/IPF.cpp ../src/QIS.cpp ../src/QIWS.cpp
+src = perf.cpp ../src/NDArrayUtils.cpp ../src/Index.cpp ../src/Sobol.cpp ../src/SobolImpl.cpp ../src/StatFuncs.cpp \
+      ../src/QIS.cpp ../src/QISI.cpp ../src/QIWS.cpp ../src/Trace.cpp ../src/Allocator.cpp ../src/MappedArray.cpp ../src/Simd.cpp \
+      ../src/Replicates.cpp ../src/Components.cpp ../src/JunctionTree.cpp ../src/Raking.cpp ../src/RecordQISI.cpp ../src/TRS.cpp \
+      ../src/Integerise.cpp ../src/TaskPool.cpp ../src/Hierarchy.cpp ../src/Adjust.cpp ../src/Mask.cpp
 obj = $(src:.cpp=.o)
 dep = $(obj:.o=.d)
 
@@ -9,14 +16,19 @@ dep = $(obj:.o=.d)
 
 CXX=g++
 # use -m32 to test for LLP64 data model issues (i.e. windows)
-CXXFLAGS=-Wall -Werror -g -O2 -std=c++11 -I..
-LDFLAGS=
+CXXFLAGS=-Wall -Werror -pthread -g -O2 -std=c++11 -I..
+# Note: this arg must come AFTER the object files
+LDFLAGS=-pthread
 
 # this doesnt test python and R interfaces!!!
-all: humanleague_perf 
+all: $(PROJECT)
+
+$(PROJECT): $(obj)
+	$(CXX) -o $@ $^ $(LDFLAGS)
 
-humanleague_perf: $(obj)
-	$(CXX) $(LDFLAGS) -o $@ $^ $(LDFLAGS)
+# full sweep, results in perf.json
+bench: $(PROJECT)
+	./$(PROJECT) --output perf.json
 
 %.d: %.cpp
 	@$(CXX) $(CXXFLAGS) $< -MM -MT $(@:.d=.o) >$@
@@ -27,5 +39,4 @@ humanleague_perf: $(obj)
 clean:
 	rm -f $(PROJECT) $(obj) $(dep)
 
-.PHONY: all clean
-
+.PHONY: all bench clean
@@ -3,6 +3,7 @@
 
 #include "Object.h"
 #include "src/NDArray.h"
+#include "src/NDArrayUtils.h"
 //#include "src/NDArrayOld.h"
 
 #include <Python.h>
@@ -115,7 +116,9 @@ namespace pycpp {
     explicit Array(const NDArray<T>& a) 
       : Array(a.dim(), convert(a.sizes()).data()) 
     {
-      std::copy(a.rawData(), a.rawData() + a.storageSize(), rawData());
+      // numpy array is row-major
+      NDArray<T> wrapper(a.sizes(), rawData());
+      transposeStorage(a, wrapper);
     }
 
     // // shallow copy, increase ref count
@@ -164,10 +167,21 @@ namespace pycpp {
       std::vector<int64_t> sizes(dim);
       for (size_t i = 0; i < dim; ++i)
         sizes[i] = shape()[i];
-      NDArray<T> tmp(sizes);
+      // preserve the numpy layout, e.g. fortran-ordered arrays are copied as-is into a column-major NDArray
+      NDArray<T> tmp(sizes, storageOrder());
       std::copy(rawData(), rawData() + tmp.storageSize(), const_cast<T*>(tmp.rawData()));
       return tmp;
     }
+
+    // Contiguous arrays only, 1-D arrays are considered row major
+    StorageOrder storageOrder() const
+    {
+      if (PyArray_IS_C_CONTIGUOUS((PyArrayObject*)m_obj))
+        return StorageOrder::RowMajor;
+      if (PyArray_IS_F_CONTIGUOUS((PyArrayObject*)m_obj))
+        return StorageOrder::ColumnMajor;
+      throw std::runtime_error("numpy array is not contiguous");
+    }
     
     // TODO dimension
     int dim() const 
@@ -9,6 +9,14 @@
 #include "src/IPF.h"
 #include "src/QIS.h"
 #include "src/QISI.h"
+#include "src/Replicates.h"
+#include "src/Components.h"
+#include "src/JunctionTree.h"
+#include "src/Raking.h"
+#include "src/RecordQISI.h"
+#include "src/Hierarchy.h"
+#include "src/SolutionCache.h"
+#include "src/MappedArray.h"
 
 #include "src/UnitTester.h"
 
@@ -34,17 +42,78 @@ pycpp::List flatten(const size_t pop, const NDArray<T>& t)
   return outer;
 }
 
+// Adds the solver instrumentation (see src/Profile.h), unless compiled out, as
+// {"phases": {name: {"time": s, "calls": n, "allocations": n}}, "counters": {name: n}}
+void insertProfile(pycpp::Dict& retval, const Profile& profile)
+{
+  if (!Profile::enabled())
+    return;
+
+  pycpp::Dict phases;
+  for (const auto& p: profile.phases())
+  {
+    pycpp::Dict phase;
+    phase.insert("time", pycpp::Double(p.second.time));
+    phase.insert("calls", pycpp::Int(p.second.calls));
+    phase.insert("allocations", pycpp::Int(p.second.allocations));
+    phases.insert(p.first.c_str(), std::move(phase));
+  }
+
+  pycpp::Dict result;
+  result.insert("phases", std::move(phases));
+  result.insert("counters", pycpp::Dict(profile.counters()));
+  retval.insert("profile", std::move(result));
+}
+
+// A mask of structural zeros (see src/Mask.h) from an optional numpy integer array, nonzero for the allowed states
+Mask toMask(PyObject* maskArg)
+{
+  if (!maskArg || maskArg == Py_None)
+    return Mask();
+  if (!PyArray_Check(maskArg))
+    throw std::runtime_error("mask should be a numpy integer array");
+  const NDArray<int64_t>& values = pycpp::Array<int64_t>(maskArg).toNDArray();
+  NDArray<bool> allowed(values.sizes());
+  for (Index index(values.sizes()); !index.end(); ++index)
+    allowed[index] = values[index] != 0;
+  return Mask(allowed);
+}
+
 // flatten n-D integer array into 2-d table
 extern "C" PyObject* humanleague_flatten(PyObject* self, PyObject* args)
 {
   try
   {
     PyObject* arrayArg;
+    PyObject* countsArg = nullptr;
 
     // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
-    if (!PyArg_ParseTuple(args, "O!", &PyArray_Type, &arrayArg))
+    if (!PyArg_ParseTuple(args, "O!|O!", &PyArray_Type, &arrayArg, &PyArray_Type, &countsArg))
       return nullptr;
 
+    // sparse population: coordinates (one row per occupied state) and counts
+    if (countsArg)
+    {
+      pycpp::Array<int64_t> coords(arrayArg);
+      const std::vector<int64_t>& counts = pycpp::Array<int64_t>(countsArg).toVector<int64_t>();
+      if (coords.dim() != 2 || coords.shape()[0] != (int64_t)counts.size())
+        throw std::runtime_error("coordinates must be a 2d array with a row for each count");
+      const NDArray<int64_t>& c = coords.toNDArray();
+      const int64_t dim = coords.shape()[1];
+      std::vector<std::vector<int>> list(dim);
+      for (size_t i = 0; i < counts.size(); ++i)
+      {
+        for (int64_t j = 0; j < dim; ++j)
+          list[j].insert(list[j].end(), counts[i], c[{(int64_t)i, j}]);
+      }
+      pycpp::List outer(dim);
+      for (int64_t i = 0; i < dim; ++i)
+      {
+        outer.set(i, pycpp::List(list[i]));
+      }
+      return outer.release();
+    }
+
     pycpp::Array<int64_t> pyarray(arrayArg);
 
     NDArray<int64_t> array(pyarray.toNDArray());
@@ -160,9 +229,12 @@ extern "C" PyObject* humanleague_ipf(PyObject *self, PyObject *args)
     PyObject* indexArg;
     PyObject* arrayArg;
     PyObject* seedArg;
+    // solve in a single precision population (the result is still float64)
+    int single = false;
 
     // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
-    if (!PyArg_ParseTuple(args, "O!O!O!", &PyArray_Type, & seedArg, &PyList_Type, &indexArg, &PyList_Type, &arrayArg))
+    if (!PyArg_ParseTuple(args, "O!O!O!|p", &PyArray_Type, & seedArg, &PyList_Type, &indexArg, &PyList_Type, &arrayArg,
+                          &single))
       return nullptr;
 
     // seed
@@ -192,16 +264,108 @@ extern "C" PyObject* humanleague_ipf(PyObject *self, PyObject *args)
       marginals.push_back(std::move(ma.toNDArray/*<double>*/()));
     }
 
-    IPF<double> ipf(indices, marginals);
-    const NDArray<double>& result = ipf.solve(seed.toNDArray());
+    std::shared_ptr<const Solution> ipf = cached::ipf(indices, marginals, seed.toNDArray(), single);
+
+    pycpp::Dict retval;
+    retval.insert("result", pycpp::Array<double>(ipf->realArray("result")));
+    retval.insert("conv", pycpp::Bool(ipf->scalar("conv")));
+    retval.insert("pop", pycpp::Double(ipf->scalar("pop")));
+    retval.insert("iterations", pycpp::Int((int64_t)ipf->scalar("iterations")));
+    // result.insert("errors", ipf.errors());
+    retval.insert("maxError", pycpp::Double(ipf->scalar("maxError")));
+    insertProfile(retval, ipf->profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+
+// IPF (unity seed) as clique tables of a junction tree, optionally sampling a (sparse) population. Not cached
+extern "C" PyObject* humanleague_junctionTree(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int sample = 0;
+    int64_t skips = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!|pi", &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &sample, &skips))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<double>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy float arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<double> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+
+    JunctionTreeIPF ipf(indices, marginals);
+    ipf.solve();
 
     pycpp::Dict retval;
-    retval.insert("result", pycpp::Array<double>(result));
+    pycpp::List cliques(ipf.cliques());
+    for (size_t c = 0; c < ipf.cliques(); ++c)
+    {
+      pycpp::Dict clique;
+      clique.insert("dims", pycpp::Array<int64_t>(ipf.clique(c)));
+      clique.insert("table", pycpp::Array<double>(ipf.cliqueTable(c)));
+      cliques.set(c, std::move(clique));
+    }
+    retval.insert("cliques", std::move(cliques));
+    pycpp::List separators(ipf.edges().size());
+    for (size_t e = 0; e < ipf.edges().size(); ++e)
+    {
+      pycpp::Dict separator;
+      separator.insert("cliques", pycpp::Array<int64_t>(std::vector<int64_t>{(int64_t)ipf.edges()[e].first, (int64_t)ipf.edges()[e].second}));
+      separator.insert("dims", pycpp::Array<int64_t>(ipf.separator(e)));
+      separator.insert("table", pycpp::Array<double>(ipf.separatorTable(e)));
+      separators.set(e, std::move(separator));
+    }
+    retval.insert("separators", std::move(separators));
+    retval.insert("decomposable", pycpp::Bool(ipf.decomposable()));
     retval.insert("conv", pycpp::Bool(ipf.conv()));
     retval.insert("pop", pycpp::Double(ipf.population()));
-    retval.insert("iterations", pycpp::Int(ipf.iters()));
-    // result.insert("errors", ipf.errors());
+    retval.insert("iterations", pycpp::Int((int64_t)ipf.iters()));
     retval.insert("maxError", pycpp::Double(ipf.maxError()));
+    if (sample)
+    {
+      // as for a sparse qis
+      NDArray<int64_t> coords;
+      NDArray<int64_t> counts;
+      ipf.sample(skips).coordinates(coords, counts);
+      pycpp::Dict result;
+      result.insert("shape", pycpp::Array<int64_t>(ipf.sizes()));
+      result.insert("coords", pycpp::Array<int64_t>(coords));
+      result.insert("counts", pycpp::Array<int64_t>(counts));
+      retval.insert("result", std::move(result));
+      retval.insert("sampleConv", pycpp::Bool(ipf.sampleConv()));
+    }
+    insertProfile(retval, ipf.profile());
 
     return retval.release();
   }
@@ -215,6 +379,317 @@ extern "C" PyObject* humanleague_ipf(PyObject *self, PyObject *args)
   }
 }
 
+// Record-level IPF (raking): categories is a (records x dimensions) integer array, weights the records' starting weights
+extern "C" PyObject* humanleague_rake(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* categoryArg;
+    PyObject* weightArg;
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int64_t threads = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!O!O!|l", &PyArray_Type, &categoryArg, &PyArray_Type, &weightArg, &PyList_Type, &indexArg,
+                          &PyList_Type, &arrayArg, &threads))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<double>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy float arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<double> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+    if (threads < 0)
+      throw std::runtime_error("threads must be non-negative");
+
+    Raking raking(indices, marginals, pycpp::Array<int64_t>(categoryArg).toNDArray(), pycpp::Array<double>(weightArg).toNDArray());
+    raking.solve(threads);
+
+    pycpp::Dict retval;
+    retval.insert("weights", pycpp::Array<double>(raking.weights()));
+    retval.insert("conv", pycpp::Bool(raking.conv()));
+    retval.insert("pop", pycpp::Double(raking.population()));
+    retval.insert("iterations", pycpp::Int((int64_t)raking.iters()));
+    retval.insert("maxError", pycpp::Double(raking.maxError()));
+    insertProfile(retval, raking.profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// QISI-like integer population composed of the records of a microdata seed, returned as the record id of each individual
+extern "C" PyObject* humanleague_qisiRecords(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* categoryArg;
+    PyObject* weightArg;
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int64_t skips = 0;
+    int64_t threads = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!O!O!|ll", &PyArray_Type, &categoryArg, &PyArray_Type, &weightArg, &PyList_Type, &indexArg,
+                          &PyList_Type, &arrayArg, &skips, &threads))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<int64_t>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy integer arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<int64_t> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+    if (threads < 0)
+      throw std::runtime_error("threads must be non-negative");
+
+    RecordQISI qisi(indices, marginals, pycpp::Array<int64_t>(categoryArg).toNDArray(), pycpp::Array<double>(weightArg).toNDArray(),
+                    skips);
+    const std::vector<int64_t>& ids = qisi.solve(threads);
+
+    pycpp::Dict retval;
+    retval.insert("result", pycpp::Array<int64_t>(ids));
+    retval.insert("conv", pycpp::Bool(qisi.conv()));
+    retval.insert("pop", pycpp::Double(qisi.population()));
+    insertProfile(retval, qisi.profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// Microsynthesis of nested areas: parents gives the parent of each area (negative for a root), marginals a list (per area)
+// of lists of marginals, over the same indices
+extern "C" PyObject* humanleague_hierarchy(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* indexArg;
+    PyObject* parentArg;
+    PyObject* arrayArg;
+    PyObject* seedArg = nullptr;
+    int64_t threads = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!O!|O!l", &PyList_Type, &indexArg, &PyArray_Type, &parentArg, &PyList_Type, &arrayArg,
+                          &PyArray_Type, &seedArg, &threads))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    std::vector<std::vector<int64_t>> indices(ilist.size());
+    for (int64_t i = 0; i < ilist.size(); ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      indices[i] = pycpp::Array<int64_t>(ilist[i]).toVector<int64_t>();
+    }
+    const std::vector<int64_t>& parents = pycpp::Array<int64_t>(parentArg).toVector<int64_t>();
+
+    pycpp::List alist(arrayArg);
+    std::vector<std::vector<NDArray<int64_t>>> marginals(alist.size());
+    for (int64_t a = 0; a < alist.size(); ++a)
+    {
+      if (!PyList_Check(alist[a]))
+        throw std::runtime_error("marginal input should be a list (per area) of lists of numpy integer arrays");
+      pycpp::List mlist(alist[a]);
+      for (int64_t i = 0; i < mlist.size(); ++i)
+      {
+        if (!PyArray_Check(mlist[i]))
+          throw std::runtime_error("marginal input should be a list (per area) of lists of numpy integer arrays");
+        marginals[a].push_back(std::move(pycpp::Array<int64_t>(mlist[i]).toNDArray()));
+      }
+    }
+    if (threads < 0)
+      throw std::runtime_error("threads must be non-negative");
+
+    std::unique_ptr<Hierarchy> hierarchy;
+    if (seedArg)
+      hierarchy.reset(new Hierarchy(indices, parents, marginals, pycpp::Array<double>(seedArg).toNDArray()));
+    else
+      hierarchy.reset(new Hierarchy(indices, parents, marginals));
+    hierarchy->solve(threads);
+
+    pycpp::Dict retval;
+    retval.insert("leaves", pycpp::Array<int64_t>(hierarchy->leaves()));
+    retval.insert("result", pycpp::Array<int64_t>(hierarchy->population()));
+    retval.insert("expectation", pycpp::Array<double>(hierarchy->expectation()));
+    retval.insert("conv", pycpp::Bool(hierarchy->conv()));
+    insertProfile(retval, hierarchy->profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// Out-of-core IPF: the seed is read from, and the result written to, array files (see src/MappedArray.h). The
+// population is held in a memory-mapped temporary file in the given directory, so need not fit in memory
+extern "C" PyObject* humanleague_ipfFile(PyObject *self, PyObject *args)
+{
+  try
+  {
+    const char* seedFile;
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    const char* resultFile;
+    const char* directory = "";
+
+    if (!PyArg_ParseTuple(args, "sO!O!s|s", &seedFile, &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &resultFile, &directory))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<double>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy float arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<double> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+
+    // the solution cache is bypassed, it would hold the result in memory
+    MappedAllocator allocator(directory);
+    pycpp::Dict retval;
+    {
+      Allocator::Scope scope(allocator);
+      IPF<double> ipf(indices, marginals);
+      const NDArray<double>& seed = loadArray<double>(seedFile);
+      if (seed.sizes() != ipf.sizes())
+        throw std::runtime_error("seed dimensions do not match those of the marginals");
+      saveArray(ipf.solve(seed), resultFile);
+      retval.insert("conv", pycpp::Bool(ipf.conv()));
+      retval.insert("pop", pycpp::Double(ipf.population()));
+      retval.insert("iterations", pycpp::Int((int64_t)ipf.iters()));
+      retval.insert("maxError", pycpp::Double(ipf.maxError()));
+      insertProfile(retval, ipf.profile());
+    }
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// Saves a float or integer numpy array as an array file
+extern "C" PyObject* humanleague_saveArray(PyObject*, PyObject* args)
+{
+  try
+  {
+    PyObject* arrayArg;
+    const char* filename;
+
+    if (!PyArg_ParseTuple(args, "O!s", &PyArray_Type, &arrayArg, &filename))
+      return nullptr;
+
+    if (PyArray_ISFLOAT(reinterpret_cast<PyArrayObject*>(arrayArg)))
+      saveArray(pycpp::Array<double>(arrayArg).toNDArray(), filename);
+    else
+      saveArray(pycpp::Array<int64_t>(arrayArg).toNDArray(), filename);
+    Py_RETURN_NONE;
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// Loads an array file (of floats or 64-bit integers) into a numpy array
+extern "C" PyObject* humanleague_loadArray(PyObject*, PyObject* args)
+{
+  try
+  {
+    const char* filename;
+
+    if (!PyArg_ParseTuple(args, "s", &filename))
+      return nullptr;
+
+    if (arrayfile::readHeader(filename).kind == 'f')
+      return pycpp::Array<double>(loadArray<double>(filename)).release();
+    return pycpp::Array<int64_t>(loadArray<int64_t>(filename)).release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
 
 // prevents name mangling (but works without this)
 extern "C" PyObject* humanleague_qis(PyObject *self, PyObject *args)
@@ -224,10 +699,15 @@ extern "C" PyObject* humanleague_qis(PyObject *self, PyObject *args)
     PyObject* indexArg;
     PyObject* arrayArg;
     int64_t skips = 0;
+    int sparse = 0;
+    int statistics = 1;
+    PyObject* maskArg = nullptr;
 
     // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
-    if (!PyArg_ParseTuple(args, "O!O!|i", &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &skips))
+    if (!PyArg_ParseTuple(args, "O!O!|ippO", &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &skips, &sparse, &statistics,
+                          &maskArg))
       return nullptr;
+    const Mask& mask = toMask(maskArg);
 
     // seed
     //pycpp::Array<double> seed(seedArg);
@@ -256,18 +736,187 @@ extern "C" PyObject* humanleague_qis(PyObject *self, PyObject *args)
       marginals.push_back(std::move(ma.toNDArray()));
     }
 
-    QIS qis(indices, marginals, skips);
-    const NDArray<int64_t>& result = qis.solve();
-    const NDArray<double>& expect = qis.expectation();
     pycpp::Dict retval;
+    std::shared_ptr<const Solution> qis;
+    if (sparse)
+    {
+      if (!mask.empty())
+        throw std::runtime_error("a mask requires a dense result");
+      // the occupied states only, as coordinates and counts. The expectation is of the same states
+      qis = cached::qisSparse(indices, marginals, skips, statistics);
+      pycpp::Dict result;
+      result.insert("shape", pycpp::Array<int64_t>(qis->intArray("shape")));
+      result.insert("coords", pycpp::Array<int64_t>(qis->intArray("coords")));
+      result.insert("counts", pycpp::Array<int64_t>(qis->intArray("counts")));
+      retval.insert("result", std::move(result));
+    }
+    else
+    {
+      qis = cached::qis(indices, marginals, skips, statistics, mask);
+      retval.insert("result", pycpp::Array<int64_t>(qis->intArray("result")));
+    }
+    retval.insert("expectation", pycpp::Array<double>(qis->realArray("expectation")));
+    retval.insert("conv", pycpp::Bool(qis->scalar("conv")));
+    retval.insert("pop", pycpp::Double(qis->scalar("pop")));
+    if (statistics)
+    {
+      retval.insert("chiSq", pycpp::Double(qis->scalar("chiSq")));
+      retval.insert("pValue", pycpp::Double(qis->scalar("pValue")));
+      retval.insert("degeneracy", pycpp::Double(qis->scalar("degeneracy")));
+    }
+    insertProfile(retval, qis->profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// independent replicates of QIS, run concurrently. Not cached
+extern "C" PyObject* humanleague_qisReplicates(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int replicates;
+    int threads = 0;
+    unsigned int seed = 0;
+    int populations = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!i|iIp", &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &replicates, &threads, &seed, &populations))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    if (replicates < 1 || threads < 0)
+      throw std::runtime_error("replicates must be positive and threads non-negative");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<int64_t>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy float arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<int64_t> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+
+    QISReplicates qis(indices, marginals, replicates, seed, populations);
+    qis.solve(threads);
+
+    pycpp::Dict retval;
+    retval.insert("mean", pycpp::Array<double>(qis.mean()));
+    retval.insert("variance", pycpp::Array<double>(qis.variance()));
+    retval.insert("expectation", pycpp::Array<double>(qis.expectation()));
+    retval.insert("chiSq", pycpp::Array<double>(qis.chiSq()));
+    retval.insert("pValue", pycpp::Array<double>(qis.pValue()));
+    retval.insert("conv", pycpp::List(qis.conv()));
+    if (populations)
+    {
+      pycpp::List list(qis.replicates());
+      for (size_t r = 0; r < qis.replicates(); ++r)
+        list.set(r, pycpp::Array<int64_t>(qis.populations()[r]));
+      retval.insert("populations", std::move(list));
+    }
+    insertProfile(retval, qis.profile());
 
-    retval.insert("result", pycpp::Array<int64_t>(result));
-    retval.insert("expectation", pycpp::Array<double>(expect));
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+// QIS solved separately on each connected component of the problem, with a sparse joint population. Not cached
+extern "C" PyObject* humanleague_qisComponents(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int64_t skips = 0;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!|i", &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &skips))
+      return nullptr;
+
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<int64_t>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy float arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<int64_t> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+
+    ComponentQIS qis(indices, marginals, skips);
+    const SparseArray<int64_t>& population = qis.solve();
+
+    pycpp::Dict retval;
+    // each component's population and expectation, over its own dimensions
+    pycpp::List components(qis.components());
+    for (size_t c = 0; c < qis.components(); ++c)
+    {
+      pycpp::Dict component;
+      component.insert("dims", pycpp::Array<int64_t>(qis.component(c).dims));
+      component.insert("result", pycpp::Array<int64_t>(qis.componentPopulation(c)));
+      component.insert("expectation", pycpp::Array<double>(qis.componentExpectation(c)));
+      components.set(c, std::move(component));
+    }
+    retval.insert("components", std::move(components));
+
+    // the joint population as for a sparse qis, with the expectation of the occupied states
+    NDArray<int64_t> coords;
+    NDArray<int64_t> counts;
+    population.coordinates(coords, counts);
+    NDArray<double> expectation({(int64_t)counts.storageSize()});
+    for (size_t i = 0; i < counts.storageSize(); ++i)
+      expectation.begin()[i] = qis.expectation(std::vector<int64_t>(coords.rawData() + i * coords.size(1),
+                                                                    coords.rawData() + (i + 1) * coords.size(1)));
+    pycpp::Dict result;
+    result.insert("shape", pycpp::Array<int64_t>(qis.sizes()));
+    result.insert("coords", pycpp::Array<int64_t>(coords));
+    result.insert("counts", pycpp::Array<int64_t>(counts));
+    retval.insert("result", std::move(result));
+    retval.insert("expectation", pycpp::Array<double>(expectation));
     retval.insert("conv", pycpp::Bool(qis.conv()));
     retval.insert("pop", pycpp::Double(qis.population()));
-    retval.insert("chiSq", pycpp::Double(qis.chiSq()));
-    retval.insert("pValue", pycpp::Double(qis.pValue()));
-    retval.insert("degeneracy", pycpp::Double(qis.degeneracy()));
+    insertProfile(retval, qis.profile());
 
     return retval.release();
   }
@@ -290,9 +939,12 @@ extern "C" PyObject* humanleague_qisi(PyObject *self, PyObject *args)
     PyObject* indexArg;
     PyObject* arrayArg;
     int64_t skips = 0;
+    int statistics = 1;
+    PyObject* maskArg = nullptr;
 
     // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
-    if (!PyArg_ParseTuple(args, "O!O!O!|i", &PyArray_Type, & seedArg, &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &skips))
+    if (!PyArg_ParseTuple(args, "O!O!O!|ipO", &PyArray_Type, & seedArg, &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &skips,
+                          &statistics, &maskArg))
       return nullptr;
 
     // seed
@@ -324,14 +976,19 @@ extern "C" PyObject* humanleague_qisi(PyObject *self, PyObject *args)
 
     pycpp::Dict retval;
 
-    QISI qisi(indices, marginals, skips);
-    retval.insert("result", pycpp::Array<int64_t>(qisi.solve(seed.toNDArray())));
-    retval.insert("ipf", pycpp::Array<double>(qisi.expectation()));
-    retval.insert("conv", pycpp::Bool(qisi.conv()));
-    retval.insert("pop", pycpp::Double(qisi.population()));
-    retval.insert("chiSq", pycpp::Double(qisi.chiSq()));
-    retval.insert("pValue", pycpp::Double(qisi.pValue()));
-    retval.insert("degeneracy", pycpp::Double(qisi.degeneracy()));
+    std::shared_ptr<const Solution> qisi = cached::qisi(indices, marginals, seed.toNDArray(), skips, statistics,
+                                                                   toMask(maskArg));
+    retval.insert("result", pycpp::Array<int64_t>(qisi->intArray("result")));
+    retval.insert("ipf", pycpp::Array<double>(qisi->realArray("ipf")));
+    retval.insert("conv", pycpp::Bool(qisi->scalar("conv")));
+    retval.insert("pop", pycpp::Double(qisi->scalar("pop")));
+    if (statistics)
+    {
+      retval.insert("chiSq", pycpp::Double(qisi->scalar("chiSq")));
+      retval.insert("pValue", pycpp::Double(qisi->scalar("pValue")));
+      retval.insert("degeneracy", pycpp::Double(qisi->scalar("degeneracy")));
+    }
+    insertProfile(retval, qisi->profile());
 
     return retval.release();;
   }
@@ -346,6 +1003,72 @@ extern "C" PyObject* humanleague_qisi(PyObject *self, PyObject *args)
 }
 
 
+// Deterministic integerisation of the IPF solution, as a fast alternative to qisi (see src/TRS.h)
+extern "C" PyObject* humanleague_trs(PyObject *self, PyObject *args)
+{
+  try
+  {
+    PyObject* seedArg;
+    PyObject* indexArg;
+    PyObject* arrayArg;
+    int statistics = 1;
+
+    // args e.g. "s" for string "i" for integer, "d" for float "ss" for 2 strings
+    if (!PyArg_ParseTuple(args, "O!O!O!|p", &PyArray_Type, &seedArg, &PyList_Type, &indexArg, &PyList_Type, &arrayArg, &statistics))
+      return nullptr;
+
+    // seed
+    pycpp::Array<double> seed(seedArg);
+    //expects a list of numpy arrays containing int64
+    pycpp::List ilist(indexArg);
+    pycpp::List mlist(arrayArg);
+
+    int64_t k = ilist.size();
+    if (k != mlist.size())
+      throw std::runtime_error("index and marginals lists differ in size");
+    std::vector<std::vector<int64_t>> indices(k);
+    std::vector<NDArray<int64_t>> marginals;
+    marginals.reserve(k);
+
+    for (int64_t i = 0; i < k; ++i)
+    {
+      if (!PyArray_Check(ilist[i]))
+        throw std::runtime_error("index input should be a list of numpy integer arrays");
+      if (!PyArray_Check(mlist[i]))
+        throw std::runtime_error("marginal input should be a list of numpy integer arrays");
+      pycpp::Array<int64_t> ia(ilist[i]);
+      pycpp::Array<int64_t> ma(mlist[i]);
+      indices[i] = ia.toVector<int64_t>();
+      marginals.push_back(std::move(ma.toNDArray()));
+    }
+
+    pycpp::Dict retval;
+
+    std::shared_ptr<const Solution> trs = cached::trs(indices, marginals, seed.toNDArray(), statistics);
+    retval.insert("result", pycpp::Array<int64_t>(trs->intArray("result")));
+    retval.insert("ipf", pycpp::Array<double>(trs->realArray("ipf")));
+    retval.insert("conv", pycpp::Bool(trs->scalar("conv")));
+    retval.insert("pop", pycpp::Double(trs->scalar("pop")));
+    if (statistics)
+    {
+      retval.insert("chiSq", pycpp::Double(trs->scalar("chiSq")));
+      retval.insert("pValue", pycpp::Double(trs->scalar("pValue")));
+      retval.insert("degeneracy", pycpp::Double(trs->scalar("degeneracy")));
+    }
+    insertProfile(retval, trs->profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
 // prevents name mangling (but works without this)
 extern "C" PyObject* humanleague_synthPop(PyObject *self, PyObject *args)
 {
@@ -381,6 +1104,7 @@ extern "C" PyObject* humanleague_synthPop(PyObject *self, PyObject *args)
     retval.insert("p-value", pycpp::Double(qiws.pValue().first));
     retval.insert("chiSq", pycpp::Double(qiws.chiSq()));
     retval.insert("pop", pycpp::Int(qiws.population()));
+    insertProfile(retval, qiws.profile());
 
     return retval.release();;
   }
@@ -418,7 +1142,7 @@ extern "C" PyObject* humanleague_synthPopG(PyObject *self, PyObject *args)
 
     // Borrow memory from the numpy array
     std::vector<int64_t> shape(exoProbs.shape(), exoProbs.shape() + exoProbs.dim());
-    NDArray<double> xp(shape, exoProbs.rawData());
+    NDArray<double> xp(shape, exoProbs.rawData(), exoProbs.storageOrder());
 
     GQIWS gqiws(marginals, xp);
     pycpp::Dict retval;
@@ -427,7 +1151,59 @@ extern "C" PyObject* humanleague_synthPopG(PyObject *self, PyObject *args)
     retval.insert("result", flatten(gqiws.population(), gqiws.result()));
     //retval.insert("result", pycpp::Array<uint32_t>(std::move(const_cast<NDArray<2,uint32_t>&>(gqiws.result()))));
     retval.insert("pop", pycpp::Int(gqiws.population()));
+    insertProfile(retval, gqiws.profile());
+
+    return retval.release();
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+
+// configure the solution cache: maxBytes (0 to disable memory tier), optional directory for disk tier
+extern "C" PyObject* humanleague_cacheConfig(PyObject*, PyObject* args)
+{
+  try
+  {
+    int64_t maxBytes;
+    const char* directory = "";
+
+    if (!PyArg_ParseTuple(args, "L|s", &maxBytes, &directory))
+      return nullptr;
+
+    if (maxBytes < 0)
+      throw std::runtime_error("cache size cannot be negative");
 
+    Global::instance<SolutionCache>().configure(maxBytes, directory);
+    Py_RETURN_NONE;
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
+
+extern "C" PyObject* humanleague_cacheStats(PyObject*, PyObject*)
+{
+  try
+  {
+    const SolutionCache::Stats& stats = Global::instance<SolutionCache>().stats();
+    pycpp::Dict retval;
+    retval.insert("hits", pycpp::Int(stats.hits));
+    retval.insert("diskHits", pycpp::Int(stats.diskHits));
+    retval.insert("misses", pycpp::Int(stats.misses));
+    retval.insert("entries", pycpp::Int(stats.entries));
+    retval.insert("bytes", pycpp::Int(stats.bytes));
     return retval.release();
   }
   catch(const std::exception& e)
@@ -440,6 +1216,22 @@ extern "C" PyObject* humanleague_synthPopG(PyObject *self, PyObject *args)
   }
 }
 
+extern "C" PyObject* humanleague_cacheClear(PyObject*, PyObject*)
+{
+  try
+  {
+    Global::instance<SolutionCache>().clear();
+    Py_RETURN_NONE;
+  }
+  catch(const std::exception& e)
+  {
+    return pycpp::String(e.what()).release();
+  }
+  catch(...)
+  {
+    return pycpp::String("unexpected exception").release();
+  }
+}
 
 // until I find a better way...
 extern "C" PyObject* humanleague_version(PyObject*, PyObject*)
@@ -547,11 +1339,24 @@ namespace {
 // Python2.7
 PyMethodDef entryPoints[] = {
   {"prob2IntFreq", humanleague_prob2IntFreq, METH_VARARGS, "Returns nearest-integer population given probs and overall population."},
-  {"flatten", humanleague_flatten, METH_VARARGS, "Converts n-D integer array into a table with columns referencing the value indices."},
+  {"flatten", humanleague_flatten, METH_VARARGS, "Converts n-D integer array (or sparse coordinates and counts) into a table with columns referencing the value indices."},
   {"sobolSequence", humanleague_sobol, METH_VARARGS, "Returns a Sobol sequence."},
-  {"ipf", humanleague_ipf, METH_VARARGS, "Synthpop (IPF)."},
-  {"qis", humanleague_qis, METH_VARARGS, "QIS."},
-  {"qisi", humanleague_qisi, METH_VARARGS, "QIS-IPF."},
+  {"ipf", humanleague_ipf, METH_VARARGS, "Synthpop (IPF), optionally in single precision."},
+  {"junctionTree", humanleague_junctionTree, METH_VARARGS, "IPF (unity seed) held as the clique tables of a junction tree, optionally sampling a sparse population."},
+  {"rake", humanleague_rake, METH_VARARGS, "Record-level IPF (raking) of survey weights to marginals, on multiple threads."},
+  {"qisiRecords", humanleague_qisiRecords, METH_VARARGS, "QISI-like integer population drawn from the records of a microdata seed, as record ids."},
+  {"hierarchy", humanleague_hierarchy, METH_VARARGS, "Microsynthesis of a hierarchy of nested areas, returning the leaf areas' populations."},
+  {"ipfFile", humanleague_ipfFile, METH_VARARGS, "IPF with the seed and result in array files, and the population memory-mapped."},
+  {"saveArray", humanleague_saveArray, METH_VARARGS, "Saves a numpy array to an array file."},
+  {"loadArray", humanleague_loadArray, METH_VARARGS, "Loads an array file into a numpy array."},
+  {"qis", humanleague_qis, METH_VARARGS, "QIS (optionally returning a sparse result, or excluding masked states)."},
+  {"qisReplicates", humanleague_qisReplicates, METH_VARARGS, "Independent QIS replicates, run concurrently, with per-state mean and variance."},
+  {"qisComponents", humanleague_qisComponents, METH_VARARGS, "QIS solved separately on each connected component of the problem, with a sparse joint population."},
+  {"qisi", humanleague_qisi, METH_VARARGS, "QIS-IPF (optionally excluding masked states)."},
+  {"trs", humanleague_trs, METH_VARARGS, "Deterministic integerisation of IPF, preserving the marginals."},
+  {"cacheConfig", humanleague_cacheConfig, METH_VARARGS, "Configures the solution cache (max memory bytes, optional directory)."},
+  {"cacheStats", humanleague_cacheStats, METH_NOARGS, "Solution cache statistics."},
+  {"cacheClear", humanleague_cacheClear, METH_NOARGS, "Empties the solution cache (memory only)."},
   {"synthPop", humanleague_synthPop, METH_VARARGS, "Synthpop."},
   {"synthPopG", humanleague_synthPopG, METH_VARARGS, "Synthpop generalised."},
   {"version", humanleague_version, METH_NOARGS, "version info"},
@@ -0,0 +1,231 @@
+
+#include "Async.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+async::Scheduler& scheduler(napi_env env)
+{
+  void* data = nullptr;
+  napi_get_instance_data(env, &data);
+  return *static_cast<async::Scheduler*>(data);
+}
+
+// runs on a worker thread: must not call into napi
+void execute(napi_env, void* data)
+{
+  async::Job* job = static_cast<async::Job*>(data);
+  job->response = async::invoke(job->handler, job->request);
+}
+
+// runs on the JS thread
+void complete(napi_env env, napi_status status, void* data)
+{
+  async::Job* job = static_cast<async::Job*>(data);
+  if (status == napi_ok)
+  {
+    napi_resolve_deferred(env, job->deferred, async::respond(env, job->request, job->response));
+  }
+  else
+  {
+    napi_value msg, error;
+    napi_create_string_utf8(env, "async work failed or was cancelled", NAPI_AUTO_LENGTH, &msg);
+    napi_create_error(env, nullptr, msg, &error);
+    napi_reject_deferred(env, job->deferred, error);
+  }
+  napi_delete_async_work(env, job->work);
+  scheduler(env).completed(job);
+}
+
+void finalise(napi_env, void* data, void*)
+{
+  delete static_cast<async::Scheduler*>(data);
+}
+
+}
+
+std::string async::invoke(handler_t handler, const Request& request)
+{
+  Message response(request.binaryOut);
+  try
+  {
+    Message message(request.binaryIn);
+    if (request.binaryIn)
+      message.json = binary::decode(request.data, message.arrays);
+    else
+      message.json = JSON::parse(request.data);
+
+    if (!message.json.is_object())
+      throw std::runtime_error("JSON request should be an object");
+
+    handler(message, response);
+  }
+  catch(const std::exception& e)
+  {
+    response = Message(request.binaryOut);
+    response.json["fatal error"] = e.what();
+  }
+  catch(...)
+  {
+    response = Message(request.binaryOut);
+    response.json["fatal error"] = "unhandled exception";
+  }
+  return request.binaryOut ? binary::encode(response.json, response.arrays) : response.json.dump();
+}
+
+bool async::getRequest(napi_env env, napi_callback_info info, Request& request)
+{
+  size_t argc = 2;
+  napi_value args[2];
+  napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (argc < 1)
+  {
+    napi_throw_type_error(env, nullptr, "request argument required");
+    return false;
+  }
+
+  bool isBuffer = false, isArrayBuffer = false, isTypedArray = false;
+  napi_is_buffer(env, args[0], &isBuffer);
+  napi_is_arraybuffer(env, args[0], &isArrayBuffer);
+  napi_is_typedarray(env, args[0], &isTypedArray);
+
+  request.binaryIn = isBuffer || isArrayBuffer || isTypedArray;
+  if (isBuffer)
+  {
+    void* data;
+    size_t length;
+    napi_get_buffer_info(env, args[0], &data, &length);
+    request.data.assign(static_cast<const char*>(data), length);
+  }
+  else if (isArrayBuffer)
+  {
+    void* data;
+    size_t length;
+    napi_get_arraybuffer_info(env, args[0], &data, &length);
+    request.data.assign(static_cast<const char*>(data), length);
+  }
+  else if (isTypedArray)
+  {
+    napi_typedarray_type type;
+    size_t length, offset;
+    napi_value arraybuffer;
+    void* data;
+    napi_get_typedarray_info(env, args[0], &type, &length, &data, &arraybuffer, &offset);
+    size_t elementSize = 1;
+    switch (type)
+    {
+      case napi_int16_array: case napi_uint16_array: elementSize = 2; break;
+      case napi_int32_array: case napi_uint32_array: case napi_float32_array: elementSize = 4; break;
+      case napi_float64_array: case napi_bigint64_array: case napi_biguint64_array: elementSize = 8; break;
+      default: break;
+    }
+    request.data.assign(static_cast<const char*>(data), length * elementSize);
+  }
+  else
+  {
+    // anything else is coerced to a (JSON) string
+    napi_value str;
+    size_t length = 0;
+    if (napi_coerce_to_string(env, args[0], &str) != napi_ok
+     || napi_get_value_string_utf8(env, str, nullptr, 0, &length) != napi_ok)
+    {
+      napi_throw_type_error(env, nullptr, "request should be a JSON string or a binary message");
+      return false;
+    }
+    std::vector<char> buf(length + 1);
+    napi_get_value_string_utf8(env, str, buf.data(), buf.size(), &length);
+    request.data.assign(buf.data(), length);
+  }
+
+  request.binaryOut = request.binaryIn;
+  if (argc > 1)
+  {
+    bool binaryOut = false;
+    if (napi_get_value_bool(env, args[1], &binaryOut) != napi_ok)
+    {
+      napi_throw_type_error(env, nullptr, "binary argument should be a boolean");
+      return false;
+    }
+    request.binaryOut |= binaryOut;
+  }
+  return true;
+}
+
+napi_value async::respond(napi_env env, const Request& request, const std::string& response)
+{
+  napi_value result;
+  if (request.binaryOut)
+  {
+    void* data;
+    napi_create_arraybuffer(env, response.size(), &data, &result);
+    std::copy(response.begin(), response.end(), static_cast<char*>(data));
+  }
+  else
+  {
+    napi_create_string_utf8(env, response.c_str(), response.size(), &result);
+  }
+  return result;
+}
+
+napi_value async::submit(napi_env env, napi_callback_info info, const char* name, handler_t handler)
+{
+  Job* job = new Job{env, nullptr, nullptr, handler, Request(), std::string()};
+  if (!getRequest(env, info, job->request))
+  {
+    delete job;
+    return nullptr;
+  }
+
+  napi_value promise, resourceName;
+  napi_create_promise(env, &job->deferred, &promise);
+  napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &resourceName);
+  napi_create_async_work(env, nullptr, resourceName, execute, complete, job, &job->work);
+
+  scheduler(env).enqueue(job);
+  return promise;
+}
+
+int async::setConcurrency(napi_env env, int n)
+{
+  return scheduler(env).setConcurrency(n);
+}
+
+napi_status async::init(napi_env env)
+{
+  return napi_set_instance_data(env, new Scheduler, finalise, nullptr);
+}
+
+void async::Scheduler::enqueue(Job* job)
+{
+  m_pending.push_back(job);
+  dispatch();
+}
+
+void async::Scheduler::completed(Job* job)
+{
+  delete job;
+  --m_running;
+  dispatch();
+}
+
+int async::Scheduler::setConcurrency(int n)
+{
+  int prev = m_maxConcurrent;
+  m_maxConcurrent = n;
+  // raising the limit may release queued jobs
+  dispatch();
+  return prev;
+}
+
+void async::Scheduler::dispatch()
+{
+  while (m_running < m_maxConcurrent && !m_pending.empty())
+  {
+    Job* job = m_pending.front();
+    m_pending.pop_front();
+    napi_queue_async_work(job->env, job->work);
+    ++m_running;
+  }
+}
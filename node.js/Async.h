@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include "json_api.h"
+
+#include <node_api.h>
+
+#include <deque>
+#include <string>
+
+// Runs request handlers on the libuv worker pool, resolving a Promise with the response.
+// At most maxConcurrent jobs are handed to libuv at any one time, the remainder wait (on the main thread) in a FIFO
+// queue. This stops a burst of large requests occupying the whole pool, which is shared with e.g. fs and dns.
+namespace async {
+
+typedef void (*handler_t)(const Message&, Message&);
+
+// serialised request, and the format of the request and response
+struct Request
+{
+  std::string data;
+  bool binaryIn;
+  bool binaryOut;
+};
+
+// parses the request, calls the handler and serialises the response. Exceptions are converted to a "fatal error"
+// response rather than propagated
+std::string invoke(handler_t handler, const Request& request);
+
+// extracts the request from the JS call arguments: (string|ArrayBuffer|TypedArray[, binary]). The request data is
+// copied so that it is safe to access from a worker thread. Returns false (with a pending JS exception) on error
+bool getRequest(napi_env env, napi_callback_info info, Request& request);
+
+// converts a serialised response to a JS string or ArrayBuffer
+napi_value respond(napi_env env, const Request& request, const std::string& response);
+
+// queues the request, returning a Promise
+napi_value submit(napi_env env, napi_callback_info info, const char* name, handler_t handler);
+
+// returns the previous value
+int setConcurrency(napi_env env, int n);
+
+// per-module-instance state, must be called when the module is loaded
+napi_status init(napi_env env);
+
+struct Job
+{
+  napi_env env;
+  napi_async_work work;
+  napi_deferred deferred;
+  handler_t handler;
+  Request request;
+  std::string response;
+};
+
+// Only ever accessed from the JS thread (napi execute callbacks do not touch it)
+class Scheduler
+{
+public:
+  static const int DefaultConcurrency = 4; // libuv default pool size
+
+  Scheduler() : m_running(0), m_maxConcurrent(DefaultConcurrency) { }
+
+  Scheduler(const Scheduler&) = delete;
+  Scheduler& operator=(const Scheduler&) = delete;
+
+  void enqueue(Job* job);
+  void completed(Job* job);
+
+  int setConcurrency(int n);
+
+private:
+  void dispatch();
+
+  std::deque<Job*> m_pending;
+  int m_running;
+  int m_maxConcurrent;
+};
+
+}
@@ -0,0 +1,259 @@
+
+#include "Message.h"
+
+#include "humanleague/src/Index.h"
+#include "humanleague/src/NDArrayUtils.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+const char Magic[4] = { 'H', 'L', 'B', '1' };
+
+// only little-endian hosts are supported, which covers everything node runs on in practice
+void checkEndianness()
+{
+  const uint16_t one = 1;
+  if (*reinterpret_cast<const uint8_t*>(&one) != 1)
+    throw std::runtime_error("binary messages are not supported on big-endian platforms");
+}
+
+size_t padded(size_t n)
+{
+  return (n + 7) & ~size_t(7);
+}
+
+template<typename T>
+void append(std::string& buf, T value)
+{
+  buf.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Infer the shape of a (non-ragged) nested JSON array, e.g. [[1,2,3],[4,5,6]] -> {2,3}
+std::vector<int64_t> shape(const JSON& json)
+{
+  if (!json.is_array())
+    throw std::runtime_error("JSON array expected");
+  std::vector<int64_t> sizes;
+  const JSON* p = &json;
+  while (p->is_array())
+  {
+    if (p->empty())
+      throw std::runtime_error("empty JSON array");
+    sizes.push_back(p->size());
+    p = &p->front();
+  }
+  return sizes;
+}
+
+template<typename T>
+void fill(const JSON& json, const std::vector<int64_t>& sizes, size_t d, T*& p)
+{
+  if (!json.is_array() || (int64_t)json.size() != sizes[d])
+    throw std::runtime_error("JSON array is ragged or has inconsistent dimensions");
+  if (d == sizes.size() - 1)
+  {
+    for (const JSON& v: json)
+    {
+      if (!v.is_number())
+        throw std::runtime_error("JSON array contains non-numeric values");
+      *p++ = v.get<T>();
+    }
+  }
+  else
+  {
+    for (const JSON& v: json)
+      fill(v, sizes, d + 1, p);
+  }
+}
+
+// nested JSON array to (row-major) NDArray
+template<typename T>
+NDArray<T> fromJSON(const JSON& json)
+{
+  NDArray<T> a(shape(json));
+  T* p = const_cast<T*>(a.rawData());
+  fill(json, a.sizes(), 0, p);
+  return a;
+}
+
+template<typename T>
+JSON toJSON(const NDArray<T>& a, Index& index, size_t d)
+{
+  JSON json = JSON::array();
+  for (index[d] = 0; index[d] < a.sizes()[d]; ++index[d])
+  {
+    if (d == a.dim() - 1)
+      json.push_back(a[index]);
+    else
+      json.push_back(toJSON(a, index, d + 1));
+  }
+  return json;
+}
+
+// NDArray (any storage order) to nested JSON array
+template<typename T>
+JSON toJSON(const NDArray<T>& a)
+{
+  Index index(a.sizes());
+  return toJSON(a, index, 0);
+}
+
+template<typename T> binary::DType dtype();
+template<> binary::DType dtype<double>() { return binary::Float64; }
+template<> binary::DType dtype<int64_t>() { return binary::Int64; }
+
+template<typename T, typename U>
+void convert(const char* src, size_t n, U* dest)
+{
+  for (size_t i = 0; i < n; ++i, src += sizeof(T))
+  {
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    dest[i] = static_cast<U>(value);
+  }
+}
+
+}
+
+bool binary::isMessage(const std::string& buf)
+{
+  return buf.size() >= 8 && std::equal(Magic, Magic + 4, buf.data());
+}
+
+JSON binary::decode(const std::string& buf, std::vector<Array>& arrays)
+{
+  checkEndianness();
+  if (!isMessage(buf))
+    throw std::runtime_error("invalid binary message");
+
+  uint32_t headerLength;
+  std::memcpy(&headerLength, buf.data() + 4, sizeof(uint32_t));
+  if (8 + size_t(headerLength) > buf.size())
+    throw std::runtime_error("binary message truncated (header)");
+  JSON header = JSON::parse(buf.begin() + 8, buf.begin() + 8 + headerLength);
+
+  arrays.clear();
+  size_t pos = padded(8 + headerLength);
+  while (pos < buf.size())
+  {
+    if (pos + 8 > buf.size())
+      throw std::runtime_error("binary message truncated (array header)");
+    Array a;
+    const uint8_t dtype = buf[pos];
+    const uint8_t ndim = buf[pos + 1];
+    if (dtype != Float64 && dtype != Int64)
+      throw std::runtime_error("invalid dtype in binary message: " + std::to_string(dtype));
+    if (ndim == 0)
+      throw std::runtime_error("zero-dimensional array in binary message");
+    a.dtype = static_cast<DType>(dtype);
+    pos += 8;
+    if (pos + 8 * ndim > buf.size())
+      throw std::runtime_error("binary message truncated (array sizes)");
+    a.sizes.resize(ndim);
+    std::memcpy(a.sizes.data(), buf.data() + pos, 8 * ndim);
+    pos += 8 * ndim;
+    size_t n = 1;
+    for (int64_t s: a.sizes)
+    {
+      if (s < 1 || s >= NDArray<double>::MaxSize)
+        throw std::runtime_error("invalid array size in binary message");
+      n *= s;
+      if (8 * n > buf.size())
+        throw std::runtime_error("binary message truncated (array data)");
+    }
+    if (pos + 8 * n > buf.size())
+      throw std::runtime_error("binary message truncated (array data)");
+    a.data = buf.data() + pos;
+    pos += 8 * n;
+    arrays.push_back(std::move(a));
+  }
+  return header;
+}
+
+std::string binary::encode(const JSON& header, const std::vector<Array>& arrays)
+{
+  checkEndianness();
+  const std::string& h = header.dump();
+
+  size_t total = padded(8 + h.size());
+  for (const Array& a: arrays)
+    total += 8 + 8 * a.sizes.size() + 8 * product(a.sizes);
+
+  std::string buf;
+  buf.reserve(total);
+  buf.append(Magic, 4);
+  append(buf, static_cast<uint32_t>(h.size()));
+  buf.append(h);
+  buf.resize(padded(buf.size()), '\0');
+  for (const Array& a: arrays)
+  {
+    append(buf, static_cast<uint8_t>(a.dtype));
+    append(buf, static_cast<uint8_t>(a.sizes.size()));
+    buf.append(6, '\0');
+    buf.append(reinterpret_cast<const char*>(a.sizes.data()), 8 * a.sizes.size());
+    buf.append(a.bytes(), 8 * product(a.sizes));
+  }
+  return buf;
+}
+
+namespace {
+
+// row-major copy of a
+template<typename T>
+binary::Array fromNDArray(const NDArray<T>& a)
+{
+  binary::Array b;
+  b.dtype = dtype<T>();
+  b.sizes = a.sizes();
+  b.data = nullptr;
+  b.owned.resize(sizeof(T) * a.storageSize());
+  NDArray<T> wrapper(a.sizes(), reinterpret_cast<T*>(&b.owned[0]));
+  transposeStorage(a, wrapper);
+  return b;
+}
+
+// row-major NDArray, converting from dtype
+template<typename T>
+NDArray<T> toNDArray(const binary::Array& a)
+{
+  NDArray<T> result(a.sizes);
+  T* p = const_cast<T*>(result.rawData());
+  if (a.dtype == binary::Float64)
+    convert<double>(a.bytes(), result.storageSize(), p);
+  else
+    convert<int64_t>(a.bytes(), result.storageSize(), p);
+  return result;
+}
+
+}
+
+template<typename T>
+NDArray<T> Message::getArray(const JSON& field) const
+{
+  if (field.is_object() && field.count("$array"))
+  {
+    size_t n = field["$array"];
+    if (n >= arrays.size())
+      throw std::runtime_error("array reference out of range in binary message");
+    return toNDArray<T>(arrays[n]);
+  }
+  return fromJSON<T>(field);
+}
+
+template<typename T>
+JSON Message::putArray(const NDArray<T>& a)
+{
+  if (!binaryFormat)
+    return toJSON(a);
+  arrays.push_back(fromNDArray(a));
+  JSON ref;
+  ref["$array"] = arrays.size() - 1;
+  return ref;
+}
+
+template NDArray<double> Message::getArray<double>(const JSON&) const;
+template NDArray<int64_t> Message::getArray<int64_t>(const JSON&) const;
+template JSON Message::putArray<double>(const NDArray<double>&);
+template JSON Message::putArray<int64_t>(const NDArray<int64_t>&);
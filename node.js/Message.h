@@ -0,0 +1,65 @@
+
+#pragma once
+
+#include "3rdParty/json/src/json.hpp"
+
+#include "humanleague/src/NDArray.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using JSON = nlohmann::json;
+
+// Binary message format, used in place of JSON text for large arrays. All values little-endian.
+//
+// message := "HLB1" (4 bytes) | header length (uint32) | header (UTF-8 JSON) | zero padding to a multiple of 8 bytes |
+//            array*
+// array   := dtype (uint8) | ndim (uint8) | zero (6 bytes) | sizes (int64 * ndim) | data (8 bytes * product(sizes))
+//
+// The header holds the scalar fields of the request/response. Array-valued fields are replaced by a reference
+// {"$array": n} to the n'th array in the message. All offsets are 8-byte aligned, so the data can be viewed directly
+// as a Float64Array/BigInt64Array in JS.
+namespace binary {
+
+enum DType : uint8_t { Float64 = 0, Int64 = 1 };
+
+// An array stored in (or to be written to) a message
+struct Array
+{
+  DType dtype;
+  std::vector<int64_t> sizes;
+  // the data is either referenced (a decoded message, which must outlive it) or owned (an array to be encoded)
+  const char* data;
+  std::string owned;
+
+  const char* bytes() const { return data ? data : owned.data(); }
+};
+
+bool isMessage(const std::string& buf);
+
+// parses buf, returning the header. The arrays reference buf which must outlive them
+JSON decode(const std::string& buf, std::vector<Array>& arrays);
+
+std::string encode(const JSON& header, const std::vector<Array>& arrays);
+
+}
+
+// A request or response. In JSON messages arrays are nested JSON arrays (e.g. [[1,2,3],[4,5,6]]), in binary messages
+// references into arrays.
+struct Message
+{
+  explicit Message(bool binaryFormat = false) : binaryFormat(binaryFormat) { }
+
+  bool binaryFormat;
+  JSON json;
+  std::vector<binary::Array> arrays;
+
+  // the array referred to by field
+  template<typename T>
+  NDArray<T> getArray(const JSON& field) const;
+
+  // returns a JSON value representing a
+  template<typename T>
+  JSON putArray(const NDArray<T>& a);
+};
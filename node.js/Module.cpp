@@ -1,15 +1,39 @@
 
 #include "json_api.h"
+#include "Async.h"
 
-#include <node.h>
-#include <v8.h>
+#include <node_api.h>
 
-void init(v8::Handle<v8::Object> target)
+namespace {
+
+napi_status addFunction(napi_env env, napi_value exports, const char* name, napi_callback f)
 {
-  NODE_SET_METHOD(target, "sobolSequence", sobolSequence);
-  //NODE_SET_METHOD(target, "synthPop", synthPop);
+  napi_value fn;
+  napi_status status = napi_create_function(env, name, NAPI_AUTO_LENGTH, f, nullptr, &fn);
+  if (status != napi_ok)
+    return status;
+  return napi_set_named_property(env, exports, name, fn);
 }
 
-NODE_MODULE(humanleague, init) 
+}
 
+napi_value init(napi_env env, napi_value exports)
+{
+  if (async::init(env) != napi_ok
+   || addFunction(env, exports, "sobolSequence", sobolSequence) != napi_ok
+   || addFunction(env, exports, "ipf", ipf) != napi_ok
+   || addFunction(env, exports, "qis", qis) != napi_ok
+   || addFunction(env, exports, "qisi", qisi) != napi_ok
+   || addFunction(env, exports, "cacheConfig", cacheConfig) != napi_ok
+   || addFunction(env, exports, "cacheStats", cacheStats) != napi_ok
+   || addFunction(env, exports, "cacheClear", cacheClear) != napi_ok
+   || addFunction(env, exports, "setConcurrency", setConcurrency) != napi_ok)
+  {
+    napi_throw_error(env, nullptr, "humanleague module initialisation failed");
+    return nullptr;
+  }
+  //addFunction(env, exports, "synthPop", synthPop);
+  return exports;
+}
 
+NAPI_MODULE(humanleague, init)
@@ -0,0 +1,128 @@
+// Encoding/decoding of humanleague binary messages (see Message.h for the format)
+//
+// Arrays are represented as { shape: [n0, n1, ...], data: Float64Array|BigInt64Array } in row-major order.
+// When encoding, arrays can be placed anywhere in the request object, data can be any typed array or plain array
+// (plain arrays are encoded as float64).
+
+var MAGIC = "HLB1";
+var FLOAT64 = 0;
+var INT64 = 1;
+
+var CONTENT_TYPE = "application/x-humanleague";
+
+function isArray(x) {
+  return x !== null && typeof x === "object" && Array.isArray(x.shape) && x.data !== undefined;
+}
+
+function padded(n) {
+  return (n + 7) & ~7;
+}
+
+// replaces arrays in obj with {$array: n} references, appending them to arrays
+function extract(obj, arrays) {
+  if (isArray(obj)) {
+    arrays.push(obj);
+    return { $array: arrays.length - 1 };
+  }
+  if (Array.isArray(obj)) {
+    return obj.map(function(x) { return extract(x, arrays); });
+  }
+  if (obj !== null && typeof obj === "object") {
+    var out = {};
+    Object.keys(obj).forEach(function(k) { out[k] = extract(obj[k], arrays); });
+    return out;
+  }
+  return obj;
+}
+
+// replaces {$array: n} references in obj with the arrays they refer to
+function insert(obj, arrays) {
+  if (Array.isArray(obj)) {
+    return obj.map(function(x) { return insert(x, arrays); });
+  }
+  if (obj !== null && typeof obj === "object") {
+    if (obj.$array !== undefined) {
+      return arrays[obj.$array];
+    }
+    var out = {};
+    Object.keys(obj).forEach(function(k) { out[k] = insert(obj[k], arrays); });
+    return out;
+  }
+  return obj;
+}
+
+// object -> ArrayBuffer
+function encode(obj) {
+  var arrays = [];
+  var header = Buffer.from(JSON.stringify(extract(obj, arrays)), "utf8");
+
+  var size = padded(8 + header.length);
+  arrays.forEach(function(a) {
+    size += 8 + 8 * a.shape.length + 8 * a.data.length;
+  });
+
+  var buf = new ArrayBuffer(size);
+  var bytes = new Uint8Array(buf);
+  var view = new DataView(buf);
+  bytes.set(Buffer.from(MAGIC, "ascii"), 0);
+  view.setUint32(4, header.length, true);
+  bytes.set(header, 8);
+
+  var pos = padded(8 + header.length);
+  arrays.forEach(function(a) {
+    var int64 = a.data instanceof BigInt64Array;
+    view.setUint8(pos, int64 ? INT64 : FLOAT64);
+    view.setUint8(pos + 1, a.shape.length);
+    pos += 8;
+    a.shape.forEach(function(s) {
+      view.setBigInt64(pos, BigInt(s), true);
+      pos += 8;
+    });
+    for (var i = 0; i < a.data.length; ++i, pos += 8) {
+      if (int64) {
+        view.setBigInt64(pos, a.data[i], true);
+      } else {
+        view.setFloat64(pos, Number(a.data[i]), true);
+      }
+    }
+  });
+  return buf;
+}
+
+// ArrayBuffer|Buffer -> object. Array data are views onto the buffer (no copy)
+function decode(buf) {
+  if (buf instanceof Buffer) {
+    // copy if the Buffer is not 8-byte aligned within its ArrayBuffer (e.g. from a pool)
+    buf = buf.byteOffset % 8 ? new Uint8Array(buf).buffer : buf.buffer.slice(buf.byteOffset, buf.byteOffset + buf.length);
+  }
+  var view = new DataView(buf);
+  if (buf.byteLength < 8 || Buffer.from(buf, 0, 4).toString("ascii") !== MAGIC) {
+    throw new Error("invalid humanleague binary message");
+  }
+  var headerLength = view.getUint32(4, true);
+  var header = JSON.parse(Buffer.from(buf, 8, headerLength).toString("utf8"));
+
+  var arrays = [];
+  var pos = padded(8 + headerLength);
+  while (pos < buf.byteLength) {
+    var dtype = view.getUint8(pos);
+    var ndim = view.getUint8(pos + 1);
+    pos += 8;
+    var shape = [];
+    var n = 1;
+    for (var d = 0; d < ndim; ++d, pos += 8) {
+      shape.push(Number(view.getBigInt64(pos, true)));
+      n *= shape[d];
+    }
+    var data = dtype === INT64 ? new BigInt64Array(buf, pos, n) : new Float64Array(buf, pos, n);
+    arrays.push({ shape: shape, data: data });
+    pos += 8 * n;
+  }
+  return insert(header, arrays);
+}
+
+module.exports = {
+  CONTENT_TYPE: CONTENT_TYPE,
+  encode: encode,
+  decode: decode
+};
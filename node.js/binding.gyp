@@ -4,8 +4,29 @@
       'target_name': 'humanleague',
       'cflags_cc': [ '-g -O2 -Wall -Werror -std=c++11' ],
       'cflags_cc!': [ '-fno-rtti', '-fno-exceptions' ],
+      'defines': [ 'NAPI_VERSION=6' ],
       'sources': [ 'json_api.cpp',
+                   'Async.cpp',
+                   'Message.cpp',
                    'Module.cpp',
+                   '../src/QIS.cpp',
+                   '../src/QISI.cpp',
+                   '../src/SolutionCache.cpp',
+                   '../src/Trace.cpp',
+                   '../src/Allocator.cpp',
+                   '../src/MappedArray.cpp',
+                   '../src/Simd.cpp',
+                   '../src/Replicates.cpp',
+                   '../src/Components.cpp',
+                   '../src/JunctionTree.cpp',
+                   '../src/Raking.cpp',
+                   '../src/RecordQISI.cpp',
+                   '../src/TRS.cpp',
+                   '../src/Integerise.cpp',
+                   '../src/TaskPool.cpp',
+                   '../src/Hierarchy.cpp',
+                   '../src/Adjust.cpp',
+                   '../src/Mask.cpp',
                    '../src/Sobol.cpp',
                    '../src/SobolImpl.cpp',
                    '../src/StatFuncs.cpp',
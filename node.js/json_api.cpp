@@ -1,58 +1,201 @@
 
 #include "json_api.h"
+#include "Async.h"
 
 #include "humanleague/src/Sobol.h"
+#include "humanleague/src/IPF.h"
+#include "humanleague/src/QIS.h"
+#include "humanleague/src/QISI.h"
+#include "humanleague/src/SolutionCache.h"
+#include "humanleague/src/Global.h"
 //#include "humanleague/src/QIWS.h"
 
-#include <node.h>
-#include <v8.h>
+#include <string>
+#include <vector>
 
-void sobolSequence(const v8::FunctionCallbackInfo<v8::Value>& args)
-{
-  v8::Isolate* isolate = v8::Isolate::GetCurrent();
-  JSON response;
+namespace {
 
-  try
+// parse the indices and marginals common to all the microsynthesis requests
+template<typename T>
+void getMarginals(const Message& request, std::vector<std::vector<int64_t>>& indices, std::vector<NDArray<T>>& marginals)
+{
+  const JSON& ilist = request.json.at("indices");
+  const JSON& mlist = request.json.at("marginals");
+  if (!ilist.is_array() || !mlist.is_array())
+    throw std::runtime_error("indices and marginals should be arrays");
+  if (ilist.size() != mlist.size())
+    throw std::runtime_error("index and marginals lists differ in size");
+
+  const size_t k = ilist.size();
+  indices.resize(k);
+  marginals.reserve(k);
+  for (size_t i = 0; i < k; ++i)
   {
-    std::string jsonStringInput = *v8::String::Utf8Value(args[0]->ToString());
-    //std::cout << "JSON: " << jsonStringInput << std::endl;
+    indices[i] = ilist[i].get<std::vector<int64_t>>();
+    marginals.push_back(request.getArray<T>(mlist[i]));
+  }
+}
 
-    const JSON& request = JSON::parse(jsonStringInput);
+int64_t getSkips(const Message& request)
+{
+  return request.json.count("skips") ? request.json["skips"].get<int64_t>() : 0;
+}
 
-    if (!request.is_object())
-      throw std::runtime_error("JSON request should be an object");
+JSON cacheStatsJson()
+{
+  SolutionCache::Stats stats = Global::instance<SolutionCache>().stats();
+  JSON json;
+  json["hits"] = stats.hits;
+  json["diskHits"] = stats.diskHits;
+  json["misses"] = stats.misses;
+  json["entries"] = stats.entries;
+  json["bytes"] = stats.bytes;
+  return json;
+}
 
-    size_t dim = request.at("dim");
-    size_t length = request.at("length");
-    size_t skips = 0;
-    //std::cout << dim << ", " << length << std::endl;
+}
 
-    Sobol sobol(dim, skips);
-    double scale = 0.5 / (1u << 31);
-    std::vector<std::vector<double>> seq;
-    seq.reserve(length);
-    for (size_t i = 0; i < length; ++i)
+void sobolSequenceImpl(const Message& request, Message& response)
+{
+  size_t dim = request.json.at("dim");
+  size_t length = request.json.at("length");
+  size_t skips = 0;
+  //std::cout << dim << ", " << length << std::endl;
+
+  Sobol sobol(dim, skips);
+  double scale = 0.5 / (1u << 31);
+  NDArray<double> seq(std::vector<int64_t>{(int64_t)length, (int64_t)dim});
+  double* p = const_cast<double*>(seq.rawData());
+  for (size_t i = 0; i < length; ++i)
+  {
+    const std::vector<uint32_t>& b = sobol.buf();
+    for (size_t j = 0; j < dim; ++j)
     {
-      std::vector<double> v(dim);
-      const std::vector<uint32_t>& b = sobol.buf();
-      for (size_t j = 0; j < dim; ++j)
-      {
-        v[j] = scale * b[j];
-      }
-      seq.push_back(v);
+      *p++ = scale * b[j];
     }
-
-    response = seq; // nice!!
   }
-  catch(const std::exception& e)
-  {
-    response["fatal error"] = e.what();
-  }
-  catch(...)
+
+  response.json = response.putArray(seq);
+}
+
+void ipfImpl(const Message& request, Message& response)
+{
+  std::vector<std::vector<int64_t>> indices;
+  std::vector<NDArray<double>> marginals;
+  getMarginals(request, indices, marginals);
+  const NDArray<double>& seed = request.getArray<double>(request.json.at("seed"));
+
+  std::shared_ptr<const Solution> ipf = cached::ipf(indices, marginals, seed);
+  response.json["result"] = response.putArray(ipf->realArray("result"));
+  response.json["conv"] = ipf->scalar("conv") != 0.0;
+  response.json["pop"] = ipf->scalar("pop");
+  response.json["iterations"] = (int64_t)ipf->scalar("iterations");
+  response.json["maxError"] = ipf->scalar("maxError");
+}
+
+void qisImpl(const Message& request, Message& response)
+{
+  std::vector<std::vector<int64_t>> indices;
+  std::vector<NDArray<int64_t>> marginals;
+  getMarginals(request, indices, marginals);
+
+  std::shared_ptr<const Solution> qis = cached::qis(indices, marginals, getSkips(request));
+  response.json["result"] = response.putArray(qis->intArray("result"));
+  response.json["expectation"] = response.putArray(qis->realArray("expectation"));
+  response.json["conv"] = qis->scalar("conv") != 0.0;
+  response.json["pop"] = qis->scalar("pop");
+  response.json["chiSq"] = qis->scalar("chiSq");
+  response.json["pValue"] = qis->scalar("pValue");
+  response.json["degeneracy"] = qis->scalar("degeneracy");
+}
+
+void qisiImpl(const Message& request, Message& response)
+{
+  std::vector<std::vector<int64_t>> indices;
+  std::vector<NDArray<int64_t>> marginals;
+  getMarginals(request, indices, marginals);
+  const NDArray<double>& seed = request.getArray<double>(request.json.at("seed"));
+
+  std::shared_ptr<const Solution> qisi = cached::qisi(indices, marginals, seed, getSkips(request));
+  response.json["result"] = response.putArray(qisi->intArray("result"));
+  response.json["ipf"] = response.putArray(qisi->realArray("ipf"));
+  response.json["conv"] = qisi->scalar("conv") != 0.0;
+  response.json["pop"] = qisi->scalar("pop");
+  response.json["chiSq"] = qisi->scalar("chiSq");
+  response.json["pValue"] = qisi->scalar("pValue");
+  response.json["degeneracy"] = qisi->scalar("degeneracy");
+}
+
+void cacheConfigImpl(const Message& request, Message& response)
+{
+  int64_t maxBytes = request.json.at("maxBytes");
+  if (maxBytes < 0)
+    throw std::runtime_error("cache size cannot be negative");
+  std::string directory = request.json.count("directory") ? request.json["directory"].get<std::string>() : "";
+
+  Global::instance<SolutionCache>().configure(maxBytes, directory);
+  response.json = cacheStatsJson();
+}
+
+napi_value sobolSequence(napi_env env, napi_callback_info info)
+{
+  async::Request request;
+  if (!async::getRequest(env, info, request))
+    return nullptr;
+  return async::respond(env, request, async::invoke(sobolSequenceImpl, request));
+}
+
+napi_value ipf(napi_env env, napi_callback_info info)
+{
+  return async::submit(env, info, "ipf", ipfImpl);
+}
+
+napi_value qis(napi_env env, napi_callback_info info)
+{
+  return async::submit(env, info, "qis", qisImpl);
+}
+
+napi_value qisi(napi_env env, napi_callback_info info)
+{
+  return async::submit(env, info, "qisi", qisiImpl);
+}
+
+napi_value cacheConfig(napi_env env, napi_callback_info info)
+{
+  async::Request request;
+  if (!async::getRequest(env, info, request))
+    return nullptr;
+  return async::respond(env, request, async::invoke(cacheConfigImpl, request));
+}
+
+napi_value cacheStats(napi_env env, napi_callback_info)
+{
+  napi_value result;
+  const std::string& json = cacheStatsJson().dump();
+  napi_create_string_utf8(env, json.c_str(), json.size(), &result);
+  return result;
+}
+
+napi_value cacheClear(napi_env env, napi_callback_info)
+{
+  Global::instance<SolutionCache>().clear();
+  return nullptr;
+}
+
+napi_value setConcurrency(napi_env env, napi_callback_info info)
+{
+  size_t argc = 1;
+  napi_value arg;
+  napi_get_cb_info(env, info, &argc, &arg, nullptr, nullptr);
+  int32_t n = 0;
+  if (argc < 1 || napi_get_value_int32(env, arg, &n) != napi_ok || n < 1)
   {
-    response["fatal error"] = "unhandled exception";
+    napi_throw_range_error(env, nullptr, "concurrency must be a positive integer");
+    return nullptr;
   }
-  args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, response.dump().c_str()));
+  napi_value result;
+  napi_create_int32(env, async::setConcurrency(env, n), &result);
+  return result;
 }
 
 
@@ -94,8 +237,3 @@ void sobolSequence(const v8::FunctionCallbackInfo<v8::Value>& args)
 //   args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, response.dump().c_str()));
 // }
 
-
-
-
-
-
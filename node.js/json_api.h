@@ -1,19 +1,13 @@
-#pragma once
-
 
-#include "3rdParty/json/src/json.hpp"
+#pragma once
 
-using JSON = nlohmann::json;
+#include "Message.h"
 
-namespace v8 
-{
-  class Value;
-  template<typename T> class FunctionCallbackInfo;
-}
+#include <node_api.h>
 
 //// conversion of scalar types from JSON to T (falling back on converting via a string using function provided)
 //// (JSON values from url query params will always be strings)
-//template<typename T> 
+//template<typename T>
 //T convertWithFallback(const JSON& json, std::function<T(const std::string&)> func)
 //{
 //  if (json.is_string())
@@ -23,8 +17,32 @@ namespace v8
 //  return json.get<T>();
 //}
 
-void sobolSequence(const v8::FunctionCallbackInfo<v8::Value>& args);
-void synthPop(const v8::FunctionCallbackInfo<v8::Value>& args);
-void synthPopC(const v8::FunctionCallbackInfo<v8::Value>& args);
-void synthPopR(const v8::FunctionCallbackInfo<v8::Value>& args);
+// Request to response implementations. These do not touch the JS engine so can run on a worker thread.
+// Errors are thrown and converted to a "fatal error" response by the caller
+void sobolSequenceImpl(const Message& request, Message& response);
+void ipfImpl(const Message& request, Message& response);
+void qisImpl(const Message& request, Message& response);
+void qisiImpl(const Message& request, Message& response);
+void cacheConfigImpl(const Message& request, Message& response);
+
+// The request is either a JSON string or a binary message (ArrayBuffer, TypedArray or Buffer, see Message.h).
+// The response is in the same format as the request, unless the optional second argument (binary) is true in which
+// case it is always a binary message (ArrayBuffer).
+
+// synchronous
+napi_value sobolSequence(napi_env env, napi_callback_info info);
+
+// Return a Promise resolving to the response. Runs on the libuv worker pool
+napi_value ipf(napi_env env, napi_callback_info info);
+napi_value qis(napi_env env, napi_callback_info info);
+napi_value qisi(napi_env env, napi_callback_info info);
+
+// Solution cache (disabled by default). cacheConfig takes a request {maxBytes, directory (optional)} and responds
+// with the cache statistics, cacheStats returns them as a JSON string. Identical ipf, qis and qisi requests are then
+// answered from the cache. cacheClear empties the in-memory cache
+napi_value cacheConfig(napi_env env, napi_callback_info info);
+napi_value cacheStats(napi_env env, napi_callback_info info);
+napi_value cacheClear(napi_env env, napi_callback_info info);
 
+// Sets the maximum number of solver jobs running at once, returns the previous value
+napi_value setConcurrency(napi_env env, napi_callback_info info);
@@ -6,21 +6,62 @@ if (process.argv.length != 3) {
 }
 
 var port = process.argv[2]
+// max number of solves running at once (others are queued)
+var concurrency = process.env.HUMANLEAGUE_CONCURRENCY || 4;
 
 var express = require('express');
 
 var app = express();
 
 var humanleague = require("./build/Release/humanleague.node");
+var binary = require("./binary.js");
+humanleague.setConcurrency(Number(concurrency));
+
+// Responses are JSON unless the client requests binary in its Accept header
+function wantsBinary(req) {
+  return req.accepts(['application/json', binary.CONTENT_TYPE]) === binary.CONTENT_TYPE;
+}
+
+function send(res, result) {
+  if (typeof result === 'string') {
+    res.status(200).type('application/json').send(result);
+  } else {
+    res.status(200).type(binary.CONTENT_TYPE).send(Buffer.from(result));
+  }
+}
+
+// binary requests are POSTed with the binary content type
+var rawBody = express.raw({ type: binary.CONTENT_TYPE, limit: '1gb' });
 
 // register entry points
 app.get('/sobolSequence', function(req, res) {
   console.log(req.query.args);
   // convert object back to string...(seems a bit perverse?)
-  var result = humanleague.sobolSequence(req.query.args);
-  res.status(200).send(result);
+  var result = humanleague.sobolSequence(req.query.args, wantsBinary(req));
+  send(res, result);
 }); 
 
+app.post('/sobolSequence', rawBody, function(req, res) {
+  send(res, humanleague.sobolSequence(req.body, wantsBinary(req)));
+});
+
+// microsynthesis runs on the libuv worker pool, so the event loop remains free to service other requests
+function registerAsync(name) {
+  app.get('/' + name, function(req, res, next) {
+    console.log(req.query.args);
+    humanleague[name](req.query.args, wantsBinary(req)).then(function(result) {
+      send(res, result);
+    }).catch(next);
+  });
+  app.post('/' + name, rawBody, function(req, res, next) {
+    humanleague[name](req.body, wantsBinary(req)).then(function(result) {
+      send(res, result);
+    }).catch(next);
+  });
+}
+
+['ipf', 'qis', 'qisi'].forEach(registerAsync);
+
 // app.get('/synthPop', function(req, res) {
 //   console.log(req.query.args);
 //   var result = humanleague.synthPop(req.query.args);
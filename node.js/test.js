@@ -1,17 +1,60 @@
 #!/usr/bin/nodejs
 
 var humanleague_api = require("./build/Release/humanleague.node");
+var binary = require("./binary.js");
 
 var seq = humanleague_api.sobolSequence(JSON.stringify({dim: 2, length: 10}));
 console.log(JSON.parse(seq));
 
+// solvers run asynchronously and return a promise
+var indices = [[0], [1]];
+var marginals = [[52, 48], [87, 13]];
+
+humanleague_api.setConcurrency(2);
+
+Promise.all([
+  humanleague_api.ipf(JSON.stringify({seed: [[1, 1], [1, 1]], indices: indices, marginals: marginals})),
+  humanleague_api.qis(JSON.stringify({indices: indices, marginals: marginals})),
+  humanleague_api.qisi(JSON.stringify({seed: [[1, 1], [1, 1]], indices: indices, marginals: marginals, skips: 0})),
+  humanleague_api.qis(JSON.stringify({indices: indices, marginals: [[52, 48], [87, 14]]}))
+]).then(function(results) {
+  results.forEach(function(r) {
+    console.log(JSON.parse(r));
+  });
+});
+
+// binary transport: request and response as ArrayBuffers
+seq = binary.decode(humanleague_api.sobolSequence(binary.encode({dim: 2, length: 10})));
+console.log(seq.shape, seq.data);
+
+// JSON request, binary response
+var resp = binary.decode(humanleague_api.sobolSequence(JSON.stringify({dim: 3, length: 4}), true));
+console.log(resp.shape, resp.data);
+
+humanleague_api.qisi(binary.encode({
+  seed: { shape: [2, 2], data: new Float64Array([1, 1, 1, 1]) },
+  indices: indices,
+  marginals: [{ shape: [2], data: new BigInt64Array([52n, 48n]) }, { shape: [2], data: [87, 13] }]
+})).then(function(r) {
+  r = binary.decode(r);
+  console.log(r);
+});
+
 // seq = humanleague_api.synthPop(JSON.stringify({marginals:[[1,1,1,1],[1,2,1]]}));
 // console.log(JSON.parse(seq));
 
-// seq = humanleague_api.synthPopC(JSON.stringify({marginals:[[1,1,1,1],[1,2,1]], 
+// seq = humanleague_api.synthPopC(JSON.stringify({marginals:[[1,1,1,1],[1,2,1]],
 //                                                 permitted:[[true,false,false],[true,true,false],[true,true,true],[true,true,true]]}));
 // console.log(JSON.parse(seq));
 
 // seq = humanleague_api.synthPopR(JSON.stringify({marginals:[[2,2,2,2,2,2],[2,2,2,2,2,2]], rho: 0.9}));
 // console.log(JSON.parse(seq));
 
+// solution cache: the repeated qis request is answered from the cache
+console.log(JSON.parse(humanleague_api.cacheConfig(JSON.stringify({maxBytes: 1 << 20}))));
+humanleague_api.qis(JSON.stringify({indices: indices, marginals: marginals})).then(function() {
+  return humanleague_api.qis(JSON.stringify({indices: indices, marginals: marginals}));
+}).then(function(r) {
+  console.log(JSON.parse(r).result, JSON.parse(humanleague_api.cacheStats()));
+  humanleague_api.cacheClear();
+});
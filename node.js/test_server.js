@@ -22,6 +22,22 @@ request(encodeURI(url), function(err, resp, res) {
   console.log(res);
 });
 
+// concurrent requests: the sobol request should not have to wait for the solvers
+var indices = [[0], [1], [2]];
+var marginals = [[5000, 5000], [2000, 3000, 5000], [1000, 2000, 3000, 4000]];
+["qis", "qisi", "ipf", "qis"].forEach(function(name) {
+  args = { indices: indices, marginals: marginals };
+  if (name != "qis") {
+    args.seed = [[[1,1,1,1],[1,1,1,1],[1,1,1,1]],[[1,1,1,1],[1,1,1,1],[1,1,1,1]]];
+  }
+  url = "http://" + hostport + "/" + name + "?args=" + JSON.stringify(args);
+  request(encodeURI(url), function(err, resp, res) {
+    // TODO some error checking
+    res = JSON.parse(res);
+    console.log(name + ": conv=" + res.conv + " pop=" + res.pop);
+  });
+});
+
 // args = { marginals: [[1,1,1,1],[1,2,1]] };
 
 // // Args are always passed as "args=<string>" as this avoids all numeric values being implicitly converted to strings
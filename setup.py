@@ -27,6 +27,21 @@ cppmodule = Extension(
              'src/NDArrayUtils.cpp',
              'src/Index.cpp',
              'src/Integerise.cpp',
+             'src/SolutionCache.cpp',
+             'src/Trace.cpp',
+             'src/Allocator.cpp',
+             'src/MappedArray.cpp',
+             'src/Simd.cpp',
+             'src/Replicates.cpp',
+             'src/Components.cpp',
+             'src/JunctionTree.cpp',
+             'src/Raking.cpp',
+             'src/RecordQISI.cpp',
+             'src/TRS.cpp',
+             'src/TaskPool.cpp',
+             'src/Hierarchy.cpp',
+             'src/Adjust.cpp',
+             'src/Mask.cpp',
              'src/UnitTester.cpp',
              'src/TestNDArray.cpp',
              'src/TestQIWS.cpp',
@@ -35,6 +50,20 @@ cppmodule = Extension(
              'src/TestIndex.cpp',
              'src/TestSlice.cpp',
              'src/TestReduce.cpp',
+             'src/TestSolutionCache.cpp',
+             'src/TestProfile.cpp',
+             'src/TestSparseArray.cpp',
+             'src/TestMappedArray.cpp',
+             'src/TestSimd.cpp',
+             'src/TestReplicates.cpp',
+             'src/TestComponents.cpp',
+             'src/TestJunctionTree.cpp',
+             'src/TestRaking.cpp',
+             'src/TestRecordQISI.cpp',
+             'src/TestTRS.cpp',
+             'src/TestHierarchy.cpp',
+             'src/TestAdjust.cpp',
+             'src/TestMask.cpp',
              'humanleague/Object.cpp',
              'humanleague/py_api.cpp'],
   # for now safer to put up with full rebuilds every time
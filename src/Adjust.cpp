@@ -0,0 +1,163 @@
+
+#include "Adjust.h"
+#include "Microsynthesis.h"
+#include "Index.h"
+#include "NDArrayUtils.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// row-major offset of the given dimensions of a state in an array of the given sizes
+int64_t offset(const std::vector<int64_t>& sizes, const std::vector<int64_t>& state, const std::vector<int64_t>& dims)
+{
+  int64_t o = 0;
+  for (size_t j = 0; j < dims.size(); ++j)
+    o = o * sizes[j] + state[dims[j]];
+  return o;
+}
+
+// a row-major copy of an array, which may be column-major (e.g. a Fortran-ordered numpy array)
+NDArray<int64_t> rowMajor(const NDArray<int64_t>& a)
+{
+  NDArray<int64_t> r(a.sizes());
+  transposeStorage(a, r);
+  return r;
+}
+
+// an occupied state in the slice of an over-full cell, and its cell in each marginal
+struct Candidate
+{
+  int64_t state;
+  std::vector<int64_t> cells;
+};
+
+}
+
+std::vector<NDArray<int64_t>> applyDeltas(const std::vector<std::vector<int64_t>>& indices,
+                                          const std::vector<NDArray<int64_t>>& marginals,
+                                          const std::vector<NDArray<int64_t>>& deltas)
+{
+  if (deltas.size() != marginals.size())
+    throw std::runtime_error("number of deltas (" + std::to_string(deltas.size()) + ") differs from the number of marginals (" +
+      std::to_string(marginals.size()) + ")");
+  std::vector<NDArray<int64_t>> result;
+  result.reserve(marginals.size());
+  for (size_t k = 0; k < marginals.size(); ++k)
+  {
+    if (deltas[k].sizes() != marginals[k].sizes())
+      throw std::runtime_error("delta " + std::to_string(k) + " dimensions do not match those of the marginal");
+    // added cell by cell, so both are row-major
+    result.push_back(rowMajor(marginals[k]));
+    const NDArray<int64_t> delta = rowMajor(deltas[k]);
+    int64_t* p = result.back().begin();
+    for (size_t i = 0; i < result.back().storageSize(); ++i)
+      p[i] += delta.rawData()[i];
+  }
+  // checks (only) the adjusted marginals are non-negative and consistent
+  Microsynthesis<int64_t> check(indices, result, false);
+  return result;
+}
+
+int64_t removeExcess(NDArray<int64_t>& population, const NDArray<double>& expectation,
+                     const std::vector<std::vector<int64_t>>& indices,
+                     std::vector<NDArray<int64_t>>& current, const std::vector<NDArray<int64_t>>& t)
+{
+  // the marginals' cells are located by row-major offset
+  std::vector<NDArray<int64_t>> target;
+  for (size_t k = 0; k < t.size(); ++k)
+  {
+    target.push_back(rowMajor(t[k]));
+    NDArray<int64_t>::copy(rowMajor(current[k]), current[k]);
+  }
+  const std::vector<int64_t>& sizes = population.sizes();
+  std::vector<int64_t> all(sizes.size());
+  for (size_t d = 0; d < all.size(); ++d)
+    all[d] = d;
+  int64_t* p = population.begin();
+  const double* e = expectation.rawData();
+  const size_t K = indices.size();
+  int64_t removed = 0;
+
+  for (size_t k = 0; k < K; ++k)
+  {
+    for (Index cell(target[k].sizes()); !cell.end(); ++cell)
+    {
+      if (current[k][cell] <= target[k][cell])
+        continue;
+
+      // the occupied states in the cell's slice
+      std::vector<std::pair<int64_t, int64_t>> fixed;
+      for (size_t j = 0; j < indices[k].size(); ++j)
+        fixed.push_back(std::make_pair(indices[k][j], cell[j]));
+      std::vector<Candidate> candidates;
+      const auto add = [&](const std::vector<int64_t>& state) {
+        Candidate c;
+        c.state = offset(sizes, state, all);
+        if (!p[c.state])
+          return;
+        for (size_t j = 0; j < K; ++j)
+          c.cells.push_back(offset(target[j].sizes(), state, indices[j]));
+        candidates.push_back(std::move(c));
+      };
+      if (fixed.size() == sizes.size())
+      {
+        std::vector<int64_t> state(sizes.size());
+        for (const std::pair<int64_t, int64_t>& f: fixed)
+          state[f.first] = f.second;
+        add(state);
+      }
+      else
+        for (FixedIndex state(sizes, fixed); !state.end(); ++state)
+          add((const Index&)state);
+
+      while (current[k][cell] > target[k][cell])
+      {
+        // the state in the most over-full cells, then the most over-represented
+        const Candidate* best = nullptr;
+        size_t bestCount = 0;
+        double bestExcess = 0.0;
+        for (const Candidate& c: candidates)
+        {
+          if (!p[c.state])
+            continue;
+          size_t count = 0;
+          for (size_t j = 0; j < K; ++j)
+            count += current[j].rawData()[c.cells[j]] > target[j].rawData()[c.cells[j]];
+          const double excess = p[c.state] - e[c.state];
+          if (!best || count > bestCount || (count == bestCount && excess > bestExcess))
+          {
+            best = &c;
+            bestCount = count;
+            bestExcess = excess;
+          }
+        }
+        if (!best)
+          throw std::runtime_error("population does not match its marginals");
+
+        // as many as can go before any of its cells stops being over-full
+        int64_t n = p[best->state];
+        for (size_t j = 0; j < K; ++j)
+        {
+          const int64_t over = current[j].rawData()[best->cells[j]] - target[j].rawData()[best->cells[j]];
+          if (over > 0)
+            n = std::min(n, over);
+        }
+        p[best->state] -= n;
+        for (size_t j = 0; j < K; ++j)
+          current[j].begin()[best->cells[j]] -= n;
+        removed += n;
+      }
+    }
+  }
+
+  for (size_t k = 0; k < K; ++k)
+  {
+    int64_t* c = current[k].begin();
+    for (size_t i = 0; i < current[k].storageSize(); ++i)
+      c[i] = target[k].rawData()[i] - c[i];
+  }
+  return removed;
+}
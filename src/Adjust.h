@@ -0,0 +1,26 @@
+// Adjust.h
+// Incremental adjustment of a solved integer population to a change in its marginals, e.g. a scenario adding 500
+// people aged 65+. Individuals are removed only from the states in the marginal cells that the change leaves over-full,
+// and the shortfall left (the increases, plus any knock-on of the removals in the other marginals) is then sampled on
+// its own and added, so every other state keeps its occupancy and the work is proportional to the size of the change
+// rather than the population. See QIS::adjust and QISI::adjust.
+
+#pragma once
+
+#include "NDArray.h"
+
+#include <vector>
+#include <cstdint>
+
+// The marginals with the deltas added. Throws if the shapes differ, or if the result is negative or inconsistent
+std::vector<NDArray<int64_t>> applyDeltas(const std::vector<std::vector<int64_t>>& indices,
+                                          const std::vector<NDArray<int64_t>>& marginals,
+                                          const std::vector<NDArray<int64_t>>& deltas);
+
+// Removes individuals from the population until none of its marginals (current, which must be those of the
+// population) exceeds target, preferring the states with the most over-full marginal cells, then those most
+// over-represented relative to the expectation. Returns the number removed, and current becomes the marginals still
+// to be added (target less those of the population, row-major whatever the storage order of the inputs)
+int64_t removeExcess(NDArray<int64_t>& population, const NDArray<double>& expectation,
+                     const std::vector<std::vector<int64_t>>& indices,
+                     std::vector<NDArray<int64_t>>& current, const std::vector<NDArray<int64_t>>& target);
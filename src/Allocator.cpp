@@ -0,0 +1,155 @@
+
+#include "Allocator.h"
+
+#include <new>
+#include <cstdlib>
+#include <cassert>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+Allocator& Allocator::aligned()
+{
+  static AlignedAllocator instance;
+  return instance;
+}
+
+Allocator& Allocator::hugePage()
+{
+  static HugePageAllocator instance;
+  return instance;
+}
+
+Allocator& Allocator::current()
+{
+  return *currentPtr();
+}
+
+Allocator*& Allocator::currentPtr()
+{
+  static thread_local Allocator* current = &hugePage();
+  return current;
+}
+
+Allocator::Scope::Scope(Allocator& allocator) : m_previous(currentPtr())
+{
+  currentPtr() = &allocator;
+}
+
+Allocator::Scope::~Scope()
+{
+  currentPtr() = m_previous;
+}
+
+
+void* AlignedAllocator::allocate(size_t bytes)
+{
+  return allocate(bytes, Alignment);
+}
+
+void AlignedAllocator::deallocate(void* p)
+{
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void* AlignedAllocator::allocate(size_t bytes, size_t alignment)
+{
+  // zero-size requests still return a unique pointer, as new T[0] does
+  bytes = roundUp(bytes ? bytes : 1, alignment);
+  void* p = nullptr;
+#ifdef _WIN32
+  p = _aligned_malloc(bytes, alignment);
+#else
+  if (posix_memalign(&p, alignment, bytes))
+    p = nullptr;
+#endif
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+
+void* HugePageAllocator::allocate(size_t bytes)
+{
+  if (bytes < m_threshold)
+    return AlignedAllocator::allocate(bytes, Alignment);
+
+  bytes = roundUp(bytes, HugePageSize);
+  void* p = AlignedAllocator::allocate(bytes, HugePageSize);
+#ifdef MADV_HUGEPAGE
+  // advisory only: the pages are still usable if THP is disabled
+  madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+  return p;
+}
+
+
+Arena::Arena(size_t blockSize, Allocator& upstream)
+  : m_blockSize(roundUp(blockSize, Alignment)), m_upstream(upstream), m_used(0), m_live(0)
+{
+}
+
+Arena::~Arena()
+{
+  assert(m_live == 0);
+  for (const Block& b: m_blocks)
+    m_upstream.deallocate(b.data);
+}
+
+void* Arena::allocate(size_t bytes)
+{
+  bytes = roundUp(bytes ? bytes : 1, Alignment);
+  if (m_blocks.empty() || m_used + bytes > m_blocks.back().size)
+  {
+    const size_t size = bytes > m_blockSize ? bytes : m_blockSize;
+    m_blocks.push_back(Block{ static_cast<char*>(m_upstream.allocate(size)), size });
+    m_used = 0;
+  }
+  void* p = m_blocks.back().data + m_used;
+  m_used += bytes;
+  ++m_live;
+  return p;
+}
+
+void Arena::deallocate(void* p)
+{
+  assert(p && m_live);
+  (void)p;
+  if (--m_live == 0)
+    rewind();
+}
+
+size_t Arena::capacity() const
+{
+  size_t size = 0;
+  for (const Block& b: m_blocks)
+    size += b.size;
+  return size;
+}
+
+void Arena::rewind()
+{
+  m_used = 0;
+  if (m_blocks.size() < 2)
+    return;
+  // replace the blocks with one that holds them all, so the same sequence of allocations won't need to grow again
+  const size_t size = capacity();
+  for (const Block& b: m_blocks)
+    m_upstream.deallocate(b.data);
+  m_blocks.clear();
+  // called from destructors, so must not throw. On failure the arena will just grow again as required
+  try
+  {
+    m_blocks.push_back(Block{ static_cast<char*>(m_upstream.allocate(size)), size });
+  }
+  catch(const std::bad_alloc&)
+  {
+  }
+}
@@ -0,0 +1,130 @@
+// Allocator.h
+// Storage policies for NDArray. Every owning array takes the calling thread's current allocator when it is
+// constructed and returns its memory to the same allocator, so the policy can be switched for a block of code with
+// Allocator::Scope without affecting arrays created elsewhere. The default is the huge-page allocator. The policies
+// are:
+// - AlignedAllocator: storage aligned to a cache line (64 bytes), suitable for vector loads
+// - HugePageAllocator: as above, but large arrays are aligned to and advised (madvise) as transparent huge pages
+//   where the OS supports it, reducing TLB misses on large joint distributions
+// - Arena: bump allocation from blocks owned by e.g. a solver, rewound whenever all its arrays have been freed, so
+//   that repeated solves reuse the same memory. Arenas are not threadsafe and must outlive the arrays they back.
+// Element types are required to be trivial, as storage is not constructed or destroyed.
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+class Allocator
+{
+public:
+  // cache line size
+  static const size_t Alignment = 64;
+
+  virtual ~Allocator() { }
+
+  // returns storage of at least the given size aligned to (at least) Alignment, throws std::bad_alloc on failure
+  virtual void* allocate(size_t bytes) = 0;
+
+  // p must have been returned by allocate (and may not be null)
+  virtual void deallocate(void* p) = 0;
+
+  // shared, threadsafe instances of the system allocators
+  static Allocator& aligned();
+  static Allocator& hugePage();
+
+  // allocator used for new arrays created on the calling thread
+  static Allocator& current();
+
+  // Makes an allocator current for the enclosing block
+  class Scope
+  {
+  public:
+    explicit Scope(Allocator& allocator);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Allocator* m_previous;
+  };
+
+protected:
+  static size_t roundUp(size_t bytes, size_t alignment)
+  {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+private:
+  static Allocator*& currentPtr();
+};
+
+
+class AlignedAllocator : public Allocator
+{
+public:
+  void* allocate(size_t bytes) override;
+  void deallocate(void* p) override;
+
+protected:
+  static void* allocate(size_t bytes, size_t alignment);
+};
+
+
+class HugePageAllocator : public AlignedAllocator
+{
+public:
+  // (typical) transparent huge page size on x86_64 and aarch64
+  static const size_t HugePageSize = 2 << 20;
+
+  // arrays smaller than the threshold are just cache-line aligned
+  explicit HugePageAllocator(size_t threshold = HugePageSize) : m_threshold(threshold) { }
+
+  void* allocate(size_t bytes) override;
+
+private:
+  size_t m_threshold;
+};
+
+
+class Arena : public Allocator
+{
+public:
+  // blocks are taken from the upstream allocator, which must outlive the arena
+  explicit Arena(size_t blockSize = 1 << 20, Allocator& upstream = Allocator::hugePage());
+
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t bytes) override;
+  void deallocate(void* p) override;
+
+  // number of allocations not yet freed
+  size_t live() const { return m_live; }
+
+  // total size of the blocks held
+  size_t capacity() const;
+
+  // number of blocks held
+  size_t blocks() const { return m_blocks.size(); }
+
+private:
+  struct Block
+  {
+    char* data;
+    size_t size;
+  };
+
+  // called when nothing is live: consolidates into a single block large enough for the previous high-water mark
+  void rewind();
+
+  size_t m_blockSize;
+  Allocator& m_upstream;
+  std::vector<Block> m_blocks;
+  // bytes used in the last block
+  size_t m_used;
+  size_t m_live;
+};
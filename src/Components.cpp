@@ -0,0 +1,330 @@
+
+#include "Components.h"
+#include "Index.h"
+
+#include <map>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+int64_t find(std::vector<int64_t>& parent, int64_t d)
+{
+  while (parent[d] != d)
+  {
+    parent[d] = parent[parent[d]];
+    d = parent[d];
+  }
+  return d;
+}
+
+// row-major index of a component state from its offset
+void unflatten(int64_t offset, const std::vector<int64_t>& sizes, std::vector<int64_t>& index)
+{
+  index.resize(sizes.size());
+  for (size_t j = sizes.size(); j > 0; --j)
+  {
+    index[j-1] = offset % sizes[j-1];
+    offset /= sizes[j-1];
+  }
+}
+
+}
+
+std::vector<Component> connectedComponents(const std::vector<std::vector<int64_t>>& indices)
+{
+  int64_t dims = 0;
+  for (const std::vector<int64_t>& index: indices)
+  {
+    for (int64_t d: index)
+    {
+      if (d < 0)
+        throw std::runtime_error("negative dimension index " + std::to_string(d));
+      dims = std::max(dims, d + 1);
+    }
+  }
+
+  // union-find over the dimensions, each marginal joining all of its own
+  std::vector<int64_t> parent(dims);
+  std::iota(parent.begin(), parent.end(), 0);
+  for (const std::vector<int64_t>& index: indices)
+  {
+    for (size_t j = 1; j < index.size(); ++j)
+    {
+      const int64_t a = find(parent, index[0]);
+      const int64_t b = find(parent, index[j]);
+      // the lower root is kept so that the components end up ordered by their lowest dimension
+      parent[std::max(a, b)] = std::min(a, b);
+    }
+  }
+
+  std::vector<Component> components;
+  std::map<int64_t, size_t> lookup;
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    if (indices[k].empty())
+      throw std::runtime_error("marginal " + std::to_string(k) + " has no dimensions");
+    const int64_t root = find(parent, indices[k][0]);
+    std::map<int64_t, size_t>::iterator it = lookup.find(root);
+    if (it == lookup.end())
+      it = lookup.insert(std::make_pair(root, 0)).first;
+  }
+  // ordered by root, which is the lowest dimension of each component
+  for (std::map<int64_t, size_t>::iterator it = lookup.begin(); it != lookup.end(); ++it)
+  {
+    it->second = components.size();
+    components.push_back(Component());
+  }
+  for (int64_t d = 0; d < dims; ++d)
+  {
+    std::map<int64_t, size_t>::const_iterator it = lookup.find(find(parent, d));
+    // a dimension in no marginal is an error in the problem, detected by validation
+    if (it != lookup.end())
+      components[it->second].dims.push_back(d);
+  }
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    Component& component = components[lookup[find(parent, indices[k][0])]];
+    component.marginals.push_back(k);
+    component.indices.push_back(std::vector<int64_t>());
+    for (int64_t d: indices[k])
+      component.indices.back().push_back(std::lower_bound(component.dims.begin(), component.dims.end(), d) - component.dims.begin());
+  }
+  return components;
+}
+
+ComponentQIS::ComponentQIS(const index_list_t& indices, const marginal_list_t& marginals, int64_t skips)
+: m_skips(skips), m_population(0), m_conv(false)
+{
+  PROFILE_SCOPE(m_profile, "validation");
+  // as Microsynthesis, the validation of marginals sharing dimensions being done by each component's QIS
+  if (indices.size() != marginals.size() || indices.size() < 2)
+    throw std::runtime_error("index and marginal lists differ in size or too small");
+  std::map<int64_t, int64_t> dim_sizes;
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    if (indices[k].size() != marginals[k].dim())
+      throw std::runtime_error("index/marginal dimension mismatch " + std::to_string(indices[k].size()) + " vs " + std::to_string(marginals[k].dim()));
+    for (size_t j = 0; j < indices[k].size(); ++j)
+    {
+      std::map<int64_t, int64_t>::iterator it = dim_sizes.find(indices[k][j]);
+      if (it == dim_sizes.end())
+        dim_sizes.insert(std::make_pair(indices[k][j], marginals[k].size(j)));
+      else if (it->second != (int64_t)marginals[k].size(j))
+        throw std::runtime_error("mismatch at index " + std::to_string(k) + ": dimension " + std::to_string(indices[k][j]) +
+          " size " + std::to_string(it->second) + " redefined to " + std::to_string(marginals[k].size(j)));
+    }
+    if (min(marginals[k]) < 0)
+      throw std::runtime_error("negative value in marginal " + std::to_string(k));
+  }
+  if (dim_sizes.size() < 2)
+    throw std::runtime_error("problem needs to have more than 1 dimension!");
+  for (size_t d = 0; d < dim_sizes.size(); ++d)
+  {
+    std::map<int64_t, int64_t>::const_iterator it = dim_sizes.find(d);
+    if (it == dim_sizes.end())
+      throw std::runtime_error("dimension " + std::to_string(d) + " size not defined");
+    m_sizes.push_back(it->second);
+  }
+  m_population = sum(marginals[0]);
+  for (size_t k = 1; k < marginals.size(); ++k)
+  {
+    if (sum(marginals[k]) != m_population)
+      throw std::runtime_error("marginal sum mismatch");
+  }
+
+  m_components = connectedComponents(indices);
+  m_marginals.resize(m_components.size());
+  for (size_t c = 0; c < m_components.size(); ++c)
+  {
+    for (size_t k: m_components[c].marginals)
+    {
+      m_marginals[c].push_back(QIS::marginal_t());
+      QIS::marginal_t::copy(marginals[k], m_marginals[c].back());
+    }
+  }
+  PROFILE_COUNT(m_profile, "components", m_components.size());
+}
+
+const SparseArray<int64_t>& ComponentQIS::solve()
+{
+  if (m_componentPopulations.size())
+    return m_joint;
+
+  m_conv = true;
+  m_componentPopulations.resize(m_components.size());
+  m_componentExpectations.resize(m_components.size());
+  for (size_t c = 0; c < m_components.size(); ++c)
+  {
+    const Component& component = m_components[c];
+    std::vector<int64_t> sizes;
+    for (int64_t d: component.dims)
+      sizes.push_back(m_sizes[d]);
+    if (component.marginals.size() == 1 || component.dims.size() == 1)
+    {
+      // a lone marginal is its own population (and expectation), permuted to ascending dimension order. So are the
+      // marginals of a 1-d component (which QIS cannot solve), which must therefore all be the same
+      PROFILE_SCOPE(m_profile, "component");
+      const QIS::marginal_t& marginal = m_marginals[c][0];
+      for (size_t k = 1; k < m_marginals[c].size(); ++k)
+      {
+        if (!std::equal(marginal.rawData(), marginal.rawData() + marginal.storageSize(), m_marginals[c][k].rawData()))
+          throw std::runtime_error("marginal partial sum mismatch");
+      }
+      m_componentPopulations[c].resize(sizes);
+      m_componentExpectations[c].resize(sizes);
+      Index index(sizes);
+      MappedIndex mapped(index, component.indices[0]);
+      for (; !index.end(); ++index)
+      {
+        m_componentPopulations[c][index] = marginal[mapped];
+        m_componentExpectations[c][index] = marginal[mapped];
+      }
+    }
+    else
+    {
+      QIS qis(component.indices, m_marginals[c], m_skips);
+      NDArray<int64_t>::copy(qis.solve(), m_componentPopulations[c]);
+      NDArray<double>::copy(qis.expectation(), m_componentExpectations[c]);
+      m_conv = m_conv && qis.conv();
+      m_profile.merge(qis.profile());
+    }
+  }
+  combine();
+  return m_joint;
+}
+
+void ComponentQIS::combine()
+{
+  PROFILE_SCOPE(m_profile, "combine");
+  m_joint.resize(m_sizes);
+
+  // a single component is the whole problem
+  if (m_components.size() == 1)
+  {
+    const NDArray<int64_t>& population = m_componentPopulations[0];
+    for (Index index(population.sizes()); !index.end(); ++index)
+    {
+      if (population[index])
+        m_joint.at(index) = population[index];
+    }
+    return;
+  }
+
+  // each component's population, flattened, is a 1-d marginal of the component states
+  index_list_t indices;
+  marginal_list_t marginals;
+  for (size_t c = 0; c < m_components.size(); ++c)
+  {
+    const NDArray<int64_t>& population = m_componentPopulations[c];
+    indices.push_back(std::vector<int64_t>{(int64_t)c});
+    marginals.push_back(QIS::marginal_t({(int64_t)population.storageSize()}));
+    std::copy(population.rawData(), population.rawData() + population.storageSize(), marginals.back().begin());
+  }
+  QIS pairing(indices, marginals, m_skips, true);
+  const SparseArray<int64_t>& paired = pairing.solveSparse();
+  m_conv = m_conv && pairing.conv();
+
+  std::vector<int64_t> index(m_sizes.size());
+  std::vector<int64_t> local;
+  for (const auto& v: paired.values())
+  {
+    const std::vector<int64_t>& states = paired.index(v.first);
+    for (size_t c = 0; c < m_components.size(); ++c)
+    {
+      unflatten(states[c], m_componentPopulations[c].sizes(), local);
+      for (size_t j = 0; j < local.size(); ++j)
+        index[m_components[c].dims[j]] = local[j];
+    }
+    m_joint.at(index) += v.second;
+  }
+}
+
+size_t ComponentQIS::components() const
+{
+  return m_components.size();
+}
+
+const Component& ComponentQIS::component(size_t c) const
+{
+  return m_components.at(c);
+}
+
+const NDArray<int64_t>& ComponentQIS::componentPopulation(size_t c) const
+{
+  if (m_componentPopulations.empty())
+    throw std::runtime_error("components are not available until solved");
+  return m_componentPopulations.at(c);
+}
+
+const NDArray<double>& ComponentQIS::componentExpectation(size_t c) const
+{
+  if (m_componentExpectations.empty())
+    throw std::runtime_error("components are not available until solved");
+  return m_componentExpectations.at(c);
+}
+
+double ComponentQIS::expectation(const std::vector<int64_t>& index) const
+{
+  if (m_componentExpectations.empty())
+    throw std::runtime_error("components are not available until solved");
+  if (!m_population)
+    return 0.0;
+  // each component's expectation sums to the population
+  double value = m_population;
+  std::vector<int64_t> local;
+  for (size_t c = 0; c < m_components.size(); ++c)
+  {
+    local.clear();
+    for (int64_t d: m_components[c].dims)
+      local.push_back(index[d]);
+    value *= m_componentExpectations[c][local] / m_population;
+  }
+  return value;
+}
+
+void ComponentQIS::expectation(NDArray<double>& dense) const
+{
+  if (m_componentExpectations.empty())
+    throw std::runtime_error("components are not available until solved");
+  dense.resize(m_sizes);
+  if (!m_population)
+  {
+    dense.assign(0.0);
+    return;
+  }
+  // outer product of the components' expectations
+  Index index(m_sizes);
+  std::vector<MappedIndex> mappings;
+  for (const Component& component: m_components)
+    mappings.push_back(MappedIndex(index, component.dims));
+  for (; !index.end(); ++index)
+  {
+    double value = m_population;
+    for (size_t c = 0; c < m_components.size(); ++c)
+      value *= m_componentExpectations[c][mappings[c]] / m_population;
+    dense[index] = value;
+  }
+}
+
+const std::vector<int64_t>& ComponentQIS::sizes() const
+{
+  return m_sizes;
+}
+
+int64_t ComponentQIS::population() const
+{
+  return m_population;
+}
+
+bool ComponentQIS::conv() const
+{
+  return m_conv;
+}
+
+const Profile& ComponentQIS::profile() const
+{
+  return m_profile;
+}
@@ -0,0 +1,88 @@
+// Components.h
+// Decomposition of a microsynthesis problem into the connected components of its dimension/marginal graph. Marginals
+// that share no dimension (directly or through other marginals) are independent, so each component can be solved on
+// its own (much smaller) array, and the joint expectation is the product of the components'.
+//
+// e.g. {age x sex} and {tenure x rooms} are two components, solved as two 2-d problems rather than one 4-d one:
+//   ComponentQIS qis(indices, marginals);
+//   const SparseArray<int64_t>& population = qis.solve();
+
+#pragma once
+
+#include "QIS.h"
+#include "SparseArray.h"
+#include "Profile.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+struct Component
+{
+  // (overall) dimensions in the component, in ascending order
+  std::vector<int64_t> dims;
+  // the marginals (by position in the problem) in the component
+  std::vector<size_t> marginals;
+  // marginal indices relative to dims, i.e. those of the component's own problem
+  std::vector<std::vector<int64_t>> indices;
+};
+
+// The connected components of the problem, ordered by their lowest dimension
+std::vector<Component> connectedComponents(const std::vector<std::vector<int64_t>>& indices);
+
+class ComponentQIS
+{
+public:
+  typedef QIS::index_list_t index_list_t;
+  typedef QIS::marginal_list_t marginal_list_t;
+
+  // The marginals are copied and validated as for QIS, except that the consistency of marginals sharing a dimension is
+  // checked as each component is solved
+  ComponentQIS(const index_list_t& indices, const marginal_list_t& marginals, int64_t skips = 0);
+
+  ComponentQIS(const ComponentQIS&) = delete;
+  ComponentQIS& operator=(const ComponentQIS&) = delete;
+
+  // Solves each component independently, then forms the joint population (sparsely, so the full state space is never
+  // allocated) by sampling pairings of the components' populations, itself a QIS problem with one (1-d) marginal per
+  // component. The joint's marginals are those of the problem
+  const SparseArray<int64_t>& solve();
+
+  size_t components() const;
+  const Component& component(size_t c) const;
+
+  // population and expected state occupancy of a component (over its own dimensions)
+  const NDArray<int64_t>& componentPopulation(size_t c) const;
+  const NDArray<double>& componentExpectation(size_t c) const;
+
+  // joint expected occupancy of a state, from the product of the components' (the joint is never stored)
+  double expectation(const std::vector<int64_t>& index) const;
+
+  // dense joint expectation, only practical for small state spaces
+  void expectation(NDArray<double>& dense) const;
+
+  const std::vector<int64_t>& sizes() const;
+
+  int64_t population() const;
+
+  // true if every component (and the joint sampling) converged
+  bool conv() const;
+
+  // timings and counters, including those of the components' solves
+  const Profile& profile() const;
+
+private:
+  void combine();
+
+  std::vector<Component> m_components;
+  std::vector<marginal_list_t> m_marginals;
+  int64_t m_skips;
+  std::vector<int64_t> m_sizes;
+  int64_t m_population;
+
+  std::vector<NDArray<int64_t>> m_componentPopulations;
+  std::vector<NDArray<double>> m_componentExpectations;
+  SparseArray<int64_t> m_joint;
+  bool m_conv;
+  Profile m_profile;
+};
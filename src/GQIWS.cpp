@@ -349,18 +349,23 @@ bool GQIWS::solve()
   bool success = false;
   size_t iter = 0;
   const size_t limit = 1;
-  while (!success && iter<limit)
   {
-    m_t.assign(0);
-    DynamicSampler sampler(m_marginals, m_exoprobs);
+    PROFILE_SCOPE(m_profile, "sampling");
+    while (!success && iter<limit)
+    {
+      m_t.assign(0);
+      DynamicSampler sampler(m_marginals, m_exoprobs);
 
-    success = sampler.sample(m_sum, sobol, m_t);
-    ++iter;
+      success = sampler.sample(m_sum, sobol, m_t);
+      ++iter;
+    }
   }
+  PROFILE_COUNT(m_profile, "samples", m_sum * iter);
 
   // switch population out of zero-probability states
   if (!success)
   {
+    PROFILE_SCOPE(m_profile, "constrain");
     NDArray<bool> permitted(m_t.sizes());
 
     for (Index index(permitted.sizes()); !index.end(); ++index)
@@ -0,0 +1,435 @@
+
+#include "Hierarchy.h"
+#include "TaskPool.h"
+#include "IPF.h"
+#include "TRS.h"
+#include "Integerise.h"
+#include "NDArrayUtils.h"
+
+#include <map>
+#include <numeric>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+// Corrects an allocation of a parent's population among its children, (children x states) row-major over the given
+// state sizes: first the children's populations in each state are made to sum to the parent's, then individuals are
+// moved between children within a state, taking the move that most reduces the children's total absolute marginal
+// error until none does. Returns true if every child then has its marginals exactly
+bool rebalance(NDArray<int64_t>& populations, const NDArray<int64_t>& parent,
+               const std::vector<const Hierarchy::marginal_list_t*>& marginals, const Hierarchy::index_list_t& indices,
+               const std::vector<int64_t>& sizes)
+{
+  const size_t J = marginals.size();
+  const size_t K = indices.size();
+  const size_t S = populations.storageSize() / J;
+
+  // the (row-major) cell of each state in each marginal
+  std::vector<std::vector<int64_t>> cells(K, std::vector<int64_t>(S));
+  std::vector<int64_t> state(sizes.size(), 0);
+  for (size_t s = 0; s < S; ++s)
+  {
+    for (size_t k = 0; k < K; ++k)
+    {
+      int64_t c = 0;
+      for (int64_t d: indices[k])
+        c = c * sizes[d] + state[d];
+      cells[k][s] = c;
+    }
+    for (size_t d = sizes.size(); d > 0 && ++state[d-1] == sizes[d-1]; --d)
+      state[d-1] = 0;
+  }
+
+  // each child's marginals less its population's, child j's marginal k at j * K + k
+  std::vector<std::vector<int64_t>> error(J * K);
+  int64_t* p = populations.begin();
+  for (size_t j = 0; j < J; ++j)
+    for (size_t k = 0; k < K; ++k)
+    {
+      const NDArray<int64_t>& m = (*marginals[j])[k];
+      error[j * K + k].assign(m.rawData(), m.rawData() + m.storageSize());
+      for (size_t s = 0; s < S; ++s)
+        error[j * K + k][cells[k][s]] -= p[j * S + s];
+    }
+
+  // the reduction in the error of adding an individual in state s to child j (or, with sign -1, removing one)
+  auto gain = [&](size_t j, size_t s, int64_t sign) {
+    int64_t g = 0;
+    for (size_t k = 0; k < K; ++k)
+    {
+      const int64_t e = error[j * K + k][cells[k][s]];
+      g += std::abs(e) - std::abs(e - sign);
+    }
+    return g;
+  };
+  auto move = [&](size_t j, size_t s, int64_t sign) {
+    p[j * S + s] += sign;
+    for (size_t k = 0; k < K; ++k)
+      error[j * K + k][cells[k][s]] -= sign;
+  };
+
+  for (size_t s = 0; s < S; ++s)
+  {
+    int64_t column = 0;
+    for (size_t j = 0; j < J; ++j)
+      column += p[j * S + s];
+    for (; column != parent.rawData()[s]; column += column < parent.rawData()[s] ? 1 : -1)
+    {
+      const int64_t sign = column < parent.rawData()[s] ? 1 : -1;
+      size_t best = J;
+      for (size_t j = 0; j < J; ++j)
+        if ((sign > 0 || p[j * S + s]) && (best == J || gain(j, s, sign) > gain(best, s, sign)))
+          best = j;
+      move(best, s, sign);
+    }
+  }
+
+  for (;;)
+  {
+    int64_t best = 0;
+    size_t from = 0, to = 0, at = 0;
+    for (size_t s = 0; s < S; ++s)
+      for (size_t j = 0; j < J; ++j)
+      {
+        if (!p[j * S + s])
+          continue;
+        const int64_t removal = gain(j, s, -1);
+        for (size_t i = 0; i < J; ++i)
+        {
+          if (i == j)
+            continue;
+          const int64_t g = removal + gain(i, s, 1);
+          if (g > best)
+          {
+            best = g;
+            from = j;
+            to = i;
+            at = s;
+          }
+        }
+      }
+    if (best <= 0)
+      break;
+    move(from, at, -1);
+    move(to, at, 1);
+  }
+
+  for (const std::vector<int64_t>& e: error)
+    if (std::any_of(e.begin(), e.end(), [](int64_t v) { return v != 0; }))
+      return false;
+  return true;
+}
+
+}
+
+Hierarchy::Hierarchy(const index_list_t& indices, const std::vector<int64_t>& parents, const std::vector<marginal_list_t>& marginals,
+                     const NDArray<double>& seed)
+: m_indices(indices), m_parents(parents), m_conv(false)
+{
+  PROFILE_SCOPE(m_profile, "validation");
+  const size_t n = m_parents.size();
+  if (!n || marginals.size() != n)
+    throw std::runtime_error("number of areas (" + std::to_string(n) + ") differs from the number of marginal lists (" +
+      std::to_string(marginals.size()) + ")");
+
+  m_marginals.resize(n);
+  for (size_t a = 0; a < n; ++a)
+  {
+    if (marginals[a].size() != m_indices.size())
+      throw std::runtime_error("area " + std::to_string(a) + " has " + std::to_string(marginals[a].size()) + " marginals, expected " +
+        std::to_string(m_indices.size()));
+    // (row-major, whatever the storage order of the originals)
+    for (const NDArray<int64_t>& m: marginals[a])
+    {
+      m_marginals[a].push_back(NDArray<int64_t>(m.sizes()));
+      transposeStorage(m, m_marginals[a].back());
+    }
+  }
+
+  // the state space, from the first area (the others are checked as they're solved)
+  std::map<int64_t, int64_t> sizes;
+  for (size_t k = 0; k < m_indices.size(); ++k)
+  {
+    if (m_indices[k].size() != m_marginals[0][k].dim())
+      throw std::runtime_error("index/marginal dimension mismatch " + std::to_string(m_indices[k].size()) + " vs " +
+        std::to_string(m_marginals[0][k].dim()));
+    for (size_t j = 0; j < m_indices[k].size(); ++j)
+      sizes[m_indices[k][j]] = m_marginals[0][k].size(j);
+  }
+  for (const std::pair<const int64_t, int64_t>& s: sizes)
+    m_sizes.push_back(s.second);
+
+  if (seed.storageSize())
+  {
+    if (seed.sizes() != m_sizes)
+      throw std::runtime_error("seed dimensions do not match those of the marginals");
+    NDArray<double>::copy(seed, m_seed);
+  }
+  else
+  {
+    m_seed.resize(m_sizes);
+    m_seed.assign(1.0);
+  }
+
+  m_children.resize(n);
+  for (size_t a = 0; a < n; ++a)
+  {
+    if (m_parents[a] >= (int64_t)n || m_parents[a] == (int64_t)a)
+      throw std::runtime_error("area " + std::to_string(a) + " has an invalid parent " + std::to_string(m_parents[a]));
+    if (m_parents[a] >= 0)
+      m_children[m_parents[a]].push_back(a);
+    // every area must lead to a root
+    size_t depth = 0;
+    for (int64_t p = m_parents[a]; p >= 0; p = m_parents[p])
+      if (++depth > n)
+        throw std::runtime_error("area " + std::to_string(a) + " is in a cycle");
+  }
+
+  m_slot.assign(n, -1);
+  for (size_t a = 0; a < n; ++a)
+  {
+    if (m_children[a].empty())
+    {
+      m_slot[a] = m_leaves.size();
+      m_leaves.push_back(a);
+    }
+  }
+  PROFILE_COUNT(m_profile, "areas", n);
+  PROFILE_COUNT(m_profile, "leaves", m_leaves.size());
+}
+
+void Hierarchy::solve(size_t threads)
+{
+  PROFILE_SCOPE(m_profile, "hierarchy");
+
+  std::vector<int64_t> sizes{(int64_t)m_leaves.size()};
+  sizes.insert(sizes.end(), m_sizes.begin(), m_sizes.end());
+  m_population.resize(sizes);
+  m_expectation.resize(sizes);
+  m_populations.clear();
+  m_populations.resize(m_parents.size());
+  m_conv = true;
+
+  TaskPool pool(threads);
+  for (size_t a = 0; a < m_parents.size(); ++a)
+  {
+    if (m_parents[a] < 0)
+    {
+      pool.push([this, a, &pool]() {
+        solveRoot(a);
+        if (!m_children[a].empty())
+          solveChildren(a, pool);
+      });
+    }
+  }
+  pool.run();
+
+  PROFILE_COUNT(m_profile, "steals", pool.steals());
+}
+
+void Hierarchy::solveRoot(size_t a)
+{
+  TRS trs(m_indices, m_marginals[a]);
+  if (trs.sizes() != m_sizes)
+    throw std::runtime_error("area " + std::to_string(a) + " dimensions do not match those of area 0");
+  const NDArray<int64_t>& population = trs.solve(m_seed);
+  store(a, trs.expectation(), population.rawData(), trs.conv());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_profile.merge(trs.profile());
+}
+
+void Hierarchy::solveChildren(size_t a, TaskPool& pool)
+{
+  const std::vector<size_t>& children = m_children[a];
+  const NDArray<int64_t>& parent = *m_populations[a];
+  const int64_t J = children.size();
+  const int64_t S = parent.storageSize();
+  bool conv = true;
+
+  // each child's solution against its own marginals, and its share of the parent's total
+  std::vector<int64_t> sizes{J};
+  sizes.insert(sizes.end(), m_sizes.begin(), m_sizes.end());
+  NDArray<double> solutions(sizes);
+  std::vector<double> shares(J);
+  Profile profile;
+  for (int64_t j = 0; j < J; ++j)
+  {
+    const size_t c = children[j];
+    IPF<int64_t> ipf(m_indices, m_marginals[c]);
+    if (ipf.sizes() != m_sizes)
+      throw std::runtime_error("area " + std::to_string(c) + " dimensions do not match those of area 0");
+    const NDArray<double>& solution = ipf.solve(m_seed);
+    std::copy(solution.rawData(), solution.rawData() + S, solutions.begin() + j * S);
+    shares[j] = double(ipf.population());
+    conv = conv && ipf.conv();
+    profile.merge(ipf.profile());
+  }
+  const int64_t total = sum(parent);
+  if (total > std::numeric_limits<int>::max())
+    throw std::runtime_error("area " + std::to_string(a) + " population " + std::to_string(total) + " is too large to allocate");
+
+  // the children's marginals are constraints if they sum to the parent's population, otherwise only their totals are
+  // (as shares of the parent's)
+  bool consistent = true;
+  for (size_t k = 0; k < m_indices.size() && consistent; ++k)
+  {
+    NDArray<int64_t> remainder = reduce<int64_t>(parent, m_indices[k]);
+    for (int64_t j = 0; j < J; ++j)
+      for (size_t i = 0; i < remainder.storageSize(); ++i)
+        remainder.begin()[i] -= m_marginals[children[j]][k].rawData()[i];
+    consistent = std::all_of(remainder.begin(), remainder.end(), [](int64_t v) { return v == 0; });
+  }
+
+  // allocate the parent's population: (children x states), constrained to the children's marginals (or totals) and the
+  // parent's states
+  NDArray<int64_t> populations(sizes);
+  populations.assign(0ll);
+  if (total > 0)
+  {
+    // states the parent occupies but none of its children's solutions do are shared in proportion to the children
+    const double sumShares = std::accumulate(shares.begin(), shares.end(), 0.0);
+    for (double& s: shares)
+      s = sumShares > 0.0 ? s / sumShares : 1.0 / J;
+    double* p = solutions.begin();
+    std::vector<int64_t> filled;
+    for (int64_t s = 0; s < S; ++s)
+    {
+      if (!parent.rawData()[s])
+        continue;
+      double column = 0.0;
+      for (int64_t j = 0; j < J; ++j)
+        column += p[j * S + s];
+      if (column == 0.0)
+      {
+        filled.push_back(s);
+        for (int64_t j = 0; j < J; ++j)
+          p[j * S + s] = shares[j];
+      }
+    }
+
+    index_list_t indices;
+    std::vector<NDArray<int64_t>> allocation;
+    if (consistent)
+    {
+      // (children x marginal) for each marginal
+      for (size_t k = 0; k < m_indices.size(); ++k)
+      {
+        indices.push_back(std::vector<int64_t>{0});
+        for (int64_t d: m_indices[k])
+          indices.back().push_back(d + 1);
+        const NDArray<int64_t>& first = m_marginals[children[0]][k];
+        std::vector<int64_t> msizes{J};
+        msizes.insert(msizes.end(), first.sizes().begin(), first.sizes().end());
+        allocation.push_back(NDArray<int64_t>(msizes));
+        const size_t M = first.storageSize();
+        for (int64_t j = 0; j < J; ++j)
+          std::copy(m_marginals[children[j]][k].rawData(), m_marginals[children[j]][k].rawData() + M, allocation.back().begin() + j * M);
+      }
+    }
+    else
+    {
+      double mse;
+      const std::vector<int>& counts = integeriseMarginalDistribution(shares, total, mse);
+      indices.push_back(std::vector<int64_t>{0});
+      allocation.push_back(NDArray<int64_t>(std::vector<int64_t>{J}));
+      std::copy(counts.begin(), counts.end(), allocation.back().begin());
+    }
+    indices.push_back(std::vector<int64_t>(m_sizes.size()));
+    std::iota(indices.back().begin(), indices.back().end(), 1);
+    allocation.push_back(NDArray<int64_t>(m_sizes));
+    std::copy(parent.rawData(), parent.rawData() + S, allocation.back().begin());
+    TRS trs(indices, allocation);
+    NDArray<int64_t>::copy(trs.solve(solutions), populations);
+    if (consistent && !trs.conv())
+    {
+      // the integerisation can leave the parent's states or some children's marginal cells a little off, which
+      // (re)allocating individuals within a state usually corrects
+      std::vector<const marginal_list_t*> marginals;
+      for (size_t c: children)
+        marginals.push_back(&m_marginals[c]);
+      conv = conv && rebalance(populations, parent, marginals, m_indices, m_sizes);
+      PROFILE_COUNT(profile, "rebalanced", 1);
+    }
+    else
+      conv = conv && trs.conv();
+    profile.merge(trs.profile());
+    PROFILE_COUNT(profile, "inconsistent", consistent ? 0 : 1);
+
+    // the children's own solutions are stored
+    for (int64_t s: filled)
+      for (int64_t j = 0; j < J; ++j)
+        p[j * S + s] = 0.0;
+  }
+
+  NDArray<double> solution(m_sizes);
+  for (int64_t j = 0; j < J; ++j)
+  {
+    std::copy(solutions.rawData() + j * S, solutions.rawData() + (j + 1) * S, solution.begin());
+    store(children[j], solution, populations.rawData() + j * S, conv);
+  }
+
+  // the parent's population is no longer needed
+  m_populations[a].reset();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_profile.merge(profile);
+  }
+
+  for (size_t c: children)
+    if (!m_children[c].empty())
+      pool.push([this, c, &pool]() { solveChildren(c, pool); });
+}
+
+void Hierarchy::store(size_t a, const NDArray<double>& expectation, const int64_t* population, bool conv)
+{
+  const size_t S = expectation.storageSize();
+  if (!conv)
+    m_conv = false;
+  if (m_slot[a] >= 0)
+  {
+    // leaves are written straight into their (disjoint) slots in the results
+    std::copy(expectation.rawData(), expectation.rawData() + S, m_expectation.begin() + m_slot[a] * S);
+    std::copy(population, population + S, m_population.begin() + m_slot[a] * S);
+  }
+  else
+  {
+    m_populations[a].reset(new NDArray<int64_t>(m_sizes));
+    std::copy(population, population + S, m_populations[a]->begin());
+  }
+}
+
+size_t Hierarchy::areas() const
+{
+  return m_parents.size();
+}
+
+const std::vector<int64_t>& Hierarchy::leaves() const
+{
+  return m_leaves;
+}
+
+const NDArray<int64_t>& Hierarchy::population() const
+{
+  return m_population;
+}
+
+const NDArray<double>& Hierarchy::expectation() const
+{
+  return m_expectation;
+}
+
+bool Hierarchy::conv() const
+{
+  return m_conv;
+}
+
+const Profile& Hierarchy::profile() const
+{
+  return m_profile;
+}
@@ -0,0 +1,89 @@
+// Hierarchy.h
+// Microsynthesis of nested areas (e.g. regions -> districts -> output areas) in one call. Every area has its own
+// marginals, over the same dimensions. A root area is solved by IPF and integerised (see TRS.h); then, top-down, each
+// area's children are solved by IPF against their own marginals, and the parent's population is allocated among them
+// by integerising the (children x states) array of their solutions, constrained to the parent's population in each
+// state and to each child's own marginals. So the populations of the children of every area sum exactly to its
+// population, and (where it can be met) each child has its marginals exactly. Children whose marginals don't sum to
+// their parent's population are treated as shares of it: only their totals, scaled to the parent's, are constrained.
+//
+// Areas whose children are to be solved are tasks on a work-stealing pool (see TaskPool.h), so siblings are solved in
+// parallel, and the result is deterministic. The leaf areas' populations are returned in one contiguous array.
+//
+// e.g. a region and 2 districts, the second with 3 output areas:
+//   Hierarchy hierarchy(indices, {-1, 0, 0, 2, 2, 2}, marginals /* per area */);
+//   hierarchy.solve();
+//   const NDArray<int64_t>& population = hierarchy.population(); // (4 leaves x states)
+
+#pragma once
+
+#include "NDArray.h"
+#include "Profile.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+class TaskPool;
+
+class Hierarchy
+{
+public:
+  typedef std::vector<std::vector<int64_t>> index_list_t;
+  typedef std::vector<NDArray<int64_t>> marginal_list_t;
+
+  // parents is the parent of each area, negative for a root. marginals are per area, each over the same indices, and
+  // are copied. The seed (over the state space) is used for every area, an empty seed meaning unity
+  Hierarchy(const index_list_t& indices, const std::vector<int64_t>& parents, const std::vector<marginal_list_t>& marginals,
+            const NDArray<double>& seed = NDArray<double>());
+
+  Hierarchy(const Hierarchy&) = delete;
+  Hierarchy& operator=(const Hierarchy&) = delete;
+
+  // Solves every area on up to the given number of threads (0 = one per hardware thread)
+  void solve(size_t threads = 0);
+
+  size_t areas() const;
+
+  // the leaf areas, ascending, in the order of the results
+  const std::vector<int64_t>& leaves() const;
+
+  // (leaves x states) integer populations and IPF solutions of the leaf areas
+  const NDArray<int64_t>& population() const;
+  const NDArray<double>& expectation() const;
+
+  // true if every IPF converged and every allocation met its constraints exactly (so every area whose marginals are
+  // consistent with its parent's has them exactly)
+  bool conv() const;
+
+  const Profile& profile() const;
+
+private:
+  // solves area a from its seed, storing its solution and population
+  void solveRoot(size_t a);
+  // allocates the population of area a to its children, and queues those with children of their own
+  void solveChildren(size_t a, TaskPool& pool);
+  void store(size_t a, const NDArray<double>& expectation, const int64_t* population, bool conv);
+
+  index_list_t m_indices;
+  std::vector<int64_t> m_parents;
+  std::vector<marginal_list_t> m_marginals;
+  NDArray<double> m_seed;
+
+  std::vector<std::vector<size_t>> m_children;
+  std::vector<int64_t> m_leaves;
+  // per area, its position in the results if it's a leaf
+  std::vector<int64_t> m_slot;
+  std::vector<int64_t> m_sizes;
+
+  // populations of the areas whose children are still to be solved
+  std::vector<std::unique_ptr<NDArray<int64_t>>> m_populations;
+
+  NDArray<int64_t> m_population;
+  NDArray<double> m_expectation;
+  std::atomic<bool> m_conv;
+  std::mutex m_mutex;
+  Profile m_profile;
+};
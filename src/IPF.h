@@ -1,6 +1,9 @@
 // IPF.h
 // C++ implementation of multidimensional* iterative proportional fitting
 // marginals are 1d in this implementation
+// The population is held in T, which may be float for problems large enough to be bound by memory bandwidth: the
+// scaling passes then move half the data, the reductions still accumulate in double precision, and convergence is
+// to within the rounding error of the population (see tolerance)
 
 #pragma once
 
@@ -9,17 +12,19 @@
 
 #include <vector>
 #include <cmath>
+#include <limits>
+#include <algorithm>
 
-template<typename M>
-class IPF : public Microsynthesis<double, M> // marginal type
+template<typename M, typename T = double>
+class IPF : public Microsynthesis<T, M> // marginal type, population type
 {
 public:
 
-  typedef typename Microsynthesis<double, M>::index_list_t index_list_t;
-  typedef typename Microsynthesis<double, M>::marginal_list_t marginal_list_t;
+  typedef typename Microsynthesis<T, M>::index_list_t index_list_t;
+  typedef typename Microsynthesis<T, M>::marginal_list_t marginal_list_t;
 
-  IPF(const typename Microsynthesis<double, M>::index_list_t& indices, typename Microsynthesis<double, M>::marginal_list_t& marginals)
-    : Microsynthesis<double, M>(indices, marginals)
+  IPF(const typename Microsynthesis<T, M>::index_list_t& indices, typename Microsynthesis<T, M>::marginal_list_t& marginals)
+    : Microsynthesis<T, M>(indices, marginals), m_tol(tolerance(this->m_population))
   {
   }
   
@@ -32,10 +37,12 @@ public:
   ~IPF() { }
 
   // TODO need a mechanism to invalidate result after its been moved
-  NDArray<double>& solve(const NDArray<double>& seed)
+  NDArray<T>& solve(const NDArray<double>& seed)
   {
     // check seed dims match those computed by base
     assert(seed.sizes() == this->m_array.sizes());
+
+    PROFILE_SCOPE(this->m_profile, "ipf");
   
     Index index_main(this->m_array.sizes());
   
@@ -47,9 +54,11 @@ public:
     }
   
     //this->m_array.assign(1.0);
-    std::copy(seed.rawData(), seed.rawData() + seed.storageSize(), const_cast<double*>(this->m_array.rawData()));
+    // seed may be in either storage order
+    transposeStorage(seed, this->m_array);
   
     std::vector<NDArray<double>> diffs(this->m_marginals.size());
+    std::vector<NDArray<double>> reduced(this->m_marginals.size());
     m_errors.resize(this->m_marginals.size());
   
     for (size_t k = 0; k < diffs.size(); ++k)
@@ -57,16 +66,18 @@ public:
       diffs[k].resize(this->m_marginals[k].sizes());
       m_errors[k].resize(this->m_marginals[k].sizes());
     }
+    // subsequent reductions are accumulated as the population is scaled
+    NDArray<double>::copy(reduceAs<double>(this->m_array, this->m_indices[0]), reduced[0]);
   
     m_conv = false;
     for (m_iters = 0; !m_conv && m_iters < s_MAXITER; ++m_iters)
     {
-      // move back into this class?
-      Microsynthesis<double, M>::rScale();
-      Microsynthesis<double, M>::rDiff(diffs);
+      TRACE_SCOPE("ipf iteration");
+      Microsynthesis<T, M>::rScaleDiff(reduced, diffs);
   
       m_conv = computeErrors(diffs);
     }
+    PROFILE_COUNT(this->m_profile, "iterations", m_iters);
   
     return this->m_array;
   }
@@ -94,8 +105,17 @@ public:
   
 private:
 
+  // absolute, but no tighter than the rounding error of a population held in less than double precision
+  static double tolerance(int64_t population)
+  {
+    if (sizeof(T) >= sizeof(double))
+      return 1e-8;
+    return std::max(1e-8, population * static_cast<double>(std::numeric_limits<T>::epsilon()));
+  }
+
   bool computeErrors(std::vector<NDArray<double>>& diffs)
   {
+    PROFILE_SCOPE(this->m_profile, "computeErrors");
     m_maxError = -std::numeric_limits<double>::max();
   
     // // create mapped indices
@@ -118,7 +138,7 @@ private:
   bool m_conv;
   Microsynthesis<double>::marginal_list_t m_errors;
   double m_maxError;
-  const double m_tol = 1e-8;
+  const double m_tol;
 
   static const size_t s_MAXITER = 1000;
 };
@@ -0,0 +1,504 @@
+
+#include "JunctionTree.h"
+#include "Index.h"
+#include "Sobol.h"
+
+#include <set>
+#include <numeric>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// positions of dims within (the sorted) within
+std::vector<int64_t> positions(const std::vector<int64_t>& dims, const std::vector<int64_t>& within)
+{
+  std::vector<int64_t> result;
+  result.reserve(dims.size());
+  for (int64_t d: dims)
+    result.push_back(std::lower_bound(within.begin(), within.end(), d) - within.begin());
+  return result;
+}
+
+std::vector<int64_t> local(const std::vector<int64_t>& index, const std::vector<int64_t>& dims)
+{
+  std::vector<int64_t> result;
+  result.reserve(dims.size());
+  for (int64_t d: dims)
+    result.push_back(index[d]);
+  return result;
+}
+
+// sums of a table over the dimensions at the given positions, in that order (which may be all of them)
+NDArray<double> project(const NDArray<double>& table, const std::vector<int64_t>& positions)
+{
+  if (positions.size() < table.dim())
+    return reduce<double>(table, positions);
+  std::vector<int64_t> sizes;
+  for (int64_t p: positions)
+    sizes.push_back(table.sizes()[p]);
+  NDArray<double> result(sizes);
+  Index index(table.sizes());
+  MappedIndex mapped(index, positions);
+  for (; !index.end(); ++index)
+    result[mapped] = table[index];
+  return result;
+}
+
+// elementwise ratio, zero where the denominator is
+NDArray<double> ratio(const NDArray<double>& numerator, const NDArray<double>& denominator)
+{
+  NDArray<double> result(denominator.sizes());
+  for (Index index(denominator.sizes()); !index.end(); ++index)
+    result[index] = denominator[index] != 0.0 ? numerator[index] / denominator[index] : 0.0;
+  return result;
+}
+
+// multiplies a table by factors over the dimensions at the given positions
+void scale(NDArray<double>& table, const std::vector<int64_t>& positions, const NDArray<double>& factors)
+{
+  Index index(table.sizes());
+  MappedIndex mapped(index, positions);
+  for (; !index.end(); ++index)
+    table[index] *= factors[mapped];
+}
+
+// uniform table summing to total
+void uniform(NDArray<double>& table, const std::vector<int64_t>& sizes, double total)
+{
+  table.resize(sizes);
+  table.assign(total / table.storageSize());
+}
+
+size_t findRoot(std::vector<size_t>& parent, size_t i)
+{
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+}
+
+JunctionTreeIPF::JunctionTreeIPF(const index_list_t& indices, marginal_list_t& marginals)
+: Microsynthesis(indices, marginals, false), m_trees(0), m_decomposable(false), m_conv(false), m_iters(0),
+  m_maxError(std::numeric_limits<double>::max()), m_sampleConv(false)
+{
+  PROFILE_SCOPE(m_profile, "triangulate");
+  triangulate();
+  buildTree();
+
+  // each marginal is fitted in a clique containing all of its dimensions (which exists, as they are connected)
+  for (const index_t& index: m_indices)
+  {
+    std::vector<int64_t> dims(index.begin(), index.end());
+    std::sort(dims.begin(), dims.end());
+    size_t c = 0;
+    while (!std::includes(m_cliques[c].begin(), m_cliques[c].end(), dims.begin(), dims.end()))
+      ++c;
+    m_assigned.push_back(c);
+    m_positions.push_back(positions(index, m_cliques[c]));
+  }
+  PROFILE_COUNT(m_profile, "cliques", m_cliques.size());
+}
+
+// Greedy minimum-fill elimination, which adds no fill edges to a chordal graph. The elimination cliques that aren't
+// contained in another are the cliques of the triangulated graph
+void JunctionTreeIPF::triangulate()
+{
+  std::vector<std::set<int64_t>> adjacent(m_dim);
+  for (const index_t& index: m_indices)
+    for (int64_t a: index)
+      for (int64_t b: index)
+        if (a != b)
+          adjacent[a].insert(b);
+
+  std::vector<bool> eliminated(m_dim, false);
+  std::vector<std::vector<int64_t>> candidates;
+  size_t fill = 0;
+  for (size_t n = 0; n < m_dim; ++n)
+  {
+    int64_t best = -1;
+    size_t bestFill = std::numeric_limits<size_t>::max();
+    for (size_t v = 0; v < m_dim; ++v)
+    {
+      if (eliminated[v])
+        continue;
+      size_t f = 0;
+      for (std::set<int64_t>::const_iterator a = adjacent[v].begin(); a != adjacent[v].end(); ++a)
+        for (std::set<int64_t>::const_iterator b = std::next(a); b != adjacent[v].end(); ++b)
+          if (!adjacent[*a].count(*b))
+            ++f;
+      if (f < bestFill)
+      {
+        best = v;
+        bestFill = f;
+      }
+    }
+    fill += bestFill;
+    std::vector<int64_t> clique(adjacent[best].begin(), adjacent[best].end());
+    for (int64_t a: clique)
+    {
+      adjacent[a].insert(clique.begin(), clique.end());
+      adjacent[a].erase(a);
+      adjacent[a].erase(best);
+    }
+    clique.push_back(best);
+    std::sort(clique.begin(), clique.end());
+    candidates.push_back(clique);
+    adjacent[best].clear();
+    eliminated[best] = true;
+  }
+
+  for (size_t i = 0; i < candidates.size(); ++i)
+  {
+    bool maximal = true;
+    for (size_t j = 0; j < candidates.size() && maximal; ++j)
+    {
+      // of identical cliques the first is kept
+      if (j != i && std::includes(candidates[j].begin(), candidates[j].end(), candidates[i].begin(), candidates[i].end()))
+        maximal = candidates[j].size() == candidates[i].size() && j > i;
+    }
+    if (maximal)
+      m_cliques.push_back(candidates[i]);
+  }
+  std::sort(m_cliques.begin(), m_cliques.end());
+
+  // decomposable if chordal and every clique is a marginal
+  m_decomposable = fill == 0;
+  for (size_t c = 0; c < m_cliques.size() && m_decomposable; ++c)
+  {
+    bool found = false;
+    for (const index_t& index: m_indices)
+    {
+      std::vector<int64_t> dims(index.begin(), index.end());
+      std::sort(dims.begin(), dims.end());
+      found = found || dims == m_cliques[c];
+    }
+    m_decomposable = found;
+  }
+}
+
+// A maximum spanning tree of the cliques, weighted by the size of their intersections, is a junction tree. Cliques
+// with no dimensions in common are in separate trees
+void JunctionTreeIPF::buildTree()
+{
+  const size_t n = m_cliques.size();
+  std::vector<std::pair<size_t, std::pair<size_t, size_t>>> candidates;
+  for (size_t i = 0; i < n; ++i)
+  {
+    for (size_t j = i + 1; j < n; ++j)
+    {
+      std::vector<int64_t> common;
+      std::set_intersection(m_cliques[i].begin(), m_cliques[i].end(), m_cliques[j].begin(), m_cliques[j].end(),
+                            std::back_inserter(common));
+      if (!common.empty())
+        candidates.push_back(std::make_pair(common.size(), std::make_pair(i, j)));
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+    [](const std::pair<size_t, std::pair<size_t, size_t>>& a, const std::pair<size_t, std::pair<size_t, size_t>>& b) {
+      return a.first > b.first;
+  });
+
+  std::vector<size_t> parent(n);
+  std::iota(parent.begin(), parent.end(), 0);
+  m_neighbours.resize(n);
+  for (const auto& candidate: candidates)
+  {
+    const size_t a = findRoot(parent, candidate.second.first);
+    const size_t b = findRoot(parent, candidate.second.second);
+    if (a == b)
+      continue;
+    parent[std::max(a, b)] = std::min(a, b);
+    const size_t i = candidate.second.first;
+    const size_t j = candidate.second.second;
+    m_neighbours[i].push_back(std::make_pair(j, m_edges.size()));
+    m_neighbours[j].push_back(std::make_pair(i, m_edges.size()));
+    m_edges.push_back(candidate.second);
+    m_separators.push_back(std::vector<int64_t>());
+    std::set_intersection(m_cliques[i].begin(), m_cliques[i].end(), m_cliques[j].begin(), m_cliques[j].end(),
+                          std::back_inserter(m_separators.back()));
+  }
+  m_trees = n - m_edges.size();
+  m_cliqueTables.resize(n);
+  m_separatorTables.resize(m_edges.size());
+}
+
+bool JunctionTreeIPF::solve()
+{
+  PROFILE_SCOPE(m_profile, "ipf");
+
+  // the unity seed: every table is uniform, each tree summing to the population
+  for (size_t c = 0; c < m_cliques.size(); ++c)
+    uniform(m_cliqueTables[c], local(m_sizes, m_cliques[c]), m_population);
+  for (size_t e = 0; e < m_edges.size(); ++e)
+    uniform(m_separatorTables[e], local(m_sizes, m_separators[e]), m_population);
+
+  m_conv = false;
+  for (m_iters = 0; !m_conv && m_iters < s_MAXITER; ++m_iters)
+  {
+    {
+      PROFILE_SCOPE(m_profile, "rScale");
+      for (size_t k = 0; k < m_indices.size(); ++k)
+      {
+        NDArray<double>& table = m_cliqueTables[m_assigned[k]];
+        const NDArray<double>& factors = ratio(m_marginals[k], project(table, m_positions[k]));
+        scale(table, m_positions[k], factors);
+        distribute(m_assigned[k]);
+      }
+    }
+    m_conv = computeErrors();
+  }
+  PROFILE_COUNT(m_profile, "iterations", m_iters);
+  return m_conv;
+}
+
+void JunctionTreeIPF::distribute(size_t c)
+{
+  // (clique, clique it was reached from)
+  std::vector<std::pair<size_t, size_t>> stack(1, std::make_pair(c, c));
+  while (!stack.empty())
+  {
+    const size_t a = stack.back().first;
+    const size_t from = stack.back().second;
+    stack.pop_back();
+    for (const std::pair<size_t, size_t>& neighbour: m_neighbours[a])
+    {
+      const size_t b = neighbour.first;
+      const size_t e = neighbour.second;
+      if (b == from)
+        continue;
+      const NDArray<double>& updated = project(m_cliqueTables[a], positions(m_separators[e], m_cliques[a]));
+      scale(m_cliqueTables[b], positions(m_separators[e], m_cliques[b]), ratio(updated, m_separatorTables[e]));
+      NDArray<double>::copy(updated, m_separatorTables[e]);
+      stack.push_back(std::make_pair(b, a));
+    }
+  }
+}
+
+bool JunctionTreeIPF::computeErrors()
+{
+  PROFILE_SCOPE(m_profile, "computeErrors");
+  m_maxError = 0.0;
+  for (size_t k = 0; k < m_indices.size(); ++k)
+  {
+    const NDArray<double>& r = project(m_cliqueTables[m_assigned[k]], m_positions[k]);
+    for (Index index(r.sizes()); !index.end(); ++index)
+      m_maxError = std::max(m_maxError, std::fabs(r[index] - m_marginals[k][index]));
+  }
+  return m_maxError < m_tol;
+}
+
+bool JunctionTreeIPF::decomposable() const
+{
+  return m_decomposable;
+}
+
+size_t JunctionTreeIPF::cliques() const
+{
+  return m_cliques.size();
+}
+
+const std::vector<int64_t>& JunctionTreeIPF::clique(size_t c) const
+{
+  return m_cliques.at(c);
+}
+
+const NDArray<double>& JunctionTreeIPF::cliqueTable(size_t c) const
+{
+  return m_cliqueTables.at(c);
+}
+
+const std::vector<std::pair<size_t, size_t>>& JunctionTreeIPF::edges() const
+{
+  return m_edges;
+}
+
+const std::vector<int64_t>& JunctionTreeIPF::separator(size_t e) const
+{
+  return m_separators.at(e);
+}
+
+const NDArray<double>& JunctionTreeIPF::separatorTable(size_t e) const
+{
+  return m_separatorTables.at(e);
+}
+
+double JunctionTreeIPF::value(const std::vector<int64_t>& index) const
+{
+  if (!m_population)
+    return 0.0;
+  double v = 1.0;
+  for (size_t c = 0; c < m_cliques.size(); ++c)
+    v *= m_cliqueTables[c][local(index, m_cliques[c])];
+  for (size_t e = 0; e < m_edges.size(); ++e)
+  {
+    const double s = m_separatorTables[e][local(index, m_separators[e])];
+    if (s == 0.0)
+      return 0.0;
+    v /= s;
+  }
+  // each tree sums to the population
+  for (size_t t = 1; t < m_trees; ++t)
+    v /= m_population;
+  return v;
+}
+
+void JunctionTreeIPF::toDense(NDArray<double>& dense) const
+{
+  int64_t states = 1;
+  for (int64_t s: m_sizes)
+  {
+    if (states > NDArray<double>::MaxSize / s)
+      throw std::runtime_error("state space is too large to convert to dense");
+    states *= s;
+  }
+  dense.resize(m_sizes);
+  for (Index index(m_sizes); !index.end(); ++index)
+    dense[index] = value(index);
+}
+
+const SparseArray<int64_t>& JunctionTreeIPF::sample(int64_t skips)
+{
+  if (m_cliqueTables.empty() || !m_cliqueTables[0].storageSize())
+    throw std::runtime_error("junction tree must be solved before sampling");
+
+  PROFILE_SCOPE(m_profile, "sampling");
+  static const double unit = 0.5 / (1u<<31);
+
+  // each tree in turn from its lowest clique, parents before their children, so that a clique's separator with its
+  // parent has already been sampled
+  const size_t n = m_cliques.size();
+  std::vector<size_t> order;
+  std::vector<bool> visited(n, false);
+  for (size_t root = 0; root < n; ++root)
+  {
+    if (visited[root])
+      continue;
+    visited[root] = true;
+    order.push_back(root);
+    // breadth first, order growing as the tree is traversed
+    for (size_t i = order.size() - 1; i < order.size(); ++i)
+    {
+      for (const std::pair<size_t, size_t>& neighbour: m_neighbours[order[i]])
+      {
+        if (!visited[neighbour.first])
+        {
+          visited[neighbour.first] = true;
+          order.push_back(neighbour.first);
+        }
+      }
+    }
+  }
+
+  std::vector<NDArray<double>> remaining(n);
+  for (size_t c = 0; c < n; ++c)
+    NDArray<double>::copy(m_cliqueTables[c], remaining[c]);
+
+  Sobol sobol(n);
+  sobol.skip(skips);
+  m_sample.resize(m_sizes);
+  m_sampleConv = true;
+
+  std::vector<int64_t> state(m_dim);
+  std::vector<std::pair<int64_t, double>> candidates;
+  for (int64_t i = 0; i < m_population; ++i)
+  {
+    std::fill(state.begin(), state.end(), -1);
+    const std::vector<uint32_t>& seq = sobol.buf();
+    for (size_t j = 0; j < n; ++j)
+    {
+      const size_t c = order[j];
+      const std::vector<int64_t>& dims = m_cliques[c];
+      // the clique's states consistent with those already sampled, weighted by their remaining occupancy, or if
+      // there is none left (as the tables aren't integral) by the solution
+      double total = 0.0;
+      for (int pass = 0; pass < 2 && total == 0.0; ++pass)
+      {
+        const NDArray<double>& table = pass ? m_cliqueTables[c] : remaining[c];
+        candidates.clear();
+        int64_t offset = 0;
+        for (Index index(table.sizes()); !index.end(); ++index, ++offset)
+        {
+          bool consistent = true;
+          for (size_t d = 0; d < dims.size() && consistent; ++d)
+            consistent = state[dims[d]] < 0 || state[dims[d]] == index[d];
+          const double w = table.rawData()[offset];
+          if (consistent && w > 0.0)
+          {
+            candidates.push_back(std::make_pair(offset, w));
+            total += w;
+          }
+        }
+      }
+      if (total == 0.0)
+        throw std::runtime_error("junction tree sampling failed");
+
+      const double r = seq[j] * unit * total;
+      double running = 0.0;
+      int64_t offset = candidates.back().first;
+      for (const std::pair<int64_t, double>& candidate: candidates)
+      {
+        running += candidate.second;
+        if (r < running)
+        {
+          offset = candidate.first;
+          break;
+        }
+      }
+      for (size_t d = dims.size(); d > 0; --d)
+      {
+        state[dims[d-1]] = offset % m_sizes[dims[d-1]];
+        offset /= m_sizes[dims[d-1]];
+      }
+    }
+    for (size_t c = 0; c < n; ++c)
+      remaining[c][local(state, m_cliques[c])] -= 1.0;
+    ++m_sample.at(state);
+  }
+  PROFILE_COUNT(m_profile, "samples", m_population);
+
+  // check the population's marginals
+  std::vector<NDArray<double>> reduced(m_indices.size());
+  for (size_t k = 0; k < m_indices.size(); ++k)
+  {
+    reduced[k].resize(m_marginals[k].sizes());
+    reduced[k].assign(0.0);
+  }
+  for (const auto& v: m_sample.values())
+  {
+    const std::vector<int64_t>& index = m_sample.index(v.first);
+    for (size_t k = 0; k < m_indices.size(); ++k)
+      reduced[k][local(index, m_indices[k])] += v.second;
+  }
+  for (size_t k = 0; k < m_indices.size(); ++k)
+    for (Index index(reduced[k].sizes()); !index.end(); ++index)
+      m_sampleConv = m_sampleConv && std::fabs(reduced[k][index] - m_marginals[k][index]) < 0.5;
+
+  return m_sample;
+}
+
+bool JunctionTreeIPF::conv() const
+{
+  return m_conv;
+}
+
+size_t JunctionTreeIPF::iters() const
+{
+  return m_iters;
+}
+
+double JunctionTreeIPF::maxError() const
+{
+  return m_maxError;
+}
+
+bool JunctionTreeIPF::sampleConv() const
+{
+  return m_sampleConv;
+}
@@ -0,0 +1,99 @@
+// JunctionTree.h
+// IPF (with a unity seed) for problems whose state space is too large to hold, e.g. 15-20 dimensions. The marginals'
+// dimension graph is triangulated and its cliques arranged in a junction tree, over which the max-entropy solution
+// factorises: the solution is held as a table per clique and per separator (the intersection of neighbouring cliques),
+//   p(x) = prod_cliques T_C(x_C) / prod_separators T_S(x_S)
+// and never as the full joint. Each IPF step scales the table of a clique containing the marginal and propagates the
+// change along the tree, which is exactly IPF on the joint. Where the marginals are themselves the cliques (a
+// decomposable model) the solution is in closed form and IPF converges in one sweep.
+//
+// A population is sampled clique by clique along the tree, each clique's dimensions conditional on those already
+// sampled (its separator with its parent).
+//
+// e.g.
+//   JunctionTreeIPF ipf(indices, marginals);
+//   ipf.solve();
+//   double p = ipf.value({0, 3, 1, ...});
+//   const SparseArray<int64_t>& population = ipf.sample();
+
+#pragma once
+
+#include "Microsynthesis.h"
+#include "SparseArray.h"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+class JunctionTreeIPF : public Microsynthesis<double>
+{
+public:
+  // Validated as for IPF, but the joint is not allocated
+  JunctionTreeIPF(const index_list_t& indices, marginal_list_t& marginals);
+
+  JunctionTreeIPF(const JunctionTreeIPF&) = delete;
+  JunctionTreeIPF& operator=(const JunctionTreeIPF&) = delete;
+
+  // Fits the clique tables, returns convergence
+  bool solve();
+
+  // true if the marginals are the cliques of their (chordal) dimension graph, i.e. no triangulation was required
+  bool decomposable() const;
+
+  // (overall) dimensions, ascending, and table of each clique
+  size_t cliques() const;
+  const std::vector<int64_t>& clique(size_t c) const;
+  const NDArray<double>& cliqueTable(size_t c) const;
+
+  // junction tree (or forest) edges, as pairs of cliques, and the corresponding separator dimensions and tables
+  const std::vector<std::pair<size_t, size_t>>& edges() const;
+  const std::vector<int64_t>& separator(size_t e) const;
+  const NDArray<double>& separatorTable(size_t e) const;
+
+  // value of the solution at a state
+  double value(const std::vector<int64_t>& index) const;
+
+  // dense solution, only practical for small state spaces
+  void toDense(NDArray<double>& dense) const;
+
+  // Samples an integer population (the marginals' total must be integral) from the solution. Each individual's clique
+  // states are drawn from the remaining occupancy of the clique tables, so that the population follows the marginals
+  const SparseArray<int64_t>& sample(int64_t skips = 0);
+
+  bool conv() const;
+  size_t iters() const;
+  double maxError() const;
+
+  // true if the sampled population's marginals are those of the problem
+  bool sampleConv() const;
+
+private:
+  void triangulate();
+  void buildTree();
+  // propagates a change in clique c to the rest of its tree
+  void distribute(size_t c);
+  bool computeErrors();
+
+  std::vector<std::vector<int64_t>> m_cliques;
+  std::vector<NDArray<double>> m_cliqueTables;
+  std::vector<std::pair<size_t, size_t>> m_edges;
+  std::vector<std::vector<int64_t>> m_separators;
+  std::vector<NDArray<double>> m_separatorTables;
+  // per clique, its edges (neighbour, edge)
+  std::vector<std::vector<std::pair<size_t, size_t>>> m_neighbours;
+  // number of trees in the junction forest
+  size_t m_trees;
+  // per marginal, the clique it's fitted in and the positions of its dimensions in that clique
+  std::vector<size_t> m_assigned;
+  std::vector<std::vector<int64_t>> m_positions;
+  bool m_decomposable;
+
+  bool m_conv;
+  size_t m_iters;
+  double m_maxError;
+  SparseArray<int64_t> m_sample;
+  bool m_sampleConv;
+
+  const double m_tol = 1e-8;
+  static const size_t s_MAXITER = 1000;
+};
@@ -0,0 +1,189 @@
+
+#include "MappedArray.h"
+#include "Global.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cassert>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char FileMagic[8] = { 'H', 'L', 'A', 'R', 'R', 'A', 'Y', '\0' };
+const uint32_t FileVersion = 1;
+
+#ifndef _WIN32
+// maps the file from the start, so the mapping is page aligned whatever the offset of the data
+void* mapFile(int fd, size_t offset, size_t bytes, int prot, int flags, const std::string& filename)
+{
+  const size_t length = offset + bytes;
+  void* base = ::mmap(nullptr, length, prot, flags, fd, 0);
+  if (base == MAP_FAILED)
+    throw std::runtime_error("unable to map " + filename + ": " + std::strerror(errno));
+  // the solvers traverse arrays sequentially: read ahead aggressively and release pages behind
+  ::madvise(base, length, MADV_SEQUENTIAL);
+  return base;
+}
+#endif
+
+}
+
+MappedAllocator::MappedAllocator(const std::string& directory, size_t threshold, Allocator& upstream)
+  : m_directory(directory), m_threshold(threshold), m_upstream(upstream)
+{
+  if (m_directory.empty())
+  {
+    const char* tmp = std::getenv("TMPDIR");
+    m_directory = tmp && *tmp ? tmp : "/tmp";
+  }
+}
+
+MappedAllocator::~MappedAllocator()
+{
+  assert(m_mappings.empty());
+}
+
+MappedAllocator& MappedAllocator::instance()
+{
+  return Global::instance<MappedAllocator>();
+}
+
+void* MappedAllocator::allocate(size_t bytes)
+{
+  if (bytes < m_threshold)
+    return m_upstream.allocate(bytes);
+#ifdef _WIN32
+  throw std::runtime_error("memory-mapped arrays are not supported on this platform");
+#else
+  std::string name = m_directory + "/humanleague.XXXXXX";
+  int fd = ::mkstemp(&name[0]);
+  if (fd < 0)
+    throw std::runtime_error("unable to create temporary file in " + m_directory + ": " + std::strerror(errno));
+  // the file is deleted when the mapping is removed (or the process exits)
+  ::unlink(name.c_str());
+  void* p = nullptr;
+  try
+  {
+    if (::ftruncate(fd, bytes) != 0)
+      throw std::runtime_error("unable to size temporary file in " + m_directory + ": " + std::strerror(errno));
+    p = mapFile(fd, 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, name);
+  }
+  catch(...)
+  {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_mappings[p] = std::make_pair(p, bytes);
+  return p;
+#endif
+}
+
+void MappedAllocator::deallocate(void* p)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_mappings.find(p);
+    if (it != m_mappings.end())
+    {
+#ifndef _WIN32
+      ::munmap(it->second.first, it->second.second);
+#endif
+      m_mappings.erase(it);
+      return;
+    }
+  }
+  m_upstream.deallocate(p);
+}
+
+void* MappedAllocator::map(const std::string& filename, size_t offset, size_t bytes)
+{
+#ifdef _WIN32
+  throw std::runtime_error("memory-mapped arrays are not supported on this platform");
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("unable to open " + filename + ": " + std::strerror(errno));
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || (size_t)st.st_size < offset + bytes)
+  {
+    ::close(fd);
+    throw std::runtime_error("file " + filename + " is truncated");
+  }
+  void* base;
+  try
+  {
+    base = mapFile(fd, offset, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, filename);
+  }
+  catch(...)
+  {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+  void* p = static_cast<char*>(base) + offset;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_mappings[p] = std::make_pair(base, offset + bytes);
+  return p;
+#endif
+}
+
+size_t MappedAllocator::mappings() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_mappings.size();
+}
+
+
+void arrayfile::writeHeader(std::ostream& os, const Header& header, const std::string& filename)
+{
+  const uint64_t dim = header.sizes.size();
+  if (24 + dim * sizeof(int64_t) > HeaderSize)
+    throw std::runtime_error("too many dimensions to save array to " + filename);
+  std::vector<char> buffer(HeaderSize, 0);
+  char* p = buffer.data();
+  std::memcpy(p, FileMagic, sizeof(FileMagic));
+  std::memcpy(p + 8, &FileVersion, sizeof(FileVersion));
+  p[12] = header.kind;
+  p[13] = static_cast<char>(header.elementSize);
+  std::memcpy(p + 16, &dim, sizeof(dim));
+  std::memcpy(p + 24, header.sizes.data(), dim * sizeof(int64_t));
+  os.write(buffer.data(), buffer.size());
+}
+
+arrayfile::Header arrayfile::readHeader(const std::string& filename)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("unable to open " + filename);
+  std::vector<char> buffer(HeaderSize);
+  file.read(buffer.data(), buffer.size());
+  if (!file || std::memcmp(buffer.data(), FileMagic, sizeof(FileMagic)))
+    throw std::runtime_error(filename + " is not an array file");
+  uint32_t version;
+  std::memcpy(&version, buffer.data() + 8, sizeof(version));
+  if (version != FileVersion)
+    throw std::runtime_error(filename + " has unsupported version " + std::to_string(version));
+  Header header;
+  header.kind = buffer[12];
+  header.elementSize = static_cast<unsigned char>(buffer[13]);
+  uint64_t dim;
+  std::memcpy(&dim, buffer.data() + 16, sizeof(dim));
+  if (dim == 0 || 24 + dim * sizeof(int64_t) > HeaderSize)
+    throw std::runtime_error(filename + " has invalid dimension " + std::to_string(dim));
+  header.sizes.resize(dim);
+  std::memcpy(header.sizes.data(), buffer.data() + 24, dim * sizeof(int64_t));
+  for (int64_t n: header.sizes)
+    if (n < 0)
+      throw std::runtime_error(filename + " has invalid size " + std::to_string(n));
+  return header;
+}
@@ -0,0 +1,138 @@
+// MappedArray.h
+// Out-of-core array storage, for problems whose (dense) arrays exceed physical memory.
+// MappedAllocator backs large arrays with memory-mapped temporary files, so the OS pages them to and from disk as
+// required rather than failing or swapping. The solvers' traversals of the population are sequential (see
+// Microsynthesis::rScaleDiff) so this runs at close to disk bandwidth. Arrays can also be saved to and loaded from
+// files in a format that can be mapped directly: a 4096-byte header (element type, dimensions) followed by the
+// elements in row-major order. Not available on Windows.
+//
+// e.g. a large IPF:
+//   MappedAllocator mapped("/scratch");
+//   Allocator::Scope scope(mapped);
+//   IPF<double> ipf(indices, marginals);
+//   saveArray(ipf.solve(loadArray<double>("seed.hla")), "result.hla");
+
+#pragma once
+
+#include "NDArray.h"
+#include "Index.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <type_traits>
+#include <cstdint>
+
+class MappedAllocator : public Allocator
+{
+public:
+  static const size_t DefaultThreshold = 64 << 20;
+
+  // Allocations of at least threshold bytes are mapped to (immediately unlinked) temporary files in directory (by
+  // default TMPDIR or /tmp), smaller ones come from upstream
+  explicit MappedAllocator(const std::string& directory = std::string(), size_t threshold = DefaultThreshold,
+                           Allocator& upstream = Allocator::hugePage());
+
+  ~MappedAllocator();
+
+  MappedAllocator(const MappedAllocator&) = delete;
+  MappedAllocator& operator=(const MappedAllocator&) = delete;
+
+  // shared instance with the default settings (which owns arrays returned by loadArray)
+  static MappedAllocator& instance();
+
+  void* allocate(size_t bytes) override;
+  void deallocate(void* p) override;
+
+  // Maps bytes at offset (which must be page aligned) of an existing file. The mapping is private: the contents can
+  // be modified but changes are not written to the file. The memory is freed by deallocate
+  void* map(const std::string& filename, size_t offset, size_t bytes);
+
+  // number of current file mappings
+  size_t mappings() const;
+
+private:
+  std::string m_directory;
+  size_t m_threshold;
+  Allocator& m_upstream;
+  mutable std::mutex m_mutex;
+  // data address -> (mapping address, mapping length)
+  std::map<void*, std::pair<void*, size_t>> m_mappings;
+};
+
+namespace arrayfile {
+
+static const size_t HeaderSize = 4096;
+
+// 'i' (signed integer), 'u' (unsigned integer) or 'f' (floating point)
+template<typename T>
+char kind()
+{
+  return std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+}
+
+struct Header
+{
+  char kind;
+  size_t elementSize;
+  std::vector<int64_t> sizes;
+};
+
+void writeHeader(std::ostream& os, const Header& header, const std::string& filename);
+
+// throws if the file is not an array file or is truncated
+Header readHeader(const std::string& filename);
+
+}
+
+// Writes the array (in row-major order, regardless of its storage order) with sequential writes
+template<typename T>
+void saveArray(const NDArray<T>& a, const std::string& filename)
+{
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file)
+    throw std::runtime_error("unable to create array file " + filename);
+  arrayfile::writeHeader(file, arrayfile::Header{arrayfile::kind<T>(), sizeof(T), a.sizes()}, filename);
+  if (a.storageOrder() == StorageOrder::RowMajor)
+  {
+    file.write(reinterpret_cast<const char*>(a.rawData()), a.storageSize() * sizeof(T));
+  }
+  else
+  {
+    std::vector<T> buffer;
+    buffer.reserve(1 << 16);
+    for (Index i(a.sizes()); !i.end(); ++i)
+    {
+      buffer.push_back(a[i]);
+      if (buffer.size() == buffer.capacity())
+      {
+        file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+        buffer.clear();
+      }
+    }
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(T));
+  }
+  file.close();
+  if (!file)
+    throw std::runtime_error("error writing array file " + filename);
+}
+
+// Maps an array file (see MappedAllocator::map). Pages are read as they are accessed, so this is fast and requires
+// little memory however large the file
+template<typename T>
+NDArray<T> loadArray(const std::string& filename)
+{
+  const arrayfile::Header& header = arrayfile::readHeader(filename);
+  if (header.kind != arrayfile::kind<T>() || header.elementSize != sizeof(T))
+    throw std::runtime_error("array file " + filename + " has elements of type " + header.kind
+                             + std::to_string(header.elementSize * 8) + ", expected " + arrayfile::kind<T>()
+                             + std::to_string(sizeof(T) * 8));
+  size_t size = 1;
+  for (int64_t n: header.sizes)
+    size *= n;
+  MappedAllocator& allocator = MappedAllocator::instance();
+  void* p = allocator.map(filename, arrayfile::HeaderSize, size * sizeof(T));
+  return NDArray<T>(header.sizes, static_cast<T*>(p), allocator);
+}
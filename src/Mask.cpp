@@ -0,0 +1,109 @@
+
+#include "Mask.h"
+#include "Index.h"
+
+#include <stdexcept>
+#include <string>
+
+Mask::Mask() : m_count(0)
+{
+}
+
+Mask::Mask(const NDArray<bool>& allowed) : m_sizes(allowed.sizes()), m_count(0)
+{
+  m_bits.assign((allowed.storageSize() + 63) / 64, 0);
+  int64_t o = 0;
+  for (Index index(m_sizes); !index.end(); ++index, ++o)
+  {
+    if (allowed[index])
+    {
+      m_bits[o >> 6] |= uint64_t(1) << (o & 63);
+      ++m_count;
+    }
+  }
+}
+
+bool Mask::empty() const
+{
+  return m_sizes.empty();
+}
+
+const std::vector<int64_t>& Mask::sizes() const
+{
+  return m_sizes;
+}
+
+const std::vector<uint64_t>& Mask::bits() const
+{
+  return m_bits;
+}
+
+int64_t Mask::count() const
+{
+  return m_count;
+}
+
+int64_t Mask::offset(const std::vector<int64_t>& state) const
+{
+  int64_t o = 0;
+  for (size_t d = 0; d < m_sizes.size(); ++d)
+    o = o * m_sizes[d] + state[d];
+  return o;
+}
+
+bool Mask::allowed(const std::vector<int64_t>& state) const
+{
+  const int64_t o = offset(state);
+  return (m_bits[o >> 6] >> (o & 63)) & 1;
+}
+
+void Mask::apply(NDArray<double>& a) const
+{
+  if (a.sizes() != m_sizes)
+    throw std::runtime_error("mask dimensions do not match those of the array");
+  for (Index index(m_sizes); !index.end(); ++index)
+    if (!allowed(index))
+      a[index] = 0.0;
+}
+
+void Mask::plan(const std::vector<int64_t>& order)
+{
+  const size_t D = m_sizes.size();
+  if (order.size() != D)
+    throw std::runtime_error("mask sampling order has " + std::to_string(order.size()) + " dimensions, expected " +
+      std::to_string(D));
+  m_order = order;
+  m_position.assign(D, -1);
+  for (size_t n = 0; n < D; ++n)
+    m_position[m_order[n]] = n;
+
+  m_counts.assign(D - 1, std::vector<uint32_t>());
+  int64_t size = 1;
+  for (size_t n = 0; n + 1 < D; ++n)
+  {
+    size *= m_sizes[m_order[n]];
+    m_counts[n].assign(size, 0);
+  }
+  for (Index index(m_sizes); !index.end(); ++index)
+  {
+    if (!allowed(index))
+      continue;
+    int64_t o = 0;
+    for (size_t n = 0; n + 1 < D; ++n)
+    {
+      o = o * m_sizes[m_order[n]] + index[m_order[n]];
+      ++m_counts[n][o];
+    }
+  }
+}
+
+bool Mask::allows(const std::vector<int64_t>& state, int64_t dim) const
+{
+  const int64_t p = m_position[dim];
+  if (p + 1 == (int64_t)m_sizes.size())
+    return allowed(state);
+  int64_t o = 0;
+  for (int64_t n = 0; n <= p; ++n)
+    o = o * m_sizes[m_order[n]] + state[m_order[n]];
+  return m_counts[p][o] > 0;
+}
@@ -0,0 +1,65 @@
+// Mask.h
+// Structural zeros: the states of a problem that are allowed (e.g. excluding age 0-15 x married), stored one bit per
+// state. For samplers that fix the dimensions of a state one at a time in a known order, the mask also holds the number
+// of allowed states in every slice along that order, so whether a value of the next dimension can still lead to an
+// allowed state is a single lookup, and masked states are never sampled (rather than sampled and rejected).
+//
+// e.g.
+//   NDArray<bool> allowed(sizes);
+//   allowed.assign(true);
+//   allowed[{0, 1}] = false;
+//   QIS qis(indices, marginals, 0, false, allowed);
+
+#pragma once
+
+#include "NDArray.h"
+
+#include <vector>
+#include <cstdint>
+
+class Mask
+{
+public:
+  // allows every state
+  Mask();
+
+  // true for the allowed states. Implicit, so that an array can be passed wherever a mask is expected
+  Mask(const NDArray<bool>& allowed);
+
+  // an empty mask allows every state (and has no sizes)
+  bool empty() const;
+
+  const std::vector<int64_t>& sizes() const;
+
+  // one bit per state, row-major
+  const std::vector<uint64_t>& bits() const;
+
+  // number of allowed states
+  int64_t count() const;
+
+  bool allowed(const std::vector<int64_t>& state) const;
+
+  // Zeroes the disallowed states of an array over the state space, e.g. a seed
+  void apply(NDArray<double>& a) const;
+
+  // Counts the allowed states in each slice in which the dimensions are fixed in the given order
+  void plan(const std::vector<int64_t>& order);
+
+  // For a state whose dimensions preceding dim in the planned order are fixed, true if some allowed state has those
+  // values and the state's value of dim
+  bool allows(const std::vector<int64_t>& state, int64_t dim) const;
+
+private:
+  int64_t offset(const std::vector<int64_t>& state) const;
+
+  std::vector<int64_t> m_sizes;
+  std::vector<uint64_t> m_bits;
+  int64_t m_count;
+
+  std::vector<int64_t> m_order;
+  // each dimension's position in the order
+  std::vector<int64_t> m_position;
+  // m_counts[n] is the number of allowed states per value of the first n+1 dimensions of the order (the last dimension
+  // needing only the bits)
+  std::vector<std::vector<uint32_t>> m_counts;
+};
@@ -6,6 +6,8 @@
 #include "NDArray.h"
 #include "NDArrayUtils.h"
 #include "Index.h"
+#include "StaticIndex.h"
+#include "Profile.h"
 
 #include <vector>
 #include <map>
@@ -25,9 +27,11 @@ public:
   typedef std::vector<std::pair<int64_t, int64_t>> marginal_indices_t;
   typedef std::vector<marginal_indices_t> marginal_indices_list_t;
 
-  Microsynthesis(const index_list_t& indices, marginal_list_t& marginals):
+  // dense = false skips allocation of the population array, for solvers that store the population sparsely
+  Microsynthesis(const index_list_t& indices, marginal_list_t& marginals, bool dense = true):
     m_indices(indices), m_marginals(marginals)
   {
+    PROFILE_SCOPE(m_profile, "validation");
     // i and m should be same size and >2
     if (m_indices.size() != m_marginals.size() || m_indices.size() < 2)
       throw std::runtime_error("index and marginal lists differ in size or too small");
@@ -81,7 +85,8 @@ public:
 
     createMappings(m_sizes, dim_sizes);
 
-    m_array.resize(m_sizes);
+    if (dense)
+      m_array.resize(m_sizes);
 
 #ifdef VERBOSE
     // print summary data
@@ -159,51 +164,165 @@ public:
     return m_population;
   }
 
+  // timings and counters (see Profile.h)
+  const Profile& profile() const
+  {
+    return m_profile;
+  }
+
   // Diffs always represented in floating point
   void rDiff(std::vector<NDArray<double>>& diffs)
   {
+    PROFILE_SCOPE(m_profile, "rDiff");
     int64_t n = m_indices.size();
     for (int64_t k = 0; k < n; ++k)
-      diff(reduce<double>(m_array, m_indices[k]), m_marginals[k], diffs[k]);
+      diff(reduceAs<double>(m_array, m_indices[k]), m_marginals[k], diffs[k]);
   }
 
 protected:
-  
+
+  // Scales the population to each marginal in turn
   void rScale()
   {
+    PROFILE_SCOPE(m_profile, "rScale");
+    std::vector<NDArray<double>> reduced(m_indices.size());
     for (size_t k = 0; k < m_indices.size(); ++k)
     {
-      const NDArray<double>& r = reduce<double>(m_array, m_indices[k]);
-      // std::cout << k << ":";
-      // print(r.rawData(), r.storageSize());
-  
-      Index main_index(m_array.sizes());
-      //std::cout << m_array.sizes()[m_indices[1-k][0]] << std::endl;
-      for (MappedIndex oindex(main_index, invert(m_array.dim(), m_indices[k])); !oindex.end(); ++oindex)
+      NDArray<double>::copy(reduceAs<double>(m_array, m_indices[k]), reduced[k]);
+      scalePass(k, reduced, k + 1, k + 1);
+    }
+  }
+
+  // Equivalent to rScale() followed by rDiff(), but with one pass over the population per marginal rather than three:
+  // each scaling pass accumulates the reduction needed by the next, and the last accumulates all of them, for the
+  // differences and for the first scaling of the next call. On entry reduced[0] must hold the reduction of the
+  // population onto the first marginal (e.g. from the previous call)
+  void rScaleDiff(std::vector<NDArray<double>>& reduced, std::vector<NDArray<double>>& diffs)
+  {
+    const size_t n = m_indices.size();
+    {
+      PROFILE_SCOPE(m_profile, "rScale");
+      for (size_t k = 0; k < n - 1; ++k)
+        scalePass(k, reduced, k + 1, k + 2);
+      scalePass(n - 1, reduced, 0, n);
+    }
+    PROFILE_SCOPE(m_profile, "rDiff");
+    for (size_t k = 0; k < n; ++k)
+      diff(reduced[k], m_marginals[k], diffs[k]);
+  }
+
+  // Scales the population by the ratio of marginal k to its reduction, in a single sequential pass (which is what
+  // matters when the population is memory-mapped), accumulating the reductions onto marginals [first, last) of the
+  // scaled population as it goes
+  void scalePass(size_t k, std::vector<NDArray<double>>& reduced, size_t first, size_t last)
+  {
+    NDArray<double> factors(m_marginals[k].sizes());
+    for (Index index(factors.sizes()); !index.end(); ++index)
+    {
+      const double r = reduced[k][index];
+#ifndef NDEBUG
+      if (r == 0.0 && m_marginals[k][index] != 0.0)
+        throw std::runtime_error("div0 in rScale with m>0");
+#endif
+      factors[index] = r != 0.0 ? m_marginals[k][index] / r : 0.0;
+    }
+
+    for (size_t j = first; j < last; ++j)
+    {
+      reduced[j].resize(m_marginals[j].sizes());
+      reduced[j].assign(0.0);
+    }
+
+    // the population is row-major, so the element pointer follows the index
+    assert(m_array.storageOrder() == StorageOrder::RowMajor);
+    if (dispatchRank<ScalePass>(m_dim, *this, k, factors, reduced, first, last))
+      return;
+
+    Index main_index(m_array.sizes());
+    MappedIndex index(main_index, m_indices[k]);
+    std::vector<MappedIndex> rindices;
+    for (size_t j = first; j < last; ++j)
+      rindices.push_back(MappedIndex(main_index, m_indices[j]));
+    T* p = m_array.begin();
+    for (; !main_index.end(); ++main_index, ++p)
+    {
+      // zero reduction means zero population
+      if (factors[index] != 0.0)
+        *p *= factors[index];
+      else
+        *p = 0.0;
+      for (size_t j = first; j < last; ++j)
+        reduced[j][rindices[j - first]] += *p;
+    }
+  }
+
+  // fixed-rank implementation of the loop in scalePass
+  template<size_t D>
+  struct ScalePass
+  {
+    static void run(Microsynthesis& ms, size_t k, const NDArray<double>& factors, std::vector<NDArray<double>>& reduced,
+                    size_t first, size_t last)
+    {
+      StaticIndex<D> main_index(ms.m_array.sizes());
+      StaticOffset<D> index(main_index, ms.m_indices[k], factors.strides());
+      std::vector<StaticOffset<D>> rindices;
+      std::vector<double*> r;
+      for (size_t j = first; j < last; ++j)
       {
-        for (MappedIndex index(main_index, m_indices[k]); !index.end(); ++index)
+        rindices.push_back(StaticOffset<D>(main_index, ms.m_indices[j], reduced[j].strides()));
+        r.push_back(reduced[j].begin());
+      }
+      const size_t n = last - first;
+      const double* f = factors.rawData();
+      T* p = ms.m_array.begin();
+
+      // where the innermost dimension is contiguous (or constant) in the factors and reductions, process it as a run
+      bool runs = index.innerStride() <= 1;
+      for (size_t j = 0; j < n; ++j)
+        runs = runs && rindices[j].innerStride() <= 1;
+      if (runs)
+      {
+        const size_t len = ms.m_sizes[D-1];
+        for (; !main_index.end(); p += len)
         {
-          //print((std::vector<int64_t>)main_index);
-#ifndef NDEBUG
-          if (r[index] == 0.0 && m_marginals[k][index] != 0.0)
-            throw std::runtime_error("div0 in rScale with m>0");
-          if (r[index] != 0.0)
-            m_array[main_index] *= m_marginals[k][index] / r[index];
+          if (index.innerStride())
+            simd::multiply(p, f + *index, len);
+          else if (f[*index] != 0.0)
+            simd::scale(p, f[*index], len);
           else
-            m_array[main_index] = 0.0;
-#else
-          if (r[index] != 0.0)
-            m_array[main_index] *= m_marginals[k][index] / r[index];
-          else
-            m_array[main_index] = 0.0;
-#endif  
+            std::fill(p, p + len, 0.0);
+          for (size_t j = 0; j < n; ++j)
+          {
+            if (rindices[j].innerStride())
+              simd::add(r[j] + *rindices[j], p, len);
+            else
+              r[j][*rindices[j]] += simd::sum(p, len);
+          }
+          main_index.nextRun();
+          index.advanceRun(main_index);
+          for (size_t j = 0; j < n; ++j)
+            rindices[j].advanceRun(main_index);
         }
+        return;
+      }
+
+      for (; !main_index.end(); ++p)
+      {
+        const double x = f[*index];
+        if (x != 0.0)
+          *p *= x;
+        else
+          *p = 0.0;
+        for (size_t j = 0; j < n; ++j)
+          r[j][*rindices[j]] += *p;
+        ++main_index;
+        index.advance(main_index);
+        for (size_t j = 0; j < n; ++j)
+          rindices[j].advance(main_index);
       }
-      // reset the main index
-      //main_index.reset();
     }
-  }
-  
+  };
+
   void createMappings(const std::vector<int64_t> sizes, const std::map<int64_t, int64_t>& dim_sizes)
   {
     // create mapping from dimension to marginal(s)
@@ -249,4 +368,6 @@ protected:
   // lists marginals and dims of marginals per overall dimension
   marginal_indices_list_t m_dim_lookup;
   NDArray<T> m_array;
+  // mutable so that values computed on demand by const accessors can be profiled
+  mutable Profile m_profile;
 };
@@ -1,17 +1,28 @@
 
 #pragma once
 
+#include "Profile.h"
+#include "Allocator.h"
+
 #include <algorithm>
 #include <stdexcept>
+#include <type_traits>
 
 #include <vector>
 #include <cstddef>
 #include <cassert>
 
-// The array storage
+// Element layout in memory. Row-major (C/numpy style, the default) has the last index varying fastest, column-major
+// (R/Fortran style) the first. Arrays can be indexed identically regardless of storage order
+enum class StorageOrder { RowMajor, ColumnMajor };
+
+// The array storage. Owned storage comes from the allocator that was current (see Allocator.h) when the array was
+// constructed
 template<typename T>
 class NDArray
 {
+  static_assert(std::is_trivial<T>::value, "NDArray elements must be trivial types");
+
 public:
 
   // Max size in any one dimension of ~1e9
@@ -23,18 +34,21 @@ public:
 
   typedef T& reference;
 
-  NDArray() : m_dim(0), m_sizes(), m_storageSize(0), m_data(0), m_owned(true)
+  NDArray() : m_dim(0), m_sizes(), m_storageSize(0), m_data(0), m_owned(true), m_order(StorageOrder::RowMajor),
+    m_allocator(&Allocator::current())
   {
   }
 
-  explicit NDArray(const std::vector<int64_t>& sizes) : m_dim(sizes.size()), m_sizes(sizes), m_storageSize(0), m_data(0), m_owned(true)
+  explicit NDArray(const std::vector<int64_t>& sizes, StorageOrder order = StorageOrder::RowMajor)
+    : m_dim(sizes.size()), m_sizes(sizes), m_storageSize(0), m_data(0), m_owned(true), m_order(order),
+    m_allocator(&Allocator::current())
   {
     resize(sizes);
   }
 
   // Construct with storage managed by some other object
-  NDArray(const std::vector<int64_t>& sizes, T* const storage)
-    : m_dim(sizes.size()), m_sizes(sizes)
+  NDArray(const std::vector<int64_t>& sizes, T* const storage, StorageOrder order = StorageOrder::RowMajor)
+    : m_dim(sizes.size()), m_sizes(sizes), m_order(order), m_allocator(&Allocator::current())
   {
     assert(m_sizes.size());
     m_storageSize = sizes[0];
@@ -50,14 +64,24 @@ public:
     m_owned = false;
   }
 
+  // Construct taking ownership of storage, which must have been allocated by allocator
+  NDArray(const std::vector<int64_t>& sizes, T* const storage, Allocator& allocator, StorageOrder order = StorageOrder::RowMajor)
+    : NDArray(sizes, storage, order)
+  {
+    m_owned = true;
+    m_allocator = &allocator;
+  }
+
   // Disallow copy
   NDArray(const NDArray&) = delete;
   NDArray& operator=(const NDArray&) = delete;
 
   // Copying is strongly discouraged for efficiency reasons, however there will always be times when a copy is unavoidable...
   // By explictly providing a copy function we avoid sloppy/inefficient coding where implicit copies are (inadvertently) taken
+  // The copy retains the storage order of the source
   static void copy(const NDArray<T>& src, NDArray<T>& dest) 
   {
+    dest.m_order = src.m_order;
     dest.resize(src.m_sizes);
     std::copy(src.m_data, src.m_data + src.m_storageSize, dest.m_data);
   }
@@ -71,6 +95,8 @@ public:
     m_storageSize = a.m_storageSize;
     m_data = a.m_data;
     m_owned = a.m_owned;
+    m_order = a.m_order;
+    m_allocator = a.m_allocator;
     a.m_owned = false;
   }
 
@@ -101,6 +127,17 @@ public:
     return m_storageSize;
   }
 
+  StorageOrder storageOrder() const
+  {
+    return m_order;
+  }
+
+  // distance in memory between adjacent elements in each dimension
+  const std::vector<int64_t>& strides() const
+  {
+    return m_offsets;
+  }
+
   const T* rawData() const
   {
     return m_data;
@@ -191,7 +228,13 @@ public:
     return m_data + m_storageSize;
   }
 
-  // relinqish ownership (caller must delete)
+  // the allocator that owns (or would own) the storage
+  Allocator& allocator() const
+  {
+    return *m_allocator;
+  }
+
+  // relinqish ownership (caller must free the storage via allocator())
   void release()
   {
     m_owned = false;
@@ -202,11 +245,22 @@ private:
   void computeOffsets()
   {
     m_offsets.resize(m_dim);
-    size_t mult = m_storageSize;
-    for (size_t i = 0; i < m_dim; ++i)
+    int64_t mult = 1;
+    if (m_order == StorageOrder::RowMajor)
     {
-      mult /= m_sizes[i];
-      m_offsets[i] = mult;
+      for (size_t i = m_dim; i > 0; --i)
+      {
+        m_offsets[i-1] = mult;
+        mult *= m_sizes[i-1];
+      }
+    }
+    else
+    {
+      for (size_t i = 0; i < m_dim; ++i)
+      {
+        m_offsets[i] = mult;
+        mult *= m_sizes[i];
+      }
     }
   }
 
@@ -234,12 +288,14 @@ private:
 
   T* allocate(size_t size) const
   {
-    return new T[size];
+    PROFILE_ALLOCATION();
+    return static_cast<T*>(m_allocator->allocate(size * sizeof(T)));
   }
 
   void deallocate(T* p) const
   {
-    delete [] p;
+    if (p)
+      m_allocator->deallocate(p);
   }
 
 private:
@@ -250,5 +306,7 @@ private:
   size_t m_storageSize;
   T* m_data;
   bool m_owned;
+  StorageOrder m_order;
+  Allocator* m_allocator;
 };
 
@@ -1,11 +1,17 @@
 #pragma once
 
 #include "NDArray.h"
+#include "SparseArray.h"
 #include "Index.h"
+#include "StaticIndex.h"
+#include "Simd.h"
 
 #include <vector>
 #include <numeric>
+#include <limits>
 #include <cassert>
+#include <cstring>
+#include <new>
 #include <iostream>
 
 
@@ -17,6 +23,11 @@ template<typename T, typename U>
 void diff(const NDArray<T>& x, const NDArray<U>& y, NDArray<double>& d)
 {
   // TODO check x y and d sizes match
+  if (x.storageOrder() == y.storageOrder() && x.storageOrder() == d.storageOrder())
+  {
+    simd::subtract(d.begin(), x.rawData(), y.rawData(), x.storageSize());
+    return;
+  }
   for (Index index(x.sizes()); !index.end(); ++index)
   {
     d[index] = x[index] - y[index];
@@ -40,29 +51,54 @@ T product(const std::vector<T>& v)
 template<typename T>
 T sum(const NDArray<T>& a)
 {
-  return std::accumulate(a.rawData(), a.rawData() + a.storageSize(), T(0));
+  return simd::sum(a.rawData(), a.storageSize());
 }
 
 template<typename T>
 T min(const NDArray<T>& a)
 {
-  T minVal = std::numeric_limits<T>::max();
-  for (Index i(a.sizes()); !i.end(); ++i)
-  {
-    minVal = std::min(minVal, a[i]);
-  }
-  return minVal;
+  if (!a.storageSize())
+    return std::numeric_limits<T>::max();
+  return *std::min_element(a.rawData(), a.rawData() + a.storageSize());
 }
 
 template<typename T>
 T max(const NDArray<T>& a)
 {
-  T minVal = std::numeric_limits<T>::max();
-  for (Index i(a.sizes()); !i.end(); ++i)
+  if (!a.storageSize())
+    return std::numeric_limits<T>::lowest();
+  return *std::max_element(a.rawData(), a.rawData() + a.storageSize());
+}
+
+// Bytes per element of the narrowest of uint16_t, int32_t and int64_t that can hold counts summing to total, e.g. the
+// occupancy of a population
+inline size_t countBytes(int64_t total)
+{
+  return total <= std::numeric_limits<uint16_t>::max() ? 2 : total <= std::numeric_limits<int32_t>::max() ? 4 : 8;
+}
+
+// A (zeroed) view of counts of type C (see countBytes), packed at the start of the storage of a, so the counts need no
+// storage of their own. The counts are created in the storage (by placement new), so they are objects of type C in their
+// own right and not int64_t elements accessed through the wrong type. a must not be accessed until widenCounts
+template<typename C>
+NDArray<C> compactCounts(NDArray<int64_t>& a)
+{
+  C* counts = ::new (static_cast<void*>(a.begin())) C[a.storageSize()]();
+  return NDArray<C>(a.sizes(), counts, a.storageOrder());
+}
+
+// Widens the counts created by compactCounts in place into the elements of a. Working back from the last, each count is
+// copied out (as bytes, which may alias anything) before the element that overlaps it is recreated
+template<typename C>
+void widenCounts(NDArray<int64_t>& a)
+{
+  unsigned char* storage = reinterpret_cast<unsigned char*>(a.begin());
+  for (size_t i = a.storageSize(); i > 0; --i)
   {
-    minVal = std::min(minVal, a[i]);
+    C c;
+    std::memcpy(&c, storage + (i - 1) * sizeof(C), sizeof(C));
+    ::new (static_cast<void*>(storage + (i - 1) * sizeof(int64_t))) int64_t(c);
   }
-  return minVal;
 }
 
 // TODO move printing somehwere else
@@ -112,6 +148,65 @@ T marginalProduct(const std::vector<std::vector<T>>& m, const std::vector<int64_
   return p;
 }
 
+namespace detail {
+
+// fixed-rank implementations of reduce and slice (see StaticIndex.h)
+
+template<size_t D>
+struct Reduce
+{
+  // sums input into output (zeroed by the caller), whose dimension j is dimension dims[j] of input
+  template<typename T, typename R>
+  static void run(const NDArray<T>& input, const std::vector<int64_t>& dims, const std::vector<int64_t>& strides, R* output)
+  {
+    StaticIndex<D> index(input.sizes());
+    StaticOffset<D> in(index, input.strides());
+    StaticOffset<D> out(index, dims, strides);
+    const T* p = input.rawData();
+    // contiguous runs of the input are either summed into one output element or added to a contiguous output run
+    if (in.innerStride() == 1 && out.innerStride() <= 1)
+    {
+      const size_t n = input.sizes()[D-1];
+      const bool preserved = out.innerStride() == 1;
+      for (; !index.end(); index.nextRun(), in.advanceRun(index), out.advanceRun(index))
+      {
+        if (preserved)
+          simd::add(output + *out, p + *in, n);
+        else
+          output[*out] += simd::sum(p + *in, n);
+      }
+      return;
+    }
+    for (; !index.end(); ++index, in.advance(index), out.advance(index))
+      output[*out] += p[*in];
+  }
+};
+
+template<size_t D>
+struct Slice
+{
+  // copies the D free dimensions of outer, starting at base, into sliced (in row-major order)
+  template<typename T>
+  static void run(const NDArray<T>& outer, const std::vector<int64_t>& strides, int64_t base, NDArray<T>& sliced)
+  {
+    StaticIndex<D> index(sliced.sizes());
+    StaticOffset<D> in(index, strides, base);
+    const T* p = outer.rawData();
+    T* q = sliced.begin();
+    if (in.innerStride() == 1)
+    {
+      const size_t n = sliced.sizes()[D-1];
+      for (; !index.end(); index.nextRun(), in.advanceRun(index), q += n)
+        std::copy(p + *in, p + *in + n, q);
+      return;
+    }
+    for (; !index.end(); ++index, in.advance(index), ++q)
+      *q = p[*in];
+  }
+};
+
+}
+
 // Reduce n-D array to 1-D sums
 template<typename T>
 std::vector<T> reduce(const NDArray<T>& input, size_t orient)
@@ -125,6 +220,10 @@ std::vector<T> reduce(const NDArray<T>& input, size_t orient)
 
   std::vector<T> sums(input.size(orient), 0);
 
+  if (dispatchRank<detail::Reduce>(input.dim(), input, std::vector<int64_t>{(int64_t)orient}, std::vector<int64_t>{1},
+                                   sums.data()))
+    return sums;
+
   // Index indexer(input.sizes(), std::make_pair(orient, 0));
   // for (; !indexer.end(); ++indexer)
   // {
@@ -147,9 +246,9 @@ std::vector<T> reduce(const NDArray<T>& input, size_t orient)
 }
 
 
-// Reduce n-D array to m-D sums (where m<n)
-template<typename T>
-NDArray<T> reduce(const NDArray<T>& input, const std::vector<int64_t>& preservedDims)
+// Reduce n-D array to m-D sums (where m<n), accumulated in R, e.g. double for a single precision array
+template<typename R, typename T>
+NDArray<R> reduceAs(const NDArray<T>& input, const std::vector<int64_t>& preservedDims)
 {
   const size_t reducedDim = preservedDims.size();
   // check valid orientation
@@ -161,8 +260,11 @@ NDArray<T> reduce(const NDArray<T>& input, const std::vector<int64_t>& preserved
     preservedSizes[d] = input.sizes()[preservedDims[d]];
   }
 
-  NDArray<T> reduced(preservedSizes);
-  reduced.assign(T(0));
+  NDArray<R> reduced(preservedSizes);
+  reduced.assign(R(0));
+
+  if (dispatchRank<detail::Reduce>(input.dim(), input, preservedDims, reduced.strides(), reduced.begin()))
+    return reduced;
 
   Index index(input.sizes());
   MappedIndex rIndex(index, preservedDims);
@@ -174,6 +276,13 @@ NDArray<T> reduce(const NDArray<T>& input, const std::vector<int64_t>& preserved
   return reduced;
 }
 
+// Reduce n-D array to m-D sums (where m<n)
+template<typename T>
+NDArray<T> reduce(const NDArray<T>& input, const std::vector<int64_t>& preservedDims)
+{
+  return reduceAs<T>(input, preservedDims);
+}
+
 
 // take a D-1 dimensional slice at element index in orientation O
 template<typename T>
@@ -195,22 +304,109 @@ NDArray<T> slice(const NDArray<T>& outer, const std::vector<std::pair<int64_t, i
   // if dims empty have to make a complete copy of marginal and return it, which is massively inefficient
   if (fixedDims.empty())
   {
-    NDArray<T> copy(outer.sizes());
+    NDArray<T> copy(outer.sizes(), outer.storageOrder());
     std::copy(outer.rawData(), outer.rawData() + outer.storageSize(), const_cast<T*>(copy.rawData()));
     return copy;
   }
 
-  FixedIndex fixedIndex(outer.sizes(), fixedDims);
+  std::vector<bool> fixed(outer.dim(), false);
+  int64_t base = 0;
+  for (const auto& f: fixedDims)
+  {
+    fixed[f.first] = true;
+    base += f.second * outer.strides()[f.first];
+  }
+  std::vector<int64_t> freeSizes;
+  std::vector<int64_t> freeStrides;
+  for (size_t d = 0; d < outer.dim(); ++d)
+  {
+    if (!fixed[d])
+    {
+      freeSizes.push_back(outer.sizes()[d]);
+      freeStrides.push_back(outer.strides()[d]);
+    }
+  }
 
-  // fixedIndex.sizes() returns the sizes of the free dimensions
-  NDArray<T> sliced(fixedIndex.sizes());
-  for(; !fixedIndex.end(); ++fixedIndex)
+  NDArray<T> sliced(freeSizes);
+  if (dispatchRank<detail::Slice>(freeSizes.size(), outer, freeStrides, base, sliced))
+    return sliced;
+
+  for (FixedIndex fixedIndex(outer.sizes(), fixedDims); !fixedIndex.end(); ++fixedIndex)
   {
     sliced[fixedIndex.free()] = outer[fixedIndex.operator const Index &()];
   }
   return sliced;
 }
 
+// Copies src into dest (which must have the same sizes), converting between storage orders if necessary.
+// Where the orders differ the first and last dimensions (which are contiguous in one or other of the arrays) are
+// traversed in square tiles so that both reads and writes stay cache-local
+template<typename T, typename U>
+void transposeStorage(const NDArray<T>& src, NDArray<U>& dest)
+{
+  if (src.sizes() != dest.sizes())
+    throw std::runtime_error("array size mismatch in transposeStorage");
+
+  const T* s = src.rawData();
+  U* d = const_cast<U*>(dest.rawData());
+
+  const size_t dim = src.dim();
+  if (src.storageOrder() == dest.storageOrder() || dim < 2)
+  {
+    std::copy(s, s + src.storageSize(), d);
+    return;
+  }
+
+  static const int64_t Tile = 32;
+  const std::vector<int64_t>& sizes = src.sizes();
+  const std::vector<int64_t>& ss = src.strides();
+  const std::vector<int64_t>& ds = dest.strides();
+  const int64_t n0 = sizes[0];
+  const int64_t nl = sizes[dim-1];
+
+  // loop over all combinations of the intermediate dimensions (a single pass for 2D)
+  std::vector<int64_t> mid(dim, 0);
+  for (;;)
+  {
+    int64_t sbase = 0, dbase = 0;
+    for (size_t k = 1; k < dim - 1; ++k)
+    {
+      sbase += mid[k] * ss[k];
+      dbase += mid[k] * ds[k];
+    }
+
+    for (int64_t i0 = 0; i0 < n0; i0 += Tile)
+    {
+      const int64_t e0 = std::min(i0 + Tile, n0);
+      for (int64_t il = 0; il < nl; il += Tile)
+      {
+        const int64_t el = std::min(il + Tile, nl);
+        for (int64_t i = i0; i < e0; ++i)
+        {
+          for (int64_t j = il; j < el; ++j)
+          {
+            d[dbase + i * ds[0] + j * ds[dim-1]] = s[sbase + i * ss[0] + j * ss[dim-1]];
+          }
+        }
+      }
+    }
+
+    // increment intermediate index, last varying fastest
+    bool done = true;
+    for (size_t k = dim - 2; k > 0; --k)
+    {
+      if (++mid[k] < sizes[k])
+      {
+        done = false;
+        break;
+      }
+      mid[k] = 0;
+    }
+    if (done)
+      break;
+  }
+}
+
 // Converts a D-dimensional population array into a list with D columns and pop rows
 template<typename T>
 std::vector<std::vector<int>> listify(const size_t pop, const NDArray<T>& t, int offset = 0)
@@ -237,3 +433,26 @@ std::vector<std::vector<int>> listify(const size_t pop, const NDArray<T>& t, int
   return list;
 }
 
+// As above, for a sparse population. Rows are in the same order as for the equivalent dense array
+template<typename T>
+std::vector<std::vector<int>> listify(const size_t pop, const SparseArray<T>& t, int offset = 0)
+{
+  std::vector<std::vector<int>> list(t.dim(), std::vector<int>(pop));
+
+  size_t pindex = 0;
+  for (int64_t off: t.offsets())
+  {
+    const std::vector<int64_t>& ref = t.index(off);
+    const T n = t.values().find(off)->second;
+    for (T i = 0; i < n; ++i)
+    {
+      for (size_t j = 0; j < t.dim(); ++j)
+      {
+        list[j][pindex] = offset + ref[j];
+      }
+      ++pindex;
+    }
+  }
+  return list;
+}
+
@@ -0,0 +1,129 @@
+// Profile.h
+// Instrumentation of the solvers' hot paths: wall time, call count and NDArray allocations per phase, plus event
+// counters (iterations, samples, IPF recomputes...). Phases are timed around whole loops or calls rather than per
+// sample, so the overhead is negligible. Nested phases are included in the time of their parent.
+// Phases are also emitted as trace events when tracing is enabled (see Trace.h).
+// Define HUMANLEAGUE_NO_PROFILE to compile the instrumentation out, in which case profiles are always empty.
+
+#pragma once
+
+#include "Trace.h"
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+class Profile
+{
+public:
+
+  struct Phase
+  {
+    double time;
+    int64_t calls;
+    int64_t allocations;
+  };
+
+  typedef std::map<std::string, Phase> phase_map_t;
+  typedef std::map<std::string, int64_t> counter_map_t;
+
+  static bool enabled()
+  {
+#ifdef HUMANLEAGUE_NO_PROFILE
+    return false;
+#else
+    return true;
+#endif
+  }
+
+  // number of NDArray allocations made by the calling thread
+  static int64_t& allocations()
+  {
+    static thread_local int64_t n = 0;
+    return n;
+  }
+
+  void record(const std::string& phase, double time, int64_t allocations)
+  {
+    Phase& p = m_phases[phase];
+    p.time += time;
+    ++p.calls;
+    p.allocations += allocations;
+  }
+
+  void count(const std::string& counter, int64_t n)
+  {
+    m_counters[counter] += n;
+  }
+
+  // accumulate another (e.g. a nested solver's) profile into this one
+  void merge(const Profile& other)
+  {
+    for (const auto& p: other.m_phases)
+    {
+      Phase& q = m_phases[p.first];
+      q.time += p.second.time;
+      q.calls += p.second.calls;
+      q.allocations += p.second.allocations;
+    }
+    for (const auto& c: other.m_counters)
+      m_counters[c.first] += c.second;
+  }
+
+  void clear()
+  {
+    m_phases.clear();
+    m_counters.clear();
+  }
+
+  const phase_map_t& phases() const { return m_phases; }
+
+  const counter_map_t& counters() const { return m_counters; }
+
+  // Times the enclosing block
+  class Scope
+  {
+  public:
+    Scope(Profile& profile, const char* phase)
+      : m_profile(profile), m_phase(phase), m_allocations(allocations()), m_start(clock_t::now()) { }
+
+    ~Scope()
+    {
+      const clock_t::time_point end = clock_t::now();
+      m_profile.record(m_phase, std::chrono::duration<double>(end - m_start).count(), allocations() - m_allocations);
+      Trace& trace = Trace::instance();
+      if (trace.enabled())
+        trace.complete(m_phase, m_start, end);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    typedef Trace::clock_t clock_t;
+
+    Profile& m_profile;
+    const char* m_phase;
+    int64_t m_allocations;
+    clock_t::time_point m_start;
+  };
+
+private:
+  phase_map_t m_phases;
+  counter_map_t m_counters;
+};
+
+#ifndef HUMANLEAGUE_NO_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+// Times the rest of the enclosing block as the named phase
+#define PROFILE_SCOPE(profile, phase) Profile::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(profile, phase)
+#define PROFILE_COUNT(profile, counter, n) (profile).count(counter, n)
+#define PROFILE_ALLOCATION() ++Profile::allocations()
+#else
+#define PROFILE_SCOPE(profile, phase)
+// the count is never evaluated (so must have no side effects), only referenced so that a variable holding it is used
+#define PROFILE_COUNT(profile, counter, n) (void)sizeof(n)
+#define PROFILE_ALLOCATION()
+#endif
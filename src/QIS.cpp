@@ -1,10 +1,18 @@
 
 #include "QIS.h"
 #include "Index.h"
+#include "StaticIndex.h"
 #include "StatFuncs.h"
+#include "Adjust.h"
+#include "IPF.h"
 
-// uncomment to sample from a (dynamic) state array rather than directly from marginals (can be slower for high dimensionality)
-//#define USE_STATE_SAMPLING
+#include <list>
+#include <set>
+#include <limits>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <numeric>
 
 namespace {
 
@@ -49,8 +57,31 @@ void recursive_pick(const NDArray<double>& p, const std::vector<uint32_t>& seq,
 #endif
 //#ifdef USE_STATE_SAMPLING
 
+// The weights of a dimension's values, excluding those that lead to no allowed state (see Mask.h). If that leaves
+// nothing with any weight, the allowed values are weighted equally (and the marginals will not be met)
+template<typename T>
+std::vector<int64_t> masked(const T* weights, size_t n, const Mask& mask, const std::vector<int64_t>& state,
+                            MappedIndex& index, int64_t d, int64_t dim)
+{
+  std::vector<int64_t> w(n);
+  std::vector<bool> allowed(n);
+  bool any = false;
+  for (size_t i = 0; i < n; ++i)
+  {
+    index[d] = i;
+    allowed[i] = mask.allows(state, dim);
+    w[i] = allowed[i] ? weights[i] : 0;
+    any = any || w[i] > 0;
+  }
+  if (!any)
+    for (size_t i = 0; i < n; ++i)
+      w[i] = allowed[i];
+  return w;
+}
+
 void recursive_sample(std::vector<std::pair<int64_t, uint32_t>>& dims, const NDArray<int64_t>& marginal,
-                      MappedIndex& index, std::map<int64_t, int64_t> slice_map)
+                      MappedIndex& index, std::map<int64_t, int64_t> slice_map, const std::vector<int64_t>& global,
+                      const Mask* mask, const std::vector<int64_t>& state)
 {
   static const double scale = 0.5 / (1u<<31);
 
@@ -58,37 +89,59 @@ void recursive_sample(std::vector<std::pair<int64_t, uint32_t>>& dims, const NDA
   std::cout << "recursive_sample: " << dims.size() << " of " << marginal.dim() << std::endl;
 #endif
 
+  const int64_t d = dims.back().first;
   // end recursion at 1 (cannot have a zero-D marginal)
   if (dims.size() == 1)
   {
-    index[dims.back().first] = pick(marginal.rawData(), marginal.storageSize(), dims.back().second * scale);
+    if (mask)
+    {
+      const std::vector<int64_t>& w = masked(marginal.rawData(), marginal.storageSize(), *mask, state, index, d, global[d]);
+      index[d] = pick(w.data(), w.size(), dims.back().second * scale);
+    }
+    else
+      index[d] = pick(marginal.rawData(), marginal.storageSize(), dims.back().second * scale);
 #ifdef VERBOSE
     std::cout << "marginal (1d):";
     print(marginal.rawData(), marginal.storageSize());
-    std::cout << "recursive_sample picked: D" << dims.back().first << ":" << index[dims.back().first] << std::endl;
+    std::cout << "recursive_sample picked: D" << d << ":" << index[d] << std::endl;
 #endif
     dims.pop_back();
     return;
   }
   else
   {
-    const std::vector<int64_t>& r = reduce<int64_t>(marginal, slice_map[dims.back().first]);
-    index[dims.back().first] = pick(r.data(), r.size(), dims.back().second * scale);
-    const NDArray<int64_t>& sliced = slice(marginal, { slice_map[dims.back().first], index[dims.back().first] });
+    const std::vector<int64_t>& r = reduce<int64_t>(marginal, slice_map[d]);
+    if (mask)
+    {
+      const std::vector<int64_t>& w = masked(r.data(), r.size(), *mask, state, index, d, global[d]);
+      index[d] = pick(w.data(), w.size(), dims.back().second * scale);
+    }
+    else
+      index[d] = pick(r.data(), r.size(), dims.back().second * scale);
+    const int64_t position = slice_map[d];
+    const NDArray<int64_t>& sliced = slice(marginal, { position, index[d] });
 #ifdef VERBOSE
     std::cout << "marginal (>1d):";
     print(marginal.rawData(), marginal.storageSize());
-    std::cout << "recursive_sample picked: D" << dims.back().first << "[" << slice_map[dims.back().first]<< "]" << ":" << index[dims.back().first] << std::endl;
+    std::cout << "recursive_sample picked: D" << d << "[" << slice_map[d]<< "]" << ":" << index[d] << std::endl;
     std::cout << "sliced marginal:";
     print(sliced.rawData(), sliced.storageSize());
 #endif
     dims.pop_back();
-    recursive_sample(dims, sliced, index, slice_map);
+    // the dimensions after the one sliced out move down
+    for (std::pair<const int64_t, int64_t>& m: slice_map)
+      if (m.second > position)
+        --m.second;
+    recursive_sample(dims, sliced, index, slice_map, global, mask, state);
   }
 }
 
 
-void sample(std::vector<int64_t>& dims, const std::vector<uint32_t>& seq, const NDArray<int64_t>& marginal, MappedIndex& index)
+// order is that in which the marginal's unsampled dimensions are sampled (see QIS::plan). mask, if not null, excludes
+// the values of each dimension that lead to no allowed state, given those of the dimensions already sampled (the full
+// state)
+void sample(std::vector<int64_t>& dims, const std::vector<uint32_t>& seq, const NDArray<int64_t>& marginal, MappedIndex& index,
+            const std::vector<int64_t>& order, const Mask* mask, const std::vector<int64_t>& state)
 {
 #ifdef VERBOSE
   std::cout << "dims:";
@@ -110,11 +163,14 @@ void sample(std::vector<int64_t>& dims, const std::vector<uint32_t>& seq, const
     }
     else
     {
-      dims_to_sample.push_back(std::make_pair(d, seq[dims[d]]));
       slice_map[d] = slice_index;
       ++slice_index;
     }
   }
+  // the last is sampled first
+  for (std::vector<int64_t>::const_reverse_iterator d = order.rbegin(); d != order.rend(); ++d)
+    if (index[*d] < 0)
+      dims_to_sample.push_back(std::make_pair(*d, seq[dims[*d]]));
 #ifdef VERBOSE
   std::cout << "slice:";
   for (size_t i = 0; i < dims_to_slice.size(); ++i)
@@ -151,40 +207,372 @@ void sample(std::vector<int64_t>& dims, const std::vector<uint32_t>& seq, const
 #endif
 
   // should now have an array with dim = dims_to_sample.size()
-  recursive_sample(dims_to_sample, free, index, slice_map);
+  recursive_sample(dims_to_sample, free, index, slice_map, dims, mask, state);
+}
+
+// fixed-rank implementation of QIS::computeStateValues: the product of the marginal values over the (row-major) states
+template<size_t D>
+struct StateValues
+{
+  static void run(const std::vector<std::vector<int64_t>>& indices, const std::vector<NDArray<int64_t>>& marginals,
+                  NDArray<double>& values)
+  {
+    StaticIndex<D> index(values.sizes());
+    std::vector<StaticOffset<D>> offsets;
+    for (size_t k = 0; k < marginals.size(); ++k)
+      offsets.push_back(StaticOffset<D>(index, indices[k], marginals[k].strides()));
+    for (double* p = values.begin(); !index.end(); ++p)
+    {
+      for (size_t k = 0; k < marginals.size(); ++k)
+        *p *= marginals[k].rawData()[*offsets[k]];
+      ++index;
+      for (size_t k = 0; k < marginals.size(); ++k)
+        offsets[k].advance(index);
+    }
+  }
+};
+
+// fixed-rank chi-squared statistic of the population against the expectation, and the log degeneracy, in a single
+// pass. The expectation is computed per state from the product of the marginal values rather than stored
+template<size_t D>
+struct FusedStatistics
+{
+  static void run(const std::vector<std::vector<int64_t>>& indices, const std::vector<NDArray<int64_t>>& marginals,
+                  const NDArray<int64_t>& population, double scale, Statistics& stats)
+  {
+    StaticIndex<D> index(population.sizes());
+    std::vector<StaticOffset<D>> offsets;
+    for (size_t k = 0; k < marginals.size(); ++k)
+      offsets.push_back(StaticOffset<D>(index, indices[k], marginals[k].strides()));
+    double chisq = 0.0;
+    double logDeg = logFactorial(population.storageSize());
+    for (const int64_t* p = population.rawData(); !index.end(); ++p)
+    {
+      double e = scale;
+      for (size_t k = 0; k < marginals.size(); ++k)
+        e *= marginals[k].rawData()[*offsets[k]];
+      chisq += (*p - e) * (*p - e) / e;
+      logDeg -= logFactorial(*p + 1);
+      ++index;
+      for (size_t k = 0; k < marginals.size(); ++k)
+        offsets[k].advance(index);
+    }
+    stats.chiSq = chisq;
+    stats.logDegeneracy = logDeg;
+  }
+};
+
+// The work (array elements visited) of sampling the dimensions of a marginal not already fixed: the marginal is sliced
+// to those dimensions, then reduced and sliced one dimension at a time. Sampling the largest first shrinks it fastest;
+// otherwise they're sampled last first. Sets order to the (local) dimensions in the order sampled
+double work(const std::vector<int64_t>& index, const std::vector<int64_t>& sizes, const std::vector<bool>& fixed,
+            bool largestFirst, std::vector<int64_t>& order)
+{
+  order.clear();
+  for (size_t j = index.size(); j-- > 0;)
+    if (!fixed[index[j]])
+      order.push_back(j);
+  if (largestFirst)
+    std::stable_sort(order.begin(), order.end(), [&](int64_t a, int64_t b) { return sizes[index[a]] > sizes[index[b]]; });
+  if (order.empty())
+    return 0.0;
+  double remaining = 1.0;
+  for (int64_t j: order)
+    remaining *= sizes[index[j]];
+  double w = remaining;
+  for (int64_t j: order)
+  {
+    w += remaining;
+    remaining /= sizes[index[j]];
+  }
+  return w;
+}
+
+template<typename C>
+inline void increment(NDArray<C>& population, const Index& index)
+{
+  ++population[index];
+}
+
+inline void increment(SparseArray<int64_t>& population, const Index& index)
+{
+  ++population.at(index);
+}
+
+typedef std::list<std::pair<std::vector<int64_t>, NDArray<double>>> factor_list_t;
+
+// the dimensions spanned by the factors that include dim
+std::set<int64_t> span(const factor_list_t& factors, int64_t dim)
+{
+  std::set<int64_t> dims;
+  for (const auto& f: factors)
+    if (std::find(f.first.begin(), f.first.end(), dim) != f.first.end())
+      dims.insert(f.first.begin(), f.first.end());
+  return dims;
+}
+
+// Sum over the whole state space of the product of the marginal values, without enumerating the state space:
+// dimensions are summed out one at a time, choosing at each step the one that creates the smallest intermediate
+double sumProduct(const std::vector<std::vector<int64_t>>& indices, const std::vector<NDArray<int64_t>>& marginals,
+                  const std::vector<int64_t>& sizes)
+{
+  // factors are (dimensions, values) pairs
+  factor_list_t factors;
+  for (size_t k = 0; k < marginals.size(); ++k)
+  {
+    factors.emplace_back(indices[k], NDArray<double>(marginals[k].sizes()));
+    for (Index i(marginals[k].sizes()); !i.end(); ++i)
+      factors.back().second[i] = marginals[k][i];
+  }
+
+  std::set<int64_t> remaining;
+  for (size_t d = 0; d < sizes.size(); ++d)
+    remaining.insert(d);
+
+  double result = 1.0;
+  while (!remaining.empty())
+  {
+    int64_t dim = *remaining.begin();
+    double smallest = std::numeric_limits<double>::max();
+    for (int64_t d: remaining)
+    {
+      double size = 1.0;
+      for (int64_t e: span(factors, d))
+        size *= sizes[e];
+      if (size < smallest)
+      {
+        smallest = size;
+        dim = d;
+      }
+    }
+    remaining.erase(dim);
+
+    // the new factor's dimensions, followed by the one being summed out
+    std::vector<int64_t> all;
+    for (int64_t e: span(factors, dim))
+      if (e != dim)
+        all.push_back(e);
+    const std::vector<int64_t> dims(all);
+    all.push_back(dim);
+    std::vector<int64_t> allSizes;
+    for (int64_t e: all)
+      allSizes.push_back(sizes[e]);
+    Index index(allSizes);
+
+    factor_list_t involved;
+    std::vector<MappedIndex> mappings;
+    for (;;)
+    {
+      factor_list_t::iterator it = std::find_if(factors.begin(), factors.end(), [dim](const factor_list_t::value_type& f) {
+        return std::find(f.first.begin(), f.first.end(), dim) != f.first.end();
+      });
+      if (it == factors.end())
+        break;
+      std::vector<int64_t> positions;
+      for (int64_t e: it->first)
+        positions.push_back(std::find(all.begin(), all.end(), e) - all.begin());
+      mappings.push_back(MappedIndex(index, positions));
+      involved.splice(involved.end(), factors, it);
+    }
+
+    // a fully summed-out factor is just a multiplier, represented here by a 1-element array
+    std::vector<int64_t> positions(dims.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    NDArray<double> out(dims.empty() ? std::vector<int64_t>{1} : std::vector<int64_t>(allSizes.begin(), allSizes.end() - 1));
+    out.assign(0.0);
+    MappedIndex outIndex(index, positions);
+    for (; !index.end(); ++index)
+    {
+      double p = 1.0;
+      size_t j = 0;
+      for (const auto& f: involved)
+        p *= f.second[mappings[j++]];
+      if (dims.empty())
+        *out.begin() += p;
+      else
+        out[outIndex] += p;
+    }
+    if (dims.empty())
+      result *= *out.begin();
+    else
+      factors.emplace_back(dims, std::move(out));
+  }
+  return result;
 }
 
 }
 
-QIS::QIS(const index_list_t& indices, marginal_list_t& marginals, int64_t skips)
-: Microsynthesis(indices, marginals), m_sobolSeq(m_dim), m_conv(false)
+QIS::QIS(const index_list_t& indices, marginal_list_t& marginals, int64_t skips, bool sparse, const Mask& mask)
+: Microsynthesis(indices, marginals, !sparse), m_sobolSeq(m_dim), m_sparse(sparse), m_mask(mask), m_stateTotal(0.0),
+  m_conv(false), m_solved(false), m_statistics(false)
 {
   m_sobolSeq.skip(skips);
-  m_stateValues.resize(m_array.sizes());
-  // compute initial state probabilities and keep a copy
-  computeStateValues();
-  NDArray<double>::copy(m_stateValues, m_expectedStateOccupancy);
-  // scale to get expected occupancy
-  double scale = double(m_population) / sum(m_stateValues);
-  for (Index index(m_expectedStateOccupancy.sizes()); !index.end(); ++index)
-    m_expectedStateOccupancy[index] *= scale;
+  planSampling();
+  if (!m_mask.empty())
+  {
+    if (m_sparse)
+      throw std::runtime_error("QIS mask requires a dense solution");
+    if (m_mask.sizes() != m_sizes)
+      throw std::runtime_error("mask dimensions do not match those of the marginals");
+    if (!m_mask.count() && m_population)
+      throw std::runtime_error("mask allows no states");
+    // the dimensions in the order they're sampled
+    std::vector<int64_t> order;
+    for (size_t k: m_visit)
+      for (int64_t j: m_order[k])
+        order.push_back(m_indices[k][j]);
+    PROFILE_SCOPE(m_profile, "mask");
+    m_mask.plan(order);
+  }
+  if (m_sparse)
+  {
+    m_sparseArray.resize(m_sizes);
+    m_sparseExpectation.resize(m_sizes);
+  }
+  m_initialMarginals.reserve(m_marginals.size());
+  for (const marginal_t& m: m_marginals)
+  {
+    m_initialMarginals.push_back(marginal_t());
+    marginal_t::copy(m, m_initialMarginals.back());
+  }
+  {
+    PROFILE_SCOPE(m_profile, "computeStateValues");
+    m_stateTotal = sumProduct(m_indices, m_marginals, m_sizes);
+  }
+#ifdef USE_STATE_SAMPLING
+  m_stateValues.resize(m_sizes);
+  computeStateValues(m_marginals, m_stateValues);
+#endif
 #ifdef VERBOSE
-  // if (sum(m_expectedStateOccupancy) != m_population)
-  //   throw std::logic_error("mismatch in expected state occupancy" + std::to_string(sum(m_expectedStateOccupancy)) + " vs " + std::to_string(m_population));
-  std::cout << "scaling factor = " << 1.0 / scale << std::endl;
+  std::cout << "scaling factor = " << m_stateTotal / m_population << std::endl;
 #endif
 }
 
 
 const NDArray<int64_t>& QIS::solve(bool reset)
 {
-  // sample from (updated) expected values, can be slow for hi
+  if (m_sparse)
+    throw std::runtime_error("QIS was constructed sparse, use solveSparse");
+  {
+    PROFILE_SCOPE(m_profile, "sampling");
+    // sample from (updated) expected values, can be slow for hi
 #ifdef USE_STATE_SAMPLING
-  return solve_p(reset);
+    solve_p(reset);
 #else
-  // fast, but complicated - slices and dices each marginal
-  return solve_m(reset);
+    // fast, but complicated - slices and dices each marginal. Sampled into the narrowest counts that can hold the
+    // population, so that the (scattered) increments touch less memory, then widened into the result
+    switch (countBytes(m_population))
+    {
+    case 2:
+      solveCompact<uint16_t>(reset);
+      break;
+    case 4:
+      solveCompact<int32_t>(reset);
+      break;
+    default:
+      m_array.assign(0ll);
+      solve_m(m_array, reset);
+    }
 #endif
+  }
+  PROFILE_COUNT(m_profile, "samples", m_population);
+  PROFILE_COUNT(m_profile, "occupancyBytes", countBytes(m_population));
+  // the statistics need the (IPF) expectation of a masked problem
+  if (!m_mask.empty())
+    expectation();
+
+  m_solved = true;
+  m_statistics = false;
+
+  return m_array;
+}
+
+const SparseArray<int64_t>& QIS::solveSparse(bool reset)
+{
+  if (!m_sparse)
+    throw std::runtime_error("QIS was not constructed sparse, use solve");
+  {
+    PROFILE_SCOPE(m_profile, "sampling");
+    m_sparseArray.clear();
+    solve_m(m_sparseArray, reset);
+  }
+  PROFILE_COUNT(m_profile, "samples", m_population);
+
+  {
+    PROFILE_SCOPE(m_profile, "expectation");
+    // expected occupancy is proportional to the product of the (original) marginal values
+    const double scale = m_population / m_stateTotal;
+    m_sparseExpectation.clear();
+    std::vector<int64_t> mindex;
+    for (const auto& v: m_sparseArray.values())
+    {
+      const std::vector<int64_t>& index = m_sparseArray.index(v.first);
+      double value = scale;
+      for (size_t k = 0; k < m_initialMarginals.size(); ++k)
+      {
+        mindex.resize(m_indices[k].size());
+        for (size_t j = 0; j < m_indices[k].size(); ++j)
+          mindex[j] = index[m_indices[k][j]];
+        value *= m_initialMarginals[k][mindex];
+      }
+      m_sparseExpectation.at(index) = value;
+    }
+  }
+
+  m_solved = true;
+  m_statistics = false;
+
+  return m_sparseArray;
+}
+
+double QIS::adjust(const marginal_list_t& deltas)
+{
+  if (m_sparse)
+    throw std::runtime_error("QIS adjust requires a dense solution");
+  if (!m_solved)
+    throw std::runtime_error("QIS cannot be adjusted until solved");
+
+  marginal_list_t target = applyDeltas(m_indices, m_initialMarginals, deltas);
+  const double before = chiSq();
+  PROFILE_SCOPE(m_profile, "adjust");
+
+  // a converged population has exactly the marginals it was solved for
+  marginal_list_t current;
+  for (size_t k = 0; k < m_indices.size(); ++k)
+  {
+    current.push_back(marginal_t());
+    if (m_conv)
+      marginal_t::copy(m_initialMarginals[k], current.back());
+    else
+      marginal_t::copy(reduce<int64_t>(m_array, m_indices[k]), current.back());
+  }
+  // (not inside PROFILE_COUNT, which is compiled out with profiling)
+  const int64_t removed = removeExcess(m_array, expectation(), m_indices, current, target);
+  PROFILE_COUNT(m_profile, "removed", removed);
+
+  // sample the shortfall on its own
+  const int64_t added = sum(current[0]);
+  m_conv = true;
+  if (added)
+  {
+    QIS qis(m_indices, current, 0, false, m_mask);
+    const NDArray<int64_t>& a = qis.solve();
+    int64_t* p = m_array.begin();
+    for (size_t i = 0; i < a.storageSize(); ++i)
+      p[i] += a.rawData()[i];
+    m_conv = qis.conv();
+  }
+  PROFILE_COUNT(m_profile, "added", added);
+
+  for (size_t k = 0; k < m_indices.size(); ++k)
+    marginal_t::copy(target[k], m_initialMarginals[k]);
+  m_population = sum(m_initialMarginals[0]);
+  m_stateTotal = sumProduct(m_indices, m_initialMarginals, m_sizes);
+  if (m_expectedStateOccupancy.storageSize())
+    computeExpectation();
+  m_statistics = false;
+
+  return chiSq() - before;
 }
 
 #ifdef USE_STATE_SAMPLING
@@ -234,19 +622,14 @@ const NDArray<int64_t>& QIS::solve_p(bool reset)
     print(m_stateValues.rawData(), m_stateValues.storageSize(), m_stateValues.sizes()[0]);
 #endif
   }
-  m_chiSq = ::chiSq(m_array, m_expectedStateOccupancy);
-
-  m_pValue = ::pValue(dof(m_array.sizes()), m_chiSq).first;
-
-  m_degeneracy = ::degeneracy(m_array);
-
   return m_array;
 }
 #endif
 
 // control state of Sobol via arg?
 // better solution? construct set of 1-d marginals and sample from these
-const NDArray<int64_t>& QIS::solve_m(bool reset)
+template<typename A>
+void QIS::solve_m(A& population, bool reset)
 {
   if (reset)
   {
@@ -255,11 +638,10 @@ const NDArray<int64_t>& QIS::solve_m(bool reset)
 
   m_conv = true;
   // loop over population
-  m_array.assign(0ll);
-
-  Index main_index(m_array.sizes());
+  Index main_index(m_sizes);
 
   std::vector<MappedIndex> mapped_indices = makeMarginalMappings(main_index);
+  const Mask* mask = m_mask.empty() ? nullptr : &m_mask;
 
   for (int64_t i = 0; i < m_population; ++i)
   {
@@ -276,9 +658,9 @@ const NDArray<int64_t>& QIS::solve_m(bool reset)
     const std::vector<uint32_t>& seq = m_sobolSeq.buf();
 
     // loop over marginals (re)sampling until main_index is populated
-    for (size_t m = 0; m < mapped_indices.size(); ++m)
+    for (size_t m: m_visit)
     {
-      sample(m_indices[m], seq, m_marginals[m], mapped_indices[m]);
+      sample(m_indices[m], seq, m_marginals[m], mapped_indices[m], m_order[m], mask, main_index);
 #ifdef VERBOSE
       print(main_index.operator const std::vector<int64_t, std::allocator<int64_t>> &());
 #endif
@@ -295,11 +677,7 @@ const NDArray<int64_t>& QIS::solve_m(bool reset)
         m_conv = false;
     }
     // increment pop
-    ++m_array[main_index];
-#ifdef VERBOSE
-    print(m_array.rawData(), m_array.storageSize());
-    std::cout << std::endl;
-#endif
+    increment(population, main_index);
   }
 
 #ifdef VERBOSE
@@ -309,37 +687,249 @@ const NDArray<int64_t>& QIS::solve_m(bool reset)
           m_marginals[m].storageSize());
   }
 #endif
+}
 
-  m_chiSq = ::chiSq(m_array, m_expectedStateOccupancy);
 
-  m_pValue = ::pValue(dof(m_array.sizes()), m_chiSq).first;
+template<typename C>
+void QIS::solveCompact(bool reset)
+{
+  // sampled into the start of the result's own storage, then widened in place, so no more memory is needed
+  NDArray<C> occupancy = compactCounts<C>(m_array);
+  solve_m(occupancy, reset);
+  widenCounts<C>(m_array);
+}
 
-  m_degeneracy = ::degeneracy(m_array);
+void QIS::planSampling()
+{
+  PROFILE_SCOPE(m_profile, "plan");
+  const size_t K = m_indices.size();
+  std::vector<int64_t> order;
+
+  // the marginals of a set (bits) and the dimensions they fix
+  const auto fixes = [&](uint64_t set) -> std::vector<bool> {
+    std::vector<bool> fixed(m_dim, false);
+    for (size_t k = 0; k < K; ++k)
+      if (set & (uint64_t(1) << k))
+        for (int64_t d: m_indices[k])
+          fixed[d] = true;
+    return fixed;
+  };
+  // the total work of visiting the marginals in the given order
+  const auto total = [&](const std::vector<size_t>& visit, bool largestFirst) -> double {
+    std::vector<bool> fixed(m_dim, false);
+    double w = 0.0;
+    for (size_t k: visit)
+    {
+      w += work(m_indices[k], m_sizes, fixed, largestFirst, order);
+      for (int64_t d: m_indices[k])
+        fixed[d] = true;
+    }
+    return w;
+  };
+
+  // the order of the marginals and their dimensions as given
+  m_visit.resize(K);
+  std::iota(m_visit.begin(), m_visit.end(), 0);
+  const double given = total(m_visit, false);
+
+  // Visiting first the marginals that share dimensions (see m_dim_lookup) with others makes the others cheaper. Up to
+  // MaxPlanned marginals the best order is found over every subset of those visited first, beyond it greedily
+  static const size_t MaxPlanned = 12;
+  std::vector<size_t> visit;
+  if (K <= MaxPlanned)
+  {
+    const uint64_t all = (uint64_t(1) << K) - 1;
+    std::vector<double> best(all + 1, std::numeric_limits<double>::max());
+    std::vector<size_t> last(all + 1, 0);
+    best[0] = 0.0;
+    for (uint64_t set = 1; set <= all; ++set)
+    {
+      for (size_t k = 0; k < K; ++k)
+      {
+        const uint64_t bit = uint64_t(1) << k;
+        if (!(set & bit))
+          continue;
+        const double w = best[set & ~bit] + work(m_indices[k], m_sizes, fixes(set & ~bit), true, order);
+        if (w < best[set])
+        {
+          best[set] = w;
+          last[set] = k;
+        }
+      }
+    }
+    for (uint64_t set = all; set; set &= ~(uint64_t(1) << visit.back()))
+      visit.push_back(last[set]);
+    std::reverse(visit.begin(), visit.end());
+  }
+  else
+  {
+    std::vector<bool> fixed(m_dim, false);
+    std::vector<bool> visited(K, false);
+    while (visit.size() < K)
+    {
+      size_t next = 0;
+      double least = std::numeric_limits<double>::max();
+      for (size_t k = 0; k < K; ++k)
+      {
+        if (visited[k])
+          continue;
+        const double w = work(m_indices[k], m_sizes, fixed, true, order);
+        if (w < least)
+        {
+          least = w;
+          next = k;
+        }
+      }
+      visit.push_back(next);
+      visited[next] = true;
+      for (int64_t d: m_indices[next])
+        fixed[d] = true;
+    }
+  }
 
-  return m_array;
+  // only replace the given order (and so change the population sampled) if it's worth it
+  const double planned = total(visit, true);
+  const bool reordered = planned < given;
+  if (reordered)
+    m_visit = visit;
+  m_order.assign(K, index_t());
+  std::vector<bool> fixed(m_dim, false);
+  for (size_t k: m_visit)
+  {
+    work(m_indices[k], m_sizes, fixed, reordered, m_order[k]);
+    for (int64_t d: m_indices[k])
+      fixed[d] = true;
+  }
+
+  PROFILE_COUNT(m_profile, "planWork", std::llround(reordered ? planned : given));
+  PROFILE_COUNT(m_profile, "givenWork", std::llround(given));
+  for (size_t i = 0; i < K; ++i)
+    PROFILE_COUNT(m_profile, "planVisit" + std::to_string(i), m_visit[i]);
 }
 
+std::string QIS::plan() const
+{
+  std::string s;
+  for (size_t k: m_visit)
+  {
+    if (!s.empty())
+      s += " ";
+    s += std::to_string(k) + "[";
+    for (size_t j = 0; j < m_order[k].size(); ++j)
+      s += (j ? "," : "") + std::to_string(m_indices[k][m_order[k][j]]);
+    s += "]";
+  }
+  return s;
+}
 
-// Expected state occupancy
+// Expected state occupancy, computed on first access
 const NDArray<double>& QIS::expectation()
 {
+  if (!m_sparse && !m_expectedStateOccupancy.storageSize())
+    computeExpectation();
   return m_expectedStateOccupancy;
 }
 
-void QIS::computeStateValues()
+void QIS::computeExpectation()
+{
+  PROFILE_SCOPE(m_profile, "expectation");
+  if (!m_mask.empty())
+  {
+    // the masked states are structural zeros in the seed
+    NDArray<double> seed(m_sizes);
+    seed.assign(1.0);
+    m_mask.apply(seed);
+    IPF<int64_t> ipf(m_indices, m_initialMarginals);
+    NDArray<double>::copy(ipf.solve(seed), m_expectedStateOccupancy);
+    return;
+  }
+  m_expectedStateOccupancy.resize(m_sizes);
+  computeStateValues(m_initialMarginals, m_expectedStateOccupancy);
+  // scale to get expected occupancy
+  simd::scale(m_expectedStateOccupancy.begin(), m_population / m_stateTotal, m_expectedStateOccupancy.storageSize());
+}
+
+const SparseArray<double>& QIS::sparseExpectation()
+{
+  return m_sparseExpectation;
+}
+
+bool QIS::sparse() const
+{
+  return m_sparse;
+}
+
+void QIS::scramble(uint32_t seed, uint32_t stream)
 {
-  Index index_main(m_array.sizes());
+  m_sobolSeq.scramble(seed, stream);
+}
+
+void QIS::computeStateValues(const marginal_list_t& marginals, NDArray<double>& values)
+{
+  PROFILE_SCOPE(m_profile, "computeStateValues");
+  values.assign(1.0);
+  if (dispatchRank<StateValues>(m_dim, m_indices, marginals, values))
+    return;
+
+  Index index_main(m_sizes);
 
   std::vector<MappedIndex> mappings = makeMarginalMappings(index_main);
 
-  m_stateValues.assign(1.0);
   for (; !index_main.end(); ++index_main)
   {
-    for (size_t k = 0; k < m_marginals.size(); ++k)
+    for (size_t k = 0; k < marginals.size(); ++k)
+    {
+      values[index_main] *= marginals[k][mappings[k]];
+    }
+  }
+}
+
+const Statistics& QIS::statistics() const
+{
+  if (m_statistics)
+    return m_stats;
+  if (!m_solved)
+    throw std::runtime_error("QIS statistics are not available until solved");
+
+  PROFILE_SCOPE(m_profile, "statistics");
+  if (m_sparse)
+  {
+    m_stats.chiSq = ::chiSq(m_sparseArray, m_sparseExpectation, m_population);
+    m_stats.logDegeneracy = ::logDegeneracy(m_sparseArray);
+    m_stats.pValue = ::pValue(dof(m_sizes), m_stats.chiSq).first;
+  }
+  // the masked states (having neither population nor expectation) are excluded
+  else if (!m_mask.empty())
+    m_stats = maskedStatistics(m_array, m_expectedStateOccupancy);
+  // use the expectation if it's already been computed
+  else if (m_expectedStateOccupancy.storageSize())
+    m_stats = ::statistics(m_array, m_expectedStateOccupancy);
+  else
+  {
+    // otherwise compute it on the fly, state by state
+    const double scale = m_population / m_stateTotal;
+    if (!dispatchRank<FusedStatistics>(m_dim, m_indices, m_initialMarginals, m_array, scale, m_stats))
     {
-      m_stateValues[index_main] *= m_marginals[k][mappings[k]];
+      Index index(m_sizes);
+      const std::vector<MappedIndex>& mappings = makeMarginalMappings(index);
+      double chisq = 0.0;
+      double logDeg = logFactorial(m_array.storageSize());
+      for (; !index.end(); ++index)
+      {
+        double e = scale;
+        for (size_t k = 0; k < m_initialMarginals.size(); ++k)
+          e *= m_initialMarginals[k][mappings[k]];
+        const int64_t a = m_array[index];
+        chisq += (a - e) * (a - e) / e;
+        logDeg -= logFactorial(a + 1);
+      }
+      m_stats.chiSq = chisq;
+      m_stats.logDegeneracy = logDeg;
     }
+    m_stats.pValue = ::pValue(dof(m_sizes), m_stats.chiSq).first;
   }
+  m_statistics = true;
+  return m_stats;
 }
 
 #ifdef USE_STATE_SAMPLING
@@ -377,17 +967,22 @@ void QIS::updateStateValues(const Index& position, const std::vector<MappedIndex
 
 double QIS::chiSq() const
 {
-  return m_chiSq;
+  return statistics().chiSq;
 }
 
 double QIS::pValue() const
 {
-  return m_pValue;
+  return statistics().pValue;
 }
 
 double QIS::degeneracy() const
 {
-  return m_degeneracy;
+  return std::exp(statistics().logDegeneracy);
+}
+
+double QIS::logDegeneracy() const
+{
+  return statistics().logDegeneracy;
 }
 
 bool QIS::conv() const
@@ -1,47 +1,113 @@
 #pragma once
 
 #include "Microsynthesis.h"
+#include "SparseArray.h"
 #include "Sobol.h"
+#include "StatFuncs.h"
+#include "Mask.h"
+
+#include <string>
+
+// uncomment to sample from a (dynamic) state array rather than directly from marginals (can be slower for high dimensionality)
+//#define USE_STATE_SAMPLING
 
 class QIS : public Microsynthesis<int64_t>
 {
 public:
-  QIS(const index_list_t& indices, marginal_list_t& marginals, int64_t skips = 0);
+  // sparse = true stores the population (and expectation) only for the occupied states, for state spaces too large to
+  // hold densely. Sparse and dense solutions are otherwise identical. A (dense only) mask excludes structural zeros
+  // from sampling, the expectation then being the IPF solution from the mask. As the samplers only know which values
+  // can lead to an allowed state, not whether the marginals remaining can still fill it, a tight mask may leave the
+  // marginals slightly unmet (see conv), which QISI avoids
+  QIS(const index_list_t& indices, marginal_list_t& marginals, int64_t skips = 0, bool sparse = false,
+      const Mask& mask = Mask());
 
   // TODO need a mechanism to invalidate result after it's been moved (or just copy it)
+  // Samples into 16 or 32 bit counts where the population fits (counted as "occupancyBytes" in the profile)
   const NDArray<int64_t>& solve(bool reset = false);
-  
-  // Expected state occupancy
+
+  // Requires sparse construction
+  const SparseArray<int64_t>& solveSparse(bool reset = false);
+
+  // Adjusts the (dense) solution to a change in the marginals, e.g. a scenario, removing and adding individuals only
+  // in the marginal cells affected (see Adjust.h) rather than resampling the whole population. The deltas have the
+  // shapes of the marginals and must leave them consistent and non-negative. Returns the change in chi-squared, the
+  // statistics and expectation thereafter being those of the adjusted marginals
+  double adjust(const marginal_list_t& deltas);
+
+  // Expected state occupancy. Computed on first access (the statistics don't require it), so that a solve need only
+  // hold the population array
   const NDArray<double>& expectation();
 
+  // Expected occupancy of the occupied states (only) of the sparse solution
+  const SparseArray<double>& sparseExpectation();
+
+  bool sparse() const;
+
+  // Owen-scrambles the Sobol sequence (see Sobol::scramble), e.g. to give replicates independent samples
+  void scramble(uint32_t seed, uint32_t stream = 0);
+
   // convergence
   bool conv() const;
 
+  // The statistics are computed (together) on first access after solving, so cost nothing if not used
   // chi-squared stat vs the IPF solution
   double chiSq() const;
 
+  // infinite if too large to represent, see logDegeneracy
   double degeneracy() const;
 
+  double logDegeneracy() const;
+
   double pValue() const;
 
+  // The sampling plan (see plan), as the marginals in the order visited, each with the dimensions it samples in order,
+  // e.g. "2[3,1] 0[0] 1[2]"
+  std::string plan() const;
+
 private:
 
   const NDArray<int64_t>& solve_p(bool reset);
-  const NDArray<int64_t>& solve_m(bool reset);
+  // samples into a dense or sparse population
+  template<typename A>
+  void solve_m(A& population, bool reset);
+  // samples into counts of type C (see countBytes) in the population's own storage, then widened in place
+  template<typename C>
+  void solveCompact(bool reset);
   
   // state values are proportional to state occupancy probabilities
   void updateStateValues(const Index& position, const std::vector<MappedIndex>& mappings);
-  void computeStateValues();
+  // product of the marginal values for each state
+  void computeStateValues(const marginal_list_t& marginals, NDArray<double>& values);
+  void computeExpectation();
+  const Statistics& statistics() const;
+  // Chooses the order in which to visit the marginals when sampling an individual, and in which to sample each one's
+  // dimensions, to minimise the work per individual
+  void planSampling();
 
   Sobol m_sobolSeq;
+  // the marginals in the order visited, and each one's (local) dimensions in the order sampled
+  std::vector<size_t> m_visit;
+  std::vector<index_t> m_order;
 
+#ifdef USE_STATE_SAMPLING
   // values proportional to state probs
   NDArray<double> m_stateValues;
-  // Required for chi-squared
+#endif
+  // empty until requested
   NDArray<double> m_expectedStateOccupancy;
-  double m_chiSq;
-  double m_pValue;
-  double m_degeneracy;
+
+  bool m_sparse;
+  Mask m_mask;
+  SparseArray<int64_t> m_sparseArray;
+  SparseArray<double> m_sparseExpectation;
+  // the marginals are consumed by sampling, but are needed to compute the expectation afterwards
+  marginal_list_t m_initialMarginals;
+  // sum over all states of the product of the marginal values
+  double m_stateTotal;
   bool m_conv;
+  bool m_solved;
+  mutable bool m_statistics;
+  mutable Statistics m_stats;
 };
 
@@ -3,6 +3,7 @@
 #include "IPF.h"
 #include "Index.h"
 #include "StatFuncs.h"
+#include "Adjust.h"
 
 namespace {
 
@@ -62,15 +63,33 @@ void getIndex(const NDArray<double>& p, const std::vector<uint32_t>& r, Index& i
 }
 
 
-QISI::QISI(const index_list_t& indices, marginal_list_t& marginals, int64_t skips)
-: Microsynthesis(indices, marginals), m_sobolSeq(m_dim), m_conv(false)
+QISI::QISI(const index_list_t& indices, marginal_list_t& marginals, int64_t skips, const Mask& mask)
+: Microsynthesis(indices, marginals), m_sobolSeq(m_dim), m_mask(mask), m_conv(false), m_statistics(false)
 {
   m_sobolSeq.skip(skips);
+  if (!m_mask.empty() && m_mask.sizes() != m_sizes)
+    throw std::runtime_error("mask dimensions do not match those of the marginals");
+  m_initialMarginals.reserve(m_marginals.size());
+  for (const marginal_t& m: m_marginals)
+  {
+    m_initialMarginals.push_back(marginal_t());
+    marginal_t::copy(m, m_initialMarginals.back());
+  }
+}
+
+const NDArray<double>& QISI::masked(const NDArray<double>& seed)
+{
+  if (m_mask.empty())
+    return seed;
+  NDArray<double>::copy(seed, m_maskedSeed);
+  m_mask.apply(m_maskedSeed);
+  return m_maskedSeed;
 }
 
 // control state of Sobol via arg?
-const NDArray<int64_t>& QISI::solve(const NDArray<double>& seed, bool reset)
+const NDArray<int64_t>& QISI::solve(const NDArray<double>& s, bool reset)
 {
+  const NDArray<double>& seed = masked(s);
   if (reset)
   {
     m_sobolSeq.reset();
@@ -78,14 +97,134 @@ const NDArray<int64_t>& QISI::solve(const NDArray<double>& seed, bool reset)
 
   m_ipfSolution.resize(m_array.sizes());
   m_expectedStateOccupancy.resize(m_array.sizes());
-  // compute initial IPF solution and keep a copy
-  recomputeIPF(seed);
-  NDArray<double>::copy(m_ipfSolution, m_expectedStateOccupancy);
 
+  {
+    // the temporaries created by the IPF recomputes and the index lookups are all freed before the next ones are
+    // created, so the arena rewinds and the same memory is reused throughout (and by subsequent solves)
+    Allocator::Scope arena(m_arena);
+
+    // compute initial IPF solution and keep a copy
+    recomputeIPF(seed);
+    NDArray<double>::copy(m_ipfSolution, m_expectedStateOccupancy);
+
+    {
+      PROFILE_SCOPE(m_profile, "sampling");
+      // into the narrowest counts that can hold the population (see QIS::solve)
+      switch (countBytes(m_population))
+      {
+      case 2:
+        sampleCompact<uint16_t>(seed);
+        break;
+      case 4:
+        sampleCompact<int32_t>(seed);
+        break;
+      default:
+        sample(seed, m_array);
+      }
+    }
+    PROFILE_COUNT(m_profile, "samples", m_population);
+    PROFILE_COUNT(m_profile, "occupancyBytes", countBytes(m_population));
+  }
+
+  m_statistics = false;
+
+  return m_array;
+}
+
+double QISI::adjust(const marginal_list_t& deltas, const NDArray<double>& s)
+{
+  if (!m_expectedStateOccupancy.storageSize())
+    throw std::runtime_error("QISI cannot be adjusted until solved");
+  const NDArray<double>& seed = masked(s);
+
+  marginal_list_t target = applyDeltas(m_indices, m_initialMarginals, deltas);
+  const double before = chiSq();
+  PROFILE_SCOPE(m_profile, "adjust");
+
+  // a converged population has exactly the marginals it was solved for
+  marginal_list_t current;
+  for (size_t k = 0; k < m_indices.size(); ++k)
+  {
+    current.push_back(marginal_t());
+    if (m_conv)
+      marginal_t::copy(m_initialMarginals[k], current.back());
+    else
+      marginal_t::copy(reduce<int64_t>(m_array, m_indices[k]), current.back());
+  }
+  // (not inside PROFILE_COUNT, which is compiled out with profiling)
+  const int64_t removed = removeExcess(m_array, m_expectedStateOccupancy, m_indices, current, target);
+  PROFILE_COUNT(m_profile, "removed", removed);
+
+  // sample the shortfall on its own. The removals take no account of the seed, so with structural zeros the shortfall
+  // may have no solution, in which case the population is resolved in full
+  const int64_t added = sum(current[0]);
+  bool resolve = false;
+  m_conv = true;
+  if (added)
+  {
+    try
+    {
+      QISI qisi(m_indices, current, 0, m_mask);
+      const NDArray<int64_t>& a = qisi.solve(seed);
+      m_profile.merge(qisi.profile());
+      resolve = !qisi.conv();
+      int64_t* p = m_array.begin();
+      for (size_t i = 0; i < a.storageSize(); ++i)
+        p[i] += a.rawData()[i];
+    }
+    catch(const std::runtime_error&)
+    {
+      resolve = true;
+    }
+  }
+  if (resolve)
+  {
+    marginal_list_t marginals;
+    for (const marginal_t& m: target)
+    {
+      marginals.push_back(marginal_t());
+      marginal_t::copy(m, marginals.back());
+    }
+    QISI qisi(m_indices, marginals, 0, m_mask);
+    NDArray<int64_t>::copy(qisi.solve(seed), m_array);
+    m_conv = qisi.conv();
+    m_profile.merge(qisi.profile());
+    PROFILE_COUNT(m_profile, "resolved", 1);
+  }
+  else
+  {
+    PROFILE_COUNT(m_profile, "added", added);
+  }
+
+  for (size_t k = 0; k < m_indices.size(); ++k)
+    marginal_t::copy(target[k], m_initialMarginals[k]);
+  m_population = sum(m_initialMarginals[0]);
+  {
+    IPF<int64_t> ipf(m_indices, target);
+    NDArray<double>::copy(ipf.solve(seed), m_expectedStateOccupancy);
+    m_profile.merge(ipf.profile());
+  }
+  m_statistics = false;
+
+  return chiSq() - before;
+}
+
+template<typename C>
+void QISI::sampleCompact(const NDArray<double>& seed)
+{
+  // sampled into the start of the result's own storage, then widened in place (see QIS::solveCompact)
+  NDArray<C> occupancy = compactCounts<C>(m_array);
+  sample(seed, occupancy);
+  widenCounts<C>(m_array);
+}
+
+template<typename C>
+void QISI::sample(const NDArray<double>& seed, NDArray<C>& population)
+{
   m_conv = true;
   Index main_index(m_array.sizes());
   const std::vector<MappedIndex>& mappedIndices = makeMarginalMappings(main_index);
-  m_array.assign(0ll);
+  population.assign(C(0));
 
   Sobol sobol_seq(m_dim);
   for (int64_t i = 0; i < m_population; ++i)
@@ -98,7 +237,7 @@ const NDArray<int64_t>& QISI::solve(const NDArray<double>& seed, bool reset)
     //print((std::vector<int64_t>)main_index);
     //print(m_ipfSolution.rawData(), m_ipfSolution.storageSize());
     // increment population
-    ++m_array[main_index];
+    ++population[main_index];
 
     // decrement marginals, checking none have gone -ve
     for (size_t j = 0; j < mappedIndices.size(); ++j)
@@ -116,13 +255,20 @@ const NDArray<int64_t>& QISI::solve(const NDArray<double>& seed, bool reset)
     if (m_ipfSolution[main_index] < 0.0)
       recomputeIPF(seed);
   }
-  m_chiSq = ::chiSq(m_array, m_expectedStateOccupancy);
-
-  m_pValue = ::pValue(dof(m_array.sizes()), m_chiSq).first;
-
-  m_degeneracy = ::degeneracy(m_array);
+}
 
-  return m_array;
+const Statistics& QISI::statistics() const
+{
+  if (!m_statistics)
+  {
+    if (!m_expectedStateOccupancy.storageSize())
+      throw std::runtime_error("QISI statistics are not available until solved");
+    PROFILE_SCOPE(m_profile, "statistics");
+    m_stats = m_mask.empty() ? ::statistics(m_array, m_expectedStateOccupancy)
+                             : maskedStatistics(m_array, m_expectedStateOccupancy);
+    m_statistics = true;
+  }
+  return m_stats;
 }
 
 // Expected state occupancy
@@ -135,25 +281,34 @@ const NDArray<double>& QISI::expectation()
 //
 void QISI::recomputeIPF(const NDArray<double>& seed)
 {
+  PROFILE_SCOPE(m_profile, "recomputeIPF");
+  PROFILE_COUNT(m_profile, "ipfRecomputes", 1);
   // TODO make more efficient
   // is this moving the marginals???
   IPF<int64_t> ipf(m_indices, m_marginals);
   NDArray<double>::copy(ipf.solve(seed), m_ipfSolution);
+  // the breakdown of the IPF (validation, rScale, iterations etc) is included
+  m_profile.merge(ipf.profile());
 }
 
 double QISI::chiSq() const
 {
-  return m_chiSq;
+  return statistics().chiSq;
 }
 
 double QISI::pValue() const
 {
-  return m_pValue;
+  return statistics().pValue;
 }
 
 double QISI::degeneracy() const
 {
-  return m_degeneracy;
+  return std::exp(statistics().logDegeneracy);
+}
+
+double QISI::logDegeneracy() const
+{
+  return statistics().logDegeneracy;
 }
 
 bool QISI::conv() const
@@ -2,38 +2,64 @@
 
 #include "Microsynthesis.h"
 #include "Sobol.h"
+#include "StatFuncs.h"
+#include "Mask.h"
 
 class QISI : public Microsynthesis<int64_t>
 {
 public:
-  QISI(const index_list_t& indices, marginal_list_t& marginals, int64_t skips = 0);
+  // A mask excludes structural zeros, as zeros in the seed would (so from the IPF solution sampled from)
+  QISI(const index_list_t& indices, marginal_list_t& marginals, int64_t skips = 0, const Mask& mask = Mask());
 
   // TODO need a mechanism to invalidate result after it's been moved (or just copy it)
+  // Samples into 16 or 32 bit counts where the population fits, as QIS::solve
   const NDArray<int64_t>& solve(const NDArray<double>& seed, bool reset = false);
 
+  // Adjusts the solution to a change in the marginals, as QIS::adjust, sampling the individuals added from the seed
+  // (which should be the one solved with). If the seed's structural zeros leave no way of adding them, the population
+  // is resolved in full (counted as "resolved" in the profile). Returns the change in chi-squared
+  double adjust(const marginal_list_t& deltas, const NDArray<double>& seed);
+
   // Expected state occupancy (IPF solution)
   const NDArray<double>& expectation();
 
   bool conv() const;
 
+  // The statistics are computed (together) on first access after solving
   // chi-squared stat vs the IPF solution
   double chiSq() const;
 
+  // infinite if too large to represent, see logDegeneracy
   double degeneracy() const;
 
+  double logDegeneracy() const;
+
   double pValue() const;
 
 private:
 
+  // into counts of type C (see countBytes)
+  template<typename C>
+  void sample(const NDArray<double>& seed, NDArray<C>& population);
+  template<typename C>
+  void sampleCompact(const NDArray<double>& seed);
+  // the seed, with the masked states zeroed if there's a mask
+  const NDArray<double>& masked(const NDArray<double>& seed);
   void recomputeIPF(const NDArray<double>& seed);
+  const Statistics& statistics() const;
 
   Sobol m_sobolSeq;
+  // backs the temporary arrays created while solving
+  Arena m_arena;
+  // the marginals are consumed by sampling, but are needed to adjust the solution
+  marginal_list_t m_initialMarginals;
+  Mask m_mask;
+  NDArray<double> m_maskedSeed;
   NDArray<double> m_expectedStateOccupancy;
   // Required for chi-squared
   NDArray<double> m_ipfSolution;
-  double m_chiSq;
-  double m_pValue;
-  double m_degeneracy;
   bool m_conv;
+  mutable bool m_statistics;
+  mutable Statistics m_stats;
 };
 
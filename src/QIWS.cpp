@@ -13,6 +13,7 @@
 
 QIWS::QIWS(const std::vector<marginal_t>& marginals) : m_dim(marginals.size()), m_marginals(marginals), m_residuals(marginals.size())
 {
+  PROFILE_SCOPE(m_profile, "validation");
   if (m_dim < 2)
     throw std::runtime_error("invalid dimension, must be > 1");
 
@@ -64,15 +65,19 @@ bool QIWS::solve()
   m_t.assign(0u);
 
   Index idx(m_t.sizes());
-  for (size_t j = 0; j < m_sum; ++j)
   {
-    for (size_t i = 0; i < m_dim; ++i)
+    PROFILE_SCOPE(m_profile, "sampling");
+    for (size_t j = 0; j < m_sum; ++j)
     {
-      idx[i] = dists[i](sobol);
+      for (size_t i = 0; i < m_dim; ++i)
+      {
+        idx[i] = dists[i](sobol);
+      }
+      //print(idx, m_dim);
+      ++m_t[idx];
     }
-    //print(idx, m_dim);
-    ++m_t[idx];
   }
+  PROFILE_COUNT(m_profile, "samples", m_sum);
 
   std::vector<std::vector<int32_t>> r(m_dim);
   calcResiduals(r);
@@ -85,6 +90,7 @@ bool QIWS::solve()
     allZero = allZero && (m == 0);
   }
 
+  PROFILE_SCOPE(m_profile, "chiSq");
   double scale = 1.0 / std::pow(m_sum, m_dim-1);
 
   for (Index index(m_t.sizes()); !index.end(); ++index)
@@ -129,8 +135,14 @@ const NDArray<double>& QIWS::stateProbabilities() const
   return m_p;
 }
 
+const Profile& QIWS::profile() const
+{
+  return m_profile;
+}
+
 void QIWS::calcResiduals(std::vector<std::vector<int32_t>>& r)
 {
+  PROFILE_SCOPE(m_profile, "residuals");
   for (size_t d = 0; d < r.size(); ++d)
   {
     r[d] = diff(reduce<uint32_t>(m_t, d), m_marginals[d]);
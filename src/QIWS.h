@@ -2,6 +2,7 @@
 #pragma once
 
 #include "NDArray.h"
+#include "Profile.h"
 
 // n-Dimensional without-replacement sampling
 class QIWS
@@ -31,6 +32,9 @@ public:
   // the mean population of each state
   const NDArray<double>& stateProbabilities() const;
 
+  // timings and counters (see Profile.h)
+  const Profile& profile() const;
+
 protected:
 
   void calcResiduals(std::vector<std::vector<int32_t>>& r);
@@ -50,5 +54,6 @@ protected:
   uint32_t m_dof;
   // TODO degeneracy S!/Product_k(Tk!)
   double m_degeneracy;
+  Profile m_profile;
 };
 
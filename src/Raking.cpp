@@ -0,0 +1,193 @@
+
+#include "Raking.h"
+#include "NDArrayUtils.h"
+
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+Raking::Raking(const index_list_t& indices, marginal_list_t& marginals, const NDArray<int64_t>& categories,
+               const NDArray<double>& weights)
+: Microsynthesis(indices, marginals, false), m_records(0), m_conv(false), m_iters(0),
+  m_maxError(std::numeric_limits<double>::max())
+{
+  PROFILE_SCOPE(m_profile, "validation");
+  if (categories.dim() != 2 || categories.size(1) != m_dim)
+    throw std::runtime_error("categories must be a (records x " + std::to_string(m_dim) + ") array");
+  m_records = categories.size(0);
+  if (weights.storageSize() != m_records)
+    throw std::runtime_error("number of weights (" + std::to_string(weights.storageSize()) + ") differs from the number of records ("
+      + std::to_string(m_records) + ")");
+  if (min(weights) < 0.0)
+    throw std::runtime_error("negative weight");
+  NDArray<double>::copy(weights, m_seed);
+
+  // the cell of each marginal that each record falls in, as an offset into the marginal's storage (which may be
+  // column-major, e.g. from a Fortran-ordered numpy array)
+  m_cells.resize(m_indices.size());
+  for (size_t k = 0; k < m_indices.size(); ++k)
+    m_cells[k].resize(m_records);
+  std::vector<int64_t> index(2);
+  std::vector<int64_t> category(m_dim);
+  for (size_t r = 0; r < m_records; ++r)
+  {
+    index[0] = r;
+    for (size_t d = 0; d < m_dim; ++d)
+    {
+      index[1] = d;
+      category[d] = categories[index];
+      if (category[d] < 0 || category[d] >= m_sizes[d])
+        throw std::runtime_error("record " + std::to_string(r) + " category " + std::to_string(category[d]) +
+          " out of range for dimension " + std::to_string(d));
+    }
+    for (size_t k = 0; k < m_indices.size(); ++k)
+    {
+      int64_t offset = 0;
+      for (size_t j = 0; j < m_indices[k].size(); ++j)
+        offset += category[m_indices[k][j]] * m_marginals[k].strides()[j];
+      m_cells[k][r] = offset;
+    }
+  }
+  PROFILE_COUNT(m_profile, "records", m_records);
+}
+
+const NDArray<double>& Raking::solve(size_t threads)
+{
+  PROFILE_SCOPE(m_profile, "ipf");
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  const size_t n = m_indices.size();
+  const size_t blocks = (m_records + s_BLOCK - 1) / s_BLOCK;
+  NDArray<double>::copy(m_seed, m_weights);
+  m_factors.resize(n);
+  m_sums.resize(n);
+  m_blockSums.assign(blocks, std::vector<std::vector<double>>(n));
+  for (size_t k = 0; k < n; ++k)
+  {
+    m_factors[k].resize(m_marginals[k].storageSize());
+    m_sums[k].resize(m_marginals[k].storageSize());
+    for (size_t b = 0; b < blocks; ++b)
+      m_blockSums[b][k].resize(m_marginals[k].storageSize());
+  }
+
+  // sums onto the first marginal
+  pass(n, 0, 1, threads);
+
+  const double tol = m_tol * std::max(1.0, double(m_population));
+  m_conv = false;
+  for (m_iters = 0; !m_conv && m_iters < s_MAXITER; ++m_iters)
+  {
+    {
+      PROFILE_SCOPE(m_profile, "rScale");
+      // as Microsynthesis::rScaleDiff, each pass accumulates the sums needed by the next, and the last all of them
+      for (size_t k = 0; k < n; ++k)
+      {
+        const double* m = m_marginals[k].rawData();
+        for (size_t c = 0; c < m_factors[k].size(); ++c)
+        {
+          // the marginal can't be matched if none of its records have weight
+          if (m_sums[k][c] == 0.0 && m[c] != 0.0)
+            throw std::runtime_error("marginal " + std::to_string(k) + " has a nonzero value in a cell with no weighted records");
+          m_factors[k][c] = m_sums[k][c] != 0.0 ? m[c] / m_sums[k][c] : 0.0;
+        }
+        if (k < n - 1)
+          pass(k, k + 1, k + 2, threads);
+        else
+          pass(k, 0, n, threads);
+      }
+    }
+    PROFILE_SCOPE(m_profile, "computeErrors");
+    m_maxError = 0.0;
+    for (size_t k = 0; k < n; ++k)
+      for (size_t c = 0; c < m_sums[k].size(); ++c)
+        m_maxError = std::max(m_maxError, std::fabs(m_sums[k][c] - m_marginals[k].rawData()[c]));
+    m_conv = m_maxError < tol;
+  }
+  PROFILE_COUNT(m_profile, "iterations", m_iters);
+
+  return m_weights;
+}
+
+void Raking::pass(size_t k, size_t first, size_t last, size_t threads)
+{
+  const size_t blocks = m_blockSums.size();
+  double* w = m_weights.begin();
+
+  // thread t takes blocks t, t + threads, ...
+  auto work = [&](size_t t) {
+    for (size_t b = t; b < blocks; b += threads)
+    {
+      const size_t begin = b * s_BLOCK;
+      const size_t end = std::min(begin + s_BLOCK, m_records);
+      for (size_t j = first; j < last; ++j)
+        std::fill(m_blockSums[b][j].begin(), m_blockSums[b][j].end(), 0.0);
+      if (k < m_indices.size())
+      {
+        const uint32_t* cells = m_cells[k].data();
+        const double* f = m_factors[k].data();
+        for (size_t r = begin; r < end; ++r)
+          w[r] *= f[cells[r]];
+      }
+      for (size_t j = first; j < last; ++j)
+      {
+        const uint32_t* cells = m_cells[j].data();
+        double* s = m_blockSums[b][j].data();
+        for (size_t r = begin; r < end; ++r)
+          s[cells[r]] += w[r];
+      }
+    }
+  };
+
+  const size_t used = std::min(threads, blocks);
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < used; ++t)
+    pool.push_back(std::thread(work, t));
+  if (used)
+    work(0);
+  for (std::thread& t: pool)
+    t.join();
+
+  // combined in block order, so that the sums don't depend on the number of threads
+  for (size_t j = first; j < last; ++j)
+  {
+    std::fill(m_sums[j].begin(), m_sums[j].end(), 0.0);
+    for (size_t b = 0; b < blocks; ++b)
+      for (size_t c = 0; c < m_sums[j].size(); ++c)
+        m_sums[j][c] += m_blockSums[b][j][c];
+  }
+}
+
+size_t Raking::records() const
+{
+  return m_records;
+}
+
+const std::vector<uint32_t>& Raking::cells(size_t k) const
+{
+  return m_cells[k];
+}
+
+const NDArray<double>& Raking::weights() const
+{
+  return m_weights;
+}
+
+bool Raking::conv() const
+{
+  return m_conv;
+}
+
+size_t Raking::iters() const
+{
+  return m_iters;
+}
+
+double Raking::maxError() const
+{
+  return m_maxError;
+}
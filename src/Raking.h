@@ -0,0 +1,72 @@
+// Raking.h
+// Record-level IPF (raking), for seeds that are survey microdata rather than an array over the state space. Each
+// record has a category in every dimension and a starting weight, and the weights are scaled in turn to each marginal,
+// as IPF scales the cells of a dense seed. The cell of each marginal that each record falls in is computed once, so an
+// iteration costs O(records x marginals) whatever the size of the state space.
+//
+// The records are processed in fixed-size blocks, in parallel, and the per-block sums combined in block order, so the
+// result doesn't depend on the number of threads.
+//
+// e.g. 10^5 records of 4 dimensions:
+//   Raking raking(indices, marginals, categories /* 100000 x 4 */, weights /* 100000 */);
+//   const NDArray<double>& fitted = raking.solve(8);
+
+#pragma once
+
+#include "Microsynthesis.h"
+
+#include <vector>
+#include <cstdint>
+
+class Raking : public Microsynthesis<double>
+{
+public:
+  // categories is a (records x dimensions) array of each record's category (index) in each dimension, weights the
+  // records' starting weights. Both are copied
+  Raking(const index_list_t& indices, marginal_list_t& marginals, const NDArray<int64_t>& categories,
+         const NDArray<double>& weights);
+
+  Raking(const Raking&) = delete;
+  Raking& operator=(const Raking&) = delete;
+
+  // Fits the weights on up to the given number of threads (0 = one per hardware thread)
+  const NDArray<double>& solve(size_t threads = 0);
+
+  size_t records() const;
+
+  // the offset of each record's cell in the storage of marginal k (in whichever storage order it has)
+  const std::vector<uint32_t>& cells(size_t k) const;
+
+  const NDArray<double>& weights() const;
+
+  bool conv() const;
+  size_t iters() const;
+  // max absolute difference between the weights' sums and the marginals
+  double maxError() const;
+
+private:
+  // scales the weights by the factors for marginal k (none if k is out of range), accumulating their sums onto
+  // marginals [first, last)
+  void pass(size_t k, size_t first, size_t last, size_t threads);
+
+  size_t m_records;
+  // per marginal, the (row-major) offset of each record's cell
+  std::vector<std::vector<uint32_t>> m_cells;
+  NDArray<double> m_seed;
+  NDArray<double> m_weights;
+
+  // per marginal, the scaling factors and the sums of the weights
+  std::vector<std::vector<double>> m_factors;
+  std::vector<std::vector<double>> m_sums;
+  // per block, per marginal, the partial sums
+  std::vector<std::vector<std::vector<double>>> m_blockSums;
+
+  bool m_conv;
+  size_t m_iters;
+  double m_maxError;
+
+  // relative to the population
+  const double m_tol = 1e-10;
+  static const size_t s_MAXITER = 1000;
+  static const size_t s_BLOCK = 8192;
+};
@@ -42,21 +42,38 @@ BEGIN_RCPP
 END_RCPP
 }
 // qis
-List qis(List indices, List marginals, int skips);
-RcppExport SEXP _humanleague_qis(SEXP indicesSEXP, SEXP marginalsSEXP, SEXP skipsSEXP) {
+List qis(List indices, List marginals, int skips, bool statistics);
+RcppExport SEXP _humanleague_qis(SEXP indicesSEXP, SEXP marginalsSEXP, SEXP skipsSEXP, SEXP statisticsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< List >::type indices(indicesSEXP);
     Rcpp::traits::input_parameter< List >::type marginals(marginalsSEXP);
     Rcpp::traits::input_parameter< int >::type skips(skipsSEXP);
-    rcpp_result_gen = Rcpp::wrap(qis(indices, marginals, skips));
+    Rcpp::traits::input_parameter< bool >::type statistics(statisticsSEXP);
+    rcpp_result_gen = Rcpp::wrap(qis(indices, marginals, skips, statistics));
+    return rcpp_result_gen;
+END_RCPP
+}
+// qisReplicates
+List qisReplicates(List indices, List marginals, int replicates, int threads, int seed, bool populations);
+RcppExport SEXP _humanleague_qisReplicates(SEXP indicesSEXP, SEXP marginalsSEXP, SEXP replicatesSEXP, SEXP threadsSEXP, SEXP seedSEXP, SEXP populationsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type indices(indicesSEXP);
+    Rcpp::traits::input_parameter< List >::type marginals(marginalsSEXP);
+    Rcpp::traits::input_parameter< int >::type replicates(replicatesSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< bool >::type populations(populationsSEXP);
+    rcpp_result_gen = Rcpp::wrap(qisReplicates(indices, marginals, replicates, threads, seed, populations));
     return rcpp_result_gen;
 END_RCPP
 }
 // qisi
-List qisi(NumericVector seed, List indices, List marginals, int skips);
-RcppExport SEXP _humanleague_qisi(SEXP seedSEXP, SEXP indicesSEXP, SEXP marginalsSEXP, SEXP skipsSEXP) {
+List qisi(NumericVector seed, List indices, List marginals, int skips, bool statistics);
+RcppExport SEXP _humanleague_qisi(SEXP seedSEXP, SEXP indicesSEXP, SEXP marginalsSEXP, SEXP skipsSEXP, SEXP statisticsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -64,7 +81,8 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< List >::type indices(indicesSEXP);
     Rcpp::traits::input_parameter< List >::type marginals(marginalsSEXP);
     Rcpp::traits::input_parameter< int >::type skips(skipsSEXP);
-    rcpp_result_gen = Rcpp::wrap(qisi(seed, indices, marginals, skips));
+    Rcpp::traits::input_parameter< bool >::type statistics(statisticsSEXP);
+    rcpp_result_gen = Rcpp::wrap(qisi(seed, indices, marginals, skips, statistics));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -105,6 +123,37 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// cacheStats
+List cacheStats();
+RcppExport SEXP _humanleague_cacheStats() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(cacheStats());
+    return rcpp_result_gen;
+END_RCPP
+}
+// cacheConfig
+List cacheConfig(double maxBytes, std::string directory);
+RcppExport SEXP _humanleague_cacheConfig(SEXP maxBytesSEXP, SEXP directorySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type maxBytes(maxBytesSEXP);
+    Rcpp::traits::input_parameter< std::string >::type directory(directorySEXP);
+    rcpp_result_gen = Rcpp::wrap(cacheConfig(maxBytes, directory));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cacheClear
+void cacheClear();
+RcppExport SEXP _humanleague_cacheClear() {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    cacheClear();
+    return R_NilValue;
+END_RCPP
+}
 // unitTest
 List unitTest();
 RcppExport SEXP _humanleague_unitTest() {
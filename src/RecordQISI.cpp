@@ -0,0 +1,229 @@
+
+#include "RecordQISI.h"
+#include "NDArrayUtils.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+RecordQISI::RecordQISI(const index_list_t& indices, marginal_list_t& marginals, const NDArray<int64_t>& categories,
+                       const NDArray<double>& weights, int64_t skips)
+: Microsynthesis(indices, marginals, false), m_total(0.0), m_sobolSeq(1), m_skips(skips), m_conv(false)
+{
+  // the raking is against a (floating-point, row-major) copy of the marginals, decremented as individuals are drawn
+  m_remaining.reserve(m_marginals.size());
+  for (size_t k = 0; k < m_marginals.size(); ++k)
+  {
+    m_remaining.push_back(NDArray<double>(m_marginals[k].sizes()));
+    transposeStorage(m_marginals[k], m_remaining[k]);
+  }
+  m_raking.reset(new Raking(m_indices, m_remaining, categories, weights));
+  m_seed.assign(weights.rawData(), weights.rawData() + weights.storageSize());
+
+  PROFILE_SCOPE(m_profile, "index");
+  const size_t n = m_raking->records();
+  m_cellStart.resize(m_marginals.size());
+  m_cellRecords.resize(m_marginals.size());
+  for (size_t k = 0; k < m_marginals.size(); ++k)
+  {
+    const std::vector<uint32_t>& cells = m_raking->cells(k);
+    std::vector<uint32_t>& start = m_cellStart[k];
+    start.assign(m_marginals[k].storageSize() + 1, 0);
+    for (size_t r = 0; r < n; ++r)
+      ++start[cells[r] + 1];
+    for (size_t c = 1; c < start.size(); ++c)
+      start[c] += start[c-1];
+    std::vector<uint32_t> next(start.begin(), start.end() - 1);
+    m_cellRecords[k].resize(n);
+    for (size_t r = 0; r < n; ++r)
+      m_cellRecords[k][next[cells[r]]++] = r;
+  }
+}
+
+const std::vector<int64_t>& RecordQISI::solve(size_t threads)
+{
+  static const double scale = 0.5 / (1u<<31);
+
+  // (copied by logical index, as the marginals may be column-major)
+  for (size_t k = 0; k < m_marginals.size(); ++k)
+    transposeStorage(m_marginals[k], m_remaining[k]);
+  // each solve draws the same sequence, so is reproducible
+  m_sobolSeq.reset(m_skips);
+  m_result.clear();
+  m_result.reserve(m_population);
+  m_conv = false;
+
+  recompute(threads);
+
+  PROFILE_SCOPE(m_profile, "sampling");
+  const size_t n = m_weights.size();
+  // weight lost, since the last recompute, from records drawn beyond their expected occupancy and from filled cells
+  double deficit = 0.0;
+  auto rerake = [&]() -> bool {
+    deficit = 0.0;
+    try
+    {
+      return recompute(threads);
+    }
+    catch(const std::runtime_error&)
+    {
+      return false;
+    }
+  };
+  for (int64_t i = 0; i < m_population; ++i)
+  {
+    const double remaining = double(m_population - i);
+    // the remaining marginals can be inconsistent with the records remaining, in which case the population is incomplete
+    if ((deficit > std::max(1.0, m_drift * remaining) || m_total <= 0.0) && !rerake())
+      break;
+
+    size_t r = draw(m_sobolSeq() * scale);
+    // rounding can leave weight in the tree but none in the records
+    if (r == n && (!rerake() || (r = draw(m_sobolSeq() * scale)) == n))
+      break;
+
+    m_result.push_back(r);
+    const double d = std::min(1.0, m_weights[r]);
+    deficit += 1.0 - d;
+    m_weights[r] -= d;
+    m_total -= d;
+    for (size_t j = r + 1; j <= n; j += j & (~j + 1))
+      m_tree[j] -= d;
+
+    // no more records are drawn from filled cells
+    for (size_t k = 0; k < m_remaining.size(); ++k)
+    {
+      const uint32_t c = m_raking->cells(k)[r];
+      if (--m_remaining[k].begin()[c] <= 0.0)
+      {
+        for (uint32_t j = m_cellStart[k][c]; j < m_cellStart[k][c+1]; ++j)
+        {
+          deficit += m_weights[m_cellRecords[k][j]];
+          remove(m_cellRecords[k][j]);
+        }
+      }
+    }
+  }
+  complete();
+  PROFILE_COUNT(m_profile, "samples", m_population);
+
+  m_conv = true;
+  for (size_t k = 0; k < m_remaining.size(); ++k)
+    m_conv = m_conv && min(m_remaining[k]) == 0.0 && max(m_remaining[k]) == 0.0;
+
+  return m_result;
+}
+
+bool RecordQISI::recompute(size_t threads)
+{
+  PROFILE_SCOPE(m_profile, "rake");
+  PROFILE_COUNT(m_profile, "recomputes", 1);
+  const NDArray<double>& w = m_raking->solve(threads);
+  PROFILE_COUNT(m_profile, "rakeIterations", m_raking->iters());
+
+  const size_t n = w.storageSize();
+  m_weights.assign(w.rawData(), w.rawData() + n);
+  m_tree.assign(n + 1, 0.0);
+  m_total = 0.0;
+  for (size_t r = 0; r < n; ++r)
+  {
+    // weights can be marginally negative where the raking doesn't converge
+    m_weights[r] = std::max(0.0, m_weights[r]);
+    m_total += m_weights[r];
+    m_tree[r + 1] += m_weights[r];
+    const size_t parent = (r + 1) + ((r + 1) & (~(r + 1) + 1));
+    if (parent <= n)
+      m_tree[parent] += m_tree[r + 1];
+  }
+  return m_total > 0.0;
+}
+
+void RecordQISI::complete()
+{
+  if ((int64_t)m_result.size() == m_population)
+    return;
+  PROFILE_SCOPE(m_profile, "complete");
+  PROFILE_COUNT(m_profile, "completed", m_population - m_result.size());
+  // as QISI, the population is completed even if the marginals can't be met, with the (seed-weighted) records that fall
+  // in the most unfilled cells
+  const size_t n = m_seed.size();
+  while ((int64_t)m_result.size() < m_population)
+  {
+    size_t best = n;
+    size_t bestOpen = 0;
+    for (size_t r = 0; r < n; ++r)
+    {
+      if (m_seed[r] <= 0.0)
+        continue;
+      size_t open = 0;
+      for (size_t k = 0; k < m_remaining.size(); ++k)
+        open += m_remaining[k].rawData()[m_raking->cells(k)[r]] > 0.0;
+      if (best == n || open > bestOpen)
+      {
+        best = r;
+        bestOpen = open;
+      }
+      if (open == m_remaining.size())
+        break;
+    }
+    m_result.push_back(best);
+    for (size_t k = 0; k < m_remaining.size(); ++k)
+      --m_remaining[k].begin()[m_raking->cells(k)[best]];
+  }
+}
+
+size_t RecordQISI::draw(double u) const
+{
+  // descend the tree to the first record whose cumulative weight exceeds the variate
+  const size_t n = m_weights.size();
+  size_t top = 1;
+  while (top * 2 <= n)
+    top *= 2;
+  double target = u * m_total;
+  size_t r = 0;
+  for (size_t step = top; step; step /= 2)
+  {
+    if (r + step <= n && m_tree[r + step] <= target)
+    {
+      r += step;
+      target -= m_tree[r];
+    }
+  }
+  // rounding in the tree could land on an empty record, so take the nearest that isn't
+  r = std::min(r, n - 1);
+  for (size_t j = r; j < n; ++j)
+    if (m_weights[j] > 0.0)
+      return j;
+  for (size_t j = r; j > 0; --j)
+    if (m_weights[j-1] > 0.0)
+      return j - 1;
+  return n;
+}
+
+void RecordQISI::remove(size_t r)
+{
+  const double d = m_weights[r];
+  if (d == 0.0)
+    return;
+  m_weights[r] = 0.0;
+  m_total -= d;
+  for (size_t j = r + 1; j < m_tree.size(); j += j & (~j + 1))
+    m_tree[j] -= d;
+}
+
+size_t RecordQISI::records() const
+{
+  return m_raking->records();
+}
+
+std::vector<int64_t> RecordQISI::counts() const
+{
+  std::vector<int64_t> counts(m_raking->records(), 0);
+  for (int64_t r: m_result)
+    ++counts[r];
+  return counts;
+}
+
+bool RecordQISI::conv() const
+{
+  return m_conv;
+}
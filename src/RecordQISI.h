@@ -0,0 +1,80 @@
+// RecordQISI.h
+// Integer populations composed of the records of a microdata seed, so that attributes outside the constrained
+// dimensions are carried through. As QISI samples states from the IPF solution of the seed, this samples record ids
+// from the record weights raked (see Raking.h) to the marginals, quasirandomly and without replacement against the
+// marginals: once a cell of a marginal is filled its records are no longer drawn. The weights are raked again (to the
+// marginals remaining) only when the drawn population has drifted from them, rather than whenever a record's expected
+// occupancy is exhausted.
+//
+// Records are drawn from a Fenwick tree over their weights, so each draw is O(log records) and the result is a
+// (person -> record id) vector, rather than an array over the state space.
+//
+// e.g.
+//   RecordQISI qisi(indices, marginals, categories /* records x dims */, weights /* records */);
+//   const std::vector<int64_t>& ids = qisi.solve();
+
+#pragma once
+
+#include "Microsynthesis.h"
+#include "Raking.h"
+#include "Sobol.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class RecordQISI : public Microsynthesis<int64_t>
+{
+public:
+  // categories is a (records x dimensions) array of each record's category (index) in each dimension, weights the
+  // records' seed weights. The marginals are not modified
+  RecordQISI(const index_list_t& indices, marginal_list_t& marginals, const NDArray<int64_t>& categories,
+             const NDArray<double>& weights, int64_t skips = 0);
+
+  RecordQISI(const RecordQISI&) = delete;
+  RecordQISI& operator=(const RecordQISI&) = delete;
+
+  // Samples the population (raking on up to the given number of threads, 0 = one per hardware thread), returning the
+  // record id of each individual
+  const std::vector<int64_t>& solve(size_t threads = 0);
+
+  size_t records() const;
+
+  // the number of times each record was drawn
+  std::vector<int64_t> counts() const;
+
+  // true if the population drawn has the marginals exactly. If not (when, towards the end, no unfilled combination of
+  // cells has records left) it's completed with the records that best fit
+  bool conv() const;
+
+private:
+  // rakes the seed to the remaining marginals and rebuilds the tree, returns false if it can't be done
+  bool recompute(size_t threads);
+  // the record at the given point (in [0,1)) of the cumulative weights, or records() if none have weight
+  size_t draw(double u) const;
+  // draws the rest of the population where the remaining marginals can no longer be raked
+  void complete();
+  // removes the remaining weight of record r from the tree
+  void remove(size_t r);
+
+  std::vector<NDArray<double>> m_remaining;
+  std::unique_ptr<Raking> m_raking;
+  std::vector<double> m_seed;
+  // per marginal, the records in each cell (in CSR form)
+  std::vector<std::vector<uint32_t>> m_cellStart;
+  std::vector<std::vector<uint32_t>> m_cellRecords;
+
+  // per record, the expected occupancy remaining, and the Fenwick tree of it
+  std::vector<double> m_weights;
+  std::vector<double> m_tree;
+  double m_total;
+
+  Sobol m_sobolSeq;
+  int64_t m_skips;
+  std::vector<int64_t> m_result;
+  bool m_conv;
+
+  // the drift (in individuals, relative to the number remaining) between the weights and the marginals that triggers a
+  // recompute
+  const double m_drift = 0.01;
+};
@@ -0,0 +1,170 @@
+
+#include "Replicates.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+QISReplicates::QISReplicates(const index_list_t& indices, const marginal_list_t& marginals, size_t replicates,
+                             uint32_t seed, bool keepPopulations)
+: m_indices(indices), m_replicates(replicates), m_seed(seed), m_keepPopulations(keepPopulations)
+{
+  if (replicates < 1)
+    throw std::runtime_error("number of replicates must be at least 1");
+  m_marginals.reserve(marginals.size());
+  for (const QIS::marginal_t& m: marginals)
+  {
+    m_marginals.push_back(QIS::marginal_t());
+    QIS::marginal_t::copy(m, m_marginals.back());
+  }
+}
+
+void QISReplicates::solve(size_t threads)
+{
+  PROFILE_SCOPE(m_profile, "replicates");
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, m_replicates);
+
+  m_chiSq.assign(m_replicates, 0.0);
+  m_pValue.assign(m_replicates, 0.0);
+  m_conv.assign(m_replicates, false);
+  m_populations.clear();
+  m_populations.resize(m_keepPopulations ? m_replicates : 0);
+
+  // sums of the populations and of their squares, allocated by the first replicate to complete
+  NDArray<int64_t> sum;
+  NDArray<int64_t> sumSq;
+  std::mutex mutex;
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+
+  auto work = [&]() {
+    for (size_t r = next++; r < m_replicates; r = next++)
+    {
+      try
+      {
+        marginal_list_t marginals;
+        marginals.reserve(m_marginals.size());
+        for (const QIS::marginal_t& m: m_marginals)
+        {
+          marginals.push_back(QIS::marginal_t());
+          QIS::marginal_t::copy(m, marginals.back());
+        }
+        QIS qis(m_indices, marginals);
+        qis.scramble(m_seed, r);
+        const NDArray<int64_t>& population = qis.solve();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!sum.storageSize())
+        {
+          // the sum of squares is at most K.P^2
+          const double bound = double(m_replicates) * qis.population() * qis.population();
+          if (bound >= double(std::numeric_limits<int64_t>::max()))
+            throw std::runtime_error("population too large to accumulate the variance over " + std::to_string(m_replicates) + " replicates");
+          sum.resize(population.sizes());
+          sum.assign(0ll);
+          sumSq.resize(population.sizes());
+          sumSq.assign(0ll);
+          NDArray<double>::copy(qis.expectation(), m_expectation);
+        }
+        const int64_t* p = population.rawData();
+        int64_t* s = sum.begin();
+        int64_t* s2 = sumSq.begin();
+        for (size_t i = 0; i < population.storageSize(); ++i)
+        {
+          s[i] += p[i];
+          s2[i] += p[i] * p[i];
+        }
+        m_chiSq[r] = qis.chiSq();
+        m_pValue[r] = qis.pValue();
+        m_conv[r] = qis.conv();
+        if (m_keepPopulations)
+          NDArray<int64_t>::copy(population, m_populations[r]);
+        m_profile.merge(qis.profile());
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+          error = std::current_exception();
+        // abandon any remaining replicates
+        next = m_replicates;
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < threads; ++t)
+    pool.push_back(std::thread(work));
+  work();
+  for (std::thread& t: pool)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+
+  PROFILE_COUNT(m_profile, "replicates", m_replicates);
+
+  m_mean.resize(sum.sizes());
+  m_variance.resize(sum.sizes());
+  const double k = double(m_replicates);
+  for (size_t i = 0; i < sum.storageSize(); ++i)
+  {
+    const double s = double(sum.rawData()[i]);
+    m_mean.begin()[i] = s / k;
+    // clamp rounding error (for large counts) in the difference
+    m_variance.begin()[i] = m_replicates > 1 ? std::max(0.0, (double(sumSq.rawData()[i]) - s * s / k) / (k - 1.0)) : 0.0;
+  }
+}
+
+size_t QISReplicates::replicates() const
+{
+  return m_replicates;
+}
+
+const NDArray<double>& QISReplicates::mean() const
+{
+  return m_mean;
+}
+
+const NDArray<double>& QISReplicates::variance() const
+{
+  return m_variance;
+}
+
+const NDArray<double>& QISReplicates::expectation() const
+{
+  return m_expectation;
+}
+
+const std::vector<double>& QISReplicates::chiSq() const
+{
+  return m_chiSq;
+}
+
+const std::vector<double>& QISReplicates::pValue() const
+{
+  return m_pValue;
+}
+
+const std::vector<bool>& QISReplicates::conv() const
+{
+  return m_conv;
+}
+
+const std::vector<NDArray<int64_t>>& QISReplicates::populations() const
+{
+  return m_populations;
+}
+
+const Profile& QISReplicates::profile() const
+{
+  return m_profile;
+}
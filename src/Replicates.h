@@ -0,0 +1,72 @@
+// Replicates.h
+// Independent replicates of a QIS problem, run concurrently, for uncertainty quantification. Replicate r samples
+// with the Sobol sequence Owen-scrambled by (seed, r) (see Sobol::scramble), so each replicate is reproducible and the
+// results do not depend on the number of threads or the order in which replicates complete. Per-state means and
+// variances are accumulated exactly (in integers) as replicates complete, so individual populations need only be
+// kept if requested.
+//
+// e.g. 100 replicates on 8 threads:
+//   QISReplicates replicates(indices, marginals, 100, seed);
+//   replicates.solve(8);
+//   const NDArray<double>& sd2 = replicates.variance();
+
+#pragma once
+
+#include "QIS.h"
+
+#include <vector>
+#include <cstdint>
+
+class QISReplicates
+{
+public:
+  typedef QIS::index_list_t index_list_t;
+  typedef QIS::marginal_list_t marginal_list_t;
+
+  // The marginals are copied, each replicate consuming its own copy
+  QISReplicates(const index_list_t& indices, const marginal_list_t& marginals, size_t replicates, uint32_t seed = 0,
+                bool keepPopulations = false);
+
+  QISReplicates(const QISReplicates&) = delete;
+  QISReplicates& operator=(const QISReplicates&) = delete;
+
+  // Runs every replicate on up to the given number of threads (0 = one per hardware thread). If any replicate fails
+  // the remaining ones are abandoned and the (first) error rethrown
+  void solve(size_t threads = 0);
+
+  size_t replicates() const;
+
+  // per-state mean and (sample, i.e. K-1 denominator) variance of the populations over the replicates
+  const NDArray<double>& mean() const;
+  const NDArray<double>& variance() const;
+
+  // expected state occupancy, common to all replicates
+  const NDArray<double>& expectation() const;
+
+  // per-replicate statistics
+  const std::vector<double>& chiSq() const;
+  const std::vector<double>& pValue() const;
+  const std::vector<bool>& conv() const;
+
+  // the individual populations, if requested at construction (otherwise empty)
+  const std::vector<NDArray<int64_t>>& populations() const;
+
+  // timings and counters summed over all replicates
+  const Profile& profile() const;
+
+private:
+  index_list_t m_indices;
+  marginal_list_t m_marginals;
+  size_t m_replicates;
+  uint32_t m_seed;
+  bool m_keepPopulations;
+
+  NDArray<double> m_mean;
+  NDArray<double> m_variance;
+  NDArray<double> m_expectation;
+  std::vector<double> m_chiSq;
+  std::vector<double> m_pValue;
+  std::vector<bool> m_conv;
+  std::vector<NDArray<int64_t>> m_populations;
+  Profile m_profile;
+};
@@ -0,0 +1,487 @@
+
+#include "Simd.h"
+
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HUMANLEAGUE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// below this the dispatch costs more than vectorisation saves
+const size_t MinVectorSize = 8;
+
+double sumScalar(const double* p, size_t n)
+{
+  double s = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    s += p[i];
+  return s;
+}
+
+void addScalar(double* dst, const double* src, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    dst[i] += src[i];
+}
+
+void subtractScalar(double* d, const double* x, const double* y, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    d[i] = x[i] - y[i];
+}
+
+void scaleScalar(double* p, double factor, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    p[i] *= factor;
+}
+
+void multiplyScalar(double* p, const double* factors, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    p[i] = factors[i] != 0.0 ? p[i] * factors[i] : 0.0;
+}
+
+double chiSqScalar(const double* x, const double* y, size_t n)
+{
+  double s = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    s += (x[i] - y[i]) * (x[i] - y[i]) / y[i];
+  return s;
+}
+
+double sumScalar(const float* p, size_t n)
+{
+  double s = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    s += p[i];
+  return s;
+}
+
+void addScalar(double* dst, const float* src, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    dst[i] += src[i];
+}
+
+void scaleScalar(float* p, double factor, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    p[i] = static_cast<float>(p[i] * factor);
+}
+
+void multiplyScalar(float* p, const double* factors, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    p[i] = factors[i] != 0.0 ? static_cast<float>(p[i] * factors[i]) : 0.0f;
+}
+
+#ifdef HUMANLEAGUE_X86_SIMD
+
+// combines the lanes of the accumulator pairwise
+__attribute__((target("avx2")))
+double horizontalSum(__m256d a)
+{
+  double lanes[4];
+  _mm256_storeu_pd(lanes, a);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+__attribute__((target("avx2")))
+double sumAVX2(const double* p, size_t n)
+{
+  // two accumulators to hide the latency of the adds
+  __m256d a0 = _mm256_setzero_pd();
+  __m256d a1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    a0 = _mm256_add_pd(a0, _mm256_loadu_pd(p + i));
+    a1 = _mm256_add_pd(a1, _mm256_loadu_pd(p + i + 4));
+  }
+  for (; i + 4 <= n; i += 4)
+    a0 = _mm256_add_pd(a0, _mm256_loadu_pd(p + i));
+  double s = horizontalSum(_mm256_add_pd(a0, a1));
+  for (; i < n; ++i)
+    s += p[i];
+  return s;
+}
+
+__attribute__((target("avx2")))
+void addAVX2(double* dst, const double* src, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+  addScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void subtractAVX2(double* d, const double* x, const double* y, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(d + i, _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+  subtractScalar(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void scaleAVX2(double* p, double factor, size_t n)
+{
+  const __m256d f = _mm256_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(p + i, _mm256_mul_pd(_mm256_loadu_pd(p + i), f));
+  scaleScalar(p + i, factor, n - i);
+}
+
+__attribute__((target("avx2")))
+void multiplyAVX2(double* p, const double* factors, size_t n)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d f = _mm256_loadu_pd(factors + i);
+    // unordered, to match != for NaN
+    const __m256d nonzero = _mm256_cmp_pd(f, zero, _CMP_NEQ_UQ);
+    _mm256_storeu_pd(p + i, _mm256_and_pd(_mm256_mul_pd(_mm256_loadu_pd(p + i), f), nonzero));
+  }
+  multiplyScalar(p + i, factors + i, n - i);
+}
+
+__attribute__((target("avx2")))
+double chiSqAVX2(const double* x, const double* y, size_t n)
+{
+  __m256d a0 = _mm256_setzero_pd();
+  __m256d a1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m256d y0 = _mm256_loadu_pd(y + i);
+    const __m256d y1 = _mm256_loadu_pd(y + i + 4);
+    const __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(x + i), y0);
+    const __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(x + i + 4), y1);
+    a0 = _mm256_add_pd(a0, _mm256_div_pd(_mm256_mul_pd(d0, d0), y0));
+    a1 = _mm256_add_pd(a1, _mm256_div_pd(_mm256_mul_pd(d1, d1), y1));
+  }
+  double s = horizontalSum(_mm256_add_pd(a0, a1));
+  return s + chiSqScalar(x + i, y + i, n - i);
+}
+
+// the single precision kernels widen 4 elements at a time, so compute exactly as the scalar versions do
+
+__attribute__((target("avx2")))
+double sumAVX2(const float* p, size_t n)
+{
+  __m256d a0 = _mm256_setzero_pd();
+  __m256d a1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    a0 = _mm256_add_pd(a0, _mm256_cvtps_pd(_mm_loadu_ps(p + i)));
+    a1 = _mm256_add_pd(a1, _mm256_cvtps_pd(_mm_loadu_ps(p + i + 4)));
+  }
+  for (; i + 4 <= n; i += 4)
+    a0 = _mm256_add_pd(a0, _mm256_cvtps_pd(_mm_loadu_ps(p + i)));
+  return horizontalSum(_mm256_add_pd(a0, a1)) + sumScalar(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void addAVX2(double* dst, const float* src, size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_cvtps_pd(_mm_loadu_ps(src + i))));
+  addScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void scaleAVX2(float* p, double factor, size_t n)
+{
+  const __m256d f = _mm256_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(p + i, _mm256_cvtpd_ps(_mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(p + i)), f)));
+  scaleScalar(p + i, factor, n - i);
+}
+
+__attribute__((target("avx2")))
+void multiplyAVX2(float* p, const double* factors, size_t n)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    const __m256d f = _mm256_loadu_pd(factors + i);
+    const __m256d nonzero = _mm256_cmp_pd(f, zero, _CMP_NEQ_UQ);
+    const __m256d x = _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(p + i)), f);
+    _mm_storeu_ps(p + i, _mm256_cvtpd_ps(_mm256_and_pd(x, nonzero)));
+  }
+  multiplyScalar(p + i, factors + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+double horizontalSum(__m512d a)
+{
+  double lanes[8];
+  _mm512_storeu_pd(lanes, a);
+  return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+__attribute__((target("avx512f")))
+double sumAVX512(const double* p, size_t n)
+{
+  __m512d a0 = _mm512_setzero_pd();
+  __m512d a1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    a0 = _mm512_add_pd(a0, _mm512_loadu_pd(p + i));
+    a1 = _mm512_add_pd(a1, _mm512_loadu_pd(p + i + 8));
+  }
+  for (; i + 8 <= n; i += 8)
+    a0 = _mm512_add_pd(a0, _mm512_loadu_pd(p + i));
+  double s = horizontalSum(_mm512_add_pd(a0, a1));
+  for (; i < n; ++i)
+    s += p[i];
+  return s;
+}
+
+__attribute__((target("avx512f")))
+void addAVX512(double* dst, const double* src, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(dst + i), _mm512_loadu_pd(src + i)));
+  addScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void subtractAVX512(double* d, const double* x, const double* y, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(d + i, _mm512_sub_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i)));
+  subtractScalar(d + i, x + i, y + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void scaleAVX512(double* p, double factor, size_t n)
+{
+  const __m512d f = _mm512_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(p + i, _mm512_mul_pd(_mm512_loadu_pd(p + i), f));
+  scaleScalar(p + i, factor, n - i);
+}
+
+__attribute__((target("avx512f")))
+void multiplyAVX512(double* p, const double* factors, size_t n)
+{
+  const __m512d zero = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m512d f = _mm512_loadu_pd(factors + i);
+    const __mmask8 nonzero = _mm512_cmp_pd_mask(f, zero, _CMP_NEQ_UQ);
+    _mm512_storeu_pd(p + i, _mm512_maskz_mul_pd(nonzero, _mm512_loadu_pd(p + i), f));
+  }
+  multiplyScalar(p + i, factors + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+double chiSqAVX512(const double* x, const double* y, size_t n)
+{
+  __m512d a0 = _mm512_setzero_pd();
+  __m512d a1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    const __m512d y0 = _mm512_loadu_pd(y + i);
+    const __m512d y1 = _mm512_loadu_pd(y + i + 8);
+    const __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(x + i), y0);
+    const __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(x + i + 8), y1);
+    a0 = _mm512_add_pd(a0, _mm512_div_pd(_mm512_mul_pd(d0, d0), y0));
+    a1 = _mm512_add_pd(a1, _mm512_div_pd(_mm512_mul_pd(d1, d1), y1));
+  }
+  double s = horizontalSum(_mm512_add_pd(a0, a1));
+  return s + chiSqScalar(x + i, y + i, n - i);
+}
+
+// widens 8 floats (the unmasked conversions leave gcc warning of an uninitialised source)
+__attribute__((target("avx512f")))
+__m512d widen(const float* p)
+{
+  return _mm512_maskz_cvtps_pd(0xff, _mm256_loadu_ps(p));
+}
+
+__attribute__((target("avx512f")))
+double sumAVX512(const float* p, size_t n)
+{
+  __m512d a0 = _mm512_setzero_pd();
+  __m512d a1 = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    a0 = _mm512_add_pd(a0, widen(p + i));
+    a1 = _mm512_add_pd(a1, widen(p + i + 8));
+  }
+  for (; i + 8 <= n; i += 8)
+    a0 = _mm512_add_pd(a0, widen(p + i));
+  return horizontalSum(_mm512_add_pd(a0, a1)) + sumScalar(p + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void addAVX512(double* dst, const float* src, size_t n)
+{
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(dst + i), widen(src + i)));
+  addScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx512f")))
+void scaleAVX512(float* p, double factor, size_t n)
+{
+  const __m512d f = _mm512_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(p + i, _mm512_maskz_cvtpd_ps(0xff, _mm512_mul_pd(widen(p + i), f)));
+  scaleScalar(p + i, factor, n - i);
+}
+
+__attribute__((target("avx512f")))
+void multiplyAVX512(float* p, const double* factors, size_t n)
+{
+  const __m512d zero = _mm512_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m512d f = _mm512_loadu_pd(factors + i);
+    const __mmask8 nonzero = _mm512_cmp_pd_mask(f, zero, _CMP_NEQ_UQ);
+    _mm256_storeu_ps(p + i, _mm512_maskz_cvtpd_ps(nonzero, _mm512_mul_pd(widen(p + i), f)));
+  }
+  multiplyScalar(p + i, factors + i, n - i);
+}
+
+#endif
+
+simd::Level detect()
+{
+#ifdef HUMANLEAGUE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return simd::Level::AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return simd::Level::AVX2;
+#endif
+  return simd::Level::Scalar;
+}
+
+std::atomic<int>& current()
+{
+  static std::atomic<int> level(static_cast<int>(simd::supported()));
+  return level;
+}
+
+// the level to use for n elements
+simd::Level levelFor(size_t n)
+{
+  return n < MinVectorSize ? simd::Level::Scalar : static_cast<simd::Level>(current().load(std::memory_order_relaxed));
+}
+
+}
+
+simd::Level simd::supported()
+{
+  static const Level level = detect();
+  return level;
+}
+
+simd::Level simd::level()
+{
+  return static_cast<Level>(current().load());
+}
+
+simd::Level simd::setLevel(Level level)
+{
+  if (static_cast<int>(level) > static_cast<int>(supported()))
+    level = supported();
+  return static_cast<Level>(current().exchange(static_cast<int>(level)));
+}
+
+const char* simd::name(Level level)
+{
+  switch (level)
+  {
+  case Level::AVX2: return "avx2";
+  case Level::AVX512: return "avx512";
+  default: return "scalar";
+  }
+}
+
+#ifdef HUMANLEAGUE_X86_SIMD
+#define DISPATCH(f, ...) \
+  switch (levelFor(n)) \
+  { \
+  case Level::AVX512: return f##AVX512(__VA_ARGS__); \
+  case Level::AVX2: return f##AVX2(__VA_ARGS__); \
+  default: return f##Scalar(__VA_ARGS__); \
+  }
+#else
+#define DISPATCH(f, ...) return f##Scalar(__VA_ARGS__);
+#endif
+
+double simd::sum(const double* p, size_t n)
+{
+  DISPATCH(sum, p, n)
+}
+
+void simd::add(double* dst, const double* src, size_t n)
+{
+  DISPATCH(add, dst, src, n)
+}
+
+void simd::subtract(double* d, const double* x, const double* y, size_t n)
+{
+  DISPATCH(subtract, d, x, y, n)
+}
+
+void simd::scale(double* p, double factor, size_t n)
+{
+  DISPATCH(scale, p, factor, n)
+}
+
+void simd::multiply(double* p, const double* factors, size_t n)
+{
+  DISPATCH(multiply, p, factors, n)
+}
+
+double simd::chiSq(const double* x, const double* y, size_t n)
+{
+  DISPATCH(chiSq, x, y, n)
+}
+
+double simd::sum(const float* p, size_t n)
+{
+  DISPATCH(sum, p, n)
+}
+
+void simd::add(double* dst, const float* src, size_t n)
+{
+  DISPATCH(add, dst, src, n)
+}
+
+void simd::scale(float* p, double factor, size_t n)
+{
+  DISPATCH(scale, p, factor, n)
+}
+
+void simd::multiply(float* p, const double* factors, size_t n)
+{
+  DISPATCH(multiply, p, factors, n)
+}
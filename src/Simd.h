@@ -0,0 +1,96 @@
+// Simd.h
+// Kernels over contiguous runs of elements, used by reduce, sum, diff, chiSq and the IPF scaling pass. Double
+// precision kernels, and the single precision ones used by IPF's float working array (which compute, and accumulate
+// into, double precision), are vectorised with AVX2 or AVX-512 where the CPU supports them (selected at runtime, so the
+// package need not be compiled for a particular instruction set), otherwise they fall back to scalar loops. Other
+// element types use the generic (scalar) versions.
+//
+// Tolerances: the elementwise kernels (add, subtract, scale, multiply) give results identical to the scalar loops.
+// The reductions (sum, chiSq) accumulate in several lanes that are combined at the end, so results can differ from
+// left-to-right summation by rounding, with the same bound: a relative error of at most n.eps in the sum of
+// magnitudes (exact for integer values below 2^53).
+
+#pragma once
+
+#include <numeric>
+#include <cstddef>
+
+namespace simd {
+
+enum class Level { Scalar, AVX2, AVX512 };
+
+// the best level supported by this CPU (and compiler)
+Level supported();
+
+// the level in use (by default the best supported), global to the process
+Level level();
+
+// Selects a level (if higher than supported, the best supported) and returns the previous one. Mainly for testing
+Level setLevel(Level level);
+
+const char* name(Level level);
+
+// sum of p[0..n)
+double sum(const double* p, size_t n);
+
+// dst[i] += src[i]
+void add(double* dst, const double* src, size_t n);
+
+// d[i] = x[i] - y[i]
+void subtract(double* d, const double* x, const double* y, size_t n);
+
+// p[i] *= factor
+void scale(double* p, double factor, size_t n);
+
+// p[i] *= factors[i], or 0 where the factor is 0 (regardless of p[i])
+void multiply(double* p, const double* factors, size_t n);
+
+// sum of (x[i] - y[i])^2 / y[i]
+double chiSq(const double* x, const double* y, size_t n);
+
+// single precision elements, computed in double precision
+
+// sum of p[0..n), accumulated in double precision
+double sum(const float* p, size_t n);
+
+// dst[i] += src[i], e.g. accumulating a reduction
+void add(double* dst, const float* src, size_t n);
+
+// p[i] *= factor
+void scale(float* p, double factor, size_t n);
+
+// p[i] *= factors[i], or 0 where the factor is 0
+void multiply(float* p, const double* factors, size_t n);
+
+// generic versions, for other element types
+
+template<typename T>
+T sum(const T* p, size_t n)
+{
+  return std::accumulate(p, p + n, T(0));
+}
+
+template<typename T, typename U>
+void add(T* dst, const U* src, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    dst[i] += src[i];
+}
+
+template<typename T, typename U>
+void subtract(double* d, const T* x, const U* y, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    d[i] = x[i] - y[i];
+}
+
+template<typename T, typename U>
+double chiSq(const T* x, const U* y, size_t n)
+{
+  double chisq = 0.0;
+  for (size_t i = 0; i < n; ++i)
+    chisq += (x[i] - y[i]) * (x[i] - y[i]) / y[i];
+  return chisq;
+}
+
+}
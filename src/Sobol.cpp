@@ -8,6 +8,43 @@
 
 #include <iostream>
 
+namespace {
+
+uint32_t reverseBits(uint32_t x)
+{
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+// integer hash with good avalanche (lowbias32)
+uint32_t hash(uint32_t x)
+{
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// Owen scrambling via a hash that only propagates from lower to higher bits of the bit-reversed value, so that each
+// bit is permuted depending only on the bits above it (Burley, "Practical Hash-based Owen Scrambling", 2020)
+uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+  x = reverseBits(x);
+  x += seed;
+  x ^= x * 0x6c50b47cu;
+  x ^= x * 0xb82f1e52u;
+  x ^= x * 0xc7afe638u;
+  x ^= x * 0x8d22f6e6u;
+  return reverseBits(x);
+}
+
+}
+
 Sobol::Sobol(uint32_t dim, uint32_t nSkip) : m_dim(dim), m_buf(dim), m_pos(dim) // ensures m_buf gets populated on 1st access
 {
   m_s = nlopt_sobol_create(dim);
@@ -25,6 +62,8 @@ const std::vector<uint32_t>& Sobol::buf()
   // TODO assert m_pos != m_dim|0 ? (i.e some of seq already used)
   if (!nlopt_sobol_next(m_s, &m_buf[0]))
     throw std::runtime_error("Exceeded generation limit (2^32-1)");
+  for (size_t d = 0; d < m_scramble.size(); ++d)
+    m_buf[d] = owenScramble(m_buf[d], m_scramble[d]);
   return m_buf;
 }
 
@@ -32,8 +71,7 @@ uint32_t Sobol::operator()()
 {
   if (m_pos == m_dim)
   {
-    if (!nlopt_sobol_next(m_s, &m_buf[0]))
-      throw std::runtime_error("Exceeded generation limit (2^32-1)");
+    buf();
     m_pos = 0;
   }
   return m_buf[m_pos++];
@@ -65,6 +103,14 @@ void Sobol::reset(uint32_t nSkip)
     skip(nSkip);
 }
 
+void Sobol::scramble(uint32_t seed, uint32_t stream)
+{
+  m_scramble.resize(m_dim);
+  const uint32_t s = hash(hash(seed) + stream);
+  for (uint32_t d = 0; d < m_dim; ++d)
+    m_scramble[d] = hash(s + d);
+}
+
 uint32_t Sobol::min() const
 {
   return 0;
@@ -34,6 +34,11 @@ public:
 
   void reset(uint32_t nSkip = 0u);
 
+  // Applies a nested uniform (Owen) scrambling to every dimension, derived from seed and stream. Scrambled sequences
+  // keep the low-discrepancy properties of the original, and different (seed, stream) pairs give independent
+  // randomisations, e.g. for replicates. Persists across reset()
+  void scramble(uint32_t seed, uint32_t stream = 0u);
+
   result_type min() const;
 
   result_type max() const;
@@ -44,4 +49,6 @@ private:
   uint32_t m_dim;
   std::vector<result_type> m_buf;
   uint32_t m_pos;
+  // per-dimension scrambling seeds, empty if unscrambled
+  std::vector<uint32_t> m_scramble;
 };
@@ -0,0 +1,790 @@
+
+#include "SolutionCache.h"
+#include "NDArrayUtils.h"
+#include "IPF.h"
+#include "QIS.h"
+#include "QISI.h"
+#include "TRS.h"
+#include "Global.h"
+
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <atomic>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+namespace {
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// murmur3 finaliser
+inline uint64_t fmix(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+const char FileMagic[8] = { 'H', 'L', 'C', '1', 0, 0, 0, 0 };
+
+// Version of the file format and of the solvers' results, in the file header and every key. Bump it whenever either
+// changes, so that entries on disk from older versions are never returned
+const uint64_t CacheVersion = 2;
+
+// a temporary name for a file being written, unique even among processes (e.g. forked workers) sharing a directory
+std::string temporaryName(const std::string& filename)
+{
+  static std::atomic<uint64_t> count(0);
+#ifdef _WIN32
+  const int pid = _getpid();
+#else
+  const pid_t pid = ::getpid();
+#endif
+  return filename + ".tmp" + std::to_string(pid) + "." + std::to_string(count++);
+}
+
+// 8-byte aligned sequential file writer/reader
+class Writer
+{
+public:
+  explicit Writer(const std::string& filename) : m_file(filename, std::ios::binary)
+  {
+    if (!m_file)
+      throw std::runtime_error("cannot write to cache file " + filename);
+  }
+
+  void write(const void* p, size_t n)
+  {
+    m_file.write(static_cast<const char*>(p), n);
+    static const char pad[8] = {0};
+    if (n % 8)
+      m_file.write(pad, 8 - n % 8);
+  }
+
+  void write(uint64_t x) { write(&x, sizeof(x)); }
+  void write(double x) { write(&x, sizeof(x)); }
+
+  void write(const std::string& s)
+  {
+    write(static_cast<uint64_t>(s.size()));
+    write(s.data(), s.size());
+  }
+
+  template<typename T>
+  void write(const NDArray<T>& a)
+  {
+    write(static_cast<uint64_t>(a.dim()));
+    write(a.sizes().data(), a.dim() * sizeof(int64_t));
+    write(a.rawData(), a.storageSize() * sizeof(T));
+  }
+
+  void close()
+  {
+    m_file.close();
+    if (!m_file)
+      throw std::runtime_error("error writing cache file");
+  }
+
+private:
+  std::ofstream m_file;
+};
+
+class Reader
+{
+public:
+  Reader(const char* begin, size_t size) : m_p(begin), m_end(begin + size) { }
+
+  const char* read(size_t n)
+  {
+    const size_t padded = (n + 7) & ~size_t(7);
+    if (padded > size_t(m_end - m_p))
+      throw std::runtime_error("cache file truncated");
+    const char* p = m_p;
+    m_p += padded;
+    return p;
+  }
+
+  uint64_t readUInt()
+  {
+    uint64_t x;
+    std::memcpy(&x, read(sizeof(x)), sizeof(x));
+    return x;
+  }
+
+  double readDouble()
+  {
+    double x;
+    std::memcpy(&x, read(sizeof(x)), sizeof(x));
+    return x;
+  }
+
+  std::string readString()
+  {
+    const size_t n = readUInt();
+    return std::string(read(n), n);
+  }
+
+  // non-owning array referring to the mapped data
+  template<typename T>
+  NDArray<T> readArray()
+  {
+    const size_t dim = readUInt();
+    if (dim == 0 || dim > 64)
+      throw std::runtime_error("invalid array dimension in cache file");
+    const int64_t* s = reinterpret_cast<const int64_t*>(read(dim * sizeof(int64_t)));
+    std::vector<int64_t> sizes(s, s + dim);
+    size_t n = 1;
+    for (int64_t x: sizes)
+    {
+      if (x < 1 || x >= NDArray<T>::MaxSize)
+        throw std::runtime_error("invalid array size in cache file");
+      n *= x;
+      if (n * sizeof(T) > size_t(m_end - m_p))
+        throw std::runtime_error("cache file truncated");
+    }
+    T* data = reinterpret_cast<T*>(const_cast<char*>(read(n * sizeof(T))));
+    return NDArray<T>(sizes, data);
+  }
+
+private:
+  const char* m_p;
+  const char* m_end;
+};
+
+// row-major copy
+template<typename T>
+NDArray<T> copyRowMajor(const NDArray<T>& a)
+{
+  NDArray<T> copy(a.sizes());
+  transposeStorage(a, copy);
+  return copy;
+}
+
+// approximate memory footprint of a named entry
+size_t entryBytes(const std::string& name, double)
+{
+  return sizeof(double) + name.size();
+}
+
+template<typename T>
+size_t entryBytes(const std::string& name, const NDArray<T>& a)
+{
+  return a.storageSize() * sizeof(T) + name.size();
+}
+
+// remove any existing entry of the given name, returning its footprint
+template<typename T>
+size_t erase(std::map<std::string, T>& entries, const std::string& name)
+{
+  auto it = entries.find(name);
+  if (it == entries.end())
+    return 0;
+  size_t bytes = entryBytes(name, it->second);
+  entries.erase(it);
+  return bytes;
+}
+
+template<typename M>
+void addProblem(Hasher& hasher, const std::string& solver, const std::vector<std::vector<int64_t>>& indices,
+                const std::vector<NDArray<M>>& marginals)
+{
+  hasher.add(CacheVersion);
+  hasher.add(solver);
+  hasher.add(indices);
+  hasher.add(static_cast<uint64_t>(marginals.size()));
+  for (const NDArray<M>& m: marginals)
+    hasher.add(m);
+}
+
+// Solutions without statistics are a distinct entry; omitting the flag when set keeps existing keys unchanged
+void addStatistics(Hasher& hasher, bool statistics)
+{
+  if (!statistics)
+    hasher.add(std::string("nostats"));
+}
+
+// likewise an empty mask
+void addMask(Hasher& hasher, const Mask& mask)
+{
+  if (!mask.empty())
+  {
+    hasher.add(std::string("mask"));
+    hasher.add(mask.sizes());
+    hasher.add(mask.bits());
+  }
+}
+
+// IPF in a population of type T
+template<typename T>
+void solveIPF(const std::vector<std::vector<int64_t>>& indices, std::vector<NDArray<double>>& marginals,
+              const NDArray<double>& seed, Solution& solution)
+{
+  IPF<double, T> ipf(indices, marginals);
+  solution.set("result", ipf.solve(seed));
+  solution.set("conv", ipf.conv());
+  solution.set("pop", ipf.population());
+  solution.set("iterations", ipf.iters());
+  solution.set("maxError", ipf.maxError());
+  solution.setProfile(ipf.profile());
+}
+
+}
+
+std::string Hasher::Key::str() const
+{
+  char buf[33];
+  std::snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+  return buf;
+}
+
+Hasher::Hasher() : m_h1(0x9e3779b97f4a7c15ull), m_h2(0x6a09e667f3bcc909ull), m_length(0)
+{
+}
+
+void Hasher::add(uint64_t word)
+{
+  m_h1 ^= fmix(word + 0x87c37b91114253d5ull);
+  m_h1 = rotl(m_h1, 27) * 0x4cf5ad432745937full + 0x52dce729ull;
+  m_h2 ^= fmix(word ^ 0x38495ab5ull);
+  m_h2 = rotl(m_h2, 31) * 0x87c37b91114253d5ull + 0x5b7e8a9full;
+  ++m_length;
+}
+
+void Hasher::add(double x)
+{
+  if (x == 0.0)
+    x = 0.0;
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  add(bits);
+}
+
+void Hasher::add(const std::string& s)
+{
+  add(static_cast<uint64_t>(s.size()));
+  for (size_t i = 0; i < s.size(); i += 8)
+  {
+    uint64_t word = 0;
+    std::memcpy(&word, s.data() + i, std::min<size_t>(8, s.size() - i));
+    add(word);
+  }
+}
+
+Hasher::Key Hasher::key() const
+{
+  uint64_t h1 = m_h1 ^ m_length;
+  uint64_t h2 = m_h2 ^ m_length;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix(h1);
+  h2 = fmix(h2);
+  h1 += h2;
+  h2 += h1;
+  return Key{h1, h2};
+}
+
+void Solution::set(const std::string& name, double value)
+{
+  m_bytes -= erase(m_scalars, name);
+  m_scalars[name] = value;
+  m_bytes += entryBytes(name, value);
+}
+
+void Solution::set(const std::string& name, const NDArray<int64_t>& a)
+{
+  m_bytes -= erase(m_intArrays, name);
+  m_intArrays.insert(std::make_pair(name, copyRowMajor(a)));
+  m_bytes += entryBytes(name, a);
+}
+
+void Solution::set(const std::string& name, const NDArray<double>& a)
+{
+  m_bytes -= erase(m_realArrays, name);
+  m_realArrays.insert(std::make_pair(name, copyRowMajor(a)));
+  m_bytes += entryBytes(name, a);
+}
+
+void Solution::set(const std::string& name, const NDArray<float>& a)
+{
+  NDArray<double> widened(a.sizes());
+  transposeStorage(a, widened);
+  m_bytes -= erase(m_realArrays, name);
+  m_bytes += entryBytes(name, widened);
+  m_realArrays.insert(std::make_pair(name, std::move(widened)));
+}
+
+double Solution::scalar(const std::string& name) const
+{
+  auto it = m_scalars.find(name);
+  if (it == m_scalars.end())
+    throw std::runtime_error("solution has no value " + name);
+  return it->second;
+}
+
+const NDArray<int64_t>& Solution::intArray(const std::string& name) const
+{
+  auto it = m_intArrays.find(name);
+  if (it == m_intArrays.end())
+    throw std::runtime_error("solution has no integer array " + name);
+  return it->second;
+}
+
+const NDArray<double>& Solution::realArray(const std::string& name) const
+{
+  auto it = m_realArrays.find(name);
+  if (it == m_realArrays.end())
+    throw std::runtime_error("solution has no real array " + name);
+  return it->second;
+}
+
+void Solution::save(const std::string& filename) const
+{
+  Writer w(filename);
+  w.write(FileMagic, sizeof(FileMagic));
+  w.write(CacheVersion);
+  w.write(static_cast<uint64_t>(m_scalars.size()));
+  w.write(static_cast<uint64_t>(m_intArrays.size()));
+  w.write(static_cast<uint64_t>(m_realArrays.size()));
+  for (const auto& kv: m_scalars)
+  {
+    w.write(kv.first);
+    w.write(kv.second);
+  }
+  for (const auto& kv: m_intArrays)
+  {
+    w.write(kv.first);
+    w.write(kv.second);
+  }
+  for (const auto& kv: m_realArrays)
+  {
+    w.write(kv.first);
+    w.write(kv.second);
+  }
+  w.close();
+}
+
+std::shared_ptr<const Solution> Solution::load(const std::string& filename)
+{
+#ifdef _WIN32
+  throw std::runtime_error("disk cache is not supported on this platform");
+#else
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return std::shared_ptr<const Solution>();
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(FileMagic))
+  {
+    ::close(fd);
+    return std::shared_ptr<const Solution>();
+  }
+  const size_t size = st.st_size;
+  void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return std::shared_ptr<const Solution>();
+
+  std::shared_ptr<Solution> solution(new Solution);
+  solution->m_storage = std::shared_ptr<void>(p, [size](void* p) { ::munmap(p, size); });
+
+  Reader r(static_cast<const char*>(p), size);
+  if (std::memcmp(r.read(sizeof(FileMagic)), FileMagic, sizeof(FileMagic)))
+    throw std::runtime_error("invalid cache file " + filename);
+  if (r.readUInt() != CacheVersion)
+    return std::shared_ptr<const Solution>();
+  const size_t nScalars = r.readUInt();
+  const size_t nInts = r.readUInt();
+  const size_t nReals = r.readUInt();
+  for (size_t i = 0; i < nScalars; ++i)
+  {
+    const std::string& name = r.readString();
+    solution->m_scalars[name] = r.readDouble();
+  }
+  for (size_t i = 0; i < nInts; ++i)
+  {
+    const std::string& name = r.readString();
+    solution->m_intArrays.insert(std::make_pair(name, r.readArray<int64_t>()));
+  }
+  for (size_t i = 0; i < nReals; ++i)
+  {
+    const std::string& name = r.readString();
+    solution->m_realArrays.insert(std::make_pair(name, r.readArray<double>()));
+  }
+  solution->m_bytes = size;
+  return solution;
+#endif
+}
+
+SolutionCache::SolutionCache() : m_maxBytes(0), m_bytes(0), m_hits(0), m_diskHits(0), m_misses(0)
+{
+}
+
+void SolutionCache::configure(size_t maxBytes, const std::string& directory)
+{
+#ifdef _WIN32
+  if (!directory.empty())
+    throw std::runtime_error("disk cache is not supported on this platform");
+#else
+  if (!directory.empty())
+  {
+    struct stat st;
+    if (::stat(directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+      throw std::runtime_error("cache directory " + directory + " does not exist");
+  }
+#endif
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_maxBytes = maxBytes;
+  m_directory = directory;
+  evict();
+}
+
+bool SolutionCache::enabled() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_maxBytes > 0 || !m_directory.empty();
+}
+
+std::shared_ptr<const Solution> SolutionCache::find(const Hasher::Key& key)
+{
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_lookup.find(key);
+    if (it != m_lookup.end())
+    {
+      // move to front
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      ++m_hits;
+      return it->second->second;
+    }
+    directory = m_directory;
+  }
+
+  if (!directory.empty())
+  {
+    std::shared_ptr<const Solution> solution;
+    try
+    {
+      solution = Solution::load(filename(key));
+    }
+    catch(const std::exception&)
+    {
+      // treat a corrupt file as a miss, it will be overwritten
+    }
+    if (solution)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_diskHits;
+      insertMemory(key, solution);
+      return solution;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  ++m_misses;
+  return std::shared_ptr<const Solution>();
+}
+
+void SolutionCache::insert(const Hasher::Key& key, const std::shared_ptr<const Solution>& solution)
+{
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    insertMemory(key, solution);
+    directory = m_directory;
+  }
+
+  if (!directory.empty())
+  {
+    // write to a temporary then rename so that concurrent readers never see a partial file
+    // failure to write (e.g. disk full) is not an error, the solution just isn't cached on disk
+    const std::string& final = filename(key);
+    const std::string& tmp = temporaryName(final);
+    try
+    {
+      solution->save(tmp);
+      if (std::rename(tmp.c_str(), final.c_str()) != 0)
+        std::remove(tmp.c_str());
+    }
+    catch(const std::exception&)
+    {
+      std::remove(tmp.c_str());
+    }
+  }
+}
+
+void SolutionCache::clear()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_lru.clear();
+  m_lookup.clear();
+  m_bytes = 0;
+  m_hits = m_diskHits = m_misses = 0;
+}
+
+SolutionCache::Stats SolutionCache::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return Stats{m_hits, m_diskHits, m_misses, m_lru.size(), m_bytes};
+}
+
+// caller must hold the lock
+void SolutionCache::insertMemory(const Hasher::Key& key, const std::shared_ptr<const Solution>& solution)
+{
+  if (solution->bytes() > m_maxBytes)
+    return;
+  auto it = m_lookup.find(key);
+  if (it != m_lookup.end())
+  {
+    m_bytes -= it->second->second->bytes();
+    m_lru.erase(it->second);
+  }
+  m_lru.push_front(std::make_pair(key, solution));
+  m_lookup[key] = m_lru.begin();
+  m_bytes += solution->bytes();
+  evict();
+}
+
+// caller must hold the lock
+void SolutionCache::evict()
+{
+  while (m_bytes > m_maxBytes && !m_lru.empty())
+  {
+    m_bytes -= m_lru.back().second->bytes();
+    m_lookup.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+}
+
+std::string SolutionCache::filename(const Hasher::Key& key) const
+{
+  return m_directory + "/" + key.str() + ".hlc";
+}
+
+std::shared_ptr<const Solution> cached::ipf(const std::vector<std::vector<int64_t>>& indices,
+                                            std::vector<NDArray<double>>& marginals,
+                                            const NDArray<double>& seed,
+                                            bool single)
+{
+  SolutionCache& cache = Global::instance<SolutionCache>();
+  const bool enabled = cache.enabled();
+
+  Hasher::Key key{0, 0};
+  if (enabled)
+  {
+    Hasher hasher;
+    addProblem(hasher, "ipf", indices, marginals);
+    hasher.add(seed);
+    // omitted for double precision, keeping existing keys unchanged
+    if (single)
+      hasher.add(std::string("single"));
+    key = hasher.key();
+    std::shared_ptr<const Solution> hit = cache.find(key);
+    if (hit)
+      return hit;
+  }
+
+  std::shared_ptr<Solution> solution(new Solution);
+  if (single)
+    solveIPF<float>(indices, marginals, seed, *solution);
+  else
+    solveIPF<double>(indices, marginals, seed, *solution);
+
+  if (enabled)
+    cache.insert(key, solution);
+  return solution;
+}
+
+std::shared_ptr<const Solution> cached::qis(const std::vector<std::vector<int64_t>>& indices,
+                                            std::vector<NDArray<int64_t>>& marginals,
+                                            int64_t skips,
+                                            bool statistics,
+                                            const Mask& mask)
+{
+  SolutionCache& cache = Global::instance<SolutionCache>();
+  const bool enabled = cache.enabled();
+
+  // the key must be computed before solving, which modifies the marginals
+  Hasher::Key key{0, 0};
+  if (enabled)
+  {
+    Hasher hasher;
+    addProblem(hasher, "qis", indices, marginals);
+    hasher.add(skips);
+    addStatistics(hasher, statistics);
+    addMask(hasher, mask);
+    key = hasher.key();
+    std::shared_ptr<const Solution> hit = cache.find(key);
+    if (hit)
+      return hit;
+  }
+
+  QIS qis(indices, marginals, skips, false, mask);
+  std::shared_ptr<Solution> solution(new Solution);
+  solution->set("result", qis.solve());
+  solution->set("expectation", qis.expectation());
+  solution->set("conv", qis.conv());
+  solution->set("pop", qis.population());
+  if (statistics)
+  {
+    solution->set("chiSq", qis.chiSq());
+    solution->set("pValue", qis.pValue());
+    solution->set("degeneracy", qis.degeneracy());
+  }
+  solution->setProfile(qis.profile());
+
+  if (enabled)
+    cache.insert(key, solution);
+  return solution;
+}
+
+std::shared_ptr<const Solution> cached::qisSparse(const std::vector<std::vector<int64_t>>& indices,
+                                                  std::vector<NDArray<int64_t>>& marginals,
+                                                  int64_t skips,
+                                                  bool statistics)
+{
+  SolutionCache& cache = Global::instance<SolutionCache>();
+  const bool enabled = cache.enabled();
+
+  Hasher::Key key{0, 0};
+  if (enabled)
+  {
+    Hasher hasher;
+    addProblem(hasher, "qisSparse", indices, marginals);
+    hasher.add(skips);
+    addStatistics(hasher, statistics);
+    key = hasher.key();
+    std::shared_ptr<const Solution> hit = cache.find(key);
+    if (hit)
+      return hit;
+  }
+
+  QIS qis(indices, marginals, skips, true);
+  std::shared_ptr<Solution> solution(new Solution);
+  NDArray<int64_t> coords;
+  NDArray<int64_t> counts;
+  qis.solveSparse().coordinates(coords, counts);
+  solution->set("coords", coords);
+  solution->set("counts", counts);
+  // in the same order as the counts
+  NDArray<double> expectation({(int64_t)counts.storageSize()});
+  for (int64_t i = 0; i < (int64_t)counts.storageSize(); ++i)
+    expectation.begin()[i] = qis.sparseExpectation()[std::vector<int64_t>(coords.rawData() + i * coords.size(1),
+                                                                          coords.rawData() + (i + 1) * coords.size(1))];
+  solution->set("expectation", expectation);
+  const std::vector<int64_t>& sizes = qis.sizes();
+  NDArray<int64_t> shape({(int64_t)sizes.size()});
+  std::copy(sizes.begin(), sizes.end(), shape.begin());
+  solution->set("shape", shape);
+  solution->set("conv", qis.conv());
+  solution->set("pop", qis.population());
+  if (statistics)
+  {
+    solution->set("chiSq", qis.chiSq());
+    solution->set("pValue", qis.pValue());
+    solution->set("degeneracy", qis.degeneracy());
+  }
+  solution->setProfile(qis.profile());
+
+  if (enabled)
+    cache.insert(key, solution);
+  return solution;
+}
+
+std::shared_ptr<const Solution> cached::qisi(const std::vector<std::vector<int64_t>>& indices,
+                                             std::vector<NDArray<int64_t>>& marginals,
+                                             const NDArray<double>& seed,
+                                             int64_t skips,
+                                             bool statistics,
+                                             const Mask& mask)
+{
+  SolutionCache& cache = Global::instance<SolutionCache>();
+  const bool enabled = cache.enabled();
+
+  Hasher::Key key{0, 0};
+  if (enabled)
+  {
+    Hasher hasher;
+    addProblem(hasher, "qisi", indices, marginals);
+    hasher.add(seed);
+    hasher.add(skips);
+    addStatistics(hasher, statistics);
+    addMask(hasher, mask);
+    key = hasher.key();
+    std::shared_ptr<const Solution> hit = cache.find(key);
+    if (hit)
+      return hit;
+  }
+
+  QISI qisi(indices, marginals, skips, mask);
+  std::shared_ptr<Solution> solution(new Solution);
+  solution->set("result", qisi.solve(seed));
+  solution->set("ipf", qisi.expectation());
+  solution->set("conv", qisi.conv());
+  solution->set("pop", qisi.population());
+  if (statistics)
+  {
+    solution->set("chiSq", qisi.chiSq());
+    solution->set("pValue", qisi.pValue());
+    solution->set("degeneracy", qisi.degeneracy());
+  }
+  solution->setProfile(qisi.profile());
+
+  if (enabled)
+    cache.insert(key, solution);
+  return solution;
+}
+
+std::shared_ptr<const Solution> cached::trs(const std::vector<std::vector<int64_t>>& indices,
+                                            std::vector<NDArray<int64_t>>& marginals,
+                                            const NDArray<double>& seed,
+                                            bool statistics)
+{
+  SolutionCache& cache = Global::instance<SolutionCache>();
+  const bool enabled = cache.enabled();
+
+  Hasher::Key key{0, 0};
+  if (enabled)
+  {
+    Hasher hasher;
+    addProblem(hasher, "trs", indices, marginals);
+    hasher.add(seed);
+    addStatistics(hasher, statistics);
+    key = hasher.key();
+    std::shared_ptr<const Solution> hit = cache.find(key);
+    if (hit)
+      return hit;
+  }
+
+  TRS trs(indices, marginals);
+  std::shared_ptr<Solution> solution(new Solution);
+  solution->set("result", trs.solve(seed));
+  solution->set("ipf", trs.expectation());
+  solution->set("conv", trs.conv());
+  solution->set("pop", trs.population());
+  if (statistics)
+  {
+    solution->set("chiSq", trs.chiSq());
+    solution->set("pValue", trs.pValue());
+    solution->set("degeneracy", trs.degeneracy());
+  }
+  solution->setProfile(trs.profile());
+
+  if (enabled)
+    cache.insert(key, solution);
+  return solution;
+}
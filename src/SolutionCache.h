@@ -0,0 +1,217 @@
+// SolutionCache.h
+// Content-addressed cache of microsynthesis solutions. Problems are keyed by a 128-bit hash of their canonical form
+// (solver, indices, marginal and seed values in logical order, skips) so that resubmitting an identical problem
+// returns the stored solution without running the solver.
+// There are two tiers: an in-memory LRU (limited by total array size) and an optional directory of solution files,
+// which are memory-mapped when read. The disk tier is not available on Windows.
+// The cache is disabled by default, enable it with configure()
+
+#pragma once
+
+#include "NDArray.h"
+#include "Index.h"
+#include "Profile.h"
+#include "Mask.h"
+
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Not cryptographic: collisions are possible in principle (~2^-64 for 2^32 entries) but are not a practical concern
+class Hasher
+{
+public:
+
+  struct Key
+  {
+    uint64_t h1;
+    uint64_t h2;
+
+    bool operator<(const Key& rhs) const { return h1 < rhs.h1 || (h1 == rhs.h1 && h2 < rhs.h2); }
+    bool operator==(const Key& rhs) const { return h1 == rhs.h1 && h2 == rhs.h2; }
+
+    std::string str() const;
+  };
+
+  Hasher();
+
+  void add(uint64_t word);
+  void add(int64_t x) { add(static_cast<uint64_t>(x)); }
+  // +0 and -0 hash the same
+  void add(double x);
+  void add(const std::string& s);
+
+  template<typename T>
+  void add(const std::vector<T>& v)
+  {
+    add(static_cast<uint64_t>(v.size()));
+    for (const T& x: v)
+      add(x);
+  }
+
+  // hashes the sizes and the values in logical (row-major) order, so is independent of storage order
+  template<typename T>
+  void add(const NDArray<T>& a)
+  {
+    add(a.sizes());
+    if (a.storageOrder() == StorageOrder::RowMajor)
+    {
+      for (const T* p = a.rawData(); p != a.rawData() + a.storageSize(); ++p)
+        add(*p);
+    }
+    else
+    {
+      for (Index i(a.sizes()); !i.end(); ++i)
+        add(a[i]);
+    }
+  }
+
+  Key key() const;
+
+private:
+  uint64_t m_h1;
+  uint64_t m_h2;
+  uint64_t m_length;
+};
+
+// Named scalars and (row-major) arrays produced by a solver
+class Solution
+{
+public:
+  Solution() : m_bytes(0) { }
+
+  Solution(const Solution&) = delete;
+  Solution& operator=(const Solution&) = delete;
+
+  void set(const std::string& name, double value);
+  // arrays are copied
+  void set(const std::string& name, const NDArray<int64_t>& a);
+  void set(const std::string& name, const NDArray<double>& a);
+  // stored (widened) as real
+  void set(const std::string& name, const NDArray<float>& a);
+
+  // throw if not present
+  double scalar(const std::string& name) const;
+  const NDArray<int64_t>& intArray(const std::string& name) const;
+  const NDArray<double>& realArray(const std::string& name) const;
+
+  // approximate memory footprint
+  size_t bytes() const { return m_bytes; }
+
+  // profile of the solve that produced the solution (cache hits return the original profile, it is not stored on disk)
+  void setProfile(const Profile& profile) { m_profile = profile; }
+  const Profile& profile() const { return m_profile; }
+
+  // file (de)serialisation. Loaded arrays refer directly to the (read-only) mapped file
+  void save(const std::string& filename) const;
+  static std::shared_ptr<const Solution> load(const std::string& filename);
+
+private:
+  friend class SolutionCache;
+
+  std::map<std::string, double> m_scalars;
+  std::map<std::string, NDArray<int64_t>> m_intArrays;
+  std::map<std::string, NDArray<double>> m_realArrays;
+  size_t m_bytes;
+  Profile m_profile;
+  // keeps the mapped file (if any) alive
+  std::shared_ptr<void> m_storage;
+};
+
+class SolutionCache
+{
+public:
+
+  struct Stats
+  {
+    size_t hits;
+    size_t diskHits;
+    size_t misses;
+    size_t entries;
+    size_t bytes;
+  };
+
+  SolutionCache();
+
+  SolutionCache(const SolutionCache&) = delete;
+  SolutionCache& operator=(const SolutionCache&) = delete;
+
+  // maxBytes = 0 disables the memory tier, an empty directory disables the disk tier. Existing entries that no longer
+  // fit are evicted
+  void configure(size_t maxBytes, const std::string& directory = std::string());
+
+  bool enabled() const;
+
+  // returns null on a miss
+  std::shared_ptr<const Solution> find(const Hasher::Key& key);
+
+  void insert(const Hasher::Key& key, const std::shared_ptr<const Solution>& solution);
+
+  // empties the memory tier and resets the stats (the disk tier is left untouched)
+  void clear();
+
+  Stats stats() const;
+
+private:
+  typedef std::list<std::pair<Hasher::Key, std::shared_ptr<const Solution>>> lru_t;
+
+  void insertMemory(const Hasher::Key& key, const std::shared_ptr<const Solution>& solution);
+  void evict();
+  std::string filename(const Hasher::Key& key) const;
+
+  mutable std::mutex m_mutex;
+  size_t m_maxBytes;
+  std::string m_directory;
+  // most recently used at the front
+  lru_t m_lru;
+  std::map<Hasher::Key, lru_t::iterator> m_lookup;
+  size_t m_bytes;
+  size_t m_hits;
+  size_t m_diskHits;
+  size_t m_misses;
+};
+
+// Solve via the cache (if enabled). Results are keyed (and so must be accessed) by the same names as the bindings use:
+// ipf:  result (real), conv, pop, iterations, maxError
+// qis:  result (int), expectation (real), conv, pop, chiSq, pValue, degeneracy
+// qisi: result (int), ipf (real), conv, pop, chiSq, pValue, degeneracy
+// trs:  as qisi
+// qisSparse: coords (int, occupied states x dims), counts (int), expectation (real, of the occupied states), shape
+//            (int), conv, pop, chiSq, pValue, degeneracy
+// With statistics = false the samplers' chiSq, pValue and degeneracy are not computed (or present)
+// qis and qisi take an optional mask of structural zeros (see Mask.h)
+// ipf with single = true solves in a single precision population (see IPF.h), the result being widened to double
+namespace cached {
+
+std::shared_ptr<const Solution> ipf(const std::vector<std::vector<int64_t>>& indices,
+                                    std::vector<NDArray<double>>& marginals,
+                                    const NDArray<double>& seed,
+                                    bool single = false);
+
+std::shared_ptr<const Solution> qis(const std::vector<std::vector<int64_t>>& indices,
+                                    std::vector<NDArray<int64_t>>& marginals,
+                                    int64_t skips,
+                                    bool statistics = true,
+                                    const Mask& mask = Mask());
+
+std::shared_ptr<const Solution> qisSparse(const std::vector<std::vector<int64_t>>& indices,
+                                          std::vector<NDArray<int64_t>>& marginals,
+                                          int64_t skips,
+                                          bool statistics = true);
+
+std::shared_ptr<const Solution> qisi(const std::vector<std::vector<int64_t>>& indices,
+                                     std::vector<NDArray<int64_t>>& marginals,
+                                     const NDArray<double>& seed,
+                                     int64_t skips,
+                                     bool statistics = true,
+                                     const Mask& mask = Mask());
+
+std::shared_ptr<const Solution> trs(const std::vector<std::vector<int64_t>>& indices,
+                                    std::vector<NDArray<int64_t>>& marginals,
+                                    const NDArray<double>& seed,
+                                    bool statistics = true);
+}
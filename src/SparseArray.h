@@ -0,0 +1,177 @@
+// SparseArray.h
+// Sparse counterpart of NDArray for high-dimensional state spaces in which few states are occupied. Only nonzero
+// elements are stored, in a hash map keyed by the row-major offset of the element, so the total number of states may
+// be up to 2^62 (there is no per-dimension limit beyond that of NDArray). Absent elements read as zero.
+
+#pragma once
+
+#include "NDArray.h"
+
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+
+template<typename T>
+class SparseArray
+{
+public:
+  typedef std::unordered_map<int64_t, T> map_t;
+
+  // Max total number of states
+  static const int64_t MaxStates = int64_t(1) << 62;
+
+  SparseArray() : m_states(0) { }
+
+  explicit SparseArray(const std::vector<int64_t>& sizes)
+  {
+    resize(sizes);
+  }
+
+  // Disallow copy, allow move (as NDArray)
+  SparseArray(const SparseArray&) = delete;
+  SparseArray& operator=(const SparseArray&) = delete;
+  SparseArray(SparseArray&&) = default;
+  SparseArray& operator=(SparseArray&&) = default;
+
+  // discards the contents
+  void resize(const std::vector<int64_t>& sizes)
+  {
+    if (sizes.empty())
+      throw std::runtime_error("sparse array must have at least one dimension");
+    m_sizes = sizes;
+    m_strides.resize(sizes.size());
+    m_states = 1;
+    for (size_t i = sizes.size(); i > 0; --i)
+    {
+      if (sizes[i-1] < 1 || sizes[i-1] >= NDArray<T>::MaxSize)
+        throw std::runtime_error("invalid size " + std::to_string(sizes[i-1]) + " for dimension " + std::to_string(i-1));
+      m_strides[i-1] = m_states;
+      if (m_states > MaxStates / sizes[i-1])
+        throw std::runtime_error("sparse array state space is too large");
+      m_states *= sizes[i-1];
+    }
+    m_values.clear();
+  }
+
+  size_t dim() const
+  {
+    return m_sizes.size();
+  }
+
+  size_t size(size_t dim) const
+  {
+    return m_sizes[dim];
+  }
+
+  const std::vector<int64_t>& sizes() const
+  {
+    return m_sizes;
+  }
+
+  // total number of (possible) states
+  int64_t states() const
+  {
+    return m_states;
+  }
+
+  // number of stored elements (which includes any that have been explicitly set to zero)
+  size_t nonzeros() const
+  {
+    return m_values.size();
+  }
+
+  void clear()
+  {
+    m_values.clear();
+  }
+
+  // row-major offset of an element
+  int64_t offset(const std::vector<int64_t>& idx) const
+  {
+    int64_t ret = 0;
+    for (size_t i = 0; i < m_sizes.size(); ++i)
+      ret += m_strides[i] * idx[i];
+    return ret;
+  }
+
+  // index of the element at an offset
+  std::vector<int64_t> index(int64_t offset) const
+  {
+    std::vector<int64_t> idx(m_sizes.size());
+    for (size_t i = 0; i < m_sizes.size(); ++i)
+    {
+      idx[i] = offset / m_strides[i];
+      offset %= m_strides[i];
+    }
+    return idx;
+  }
+
+  // read access, zero if not present
+  T operator[](const std::vector<int64_t>& idx) const
+  {
+    typename map_t::const_iterator it = m_values.find(offset(idx));
+    return it == m_values.end() ? T(0) : it->second;
+  }
+
+  // write access, inserts the element (as zero) if not present
+  T& at(const std::vector<int64_t>& idx)
+  {
+    return m_values[offset(idx)];
+  }
+
+  const map_t& values() const
+  {
+    return m_values;
+  }
+
+  // the nonzero elements' offsets, in ascending (i.e. row-major) order
+  std::vector<int64_t> offsets() const
+  {
+    std::vector<int64_t> result;
+    result.reserve(m_values.size());
+    for (const auto& v: m_values)
+    {
+      if (v.second != T(0))
+        result.push_back(v.first);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  // nonzero elements as a (nonzeros x dim) array of indices and a corresponding array of values, in row-major order
+  void coordinates(NDArray<int64_t>& coords, NDArray<T>& values) const
+  {
+    const std::vector<int64_t>& offs = offsets();
+    const int64_t n = offs.size();
+    coords.resize({n, (int64_t)dim()});
+    values.resize({n});
+    int64_t* c = coords.begin();
+    for (int64_t i = 0; i < n; ++i)
+    {
+      const std::vector<int64_t>& idx = index(offs[i]);
+      c = std::copy(idx.begin(), idx.end(), c);
+      values.begin()[i] = m_values.find(offs[i])->second;
+    }
+  }
+
+  // dense copy, only practical for small state spaces
+  void toDense(NDArray<T>& dense) const
+  {
+    if (m_states >= std::numeric_limits<int32_t>::max())
+      throw std::runtime_error("sparse array state space is too large to convert to dense");
+    dense.resize(m_sizes);
+    dense.assign(T(0));
+    for (const auto& v: m_values)
+      dense[index(v.first)] = v.second;
+  }
+
+private:
+  std::vector<int64_t> m_sizes;
+  std::vector<int64_t> m_strides;
+  int64_t m_states;
+  map_t m_values;
+};
@@ -7,6 +7,18 @@
 
 namespace {
 
+// log of the gamma function. lgamma sets the global signgam so is not threadsafe, use the reentrant version where
+// there is one (solvers may run concurrently, see Replicates.h)
+double logGamma(double x)
+{
+#ifdef __GLIBC__
+  int sign;
+  return lgamma_r(x, &sign);
+#else
+  return std::lgamma(x);
+#endif
+}
+
 //****************************************************************************
 // Adapted from: https://people.sc.fsu.edu/~jburkardt/cpp_src/asa032/asa032.html
 // Licence: LGPL
@@ -103,7 +115,7 @@ double gamain ( double x, double p, int *ifault )
     return value;
   }
 
-  g = lgamma ( p );
+  g = logGamma ( p );
 
   arg = p * log ( x ) - x - g;
 
@@ -351,16 +363,93 @@ int64_t dof(std::vector<int64_t> sizes)
   return result;
 }
 
+double logFactorial(int64_t n)
+{
+  // occupancies are mostly small, so tabulate
+  static const int64_t TableSize = 256;
+  static const std::vector<double> table = []() {
+    std::vector<double> t(TableSize);
+    for (int64_t i = 0; i < TableSize; ++i)
+      t[i] = logGamma(i + 1.0);
+    return t;
+  }();
+  return n < TableSize ? table[n] : logGamma(n + 1.0);
+}
+
 // S!/(prod_k(a_k!)) not convinced that this is correct
-double degeneracy(const NDArray<int64_t>& a)
+double logDegeneracy(const NDArray<int64_t>& a)
 {
-  double s = a.storageSize();
-  double result = 1.0;
-  for (Index i(a.sizes()); !i.end(); ++i, --s)
+  double result = logFactorial(a.storageSize());
+  for (const int64_t* p = a.rawData(); p != a.rawData() + a.storageSize(); ++p)
+    result -= logFactorial(*p + 1);
+  return result;
+}
+
+// as the dense version, the empty states each contribute a factor of 1/1!
+double logDegeneracy(const SparseArray<int64_t>& a)
+{
+  double result = logGamma(a.states() + 1.0);
+  for (const auto& v: a.values())
   {
-    result *= s / factorial(a[i]+1);
+    result -= logFactorial(v.second + 1);
   }
   return result;
 }
 
+double degeneracy(const NDArray<int64_t>& a)
+{
+  return std::exp(logDegeneracy(a));
+}
+
+double degeneracy(const SparseArray<int64_t>& a)
+{
+  return std::exp(logDegeneracy(a));
+}
+
+Statistics statistics(const NDArray<int64_t>& sample, const NDArray<double>& reference)
+{
+  Statistics s;
+  if (sample.storageOrder() != reference.storageOrder())
+  {
+    s.chiSq = chiSq(sample, reference);
+    s.logDegeneracy = logDegeneracy(sample);
+  }
+  else
+  {
+    const int64_t* a = sample.rawData();
+    const double* e = reference.rawData();
+    const size_t n = sample.storageSize();
+    double chisq = 0.0;
+    double logDeg = logFactorial(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      chisq += (a[i] - e[i]) * (a[i] - e[i]) / e[i];
+      logDeg -= logFactorial(a[i] + 1);
+    }
+    s.chiSq = chisq;
+    s.logDegeneracy = logDeg;
+  }
+  s.pValue = pValue(dof(sample.sizes()), s.chiSq).first;
+  return s;
+}
+
+Statistics maskedStatistics(const NDArray<int64_t>& sample, const NDArray<double>& reference)
+{
+  Statistics s;
+  double chisq = 0.0;
+  double logDeg = logFactorial(sample.storageSize());
+  for (Index index(sample.sizes()); !index.end(); ++index)
+  {
+    const int64_t a = sample[index];
+    const double e = reference[index];
+    if (e > 0.0)
+      chisq += (a - e) * (a - e) / e;
+    logDeg -= logFactorial(a + 1);
+  }
+  s.chiSq = chisq;
+  s.logDegeneracy = logDeg;
+  s.pValue = pValue(dof(sample.sizes()), s.chiSq).first;
+  return s;
+}
+
 
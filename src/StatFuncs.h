@@ -3,9 +3,12 @@
 
 
 #include "NDArray.h"
+#include "SparseArray.h"
 #include "Index.h"
+#include "Simd.h"
 
 #include <vector>
+#include <stdexcept>
 #include <utility>
 #include <cstdint>
 #include <cmath>
@@ -35,6 +38,8 @@ private:
 template<typename T, typename U>
 double chiSq(const NDArray<T>& sample, const NDArray<U>& reference)
 {
+  if (sample.storageOrder() == reference.storageOrder())
+    return simd::chiSq(sample.rawData(), reference.rawData(), sample.storageSize());
   double chisq = 0.0;
   for (Index index(sample.sizes()); !index.end(); ++index)
   {
@@ -44,6 +49,24 @@ double chiSq(const NDArray<T>& sample, const NDArray<U>& reference)
   return chisq;
 }
 
+// Sparse version: the reference must contain every occupied state of the sample. States absent from the sample
+// contribute their expected value, i.e. in total the reference total less the reference sum over the occupied states
+template<typename T, typename U>
+double chiSq(const SparseArray<T>& sample, const SparseArray<U>& reference, double referenceTotal)
+{
+  double chisq = 0.0;
+  double occupied = 0.0;
+  for (const auto& v: sample.values())
+  {
+    const auto it = reference.values().find(v.first);
+    if (it == reference.values().end())
+      throw std::runtime_error("sparse chi-squared reference has no value for an occupied state");
+    chisq += (v.second - it->second) * (v.second - it->second) / it->second;
+    occupied += it->second;
+  }
+  return chisq + referenceTotal - occupied;
+}
+
 template<typename T>
 inline double factorial(T x)
 {
@@ -55,5 +78,31 @@ int64_t dof(std::vector<int64_t> sizes);
 // Chi-squared p-value calculation using incomplete gamma function
 std::pair<double,bool> pValue(uint32_t df, double x);
 
-// S!/(prod_k(a_k!))
+// log(n!)
+double logFactorial(int64_t n);
+
+// log(S!/(prod_k(a_k!))), computed with lgamma so it doesn't overflow for large counts or state spaces
+double logDegeneracy(const NDArray<int64_t>& a);
+
+// as above, only the occupied states need to be visited
+double logDegeneracy(const SparseArray<int64_t>& a);
+
+// S!/(prod_k(a_k!)), i.e. exp(logDegeneracy), which is infinite if not representable
 double degeneracy(const NDArray<int64_t>& a);
+
+double degeneracy(const SparseArray<int64_t>& a);
+
+// the statistics reported by the samplers
+struct Statistics
+{
+  double chiSq;
+  double pValue;
+  double logDegeneracy;
+};
+
+// chi-squared of the sample against the reference, its p-value and the log degeneracy of the sample, computed in a
+// single pass
+Statistics statistics(const NDArray<int64_t>& sample, const NDArray<double>& reference);
+
+// As above, excluding structural zeros (states with no reference, and so no sample either) from the chi-squared
+Statistics maskedStatistics(const NDArray<int64_t>& sample, const NDArray<double>& reference);
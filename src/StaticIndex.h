@@ -0,0 +1,183 @@
+// StaticIndex.h
+// Fixed-rank counterparts of Index and MappedIndex for the hot loops. Storage is std::array and the increment is
+// non-virtual with a compile-time trip count, so the compiler can unroll the carry logic and keep the index in
+// registers. Rather than recomputing array offsets from the index (D multiply-adds per element per array),
+// StaticOffset updates each offset incrementally from the dimension at which the index carried.
+//
+// Problems are mostly low-dimensional, so code is instantiated for ranks 1..MaxStaticRank and selected at runtime
+// with dispatchRank, falling back to Index/MappedIndex for higher ranks:
+//
+//   template<size_t D> struct Kernel { static void run(const NDArray<double>& a, ...) { ... } };
+//   if (!dispatchRank<Kernel>(a.dim(), a, ...))
+//     ... // dynamic-rank implementation
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+static const size_t MaxStaticRank = 8;
+
+// Row-major index over a D-dimensional array
+template<size_t D>
+class StaticIndex
+{
+public:
+  explicit StaticIndex(const std::vector<int64_t>& sizes) : m_carry(0), m_atEnd(false)
+  {
+    assert(sizes.size() == D);
+    for (size_t i = 0; i < D; ++i)
+    {
+      m_sizes[i] = sizes[i];
+      m_idx[i] = 0;
+    }
+  }
+
+  StaticIndex& operator++()
+  {
+    for (size_t i = D; i > 0; --i)
+    {
+      if (++m_idx[i-1] != m_sizes[i-1])
+      {
+        m_carry = i - 1;
+        return *this;
+      }
+      m_idx[i-1] = 0;
+    }
+    m_carry = 0;
+    m_atEnd = true;
+    return *this;
+  }
+
+  // Moves to the start of the next run of the innermost dimension, for kernels that process it as a whole (see
+  // StaticOffset::advanceRun)
+  StaticIndex& nextRun()
+  {
+    m_idx[D-1] = m_sizes[D-1] - 1;
+    return ++*this;
+  }
+
+  // the outermost dimension changed by the last increment (all inner dimensions having wrapped to zero)
+  size_t carry() const
+  {
+    return m_carry;
+  }
+
+  const int64_t& operator[](size_t i) const
+  {
+    return m_idx[i];
+  }
+
+  const std::array<int64_t, D>& sizes() const
+  {
+    return m_sizes;
+  }
+
+  bool end() const
+  {
+    return m_atEnd;
+  }
+
+private:
+  std::array<int64_t, D> m_idx;
+  std::array<int64_t, D> m_sizes;
+  size_t m_carry;
+  bool m_atEnd;
+};
+
+// Offset into an array, tracking a StaticIndex. Call advance() after each increment of the index
+template<size_t D>
+class StaticOffset
+{
+public:
+  // strides[i] is the array stride of index dimension i (zero if the array does not vary in that dimension)
+  StaticOffset(const StaticIndex<D>& index, const std::vector<int64_t>& strides, int64_t base = 0)
+    : m_offset(base)
+  {
+    assert(strides.size() == D);
+    std::array<int64_t, D> s;
+    for (size_t i = 0; i < D; ++i)
+      s[i] = strides[i];
+    init(index, s);
+  }
+
+  // array dimension j is index dimension dims[j], e.g. a marginal of the population
+  StaticOffset(const StaticIndex<D>& index, const std::vector<int64_t>& dims, const std::vector<int64_t>& strides)
+    : m_offset(0)
+  {
+    assert(dims.size() == strides.size());
+    std::array<int64_t, D> s;
+    s.fill(0);
+    for (size_t j = 0; j < dims.size(); ++j)
+    {
+      assert((size_t)dims[j] < D);
+      s[dims[j]] = strides[j];
+    }
+    init(index, s);
+  }
+
+  void advance(const StaticIndex<D>& index)
+  {
+    m_offset += m_delta[index.carry()];
+  }
+
+  // call after StaticIndex::nextRun
+  void advanceRun(const StaticIndex<D>& index)
+  {
+    m_offset += m_delta[index.carry()] + m_runLength;
+  }
+
+  int64_t operator*() const
+  {
+    return m_offset;
+  }
+
+  // stride in the innermost dimension of the index: 1 means runs are contiguous, 0 that they map to a single element
+  int64_t innerStride() const
+  {
+    return m_innerStride;
+  }
+
+private:
+  // incrementing dimension i moves one stride in i and back to the start of every dimension inside it
+  void init(const StaticIndex<D>& index, const std::array<int64_t, D>& strides)
+  {
+    m_innerStride = strides[D-1];
+    m_runLength = (index.sizes()[D-1] - 1) * strides[D-1];
+    int64_t rewind = 0;
+    for (size_t i = D; i > 0; --i)
+    {
+      m_delta[i-1] = strides[i-1] - rewind;
+      rewind += (index.sizes()[i-1] - 1) * strides[i-1];
+      m_offset += index[i-1] * strides[i-1];
+    }
+  }
+
+  int64_t m_offset;
+  std::array<int64_t, D> m_delta;
+  int64_t m_innerStride;
+  // offset from the start to the end of a run
+  int64_t m_runLength;
+};
+
+// Calls F<dim>::run(args...) if dim is in [1, MaxStaticRank], otherwise returns false
+template<template<size_t> class F, typename... Args>
+bool dispatchRank(size_t dim, Args&&... args)
+{
+  switch (dim)
+  {
+  case 1: F<1>::run(std::forward<Args>(args)...); return true;
+  case 2: F<2>::run(std::forward<Args>(args)...); return true;
+  case 3: F<3>::run(std::forward<Args>(args)...); return true;
+  case 4: F<4>::run(std::forward<Args>(args)...); return true;
+  case 5: F<5>::run(std::forward<Args>(args)...); return true;
+  case 6: F<6>::run(std::forward<Args>(args)...); return true;
+  case 7: F<7>::run(std::forward<Args>(args)...); return true;
+  case 8: F<8>::run(std::forward<Args>(args)...); return true;
+  default: return false;
+  }
+}
@@ -0,0 +1,177 @@
+
+#include "TRS.h"
+#include "IPF.h"
+#include "NDArrayUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+TRS::TRS(const index_list_t& indices, marginal_list_t& marginals)
+: Microsynthesis(indices, marginals), m_conv(false), m_statistics(false)
+{
+}
+
+const NDArray<int64_t>& TRS::solve(const NDArray<double>& seed)
+{
+  {
+    IPF<int64_t> ipf(m_indices, m_marginals);
+    NDArray<double>::copy(ipf.solve(seed), m_ipfSolution);
+    m_profile.merge(ipf.profile());
+  }
+
+  PROFILE_SCOPE(m_profile, "integerise");
+  const size_t n = m_array.storageSize();
+  const size_t K = m_indices.size();
+
+  // the amount each marginal cell is short, in row-major order whatever the storage order of the marginals
+  std::vector<std::vector<int64_t>> shortfall(K);
+  for (size_t k = 0; k < K; ++k)
+  {
+    NDArray<int64_t> rowMajor(m_marginals[k].sizes());
+    transposeStorage(m_marginals[k], rowMajor);
+    shortfall[k].assign(rowMajor.rawData(), rowMajor.rawData() + rowMajor.storageSize());
+  }
+
+  // per marginal, the stride of each (overall) dimension in its cells, so that a state's cells are computed from its
+  // offset without holding them for every state
+  std::vector<std::vector<int64_t>> strides(K, std::vector<int64_t>(m_dim, 0));
+  for (size_t k = 0; k < K; ++k)
+  {
+    int64_t stride = 1;
+    for (size_t j = m_indices[k].size(); j > 0; --j)
+    {
+      strides[k][m_indices[k][j-1]] = stride;
+      stride *= m_marginals[k].size(j-1);
+    }
+  }
+  std::vector<int64_t> cells(K);
+  auto locate = [&](size_t s) {
+    std::fill(cells.begin(), cells.end(), 0);
+    for (size_t d = m_dim; d > 0; --d)
+    {
+      const int64_t x = s % m_sizes[d-1];
+      s /= m_sizes[d-1];
+      for (size_t k = 0; k < K; ++k)
+        cells[k] += x * strides[k][d-1];
+    }
+  };
+
+  // truncate
+  const double* e = m_ipfSolution.rawData();
+  int64_t* p = m_array.begin();
+  int64_t remaining = m_population;
+  for (size_t s = 0; s < n; ++s)
+  {
+    // values within rounding error of an integer aren't truncated down
+    p[s] = static_cast<int64_t>(std::floor(e[s] + 1e-9));
+    if (!p[s])
+      continue;
+    remaining -= p[s];
+    locate(s);
+    for (size_t k = 0; k < K; ++k)
+      shortfall[k][cells[k]] -= p[s];
+  }
+
+  // states in decreasing order of their fractional part, excluding those that can't be occupied
+  std::vector<size_t> order;
+  order.reserve(n);
+  for (size_t s = 0; s < n; ++s)
+    if (e[s] > 0.0)
+      order.push_back(s);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return e[a] - p[a] > e[b] - p[b]; });
+
+  auto allocate = [&](size_t s) {
+    ++p[s];
+    --remaining;
+    locate(s);
+    for (size_t k = 0; k < K; ++k)
+      --shortfall[k][cells[k]];
+  };
+  // the number of the state's marginal cells that are short
+  auto open = [&](size_t s) -> size_t {
+    locate(s);
+    size_t count = 0;
+    for (size_t k = 0; k < K; ++k)
+      count += shortfall[k][cells[k]] > 0;
+    return count;
+  };
+
+  // largest remainders first, only where every marginal cell of the state is short
+  for (size_t i = 0; i < order.size() && remaining > 0; ++i)
+    if (e[order[i]] > p[order[i]] && open(order[i]) == K)
+      allocate(order[i]);
+  // then (as a correction) any occupiable state, in the same order
+  for (size_t i = 0; i < order.size() && remaining > 0; ++i)
+    while (remaining > 0 && open(order[i]) == K)
+      allocate(order[i]);
+  PROFILE_COUNT(m_profile, "shortfall", remaining);
+  // the marginals can't be met exactly, so fill as many short cells as possible
+  while (remaining > 0 && !order.empty())
+  {
+    size_t best = order[0];
+    size_t bestOpen = open(best);
+    for (size_t i = 1; i < order.size() && bestOpen < K; ++i)
+    {
+      const size_t o = open(order[i]);
+      if (o > bestOpen)
+      {
+        best = order[i];
+        bestOpen = o;
+      }
+    }
+    allocate(best);
+  }
+
+  m_conv = true;
+  for (size_t k = 0; k < K; ++k)
+    m_conv = m_conv && std::all_of(shortfall[k].begin(), shortfall[k].end(), [](int64_t v) { return v == 0; });
+
+  PROFILE_COUNT(m_profile, "samples", m_population);
+  m_statistics = false;
+
+  return m_array;
+}
+
+const Statistics& TRS::statistics() const
+{
+  if (!m_statistics)
+  {
+    if (!m_ipfSolution.storageSize())
+      throw std::runtime_error("TRS statistics are not available until solved");
+    PROFILE_SCOPE(m_profile, "statistics");
+    m_stats = ::statistics(m_array, m_ipfSolution);
+    m_statistics = true;
+  }
+  return m_stats;
+}
+
+const NDArray<double>& TRS::expectation() const
+{
+  return m_ipfSolution;
+}
+
+bool TRS::conv() const
+{
+  return m_conv;
+}
+
+double TRS::chiSq() const
+{
+  return statistics().chiSq;
+}
+
+double TRS::pValue() const
+{
+  return statistics().pValue;
+}
+
+double TRS::degeneracy() const
+{
+  return std::exp(statistics().logDegeneracy);
+}
+
+double TRS::logDegeneracy() const
+{
+  return statistics().logDegeneracy;
+}
@@ -0,0 +1,52 @@
+// TRS.h
+// Deterministic integerisation of the IPF solution (truncate, replicate, sample), as a fast alternative to QISI, which
+// recomputes IPF as it samples. The IPF solution is truncated to its integer parts and the remainder of the population
+// allocated, one at a time, to the states with the largest fractional parts whose marginal cells are all still short
+// (generalising integeriseMarginalDistribution to N dimensions). Any shortfall left (when no such state remains) is
+// allocated to the states that fill the most short marginal cells. Costs O(states log states) after the IPF, and the
+// same statistics as QISI are available.
+//
+// e.g.
+//   TRS trs(indices, marginals);
+//   const NDArray<int64_t>& population = trs.solve(seed);
+
+#pragma once
+
+#include "Microsynthesis.h"
+#include "StatFuncs.h"
+
+class TRS : public Microsynthesis<int64_t>
+{
+public:
+  TRS(const index_list_t& indices, marginal_list_t& marginals);
+
+  TRS(const TRS&) = delete;
+  TRS& operator=(const TRS&) = delete;
+
+  const NDArray<int64_t>& solve(const NDArray<double>& seed);
+
+  // Expected state occupancy (IPF solution)
+  const NDArray<double>& expectation() const;
+
+  // true if the population has the marginals exactly
+  bool conv() const;
+
+  // The statistics are computed (together) on first access after solving
+  // chi-squared stat vs the IPF solution
+  double chiSq() const;
+
+  // infinite if too large to represent, see logDegeneracy
+  double degeneracy() const;
+
+  double logDegeneracy() const;
+
+  double pValue() const;
+
+private:
+  const Statistics& statistics() const;
+
+  NDArray<double> m_ipfSolution;
+  bool m_conv;
+  mutable bool m_statistics;
+  mutable Statistics m_stats;
+};
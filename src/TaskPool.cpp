@@ -0,0 +1,120 @@
+
+#include "TaskPool.h"
+
+#include <thread>
+#include <algorithm>
+
+namespace {
+
+// the pool and queue of the calling worker, if any
+thread_local const TaskPool* t_pool = nullptr;
+thread_local size_t t_worker = 0;
+
+}
+
+TaskPool::TaskPool(size_t threads) : m_pending(0), m_next(0), m_steals(0), m_abandon(false)
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t t = 0; t < threads; ++t)
+    m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+}
+
+size_t TaskPool::threads() const
+{
+  return m_queues.size();
+}
+
+void TaskPool::push(Task task)
+{
+  const size_t t = t_pool == this ? t_worker : m_next++ % m_queues.size();
+  ++m_pending;
+  std::lock_guard<std::mutex> lock(m_queues[t]->mutex);
+  m_queues[t]->tasks.push_back(std::move(task));
+}
+
+void TaskPool::run()
+{
+  m_abandon = false;
+  m_error = nullptr;
+
+  std::vector<std::thread> pool;
+  for (size_t t = 1; t < m_queues.size(); ++t)
+    pool.push_back(std::thread(&TaskPool::work, this, t));
+  work(0);
+  for (std::thread& t: pool)
+    t.join();
+
+  if (m_error)
+    std::rethrow_exception(m_error);
+}
+
+size_t TaskPool::steals() const
+{
+  return m_steals;
+}
+
+void TaskPool::work(size_t t)
+{
+  const TaskPool* pool = t_pool;
+  const size_t worker = t_worker;
+  t_pool = this;
+  t_worker = t;
+
+  Task task;
+  while (m_pending)
+  {
+    if (!pop(t, task))
+    {
+      // other workers' tasks are still running, and may push more
+      std::this_thread::yield();
+      continue;
+    }
+    if (!m_abandon)
+    {
+      try
+      {
+        task();
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+        if (!m_error)
+          m_error = std::current_exception();
+        m_abandon = true;
+      }
+    }
+    task = nullptr;
+    --m_pending;
+  }
+
+  t_pool = pool;
+  t_worker = worker;
+}
+
+bool TaskPool::pop(size_t t, Task& task)
+{
+  {
+    Queue& own = *m_queues[t];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty())
+    {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < m_queues.size(); ++i)
+  {
+    Queue& other = *m_queues[(t + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty())
+    {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      ++m_steals;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,62 @@
+// TaskPool.h
+// A work-stealing pool for task trees, e.g. the areas of a geographic hierarchy, where a task pushes further tasks as
+// it completes. Each worker thread has its own queue, taking its newest task first (so that a task's children run
+// while its data is still hot) and, when empty, stealing the oldest task of another worker.
+//
+// e.g.
+//   TaskPool pool(8);
+//   pool.push([&]() { ...; pool.push(...); });
+//   pool.run();
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <cstddef>
+
+class TaskPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  // 0 = one thread per hardware thread
+  explicit TaskPool(size_t threads = 0);
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  size_t threads() const;
+
+  // Queues a task. Called from within a task, it's queued on the calling worker's queue
+  void push(Task task);
+
+  // Runs until every task, including those pushed by tasks, has completed. If any task throws, the tasks remaining
+  // are abandoned and the (first) error rethrown
+  void run();
+
+  // number of tasks taken from another worker's queue, over all runs
+  size_t steals() const;
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void work(size_t t);
+  bool pop(size_t t, Task& task);
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::atomic<size_t> m_pending;
+  std::atomic<size_t> m_next;
+  std::atomic<size_t> m_steals;
+  std::atomic<bool> m_abandon;
+  std::mutex m_errorMutex;
+  std::exception_ptr m_error;
+};
@@ -0,0 +1,167 @@
+
+#include "UnitTester.h"
+#include "QIS.h"
+#include "QISI.h"
+#include "Adjust.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+typedef std::vector<std::vector<int64_t>> index_list_t;
+typedef std::vector<NDArray<int64_t>> marginal_list_t;
+
+// 1-d (age x sex) marginals
+marginal_list_t marginals(const std::vector<int64_t>& age, const std::vector<int64_t>& sex)
+{
+  marginal_list_t m;
+  m.push_back(NDArray<int64_t>(std::vector<int64_t>{(int64_t)age.size()}));
+  m.push_back(NDArray<int64_t>(std::vector<int64_t>{(int64_t)sex.size()}));
+  std::copy(age.begin(), age.end(), m[0].begin());
+  std::copy(sex.begin(), sex.end(), m[1].begin());
+  return m;
+}
+
+bool matches(const NDArray<int64_t>& population, const std::vector<int64_t>& age, const std::vector<int64_t>& sex)
+{
+  return reduce<int64_t>(population, 0) == age && reduce<int64_t>(population, 1) == sex;
+}
+
+// true if the (age x 2) populations agree in the given age band
+bool same(const NDArray<int64_t>& a, const NDArray<int64_t>& b, int64_t age)
+{
+  return a.rawData()[age * 2] == b.rawData()[age * 2] && a.rawData()[age * 2 + 1] == b.rawData()[age * 2 + 1];
+}
+
+}
+
+void unittest::testAdjust()
+{
+  const index_list_t indices{{0}, {1}};
+
+  // QIS: 5 more aged 65+, then 4 moved from the youngest band to the oldest, then 3 fewer in the second band
+  {
+    marginal_list_t m = marginals({40, 30, 20, 10}, {52, 48});
+    QIS qis(indices, m);
+    const NDArray<int64_t>& population = qis.solve();
+    NDArray<int64_t> before;
+    NDArray<int64_t>::copy(population, before);
+    CHECK(qis.conv());
+
+    const double chiSq = qis.chiSq();
+    double change = qis.adjust(marginals({0, 0, 0, 5}, {3, 2}));
+    CHECK(qis.conv());
+    CHECK(qis.population() == 105);
+    CHECK(matches(population, {40, 30, 20, 15}, {55, 50}));
+    CHECK(std::fabs(qis.chiSq() - chiSq - change) < 1e-9);
+    // nothing removed, and only the 65+ band touched
+    bool kept = true;
+    for (int64_t a = 0; a < 3; ++a)
+      kept = kept && same(before, population, a);
+    CHECK(kept);
+    CHECK(!Profile::enabled() || qis.profile().counters().at("removed") == 0);
+    CHECK(!Profile::enabled() || qis.profile().counters().at("added") == 5);
+
+    NDArray<int64_t>::copy(population, before);
+    qis.adjust(marginals({-4, 0, 0, 4}, {0, 0}));
+    CHECK(qis.conv());
+    CHECK(matches(population, {36, 30, 20, 19}, {55, 50}));
+    CHECK(same(before, population, 1));
+    CHECK(same(before, population, 2));
+
+    NDArray<int64_t>::copy(population, before);
+    qis.adjust(marginals({0, -3, 0, 0}, {-2, -1}));
+    CHECK(qis.conv());
+    CHECK(matches(population, {36, 27, 20, 19}, {53, 49}));
+    CHECK(same(before, population, 0));
+    CHECK(same(before, population, 2));
+    CHECK(same(before, population, 3));
+    // the expectation is that of the adjusted marginals
+    CHECK(std::fabs(sum(qis.expectation()) - 102.0) < 1e-9);
+
+    // deltas that are inconsistent, or would leave a negative marginal
+    CHECK_THROWS(qis.adjust(marginals({0, 0, 0, 1}, {0, 0})), std::runtime_error);
+    CHECK_THROWS(qis.adjust(marginals({-37, 0, 0, 37}, {0, 0})), std::runtime_error);
+    CHECK_THROWS(qis.adjust(marginals({0, 0, 0}, {0, 0})), std::runtime_error);
+  }
+
+  // QISI
+  {
+    marginal_list_t m = marginals({40, 30, 20, 10}, {52, 48});
+    NDArray<double> seed(std::vector<int64_t>{4, 2});
+    for (size_t i = 0; i < seed.storageSize(); ++i)
+      seed.begin()[i] = 1.0 + i % 3;
+    QISI qisi(indices, m);
+    CHECK_THROWS(qisi.adjust(marginals({0, 0, 0, 5}, {5, 0}), seed), std::runtime_error);
+    const NDArray<int64_t>& population = qisi.solve(seed);
+    CHECK(qisi.conv());
+
+    const double chiSq = qisi.chiSq();
+    const double change = qisi.adjust(marginals({0, -6, 0, 6}, {0, 0}), seed);
+    CHECK(qisi.conv());
+    CHECK(matches(population, {40, 24, 20, 16}, {52, 48}));
+    CHECK(std::fabs(qisi.chiSq() - chiSq - change) < 1e-9);
+    CHECK(!Profile::enabled() || qisi.profile().counters().at("added") == 6);
+    CHECK(!Profile::enabled() || !qisi.profile().counters().count("resolved"));
+  }
+
+  // QISI, with a structural zero in the seed: moving people into a band only one sex can occupy may need the
+  // population resolving
+  {
+    marginal_list_t m = marginals({40, 30, 20, 10}, {52, 48});
+    NDArray<double> seed(std::vector<int64_t>{4, 2});
+    seed.assign(1.0);
+    seed[{3, 1}] = 0.0;
+    QISI qisi(indices, m);
+    const NDArray<int64_t>& population = qisi.solve(seed);
+    qisi.adjust(marginals({-5, 0, 0, 5}, {0, 0}), seed);
+    CHECK(qisi.conv());
+    CHECK(matches(population, {35, 30, 20, 15}, {52, 48}));
+    CHECK((population[{3, 1}] == 0));
+    CHECK((qisi.expectation()[{3, 1}] == 0.0));
+  }
+
+  // column-major (e.g. Fortran-ordered numpy) 2-d marginals and deltas: 2 moved from cell (0,1) to (1,1) of the
+  // first, then back again with row-major deltas
+  {
+    const index_list_t indices2{{0,1}, {1,2}};
+    const std::vector<int64_t> sizes{3, 4, 2};
+    marginal_list_t m = fixtures::marginalsOf<int64_t>(sizes, indices2, 2, 2);
+    marginal_list_t deltas;
+    deltas.push_back(NDArray<int64_t>(std::vector<int64_t>{3, 4}));
+    deltas.push_back(NDArray<int64_t>(std::vector<int64_t>{4, 2}));
+    deltas[0].assign(0ll);
+    deltas[1].assign(0ll);
+    deltas[0].begin()[1] = -2;
+    deltas[0].begin()[5] = 2;
+    marginal_list_t target = applyDeltas(indices2, m, deltas);
+
+    // true if the population has the marginals exactly
+    auto meets = [&](const NDArray<int64_t>& population, const marginal_list_t& marginals) {
+      bool ok = true;
+      for (size_t k = 0; k < indices2.size(); ++k)
+      {
+        const NDArray<int64_t> r = reduce<int64_t>(population, indices2[k]);
+        ok = ok && std::equal(r.rawData(), r.rawData() + r.storageSize(), marginals[k].rawData());
+      }
+      return ok;
+    };
+
+    marginal_list_t cm = fixtures::columnMajor(m);
+    QIS qis(indices2, cm);
+    const NDArray<int64_t>& population = qis.solve();
+    CHECK(qis.conv());
+    qis.adjust(fixtures::columnMajor(deltas));
+    CHECK(qis.conv());
+    CHECK(meets(population, target));
+
+    for (int64_t* d = deltas[0].begin(); d != deltas[0].end(); ++d)
+      *d = -*d;
+    qis.adjust(deltas);
+    CHECK(qis.conv());
+    CHECK(meets(population, m));
+  }
+}
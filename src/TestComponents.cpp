@@ -0,0 +1,171 @@
+
+#include "UnitTester.h"
+#include "Components.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+std::vector<NDArray<int64_t>> copy(const std::vector<NDArray<int64_t>>& marginals)
+{
+  std::vector<NDArray<int64_t>> result;
+  for (const NDArray<int64_t>& m: marginals)
+  {
+    result.push_back(NDArray<int64_t>());
+    NDArray<int64_t>::copy(m, result.back());
+  }
+  return result;
+}
+
+}
+
+void unittest::testComponents()
+{
+  {
+    const std::vector<Component>& c = connectedComponents({{0,1}, {2,3}});
+    CHECK(c.size() == 2);
+    CHECK((c[0].dims == std::vector<int64_t>{0,1}));
+    CHECK((c[1].dims == std::vector<int64_t>{2,3}));
+    CHECK((c[1].marginals == std::vector<size_t>{1}));
+    CHECK((c[1].indices == std::vector<std::vector<int64_t>>{{0,1}}));
+  }
+  {
+    // joined through dimension 2, and ordered by lowest dimension
+    const std::vector<Component>& c = connectedComponents({{3,1}, {0,2}, {2,4}});
+    CHECK(c.size() == 2);
+    CHECK((c[0].dims == std::vector<int64_t>{0,2,4}));
+    CHECK((c[0].marginals == std::vector<size_t>{1,2}));
+    CHECK((c[0].indices == std::vector<std::vector<int64_t>>{{0,1}, {1,2}}));
+    CHECK((c[1].dims == std::vector<int64_t>{1,3}));
+    CHECK((c[1].indices == std::vector<std::vector<int64_t>>{{1,0}}));
+  }
+  CHECK(connectedComponents({{0,1}, {1,2}, {2,3}}).size() == 1);
+
+  // three components: {0,1,2} from two marginals, {3} and {4,5} (transposed) from one each
+  std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}, {3}, {5,4}};
+  std::vector<NDArray<int64_t>> marginals;
+  marginals.push_back(NDArray<int64_t>({4,6}));
+  marginals.push_back(NDArray<int64_t>({6,5}));
+  marginals.push_back(NDArray<int64_t>({4}));
+  marginals.push_back(NDArray<int64_t>({3,2}));
+  marginals[0].assign(10ll);
+  for (int64_t* p = marginals[1].begin(); p != marginals[1].end(); ++p)
+    *p = 6 + (p - marginals[1].begin()) % 5;
+  marginals[2].assign(60ll);
+  const int64_t m3[] = {10, 20, 30, 40, 60, 80};
+  std::copy(m3, m3 + 6, marginals[3].begin());
+  const int64_t population = 240;
+
+  ComponentQIS qis(indices, marginals);
+  CHECK(qis.components() == 3);
+  CHECK_THROWS(qis.componentPopulation(0), std::runtime_error);
+  const SparseArray<int64_t>& joint = qis.solve();
+  CHECK(qis.conv());
+  CHECK(qis.population() == population);
+  CHECK((qis.sizes() == std::vector<int64_t>{4,6,5,4,2,3}));
+  CHECK(!Profile::enabled() || qis.profile().counters().at("components") == 3);
+
+  // the components are far smaller than the joint
+  CHECK(qis.componentPopulation(0).storageSize() == 120);
+  CHECK(qis.componentPopulation(2).storageSize() == 6);
+
+  // the joint population has the marginals of the problem
+  NDArray<int64_t> dense;
+  joint.toDense(dense);
+  CHECK(sum(dense) == population);
+  bool marginalsMatch = true;
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    const NDArray<int64_t>& r = reduce<int64_t>(dense, indices[k]);
+    marginalsMatch = marginalsMatch && std::equal(r.begin(), r.end(), marginals[k].begin());
+  }
+  CHECK(marginalsMatch);
+
+  // a multi-marginal component is solved exactly as its own problem
+  {
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>());
+    NDArray<int64_t>::copy(marginals[0], m.back());
+    m.push_back(NDArray<int64_t>());
+    NDArray<int64_t>::copy(marginals[1], m.back());
+    QIS component({{0,1}, {1,2}}, m);
+    const NDArray<int64_t>& p = component.solve();
+    CHECK(std::equal(p.begin(), p.end(), qis.componentPopulation(0).begin()));
+  }
+  // and a lone marginal is its own population
+  CHECK((qis.componentPopulation(2)[std::vector<int64_t>{1,0}] == 20));
+  CHECK((qis.componentPopulation(2)[std::vector<int64_t>{0,1}] == 30));
+
+  // the product of the components' expectations is the expectation of the whole problem
+  {
+    std::vector<NDArray<int64_t>> m = copy(marginals);
+    QIS whole(indices, m);
+    const NDArray<double>& expected = whole.expectation();
+    NDArray<double> e;
+    qis.expectation(e);
+    double maxErr = 0.0;
+    for (Index index(e.sizes()); !index.end(); ++index)
+    {
+      maxErr = std::max(maxErr, std::fabs(e[index] - expected[index]));
+      maxErr = std::max(maxErr, std::fabs(qis.expectation(index) - expected[index]));
+    }
+    CHECK(maxErr < 1e-9);
+  }
+
+  // a connected problem is a single component, identical to QIS
+  {
+    std::vector<std::vector<int64_t>> connected{{0,1}, {1,2}};
+    std::vector<NDArray<int64_t>> m = copy(marginals);
+    m.resize(2);
+    std::vector<NDArray<int64_t>> cm = fixtures::columnMajor(m);
+    ComponentQIS single(connected, m);
+    NDArray<int64_t> s;
+    single.solve().toDense(s);
+    QIS whole(connected, m);
+    const NDArray<int64_t>& p = whole.solve();
+    CHECK(single.components() == 1);
+    CHECK(std::equal(p.begin(), p.end(), s.begin()));
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same population
+    ComponentQIS singlec(connected, cm);
+    singlec.solve().toDense(s);
+    CHECK(std::equal(p.begin(), p.end(), s.begin()));
+  }
+
+  // a 1-d component with more than one marginal is its own population too
+  {
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>({4}));
+    m.push_back(NDArray<int64_t>({3}));
+    m.push_back(NDArray<int64_t>({3}));
+    m[0].assign(15ll);
+    const int64_t m1[] = {10, 20, 30};
+    std::copy(m1, m1 + 3, m[1].begin());
+    std::copy(m1, m1 + 3, m[2].begin());
+    ComponentQIS oned({{0}, {1}, {1}}, m);
+    const SparseArray<int64_t>& j = oned.solve();
+    CHECK(oned.conv());
+    CHECK(oned.components() == 2);
+    CHECK(std::equal(m1, m1 + 3, oned.componentPopulation(1).begin()));
+    NDArray<int64_t> d;
+    j.toDense(d);
+    const std::vector<int64_t>& r = reduce<int64_t>(d, 1);
+    CHECK(std::equal(m1, m1 + 3, r.begin()));
+    // but the marginals must agree
+    m[2].begin()[0] = 11;
+    m[2].begin()[1] = 19;
+    ComponentQIS inconsistent({{0}, {1}, {1}}, m);
+    CHECK_THROWS(inconsistent.solve(), std::runtime_error);
+  }
+
+  // validation
+  {
+    std::vector<NDArray<int64_t>> m = copy(marginals);
+    m[2].assign(61ll);
+    CHECK_THROWS((ComponentQIS(indices, m)), std::runtime_error);
+    m[2].assign(60ll);
+    CHECK_THROWS((ComponentQIS({{0,1}, {1,2}, {4}, {5,4}}, m)), std::runtime_error);
+  }
+}
@@ -0,0 +1,60 @@
+// TestFixtures.h
+// Problems shared by the unit tests
+
+#pragma once
+
+#include "NDArray.h"
+#include "NDArrayUtils.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace fixtures {
+
+// Marginals of a (non-uniform) population, so that they're consistent: the state at (row-major) offset o has
+// base + scale * ((7 o + shift) % 5) individuals, shift varying the population, e.g. by area
+template<typename T>
+std::vector<NDArray<T>> marginalsOf(const std::vector<int64_t>& sizes, const std::vector<std::vector<int64_t>>& indices,
+                                    T base, T scale, int64_t shift = 0)
+{
+  NDArray<T> population(sizes);
+  for (T* p = population.begin(); p != population.end(); ++p)
+    *p = base + scale * (((p - population.begin()) * 7 + shift) % 5);
+  std::vector<NDArray<T>> marginals;
+  for (const std::vector<int64_t>& index: indices)
+  {
+    marginals.push_back(NDArray<T>());
+    NDArray<T>::copy(reduce<T>(population, index), marginals.back());
+  }
+  return marginals;
+}
+
+// Column-major copies of arrays, e.g. marginals, as the python bindings pass Fortran-ordered numpy arrays
+template<typename T>
+std::vector<NDArray<T>> columnMajor(const std::vector<NDArray<T>>& arrays)
+{
+  std::vector<NDArray<T>> copies;
+  for (const NDArray<T>& a: arrays)
+  {
+    copies.push_back(NDArray<T>(a.sizes(), StorageOrder::ColumnMajor));
+    transposeStorage(a, copies.back());
+  }
+  return copies;
+}
+
+// n pseudorandom records (rows) of the categories of each dimension, covering every state if n is large enough
+inline NDArray<int64_t> recordsOf(const std::vector<int64_t>& sizes, int64_t n, uint32_t seed)
+{
+  NDArray<int64_t> categories(std::vector<int64_t>{n, (int64_t)sizes.size()});
+  uint32_t x = seed;
+  int64_t* p = categories.begin();
+  for (int64_t r = 0; r < n; ++r)
+    for (size_t d = 0; d < sizes.size(); ++d)
+    {
+      x = x * 1664525u + 1013904223u;
+      *p++ = (x >> 16) % sizes[d];
+    }
+  return categories;
+}
+
+}
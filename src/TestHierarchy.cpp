@@ -0,0 +1,163 @@
+
+#include "UnitTester.h"
+#include "Hierarchy.h"
+#include "TaskPool.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <atomic>
+#include <cmath>
+
+namespace {
+
+// consistent (3 x 4) marginals of an area's population, varying with the area
+Hierarchy::marginal_list_t marginalsOf(size_t area, int64_t scale)
+{
+  return fixtures::marginalsOf<int64_t>({3, 4}, {{0}, {1}}, scale, scale, area * 3);
+}
+
+std::vector<int64_t> values(const NDArray<int64_t>& a)
+{
+  return std::vector<int64_t>(a.rawData(), a.rawData() + a.storageSize());
+}
+
+// the sum of the populations of the leaves in [first, last)
+NDArray<int64_t> total(const NDArray<int64_t>& population, int64_t first, int64_t last)
+{
+  const int64_t S = population.storageSize() / population.size(0);
+  NDArray<int64_t> t(std::vector<int64_t>{3, 4});
+  t.assign(0ll);
+  for (int64_t l = first; l < last; ++l)
+    for (int64_t s = 0; s < S; ++s)
+      t.begin()[s] += population.rawData()[l * S + s];
+  return t;
+}
+
+}
+
+void unittest::testHierarchy()
+{
+  // tasks pushing tasks
+  {
+    TaskPool pool(4);
+    std::atomic<int> count(0);
+    for (int i = 0; i < 10; ++i)
+      pool.push([&]() {
+        ++count;
+        for (int j = 0; j < 10; ++j)
+          pool.push([&]() { ++count; });
+      });
+    pool.run();
+    CHECK(count == 110);
+    pool.push([]() { throw std::runtime_error("task failed"); });
+    CHECK_THROWS(pool.run(), std::runtime_error);
+  }
+
+  const Hierarchy::index_list_t indices{{0}, {1}};
+
+  // a region, 2 districts and 5 output areas
+  {
+    const std::vector<int64_t> parents{-1, 0, 0, 1, 1, 2, 2, 2};
+    std::vector<Hierarchy::marginal_list_t> marginals;
+    for (size_t a = 0; a < parents.size(); ++a)
+      marginals.push_back(marginalsOf(a, a ? 1 : 10));
+    Hierarchy hierarchy(indices, parents, marginals);
+    hierarchy.solve(2);
+    CHECK(hierarchy.conv());
+    CHECK(hierarchy.areas() == 8);
+    CHECK(hierarchy.leaves() == (std::vector<int64_t>{3, 4, 5, 6, 7}));
+    const NDArray<int64_t>& population = hierarchy.population();
+    CHECK(population.size(0) == 5);
+    CHECK(hierarchy.expectation().sizes() == population.sizes());
+
+    // the leaves have the region's marginals exactly
+    NDArray<int64_t> t = total(population, 0, 5);
+    CHECK(reduce<int64_t>(t, 0) == values(marginals[0][0]));
+    CHECK(reduce<int64_t>(t, 1) == values(marginals[0][1]));
+    // and the first district (leaves 3 and 4) has its share of the region's population, rounded up or down
+    const double share = double(sum(marginals[1][0])) / (sum(marginals[1][0]) + sum(marginals[2][0]));
+    CHECK(std::fabs(sum(total(population, 0, 2)) - share * sum(marginals[0][0])) < 1.0);
+    CHECK(!Profile::enabled() || hierarchy.profile().counters().at("leaves") == 5);
+  }
+
+  // 20 districts of 25 output areas, the same whatever the number of threads
+  {
+    std::vector<int64_t> parents{-1};
+    for (int64_t d = 0; d < 20; ++d)
+      parents.push_back(0);
+    for (int64_t d = 0; d < 20; ++d)
+      for (int64_t o = 0; o < 25; ++o)
+        parents.push_back(d + 1);
+    std::vector<Hierarchy::marginal_list_t> marginals;
+    for (size_t a = 0; a < parents.size(); ++a)
+      marginals.push_back(marginalsOf(a, a ? 1 : 1000));
+    Hierarchy hierarchy(indices, parents, marginals);
+    hierarchy.solve(1);
+    CHECK(hierarchy.leaves().size() == 500);
+    NDArray<int64_t> t = total(hierarchy.population(), 0, 500);
+    CHECK(reduce<int64_t>(t, 0) == values(marginals[0][0]));
+    CHECK(reduce<int64_t>(t, 1) == values(marginals[0][1]));
+
+    NDArray<int64_t> single;
+    NDArray<int64_t>::copy(hierarchy.population(), single);
+    hierarchy.solve(4);
+    bool same = true;
+    for (size_t i = 0; i < single.storageSize(); ++i)
+      same = same && single.rawData()[i] == hierarchy.population().rawData()[i];
+    CHECK(same);
+  }
+
+  // output areas whose marginals sum to their district's, and districts to the region's: each area has its own exactly
+  {
+    const std::vector<int64_t> parents{-1, 0, 0, 1, 1, 2, 2, 2};
+    std::vector<Hierarchy::marginal_list_t> marginals(parents.size());
+    for (size_t a = parents.size() - 1; a > 0; --a)
+    {
+      if (marginals[a].empty())
+        marginals[a] = marginalsOf(a, 2);
+      Hierarchy::marginal_list_t& parent = marginals[parents[a]];
+      if (parent.empty())
+        for (const NDArray<int64_t>& m: marginals[a])
+        {
+          parent.push_back(NDArray<int64_t>(m.sizes()));
+          parent.back().assign(0ll);
+        }
+      for (size_t k = 0; k < indices.size(); ++k)
+        for (size_t i = 0; i < marginals[a][k].storageSize(); ++i)
+          parent[k].begin()[i] += marginals[a][k].rawData()[i];
+    }
+    Hierarchy hierarchy(indices, parents, marginals);
+    hierarchy.solve(2);
+    CHECK(hierarchy.conv());
+    const NDArray<int64_t>& population = hierarchy.population();
+    bool exact = true;
+    for (int64_t l = 0; l < 5; ++l)
+    {
+      NDArray<int64_t> t = total(population, l, l + 1);
+      const int64_t area = hierarchy.leaves()[l];
+      exact = exact && reduce<int64_t>(t, 0) == values(marginals[area][0]) && reduce<int64_t>(t, 1) == values(marginals[area][1]);
+    }
+    CHECK(exact);
+    CHECK(!Profile::enabled() || hierarchy.profile().counters().at("inconsistent") == 0);
+
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same population
+    std::vector<Hierarchy::marginal_list_t> cm;
+    for (const Hierarchy::marginal_list_t& m: marginals)
+      cm.push_back(fixtures::columnMajor(m));
+    Hierarchy hierarchyc(indices, parents, cm);
+    hierarchyc.solve(2);
+    CHECK(hierarchyc.conv());
+    CHECK(values(hierarchyc.population()) == values(population));
+  }
+
+  // errors
+  {
+    std::vector<Hierarchy::marginal_list_t> marginals;
+    for (size_t a = 0; a < 3; ++a)
+      marginals.push_back(marginalsOf(a, 1));
+    CHECK_THROWS((Hierarchy(indices, {-1, 0}, marginals)), std::runtime_error);
+    CHECK_THROWS((Hierarchy(indices, {-1, 3, 0}, marginals)), std::runtime_error);
+    CHECK_THROWS((Hierarchy(indices, {-1, 2, 1}, marginals)), std::runtime_error);
+  }
+}
@@ -2,6 +2,7 @@
 #include "NDArray.h"
 #include "NDArrayUtils.h"
 #include "Index.h"
+#include "StaticIndex.h"
 
 #include <iostream>
 
@@ -134,4 +135,71 @@ void unittest::testIndex()
         }
       }
   }
+
+  // Fixed-rank index tests
+  {
+    Index index(a3.sizes());
+    StaticIndex<3> sindex(a3.sizes());
+    // mapped to a {5,2} array (dims 2,0)
+    NDArray<int64_t> m({5,2});
+    for (Index i(m.sizes()); !i.end(); ++i)
+      m[i] = i[0] * 10 + i[1];
+    StaticOffset<3> moffset(sindex, {2,0}, m.strides());
+    MappedIndex mindex(index, {2,0});
+    // column-major
+    NDArray<int64_t> c(a3.sizes(), StorageOrder::ColumnMajor);
+    transposeStorage(a3, c);
+    StaticOffset<3> coffset(sindex, c.strides());
+    size_t n = 0;
+    bool same = true;
+    for (; !index.end(); ++index, ++n)
+    {
+      CHECK(!sindex.end());
+      same = same && sindex[0] == index[0] && sindex[1] == index[1] && sindex[2] == index[2];
+      same = same && m.rawData()[*moffset] == m[mindex];
+      same = same && c.rawData()[*coffset] == a3[index];
+      ++sindex;
+      moffset.advance(sindex);
+      coffset.advance(sindex);
+    }
+    CHECK(same);
+    CHECK(sindex.end());
+    CHECK(n == a3.storageSize());
+  }
+
+  // reduce and slice with storage order, and beyond MaxStaticRank (dynamic rank)
+  {
+    NDArray<int64_t> c(a3.sizes(), StorageOrder::ColumnMajor);
+    transposeStorage(a3, c);
+    CHECK(reduce(c, std::vector<int64_t>{2,0}).sizes() == reduce(a3, std::vector<int64_t>{2,0}).sizes());
+    const NDArray<int64_t>& rc = reduce(c, std::vector<int64_t>{2,0});
+    const NDArray<int64_t>& ra = reduce(a3, std::vector<int64_t>{2,0});
+    CHECK(std::equal(ra.rawData(), ra.rawData() + ra.storageSize(), rc.rawData()));
+    CHECK(reduce(c, 1) == reduce(a3, 1));
+    const NDArray<int64_t>& sc = slice(c, {1,2});
+    const NDArray<int64_t>& sa = slice(a3, {1,2});
+    CHECK(std::equal(sa.rawData(), sa.rawData() + sa.storageSize(), sc.rawData()));
+
+    std::vector<int64_t> sizes(MaxStaticRank + 1, 2);
+    sizes[0] = 3;
+    NDArray<int64_t> a(sizes);
+    int64_t v = 0;
+    for (int64_t* p = a.begin(); p != a.end(); ++p)
+      *p = v++;
+    const std::vector<int64_t> dims{(int64_t)MaxStaticRank, 0};
+    const NDArray<int64_t>& r = reduce(a, dims);
+    NDArray<int64_t> expected({2,3});
+    expected.assign(0);
+    Index index(sizes);
+    for (MappedIndex mindex(index, dims); !index.end(); ++index)
+      expected[mindex] += a[index];
+    CHECK(std::equal(r.rawData(), r.rawData() + r.storageSize(), expected.rawData()));
+
+    // MaxStaticRank free dimensions
+    const NDArray<int64_t>& s = slice(a, {0,1});
+    bool same = true;
+    for (FixedIndex findex(sizes, {{0,1}}); !findex.end(); ++findex)
+      same = same && s[findex.free()] == a[findex.operator const Index &()];
+    CHECK(same);
+  }
 }
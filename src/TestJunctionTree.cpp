@@ -0,0 +1,149 @@
+
+#include "UnitTester.h"
+#include "JunctionTree.h"
+#include "IPF.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+// max difference between a (solved) junction tree solution and dense IPF
+double compareIPF(const JunctionTreeIPF& tree, const std::vector<std::vector<int64_t>>& indices)
+{
+  const std::vector<int64_t>& sizes = tree.sizes();
+  std::vector<NDArray<double>> m = fixtures::marginalsOf(sizes, indices, 1.0, 1.0);
+  IPF<double> ipf(indices, m);
+  NDArray<double> seed(sizes);
+  seed.assign(1.0);
+  const NDArray<double>& expected = ipf.solve(seed);
+
+  NDArray<double> dense;
+  tree.toDense(dense);
+  double maxErr = 0.0;
+  for (Index index(sizes); !index.end(); ++index)
+    maxErr = std::max(maxErr, std::fabs(dense[index] - expected[index]));
+  return maxErr;
+}
+
+}
+
+void unittest::testJunctionTree()
+{
+  // decomposable: the marginals are the cliques, so the solution is found in one sweep
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}, {2,3}};
+    std::vector<NDArray<double>> m = fixtures::marginalsOf({3,4,2,3}, indices, 1.0, 1.0);
+    JunctionTreeIPF tree(indices, m);
+    CHECK(tree.solve());
+    CHECK(compareIPF(tree, indices) < 1e-6);
+    CHECK(tree.decomposable());
+    CHECK(tree.iters() <= 2);
+    CHECK(tree.cliques() == 3);
+    CHECK(tree.edges().size() == 2);
+    CHECK((tree.separator(0) == std::vector<int64_t>{1} || tree.separator(0) == std::vector<int64_t>{2}));
+    CHECK(!Profile::enabled() || tree.profile().counters().at("cliques") == 3);
+  }
+
+  // chordal, but the clique {0,1,2} isn't a marginal
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}, {0,2}};
+    std::vector<NDArray<double>> m = fixtures::marginalsOf({3,4,2}, indices, 1.0, 1.0);
+    JunctionTreeIPF tree(indices, m);
+    CHECK(tree.solve());
+    CHECK(compareIPF(tree, indices) < 1e-6);
+    CHECK(!tree.decomposable());
+    CHECK(tree.cliques() == 1);
+  }
+
+  // a 4-cycle is triangulated into two 3-d cliques
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}, {2,3}, {3,0}};
+    std::vector<NDArray<double>> m = fixtures::marginalsOf({3,4,2,3}, indices, 1.0, 1.0);
+    JunctionTreeIPF tree(indices, m);
+    CHECK(tree.solve());
+    CHECK(compareIPF(tree, indices) < 1e-6);
+    CHECK(!tree.decomposable());
+    CHECK(tree.cliques() == 2);
+    CHECK(tree.clique(0).size() == 3);
+    CHECK(tree.clique(1).size() == 3);
+
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same solution
+    std::vector<NDArray<double>> cm = fixtures::columnMajor(m);
+    JunctionTreeIPF treec(indices, cm);
+    CHECK(treec.solve());
+    NDArray<double> dense, densec;
+    tree.toDense(dense);
+    treec.toDense(densec);
+    double maxErr = 0.0;
+    for (Index index(dense.sizes()); !index.end(); ++index)
+      maxErr = std::max(maxErr, std::fabs(dense[index] - densec[index]));
+    CHECK(maxErr < 1e-12);
+  }
+
+  // independent marginals form a forest
+  {
+    std::vector<std::vector<int64_t>> indices{{1,0}, {2,3}};
+    std::vector<NDArray<double>> m = fixtures::marginalsOf({3,4,2,3}, indices, 1.0, 1.0);
+    JunctionTreeIPF tree(indices, m);
+    CHECK(tree.solve());
+    CHECK(compareIPF(tree, indices) < 1e-6);
+    CHECK(tree.edges().empty());
+
+    // the population sampled from integral clique tables has the marginals exactly
+    const SparseArray<int64_t>& population = tree.sample();
+    CHECK(tree.sampleConv());
+    int64_t total = 0;
+    for (const auto& v: population.values())
+      total += v.second;
+    CHECK(total == tree.population());
+  }
+
+  // 16 dimensions, 4^16 states: a chain of identical marginals with equal row and column sums
+  {
+    const double a[] = {40, 20, 30, 10,
+                        10, 40, 20, 30,
+                        30, 10, 40, 20,
+                        20, 30, 10, 40};
+    std::vector<std::vector<int64_t>> indices;
+    std::vector<NDArray<double>> m;
+    for (int64_t d = 0; d < 15; ++d)
+    {
+      indices.push_back({d, d+1});
+      m.push_back(NDArray<double>({4,4}));
+      std::copy(a, a + 16, m.back().begin());
+    }
+    JunctionTreeIPF ipf(indices, m);
+    CHECK(ipf.solve());
+    CHECK(ipf.decomposable());
+    CHECK(ipf.cliques() == 15);
+    CHECK(ipf.population() == 400);
+    double maxErr = 0.0;
+    for (size_t c = 0; c < ipf.cliques(); ++c)
+      for (size_t i = 0; i < 16; ++i)
+        maxErr = std::max(maxErr, std::fabs(ipf.cliqueTable(c).rawData()[i] - a[i]));
+    CHECK(maxErr < 1e-8);
+    // p(x) = prod a(x_d, x_d+1) / 100^14, as every separator value is 100
+    std::vector<int64_t> index{0,0,1,2,2,3,0,1,1,1,2,3,3,0,0,2};
+    double expected = 100.0;
+    for (size_t d = 0; d < 15; ++d)
+      expected *= a[index[d] * 4 + index[d+1]] / 100.0;
+    CHECK(std::fabs(ipf.value(index) / expected - 1.0) < 1e-9);
+
+    const SparseArray<int64_t>& population = ipf.sample();
+    CHECK(ipf.sampleConv());
+    CHECK(population.nonzeros() <= 400);
+  }
+
+  // errors
+  {
+    std::vector<NDArray<double>> m = fixtures::marginalsOf({3,4,2}, {{0,1}, {1,2}}, 1.0, 1.0);
+    JunctionTreeIPF ipf({{0,1}, {1,2}}, m);
+    CHECK_THROWS(ipf.sample(), std::runtime_error);
+    m[1].begin()[0] += 1.0;
+    m[1].begin()[2] -= 1.0;
+    CHECK_THROWS((JunctionTreeIPF({{0,1}, {1,2}}, m)), std::runtime_error);
+  }
+}
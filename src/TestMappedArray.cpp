@@ -0,0 +1,109 @@
+
+#include "UnitTester.h"
+#include "MappedArray.h"
+#include "IPF.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+void unittest::testMappedArray()
+{
+#ifndef _WIN32
+  char tmpl[] = "/tmp/humanleague_array_XXXXXX";
+  int fd = mkstemp(tmpl);
+  CHECK(fd != -1);
+  close(fd);
+  const std::string filename(tmpl);
+
+  // round trip, the file is always row-major
+  {
+    std::vector<int64_t> s{4,3,5};
+    NDArray<double> a(s, StorageOrder::ColumnMajor);
+    for (Index i(s); !i.end(); ++i)
+      a[i] = i[0] * 100 + i[1] * 10 + i[2] + 0.5;
+    saveArray(a, filename);
+
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    CHECK((size_t)file.tellg() == arrayfile::HeaderSize + 60 * sizeof(double));
+
+    const arrayfile::Header& header = arrayfile::readHeader(filename);
+    CHECK(header.kind == 'f');
+    CHECK(header.elementSize == 8);
+    CHECK(header.sizes == s);
+
+    MappedAllocator& mapped = MappedAllocator::instance();
+    const size_t mappings = mapped.mappings();
+    {
+      NDArray<double> b = loadArray<double>(filename);
+      CHECK(mapped.mappings() == mappings + 1);
+      CHECK(&b.allocator() == &mapped);
+      CHECK(b.storageOrder() == StorageOrder::RowMajor);
+      CHECK(b.sizes() == s);
+      bool same = true;
+      for (Index i(s); !i.end(); ++i)
+        same = same && b[i] == a[i];
+      CHECK(same);
+      CHECK(b.rawData()[1] == 1.5);
+      // private mapping: changes are not written to the file
+      b.begin()[0] = -1.0;
+    }
+    CHECK(mapped.mappings() == mappings);
+    CHECK(loadArray<double>(filename).rawData()[0] == 0.5);
+
+    CHECK_THROWS(loadArray<int64_t>(filename), std::runtime_error);
+    CHECK_THROWS(loadArray<double>("/tmp/humanleague_no_such_file"), std::runtime_error);
+
+    // truncated
+    CHECK(truncate(filename.c_str(), arrayfile::HeaderSize + 8) == 0);
+    CHECK_THROWS(loadArray<double>(filename), std::runtime_error);
+  }
+
+  // IPF with a memory-mapped population gives the same result as in memory
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+    std::vector<NDArray<double>> marginals;
+    double m[] = {10,20,10, 10,10,20, 20,10,10};
+    for (size_t k = 0; k < 2; ++k)
+    {
+      marginals.push_back(NDArray<double>({3,3}));
+      std::copy(m, m + 9, marginals.back().begin());
+    }
+    NDArray<double> seed({3,3,3});
+    for (Index i(seed.sizes()); !i.end(); ++i)
+      seed[i] = 1.0 + i[0] + i[1] * i[2];
+    saveArray(seed, filename);
+
+    IPF<double> ipf(indices, marginals);
+    const NDArray<double>& result = ipf.solve(seed);
+    CHECK(ipf.conv());
+
+    // threshold low enough to map the population
+    MappedAllocator mapped("", 128);
+    {
+      Allocator::Scope scope(mapped);
+      IPF<double> mipf(indices, marginals);
+      CHECK(mapped.mappings() == 1);
+      const NDArray<double>& mresult = mipf.solve(loadArray<double>(filename));
+      CHECK(&mresult.allocator() == &mapped);
+      CHECK(mipf.iters() == ipf.iters());
+      bool same = true;
+      for (Index i(result.sizes()); !i.end(); ++i)
+        same = same && mresult[i] == result[i];
+      CHECK(same);
+      saveArray(mresult, filename);
+    }
+    CHECK(mapped.mappings() == 0);
+    NDArray<double> saved = loadArray<double>(filename);
+    CHECK(std::equal(result.rawData(), result.rawData() + result.storageSize(), saved.rawData()));
+  }
+
+  std::remove(filename.c_str());
+#endif
+}
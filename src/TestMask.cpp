@@ -0,0 +1,134 @@
+
+#include "UnitTester.h"
+#include "Mask.h"
+#include "QIS.h"
+#include "QISI.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+typedef std::vector<std::vector<int64_t>> index_list_t;
+typedef std::vector<NDArray<int64_t>> marginal_list_t;
+
+NDArray<int64_t> marginal(const std::vector<int64_t>& sizes, const std::vector<int64_t>& values)
+{
+  NDArray<int64_t> m(sizes);
+  std::copy(values.begin(), values.end(), m.begin());
+  return m;
+}
+
+// true if the population has no one in a masked state
+bool respects(const NDArray<int64_t>& population, const Mask& mask)
+{
+  bool ok = true;
+  for (Index index(population.sizes()); !index.end(); ++index)
+    ok = ok && (mask.allowed(index) || population[index] == 0);
+  return ok;
+}
+
+}
+
+void unittest::testMask()
+{
+  // (age x marital status x sex), no one aged 0-15 married or widowed
+  NDArray<bool> allowed(std::vector<int64_t>{3, 3, 2});
+  allowed.assign(true);
+  for (int64_t s = 0; s < 2; ++s)
+  {
+    allowed[{0, 1, s}] = false;
+    allowed[{0, 2, s}] = false;
+  }
+  Mask mask(allowed);
+  CHECK(!mask.empty());
+  CHECK(Mask().empty());
+  CHECK(mask.count() == 14);
+  CHECK(mask.bits().size() == 1);
+  CHECK((mask.allowed({0, 0, 1})));
+  CHECK((!mask.allowed({0, 2, 1})));
+
+  // fixing sex, then marital status, then age
+  mask.plan({2, 1, 0});
+  bool allows = true;
+  for (int64_t s = 0; s < 2; ++s)
+    allows = allows && mask.allows({0, 0, s}, 2) && mask.allows({0, 1, s}, 1) && !mask.allows({0, 1, s}, 0) &&
+      mask.allows({1, 1, s}, 0);
+  CHECK(allows);
+
+  NDArray<double> seed(std::vector<int64_t>{3, 3, 2});
+  seed.assign(1.0);
+  mask.apply(seed);
+  CHECK(sum(seed) == 14.0);
+
+  const index_list_t indices{{0, 1}, {2}};
+  {
+    // age x marital status, and sex
+    marginal_list_t m;
+    m.push_back(marginal({3, 3}, {20, 0, 0, 30, 25, 5, 10, 20, 15}));
+    m.push_back(marginal({2}, {60, 65}));
+    marginal_list_t cm = fixtures::columnMajor(m);
+    QIS qis(indices, m, 0, false, allowed);
+    const NDArray<int64_t>& population = qis.solve();
+    CHECK(qis.conv());
+    CHECK(respects(population, mask));
+    CHECK((reduce<int64_t>(population, 2) == std::vector<int64_t>{60, 65}));
+    CHECK((qis.expectation()[{0, 1, 0}] == 0.0));
+    CHECK(std::isfinite(qis.chiSq()));
+    CHECK(!Profile::enabled() || qis.profile().phases().count("mask"));
+
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same population
+    QIS qisc(indices, cm, 0, false, allowed);
+    const NDArray<int64_t>& populationc = qisc.solve();
+    CHECK(qisc.conv());
+    CHECK(std::equal(population.begin(), population.end(), populationc.begin()));
+  }
+
+  // 1-d marginals only: the samplers steer clear of the masked states, but (unlike QISI) cannot foresee the remaining
+  // marginals running out of allowed combinations, so may miss them slightly
+  {
+    marginal_list_t m;
+    m.push_back(marginal({3}, {20, 55, 45}));
+    m.push_back(marginal({3}, {50, 30, 40}));
+    m.push_back(marginal({2}, {62, 58}));
+    QIS qis({{0}, {1}, {2}}, m, 0, false, allowed);
+    const NDArray<int64_t>& population = qis.solve();
+    CHECK(respects(population, mask));
+    CHECK(sum(population) == 120);
+    CHECK((reduce<int64_t>(population, 0) == std::vector<int64_t>{20, 55, 45}));
+    CHECK(std::isfinite(qis.chiSq()));
+  }
+
+  {
+    marginal_list_t m;
+    m.push_back(marginal({3}, {20, 55, 45}));
+    m.push_back(marginal({3}, {50, 30, 40}));
+    m.push_back(marginal({2}, {62, 58}));
+    NDArray<double> unity(std::vector<int64_t>{3, 3, 2});
+    unity.assign(1.0);
+    QISI qisi({{0}, {1}, {2}}, m, 0, allowed);
+    const NDArray<int64_t>& population = qisi.solve(unity);
+    CHECK(qisi.conv());
+    CHECK(respects(population, mask));
+    CHECK((qisi.expectation()[{0, 2, 1}] == 0.0));
+    CHECK(std::isfinite(qisi.chiSq()));
+  }
+
+  // errors
+  {
+    marginal_list_t m;
+    m.push_back(marginal({3}, {20, 55, 45}));
+    m.push_back(marginal({2}, {62, 58}));
+    CHECK_THROWS((QIS({{0}, {2}}, m, 0, false, allowed)), std::runtime_error);
+    marginal_list_t m3;
+    m3.push_back(marginal({3}, {20, 55, 45}));
+    m3.push_back(marginal({3}, {50, 30, 40}));
+    m3.push_back(marginal({2}, {62, 58}));
+    CHECK_THROWS((QIS({{0}, {1}, {2}}, m3, 0, true, allowed)), std::runtime_error);
+    NDArray<bool> none(std::vector<int64_t>{3, 3, 2});
+    none.assign(false);
+    CHECK_THROWS((QIS({{0}, {1}, {2}}, m3, 0, false, none)), std::runtime_error);
+  }
+}
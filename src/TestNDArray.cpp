@@ -1,6 +1,7 @@
 
 #include "UnitTester.h"
 #include "NDArray.h"
+#include "NDArrayUtils.h"
 #include "Index.h"
 
 #include <cstdint>
@@ -31,6 +32,127 @@ void unittest::testNDArray()
     }
   }
 
+  CHECK(a.storageOrder() == StorageOrder::RowMajor);
+  CHECK(a.strides()[0] == 6);
+  CHECK(a.strides()[1] == 3);
+  CHECK(a.strides()[2] == 1);
+  CHECK(a.rawData()[1] == 1);
+  CHECK(a.rawData()[3] == 10);
+
+  // column-major: same logical contents, first index varies fastest in memory
+  NDArray<uint32_t> c(s, StorageOrder::ColumnMajor);
+  CHECK(c.storageOrder() == StorageOrder::ColumnMajor);
+  CHECK(c.strides()[0] == 1);
+  CHECK(c.strides()[1] == 5);
+  CHECK(c.strides()[2] == 10);
+  transposeStorage(a, c);
+  for (Index i(s); !i.end(); ++i)
+  {
+    CHECK(c[i] == a[i]);
+  }
+  CHECK(c.rawData()[1] == 100);
+  CHECK(c.rawData()[5] == 10);
+
+  // copy and move retain order
+  {
+    NDArray<uint32_t> cc;
+    NDArray<uint32_t>::copy(c, cc);
+    CHECK(cc.storageOrder() == StorageOrder::ColumnMajor);
+    std::vector<int64_t> i0{4,1,2};
+    CHECK(cc[i0] == 412);
+    NDArray<uint32_t> cm(std::move(cc));
+    CHECK(cm.storageOrder() == StorageOrder::ColumnMajor);
+    std::vector<int64_t> i1{3,0,1};
+    CHECK(cm[i1] == 301);
+  }
+
+  // non-owning column-major wrapper (as used for R arrays)
+  {
+    std::vector<double> raw{1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+    NDArray<double> w({2,3}, raw.data(), StorageOrder::ColumnMajor);
+    std::vector<int64_t> i10{1,0}, i01{0,1}, i12{1,2};
+    CHECK(w[i10] == 2.0);
+    CHECK(w[i01] == 3.0);
+    CHECK(w[i12] == 6.0);
+    NDArray<double> r({2,3});
+    transposeStorage(w, r);
+    CHECK(r.rawData()[0] == 1.0);
+    CHECK(r.rawData()[1] == 3.0);
+    CHECK(r.rawData()[2] == 5.0);
+    CHECK(r.rawData()[3] == 2.0);
+  }
+
+  // larger than a single tile in the contiguous dimensions, odd sizes
+  {
+    std::vector<int64_t> bs{41,3,70};
+    NDArray<int64_t> r(bs);
+    for (Index i(bs); !i.end(); ++i)
+    {
+      r[i] = i[0] * 10000 + i[1] * 1000 + i[2];
+    }
+    NDArray<int64_t> cm(bs, StorageOrder::ColumnMajor);
+    transposeStorage(r, cm);
+    NDArray<int64_t> rr(bs);
+    transposeStorage(cm, rr);
+    bool same = true;
+    for (Index i(bs); !i.end(); ++i)
+    {
+      same = same && cm[i] == r[i] && rr[i] == r[i];
+    }
+    CHECK(same);
+    CHECK(cm.rawData()[1] == 10000);
+    CHECK(cm.rawData()[41] == 1000);
+    CHECK_THROWS(transposeStorage(r, c), std::runtime_error);
+  }
+
+  // storage is cache-line aligned by default, large arrays are huge-page aligned
+  {
+    CHECK(&a.allocator() == &Allocator::hugePage());
+    CHECK(reinterpret_cast<uintptr_t>(a.rawData()) % Allocator::Alignment == 0);
+    NDArray<double> big({512, 1024});
+    CHECK(reinterpret_cast<uintptr_t>(big.rawData()) % HugePageAllocator::HugePageSize == 0);
+  }
+
+  // arrays keep the allocator they were created with, and an arena is reused once its arrays are freed
+  {
+    Arena arena(4096);
+    {
+      Allocator::Scope scope(arena);
+      NDArray<int64_t> x({10});
+      NDArray<double> y({1000});
+      CHECK(&x.allocator() == &arena);
+      CHECK(reinterpret_cast<uintptr_t>(y.rawData()) % Allocator::Alignment == 0);
+      CHECK(arena.live() == 2);
+      CHECK(arena.blocks() == 2);
+      // growing reallocates from the arena
+      x.resize({20});
+      CHECK(arena.live() == 2);
+    }
+    CHECK(&Allocator::current() == &Allocator::hugePage());
+    CHECK(arena.live() == 0);
+    // the blocks have been consolidated
+    CHECK(arena.blocks() == 1);
+    CHECK(arena.capacity() >= 80 + 8000 + 160);
+
+    NDArray<int64_t> z({10});
+    CHECK(&z.allocator() == &Allocator::hugePage());
+    const int64_t* p = nullptr;
+    for (int i = 0; i < 2; ++i)
+    {
+      Allocator::Scope scope(arena);
+      NDArray<int64_t> x({10});
+      NDArray<double> y({1000});
+      CHECK(arena.blocks() == 1);
+      CHECK(i == 0 || x.rawData() == p);
+      p = x.rawData();
+      // moved arrays are still freed to the arena
+      NDArray<double> w(std::move(y));
+      CHECK(&w.allocator() == &arena);
+      CHECK(arena.live() == 2);
+    }
+    CHECK(arena.live() == 0);
+  }
+
 //  {
 //    NDArray<3, uint32_t>::ConstIterator<0> it(a, v);
 //    std::cout << it.idx()[0] << it.idx()[1] << it.idx()[2] << std::endl;
@@ -0,0 +1,198 @@
+
+#include "UnitTester.h"
+#include "Profile.h"
+#include "Trace.h"
+#include "QIS.h"
+#include "QISI.h"
+#include "IPF.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+void unittest::testProfile()
+{
+  if (!Profile::enabled())
+    return;
+
+  {
+    Profile profile;
+    const int64_t allocations = Profile::allocations();
+    {
+      PROFILE_SCOPE(profile, "outer");
+      NDArray<double> a(std::vector<int64_t>{2, 3});
+      {
+        PROFILE_SCOPE(profile, "inner");
+      }
+      PROFILE_COUNT(profile, "things", 3);
+    }
+    CHECK(Profile::allocations() == allocations + 1);
+    CHECK(profile.phases().size() == 2);
+    CHECK(profile.phases().at("outer").calls == 1);
+    CHECK(profile.phases().at("outer").allocations == 1);
+    CHECK(profile.phases().at("inner").allocations == 0);
+    CHECK(profile.phases().at("outer").time >= profile.phases().at("inner").time);
+    CHECK(profile.counters().at("things") == 3);
+
+    Profile other;
+    other.merge(profile);
+    other.merge(profile);
+    CHECK(other.phases().at("outer").calls == 2);
+    CHECK(other.counters().at("things") == 6);
+  }
+
+  {
+    int64_t m0[] = {52, 48};
+    int64_t m1[] = {10, 77, 13};
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>({2}, m0));
+    m.push_back(NDArray<int64_t>({3}, m1));
+    std::vector<std::vector<int64_t>> i{{0}, {1}};
+
+    QIS qis(i, m);
+    qis.solve();
+    const Profile& profile = qis.profile();
+    CHECK(profile.phases().count("validation") == 1);
+    CHECK(profile.phases().count("computeStateValues") == 1);
+    CHECK(profile.phases().count("sampling") == 1);
+    CHECK(profile.counters().at("samples") == 100);
+    // sampled into 16 bit counts
+    CHECK(profile.counters().at("occupancyBytes") == 2);
+    // the statistics are computed once, when first requested
+    CHECK(profile.phases().count("statistics") == 0);
+    qis.chiSq();
+    qis.degeneracy();
+    CHECK(profile.phases().at("statistics").calls == 1);
+    // the expectation is only computed when requested
+    CHECK(profile.phases().count("expectation") == 0);
+    qis.expectation();
+    CHECK(profile.phases().count("expectation") == 1);
+    // nothing to gain from reordering 1-d marginals
+    CHECK(qis.plan() == "0[0] 1[1]");
+    CHECK(profile.counters().at("planWork") == profile.counters().at("givenWork"));
+  }
+
+  // populations at the limit of 16 bit counts, sampled into the result's own storage and widened in place
+  for (int64_t population: {int64_t(65535), int64_t(65536)})
+  {
+    const std::vector<int64_t> m0{population - 35, 35};
+    const std::vector<int64_t> m1{1, population - 1};
+    // NB the solvers consume their marginals
+    std::vector<NDArray<int64_t>> m[2];
+    for (std::vector<NDArray<int64_t>>& mk: m)
+    {
+      mk.push_back(NDArray<int64_t>({2}));
+      mk.push_back(NDArray<int64_t>({2}));
+      std::copy(m0.begin(), m0.end(), mk[0].begin());
+      std::copy(m1.begin(), m1.end(), mk[1].begin());
+    }
+    NDArray<double> seed({2, 2});
+    seed.assign(1.0);
+    QISI qisi({{0}, {1}}, m[0]);
+    const NDArray<int64_t>& qisiPopulation = qisi.solve(seed);
+    QIS qis({{0}, {1}}, m[1]);
+    const NDArray<int64_t>& qisPopulation = qis.solve();
+    for (const NDArray<int64_t>* p: {&qisPopulation, &qisiPopulation})
+    {
+      CHECK(reduce<int64_t>(*p, 0) == m0);
+      CHECK(reduce<int64_t>(*p, 1) == m1);
+      CHECK(max(*p) >= population - 36);
+    }
+    CHECK(!Profile::enabled() || qis.profile().counters().at("occupancyBytes") == (population > 65535 ? 4 : 2));
+    CHECK(!Profile::enabled() || qisi.profile().counters().at("occupancyBytes") == (population > 65535 ? 4 : 2));
+  }
+
+  // the sampling plan: visiting the 1-d marginal first fixes dimension 1 of the others cheaply
+  {
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>({2, 10}));
+    m.push_back(NDArray<int64_t>({10}));
+    m.push_back(NDArray<int64_t>({10, 2}));
+    m[0].assign(3ll);
+    m[1].assign(6ll);
+    m[2].assign(3ll);
+    QIS qis({{0, 1}, {1}, {1, 2}}, m);
+    const NDArray<int64_t>& population = qis.solve();
+    CHECK(qis.conv());
+    CHECK(sum(population) == 60);
+    CHECK(qis.plan() == "1[1] 2[2] 0[0]");
+    CHECK(qis.profile().counters().at("planWork") < qis.profile().counters().at("givenWork"));
+    CHECK(qis.profile().counters().at("planVisit0") == 1);
+  }
+
+  // and a marginal's largest dimension is sampled first
+  {
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>({10, 2}));
+    m.push_back(NDArray<int64_t>({3}));
+    for (int64_t n = 0; n < 20; ++n)
+      m[0].begin()[n] = 1 + n % 4;
+    m[1].begin()[0] = 20;
+    m[1].begin()[1] = 15;
+    m[1].begin()[2] = 15;
+    QIS qis({{0, 1}, {2}}, m);
+    const NDArray<int64_t>& population = qis.solve();
+    CHECK(qis.conv());
+    CHECK(qis.plan() == "1[2] 0[0,1]");
+    bool met = true;
+    const NDArray<int64_t>& r = reduce<int64_t>(population, std::vector<int64_t>{0, 1});
+    for (int64_t n = 0; n < 20; ++n)
+      met = met && r.rawData()[n] == 1 + n % 4;
+    CHECK(met);
+  }
+
+  {
+    std::vector<NDArray<double>> m;
+    m.push_back(NDArray<double>({2}));
+    m.push_back(NDArray<double>({2}));
+    m[0].assign(50.0);
+    m[1].assign(50.0);
+    std::vector<std::vector<int64_t>> i{{0}, {1}};
+    NDArray<double> seed({2, 2});
+    seed.assign(1.0);
+
+    IPF<double> ipf(i, m);
+    ipf.solve(seed);
+    CHECK(ipf.profile().counters().at("iterations") == (int64_t)ipf.iters());
+    CHECK(ipf.profile().phases().at("rScale").calls == (int64_t)ipf.iters());
+  }
+
+#ifndef _WIN32
+  // trace events are written to file
+  {
+    char tmpl[] = "/tmp/humanleague_trace_XXXXXX";
+    int fd = mkstemp(tmpl);
+    CHECK(fd != -1);
+    close(fd);
+    const std::string filename(tmpl);
+    Trace& trace = Trace::instance();
+    trace.open(filename);
+    CHECK(trace.enabled());
+    {
+      TRACE_SCOPE("outer");
+      Profile profile;
+      PROFILE_SCOPE(profile, "inner");
+    }
+    // closes the file
+    trace.open("");
+    CHECK(!trace.enabled());
+
+    std::ifstream file(filename);
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string& json = content.str();
+    CHECK(json.find("[") == 0);
+    CHECK(json.find("\"name\":\"outer\"") != std::string::npos);
+    CHECK(json.find("\"name\":\"inner\"") != std::string::npos);
+    CHECK(json.find("\"ph\":\"X\"") != std::string::npos);
+    CHECK(json.find("]") == json.size() - 2);
+    std::remove(filename.c_str());
+  }
+#endif
+}
@@ -0,0 +1,113 @@
+
+#include "UnitTester.h"
+#include "Raking.h"
+#include "IPF.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+// the records' weights aggregated over the state space
+NDArray<double> aggregate(const std::vector<int64_t>& sizes, const NDArray<int64_t>& categories, const NDArray<double>& weights)
+{
+  NDArray<double> dense(sizes);
+  dense.assign(0.0);
+  std::vector<int64_t> index(sizes.size());
+  for (size_t r = 0; r < weights.storageSize(); ++r)
+  {
+    for (size_t d = 0; d < sizes.size(); ++d)
+      index[d] = categories[std::vector<int64_t>{(int64_t)r, (int64_t)d}];
+    dense[index] += weights.rawData()[r];
+  }
+  return dense;
+}
+
+}
+
+void unittest::testRaking()
+{
+  const std::vector<int64_t> sizes{3,4,2};
+  const std::vector<std::vector<int64_t>> indices{{0,1}, {2,1}};
+  // several blocks of records
+  NDArray<int64_t> categories = fixtures::recordsOf(sizes, 20000, 12345);
+  NDArray<double> weights(std::vector<int64_t>{20000});
+  for (double* w = weights.begin(); w != weights.end(); ++w)
+    *w = 1.0 + (w - weights.begin()) % 3;
+
+  {
+    std::vector<NDArray<double>> m = fixtures::marginalsOf(sizes, indices, 100.0, 1.0);
+    Raking raking(indices, m, categories, weights);
+    CHECK(raking.records() == 20000);
+    const NDArray<double>& fitted = raking.solve(1);
+    CHECK(raking.conv());
+    CHECK(raking.maxError() < 1e-6);
+    CHECK(!Profile::enabled() || raking.profile().counters().at("records") == 20000);
+
+    // the fitted weights' sums are the marginals
+    NDArray<double> dense = aggregate(sizes, categories, fitted);
+    double maxErr = 0.0;
+    for (size_t k = 0; k < indices.size(); ++k)
+    {
+      NDArray<double> r = reduce<double>(dense, indices[k]);
+      for (size_t i = 0; i < r.storageSize(); ++i)
+        maxErr = std::max(maxErr, std::fabs(r.rawData()[i] - m[k].rawData()[i]));
+    }
+    CHECK(maxErr < 1e-6);
+
+    // equivalent to IPF seeded with the aggregated starting weights
+    IPF<double> ipf(indices, m);
+    NDArray<double> seed = aggregate(sizes, categories, weights);
+    const NDArray<double>& expected = ipf.solve(seed);
+    maxErr = 0.0;
+    for (Index index(sizes); !index.end(); ++index)
+      maxErr = std::max(maxErr, std::fabs(dense[index] - expected[index]));
+    CHECK(maxErr < 1e-6);
+
+    // the result doesn't depend on the number of threads
+    NDArray<double> single;
+    NDArray<double>::copy(fitted, single);
+    raking.solve(4);
+    bool same = true;
+    for (size_t r = 0; r < single.storageSize(); ++r)
+      same = same && single.rawData()[r] == raking.weights().rawData()[r];
+    CHECK(same);
+    CHECK(raking.iters() > 0);
+  }
+
+  // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same fit
+  {
+    std::vector<NDArray<double>> m = fixtures::marginalsOf(sizes, indices, 100.0, 1.0);
+    Raking raking(indices, m, categories, weights);
+    const NDArray<double>& fitted = raking.solve(1);
+    std::vector<NDArray<double>> cm = fixtures::columnMajor(m);
+    Raking craking(indices, cm, categories, weights);
+    const NDArray<double>& cfitted = craking.solve(1);
+    CHECK(craking.conv());
+    bool same = true;
+    for (size_t r = 0; r < fitted.storageSize(); ++r)
+      same = same && fitted.rawData()[r] == cfitted.rawData()[r];
+    CHECK(same);
+  }
+
+  // errors
+  {
+    std::vector<NDArray<double>> m = fixtures::marginalsOf(sizes, indices, 100.0, 1.0);
+    NDArray<int64_t> wrongDim(std::vector<int64_t>{20000, 2});
+    CHECK_THROWS(Raking(indices, m, wrongDim, weights), std::runtime_error);
+    NDArray<double> wrongSize(std::vector<int64_t>{10});
+    wrongSize.assign(1.0);
+    CHECK_THROWS(Raking(indices, m, categories, wrongSize), std::runtime_error);
+    NDArray<int64_t> outOfRange = fixtures::recordsOf(sizes, 20000, 12345);
+    outOfRange.begin()[1] = 4;
+    CHECK_THROWS(Raking(indices, m, outOfRange, weights), std::runtime_error);
+
+    // no record can match a nonzero cell
+    NDArray<double> zeros(std::vector<int64_t>{20000});
+    zeros.assign(0.0);
+    Raking raking(indices, m, categories, zeros);
+    CHECK_THROWS(raking.solve(), std::runtime_error);
+  }
+}
@@ -0,0 +1,97 @@
+
+#include "UnitTester.h"
+#include "RecordQISI.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+
+namespace {
+
+// true if the population drawn has the marginals exactly
+bool matches(const std::vector<int64_t>& ids, const NDArray<int64_t>& categories, const std::vector<std::vector<int64_t>>& indices,
+             const std::vector<NDArray<int64_t>>& marginals)
+{
+  const int64_t dim = categories.size(1);
+  bool ok = true;
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    NDArray<int64_t> sums(marginals[k].sizes());
+    sums.assign(0ll);
+    std::vector<int64_t> index(indices[k].size());
+    for (int64_t id: ids)
+    {
+      for (size_t j = 0; j < indices[k].size(); ++j)
+        index[j] = categories.rawData()[id * dim + indices[k][j]];
+      ++sums[index];
+    }
+    for (size_t i = 0; i < sums.storageSize(); ++i)
+      ok = ok && sums.rawData()[i] == marginals[k].rawData()[i];
+  }
+  return ok;
+}
+
+}
+
+void unittest::testRecordQISI()
+{
+  const std::vector<int64_t> sizes{3,4,2};
+  const std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+  NDArray<int64_t> categories = fixtures::recordsOf(sizes, 2000, 54321);
+  NDArray<double> weights(std::vector<int64_t>{2000});
+  for (double* w = weights.begin(); w != weights.end(); ++w)
+    *w = 1.0 + (w - weights.begin()) % 4;
+  // an unweighted record is never drawn
+  weights.begin()[7] = 0.0;
+
+  {
+    std::vector<NDArray<int64_t>> m = fixtures::marginalsOf<int64_t>(sizes, indices, 1, 1);
+    RecordQISI qisi(indices, m, categories, weights);
+    CHECK(qisi.records() == 2000);
+    const std::vector<int64_t>& ids = qisi.solve(2);
+    CHECK(qisi.conv());
+    CHECK(ids.size() == (size_t)qisi.population());
+    CHECK(matches(ids, categories, indices, m));
+    std::vector<int64_t> counts = qisi.counts();
+    CHECK(counts[7] == 0);
+    // the marginals are not consumed
+    CHECK(sum(m[0]) == qisi.population());
+    CHECK(!Profile::enabled() || qisi.profile().counters().at("recomputes") >= 1);
+  }
+
+  // a population much larger than the pool of records
+  {
+    std::vector<NDArray<int64_t>> m = fixtures::marginalsOf<int64_t>(sizes, indices, 1000, 1000);
+    RecordQISI qisi(indices, m, categories, weights);
+    const std::vector<int64_t>& ids = qisi.solve();
+    CHECK(qisi.conv());
+    CHECK(ids.size() == (size_t)qisi.population());
+    CHECK(matches(ids, categories, indices, m));
+    // the same result for a different number of threads
+    std::vector<int64_t> first(ids);
+    CHECK(qisi.solve(1) == first);
+  }
+
+  // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same population
+  {
+    std::vector<NDArray<int64_t>> m = fixtures::marginalsOf<int64_t>(sizes, indices, 1, 1);
+    std::vector<NDArray<int64_t>> cm = fixtures::columnMajor(m);
+    RecordQISI rowMajor(indices, m, categories, weights);
+    RecordQISI colMajor(indices, cm, categories, weights);
+    const std::vector<int64_t>& ids = colMajor.solve();
+    CHECK(colMajor.conv());
+    CHECK(matches(ids, categories, indices, m));
+    CHECK(ids == rowMajor.solve());
+  }
+
+  // errors
+  {
+    std::vector<NDArray<int64_t>> m = fixtures::marginalsOf<int64_t>(sizes, indices, 1, 1);
+    NDArray<int64_t> wrongDim(std::vector<int64_t>{2000, 2});
+    CHECK_THROWS(RecordQISI(indices, m, wrongDim, weights), std::runtime_error);
+    NDArray<double> zeros(std::vector<int64_t>{2000});
+    zeros.assign(0.0);
+    RecordQISI qisi(indices, m, categories, zeros);
+    CHECK_THROWS(qisi.solve(), std::runtime_error);
+  }
+}
@@ -39,4 +39,36 @@ void unittest::testReduce()
     CHECK_THROWS(reduce(a3,-1), std::runtime_error);
     CHECK_THROWS(reduce(a3,17), std::runtime_error);
   }
+  {
+    // single precision, accumulated in double beyond float precision (both the run and the element-wise paths)
+    NDArray<float> f({2,3,17});
+    f.assign(1.0f);
+    f.begin()[0] = 1 << 24;
+    const NDArray<double>& r0 = reduceAs<double>(f, std::vector<int64_t>{0});
+    CHECK_EQUAL(r0.rawData()[0], (1 << 24) + 50.0);
+    CHECK_EQUAL(r0.rawData()[1], 51.0);
+    const NDArray<double>& r1 = reduceAs<double>(f, std::vector<int64_t>{0,2});
+    CHECK_EQUAL(r1.rawData()[0], (1 << 24) + 2.0);
+    CHECK_EQUAL(r1.rawData()[33], 3.0);
+  }
+  // the narrowest integer counts for a population
+  CHECK_EQUAL(countBytes(65535), 2);
+  CHECK_EQUAL(countBytes(65536), 4);
+  CHECK_EQUAL(countBytes(2147483647ll), 4);
+  CHECK_EQUAL(countBytes(2147483648ll), 8);
+  // packed at the start of an array's own storage, and widened in place
+  {
+    NDArray<int64_t> a(std::vector<int64_t>{3, 5});
+    a.assign(-1ll);
+    NDArray<uint16_t> c = compactCounts<uint16_t>(a);
+    CHECK(c.sizes() == a.sizes());
+    CHECK_EQUAL(max(c), 0);
+    for (uint16_t i = 0; i < 15; ++i)
+      c.begin()[i] = 65535 - i;
+    widenCounts<uint16_t>(a);
+    bool widened = true;
+    for (int64_t i = 0; i < 15; ++i)
+      widened = widened && a.rawData()[i] == 65535 - i;
+    CHECK(widened);
+  }
 }
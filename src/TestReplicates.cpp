@@ -0,0 +1,152 @@
+
+#include "UnitTester.h"
+#include "Replicates.h"
+#include "Sobol.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <set>
+#include <cmath>
+
+void unittest::testReplicates()
+{
+  // scrambled Sobol sequences
+  {
+    const size_t dim = 3;
+    Sobol s(dim);
+    Sobol s0(dim);
+    s0.scramble(42);
+    Sobol s1(dim);
+    s1.scramble(42, 1);
+
+    // each of the first 2^k points falls in a different interval of width 2^-k in every dimension, as for the
+    // unscrambled sequence
+    const size_t n = 64;
+    std::vector<std::set<uint32_t>> strata(dim), strata0(dim);
+    bool differ = true;
+    std::vector<uint32_t> first;
+    for (size_t i = 0; i < n; ++i)
+    {
+      const std::vector<uint32_t> x = s.buf();
+      const std::vector<uint32_t>& x0 = s0.buf();
+      const std::vector<uint32_t>& x1 = s1.buf();
+      if (i == 0)
+        first = x0;
+      for (size_t d = 0; d < dim; ++d)
+      {
+        strata[d].insert(x[d] >> 26);
+        strata0[d].insert(x0[d] >> 26);
+        differ = differ && x0[d] != x[d] && x0[d] != x1[d];
+      }
+    }
+    CHECK(differ);
+    bool stratified = true;
+    for (size_t d = 0; d < dim; ++d)
+      stratified = stratified && strata0[d].size() == strata[d].size();
+    CHECK(stratified);
+
+    // reproducible, and persists across reset
+    s0.reset();
+    CHECK(s0.buf() == first);
+    Sobol s2(dim);
+    s2.scramble(42);
+    CHECK(s2.buf() == first);
+  }
+
+  std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+  std::vector<NDArray<int64_t>> marginals;
+  marginals.push_back(NDArray<int64_t>({4,6}));
+  marginals.push_back(NDArray<int64_t>({6,5}));
+  for (int64_t* p = marginals[0].begin(); p != marginals[0].end(); ++p)
+    *p = 10;
+  for (int64_t* p = marginals[1].begin(); p != marginals[1].end(); ++p)
+    *p = 6 + (p - marginals[1].begin()) % 5;
+  const int64_t population = 240;
+
+  {
+    const size_t k = 9;
+    QISReplicates serial(indices, marginals, k, 7, true);
+    serial.solve(1);
+    QISReplicates parallel(indices, marginals, k, 7);
+    parallel.solve(4);
+
+    // the marginals are not consumed
+    CHECK(sum(marginals[0]) == population);
+
+    // results don't depend on the number of threads
+    CHECK(serial.replicates() == k);
+    CHECK(serial.chiSq() == parallel.chiSq());
+    CHECK(serial.pValue() == parallel.pValue());
+    CHECK(serial.conv() == parallel.conv());
+    CHECK(std::equal(serial.mean().begin(), serial.mean().end(), parallel.mean().begin()));
+    CHECK(std::equal(serial.variance().begin(), serial.variance().end(), parallel.variance().begin()));
+    CHECK(parallel.populations().empty());
+    CHECK(serial.populations().size() == k);
+
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same replicates
+    QISReplicates colMajor(indices, fixtures::columnMajor(marginals), k, 7);
+    colMajor.solve(4);
+    CHECK(colMajor.chiSq() == serial.chiSq());
+    CHECK(std::equal(serial.mean().begin(), serial.mean().end(), colMajor.mean().begin()));
+
+    // replicates are distinct, and each matches a plain QIS with the same scrambling
+    std::set<std::vector<int64_t>> distinct;
+    for (size_t r = 0; r < k; ++r)
+    {
+      const NDArray<int64_t>& p = serial.populations()[r];
+      distinct.insert(std::vector<int64_t>(p.begin(), p.end()));
+      CHECK(serial.conv()[r]);
+    }
+    CHECK(distinct.size() == k);
+    {
+      std::vector<NDArray<int64_t>> m;
+      for (const NDArray<int64_t>& a: marginals)
+      {
+        m.push_back(NDArray<int64_t>());
+        NDArray<int64_t>::copy(a, m.back());
+      }
+      QIS qis(indices, m);
+      qis.scramble(7, 3);
+      const NDArray<int64_t>& p = qis.solve();
+      CHECK(std::equal(p.begin(), p.end(), serial.populations()[3].begin()));
+      CHECK(qis.chiSq() == serial.chiSq()[3]);
+    }
+
+    // mean and variance agree with those computed from the populations
+    double maxErr = 0.0;
+    for (size_t i = 0; i < serial.mean().storageSize(); ++i)
+    {
+      double s = 0.0, s2 = 0.0;
+      for (size_t r = 0; r < k; ++r)
+        s += serial.populations()[r].rawData()[i];
+      const double mean = s / k;
+      for (size_t r = 0; r < k; ++r)
+        s2 += (serial.populations()[r].rawData()[i] - mean) * (serial.populations()[r].rawData()[i] - mean);
+      maxErr = std::max(maxErr, std::fabs(serial.mean().rawData()[i] - mean));
+      maxErr = std::max(maxErr, std::fabs(serial.variance().rawData()[i] - s2 / (k - 1)));
+    }
+    CHECK(maxErr < 1e-12);
+    CHECK(std::fabs(sum(serial.mean()) - population) < 1e-9);
+    CHECK(std::fabs(sum(serial.expectation()) - population) < 1e-9);
+  }
+
+  // a single replicate has zero variance
+  {
+    QISReplicates single(indices, marginals, 1);
+    single.solve();
+    CHECK(sum(single.variance()) == 0.0);
+    CHECK(!Profile::enabled() || single.profile().counters().at("replicates") == 1);
+  }
+
+  // errors in replicates are propagated
+  CHECK_THROWS((QISReplicates(indices, marginals, 0)), std::runtime_error);
+  {
+    std::vector<NDArray<int64_t>> bad;
+    bad.push_back(NDArray<int64_t>({4,6}));
+    bad.push_back(NDArray<int64_t>({6,5}));
+    bad[0].assign(1ll);
+    bad[1].assign(1ll);
+    QISReplicates replicates(indices, bad, 4);
+    CHECK_THROWS(replicates.solve(2), std::runtime_error);
+  }
+}
@@ -0,0 +1,187 @@
+
+#include "UnitTester.h"
+#include "Simd.h"
+#include "NDArrayUtils.h"
+#include "StatFuncs.h"
+#include "IPF.h"
+
+#include <vector>
+#include <random>
+#include <limits>
+#include <cmath>
+
+void unittest::testSimd()
+{
+  const simd::Level saved = simd::level();
+  CHECK(static_cast<int>(saved) <= static_cast<int>(simd::supported()));
+  // can't select an unsupported level
+  simd::setLevel(simd::Level::AVX512);
+  CHECK(simd::level() == simd::supported());
+
+  std::mt19937 rng(19937);
+  std::uniform_real_distribution<double> u(0.5, 100.0);
+  std::vector<double> x(103), y(103), f(103);
+  for (size_t i = 0; i < x.size(); ++i)
+  {
+    x[i] = u(rng);
+    y[i] = u(rng);
+    f[i] = i % 7 ? u(rng) : 0.0;
+  }
+  const double eps = std::numeric_limits<double>::epsilon();
+
+  // every supported level against the scalar loops, for lengths and (unaligned) offsets either side of the vector widths
+  for (int l = 0; l <= static_cast<int>(simd::supported()); ++l)
+  {
+    simd::setLevel(static_cast<simd::Level>(l));
+    bool sums = true, elementwise = true;
+    for (size_t off = 0; off < 3; ++off)
+    {
+      for (size_t n = 0; n + off <= x.size(); n += 5)
+      {
+        const double* px = x.data() + off;
+        const double* py = y.data() + off;
+        double s = 0.0, c = 0.0, m = 0.0;
+        for (size_t i = 0; i < n; ++i)
+        {
+          s += px[i];
+          c += (px[i] - py[i]) * (px[i] - py[i]) / py[i];
+          m += std::fabs(px[i]);
+        }
+        sums = sums && std::fabs(simd::sum(px, n) - s) <= n * eps * m;
+        sums = sums && std::fabs(simd::chiSq(px, py, n) - c) <= n * eps * c;
+
+        std::vector<double> a(px, px + n), b(px, px + n), d(n);
+        simd::add(a.data(), py, n);
+        simd::subtract(d.data(), px, py, n);
+        for (size_t i = 0; i < n; ++i)
+          elementwise = elementwise && a[i] == px[i] + py[i] && d[i] == px[i] - py[i];
+        a.assign(px, px + n);
+        simd::scale(a.data(), 0.3, n);
+        simd::multiply(b.data(), f.data() + off, n);
+        for (size_t i = 0; i < n; ++i)
+          elementwise = elementwise && a[i] == px[i] * 0.3 && b[i] == (f[off + i] != 0.0 ? px[i] * f[off + i] : 0.0);
+      }
+    }
+    CHECK(sums);
+    CHECK(elementwise);
+
+    // zero factors zero the element whatever its value
+    std::vector<double> inf(16, std::numeric_limits<double>::infinity());
+    simd::multiply(inf.data(), std::vector<double>(16, 0.0).data(), inf.size());
+    CHECK(simd::sum(inf.data(), inf.size()) == 0.0);
+
+    // single precision elements, computed in double precision exactly as the scalar loops
+    const std::vector<float> xf(x.begin(), x.end());
+    bool singles = true;
+    for (size_t off = 0; off < 3; ++off)
+    {
+      for (size_t n = 0; n + off <= xf.size(); n += 5)
+      {
+        const float* px = xf.data() + off;
+        const double* pf = f.data() + off;
+        double s = 0.0;
+        for (size_t i = 0; i < n; ++i)
+          s += px[i];
+        singles = singles && std::fabs(simd::sum(px, n) - s) <= n * eps * s;
+
+        std::vector<double> r(y.begin() + off, y.begin() + off + n);
+        simd::add(r.data(), px, n);
+        std::vector<float> a(px, px + n), b(px, px + n);
+        simd::scale(a.data(), 0.3, n);
+        simd::multiply(b.data(), pf, n);
+        for (size_t i = 0; i < n; ++i)
+          singles = singles && r[i] == y[off + i] + px[i] && a[i] == static_cast<float>(px[i] * 0.3) &&
+            b[i] == (pf[i] != 0.0 ? static_cast<float>(px[i] * pf[i]) : 0.0f);
+      }
+    }
+    CHECK(singles);
+    // beyond float precision
+    std::vector<float> big(17, 1.0f);
+    big[0] = 1 << 24;
+    CHECK(simd::sum(big.data(), big.size()) == (1 << 24) + 16.0);
+  }
+  CHECK(std::string(simd::name(simd::Level::Scalar)) == "scalar");
+
+  // array functions give the same results in either storage order (contiguous and strided paths) and at any level
+  {
+    std::vector<int64_t> sizes{3,4,17};
+    NDArray<double> a(sizes);
+    NDArray<double> e(sizes);
+    for (Index i(sizes); !i.end(); ++i)
+    {
+      a[i] = std::floor(u(rng));
+      e[i] = u(rng);
+    }
+    NDArray<double> c(sizes, StorageOrder::ColumnMajor);
+    transposeStorage(a, c);
+    NDArray<double> ec(sizes, StorageOrder::ColumnMajor);
+    transposeStorage(e, ec);
+
+    simd::setLevel(simd::Level::Scalar);
+    const double chisq = chiSq(a, e);
+    const double chisqStrided = chiSq(a, ec);
+    simd::setLevel(simd::supported());
+    CHECK(std::fabs(chiSq(a, e) / chisq - 1.0) < 1e-13);
+    CHECK(std::fabs(chisqStrided / chisq - 1.0) < 1e-13);
+
+    // integer values: summation order doesn't matter
+    CHECK(sum(a) == sum(c));
+    for (const std::vector<int64_t>& dims: std::vector<std::vector<int64_t>>{{0}, {2}, {0,1}, {2,0}, {1,2}})
+    {
+      const NDArray<double>& r = reduce(a, dims);
+      const NDArray<double>& rc = reduce(c, dims);
+      CHECK(std::equal(r.rawData(), r.rawData() + r.storageSize(), rc.rawData()));
+    }
+    CHECK(min(a) <= max(a));
+    CHECK(max(a) == *std::max_element(a.rawData(), a.rawData() + a.storageSize()));
+
+    NDArray<double> d(sizes);
+    diff(a, e, d);
+    NDArray<double> dc(sizes);
+    diff(a, ec, dc);
+    CHECK(std::equal(d.rawData(), d.rawData() + d.storageSize(), dc.rawData()));
+  }
+
+  // IPF agrees across levels
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+    std::vector<NDArray<double>> marginals;
+    marginals.push_back(NDArray<double>({2,16}));
+    marginals.push_back(NDArray<double>({16,12}));
+    for (double* p = marginals[0].begin(); p != marginals[0].end(); ++p)
+      *p = 12.0;
+    for (double* p = marginals[1].begin(); p != marginals[1].end(); ++p)
+      *p = 1.0 + (p - marginals[1].begin()) % 3;
+    NDArray<double> seed({2,16,12});
+    for (double* p = seed.begin(); p != seed.end(); ++p)
+      *p = 1.0 + (p - seed.begin()) % 5;
+
+    simd::setLevel(simd::Level::Scalar);
+    IPF<double> ipf(indices, marginals);
+    const NDArray<double>& r = ipf.solve(seed);
+    simd::setLevel(simd::supported());
+    IPF<double> vipf(indices, marginals);
+    const NDArray<double>& vr = vipf.solve(seed);
+    CHECK(ipf.conv() && vipf.conv());
+    double maxDiff = 0.0;
+    for (size_t i = 0; i < r.storageSize(); ++i)
+      maxDiff = std::max(maxDiff, std::fabs(r.rawData()[i] - vr.rawData()[i]));
+    CHECK(maxDiff < 1e-10);
+
+    // in single precision, accumulating the reductions in double, the solution agrees to within float rounding
+    IPF<double, float> fipf(indices, marginals);
+    const NDArray<float>& fr = fipf.solve(seed);
+    CHECK(fipf.conv());
+    double maxRelDiff = 0.0;
+    for (size_t i = 0; i < r.storageSize(); ++i)
+      maxRelDiff = std::max(maxRelDiff, std::fabs(fr.rawData()[i] / r.rawData()[i] - 1.0));
+    CHECK(maxRelDiff < 1e-5);
+    const NDArray<double>& fm = reduceAs<double>(fr, indices[1]);
+    double maxError = 0.0;
+    for (size_t i = 0; i < fm.storageSize(); ++i)
+      maxError = std::max(maxError, std::fabs(fm.rawData()[i] - marginals[1].rawData()[i]));
+    CHECK(maxError <= fipf.maxError() + 1e-9);
+  }
+
+  simd::setLevel(saved);
+}
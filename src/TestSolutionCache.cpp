@@ -0,0 +1,211 @@
+
+#include "UnitTester.h"
+#include "SolutionCache.h"
+#include "NDArrayUtils.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+void unittest::testSolutionCache()
+{
+  // key is independent of storage order but sensitive to values, sizes and order of addition
+  {
+    double values[] = {1.0, 2.0, 3.0, 4.0, 5.0, 6.0};
+    double transposed[] = {1.0, 4.0, 2.0, 5.0, 3.0, 6.0};
+    NDArray<double> r({2,3}, values);
+    NDArray<double> c({2,3}, transposed, StorageOrder::ColumnMajor);
+    NDArray<double> r32({3,2}, values);
+
+    Hasher hr, hc, h32;
+    hr.add(r);
+    hc.add(c);
+    h32.add(r32);
+    CHECK(hr.key() == hc.key());
+    CHECK(!(hr.key() == h32.key()));
+
+    values[5] = 6.5;
+    Hasher hr2;
+    hr2.add(r);
+    CHECK(!(hr.key() == hr2.key()));
+
+    Hasher h0, h1, h2;
+    h0.add(std::string("qis"));
+    h1.add(std::string("qisi"));
+    h2.add(-0.0);
+    Hasher h3;
+    h3.add(0.0);
+    CHECK(!(h0.key() == h1.key()));
+    CHECK(h2.key() == h3.key());
+    CHECK(h0.key().str().size() == 32);
+  }
+
+  // LRU eviction by size
+  {
+    SolutionCache cache;
+    CHECK(!cache.enabled());
+    cache.configure(1000);
+    CHECK(cache.enabled());
+
+    std::vector<Hasher::Key> keys;
+    for (uint64_t i = 0; i < 3; ++i)
+    {
+      Hasher h;
+      h.add(i);
+      keys.push_back(h.key());
+      NDArray<double> a({40});
+      a.assign(double(i));
+      std::shared_ptr<Solution> s(new Solution);
+      s->set("a", a);
+      cache.insert(keys.back(), s);
+    }
+    // each entry is ~320 bytes so all fit
+    CHECK_EQUAL(cache.stats().entries, 3);
+    CHECK(cache.find(keys[0]));
+    // 4th entry evicts the least recently used (keys[1])
+    Hasher h;
+    h.add(uint64_t(3));
+    std::shared_ptr<Solution> s(new Solution);
+    NDArray<double> a({40});
+    a.assign(3.0);
+    s->set("a", a);
+    cache.insert(h.key(), s);
+    CHECK_EQUAL(cache.stats().entries, 3);
+    CHECK(!cache.find(keys[1]));
+    CHECK(cache.find(keys[0]));
+    CHECK(cache.find(keys[2]));
+    CHECK_EQUAL(cache.find(keys[2])->realArray("a")[std::vector<int64_t>{5}], 2.0);
+    CHECK_THROWS(cache.find(keys[2])->intArray("a"), std::runtime_error);
+    CHECK_EQUAL(cache.stats().misses, 1);
+
+    // shrinking evicts
+    cache.configure(400);
+    CHECK_EQUAL(cache.stats().entries, 1);
+    cache.clear();
+    CHECK_EQUAL(cache.stats().entries, 0);
+    CHECK_EQUAL(cache.stats().bytes, 0);
+
+    // re-setting an entry replaces its size rather than adding to it
+    std::shared_ptr<Solution> r(new Solution);
+    r->set("a", a);
+    r->set("a", a);
+    r->set("x", 1.0);
+    r->set("x", 2.0);
+    CHECK_EQUAL(r->bytes(), 40 * sizeof(double) + 1 + sizeof(double) + 1);
+    cache.insert(h.key(), r);
+    CHECK_EQUAL(cache.stats().bytes, r->bytes());
+  }
+
+  // cached solves return identical results without resolving. NB qis modifies its marginals
+  {
+    SolutionCache& cache = Global::instance<SolutionCache>();
+    cache.configure(1 << 20);
+    cache.clear();
+
+    std::vector<std::vector<int64_t>> indices{{0}, {1}};
+    std::vector<NDArray<int64_t>> m0;
+    m0.push_back(NDArray<int64_t>({2}));
+    m0.push_back(NDArray<int64_t>({3}));
+    std::vector<NDArray<int64_t>> m1;
+    m1.push_back(NDArray<int64_t>({2}));
+    m1.push_back(NDArray<int64_t>({3}));
+    for (auto* m: { &m0, &m1 })
+    {
+      (*m)[0][std::vector<int64_t>{0}] = 40; (*m)[0][std::vector<int64_t>{1}] = 60;
+      (*m)[1][std::vector<int64_t>{0}] = 10; (*m)[1][std::vector<int64_t>{1}] = 30; (*m)[1][std::vector<int64_t>{2}] = 60;
+    }
+
+    std::shared_ptr<const Solution> s0 = cached::qis(indices, m0, 0);
+    std::shared_ptr<const Solution> s1 = cached::qis(indices, m1, 0);
+    CHECK(s0 == s1);
+    CHECK_EQUAL(cache.stats().hits, 1);
+    CHECK_EQUAL(cache.stats().misses, 1);
+    CHECK_EQUAL(s1->scalar("pop"), 100);
+    CHECK_EQUAL(sum(s1->intArray("result")), 100);
+    // different skips is a different problem
+    std::shared_ptr<const Solution> s2 = cached::qis(indices, m1, 1);
+    CHECK(s2 != s1);
+    CHECK_EQUAL(cache.stats().misses, 2);
+
+#ifndef _WIN32
+    // disk tier round trip
+    char dirTemplate[] = "/tmp/hlcacheXXXXXX";
+    const char* dir = mkdtemp(dirTemplate);
+    CHECK(dir != nullptr);
+    if (dir)
+    {
+      cache.configure(1 << 20, dir);
+      std::vector<NDArray<double>> mr;
+      mr.push_back(NDArray<double>({2}));
+      mr.push_back(NDArray<double>({3}));
+      mr[0].assign(50.0);
+      mr[1].assign(100.0 / 3);
+      NDArray<double> seed({2,3});
+      seed.assign(1.0);
+      std::shared_ptr<const Solution> r0 = cached::ipf(indices, mr, seed);
+      // drop memory tier so that the next lookup has to come from disk
+      cache.clear();
+      std::shared_ptr<const Solution> r1 = cached::ipf(indices, mr, seed);
+      CHECK(r0 != r1);
+      CHECK_EQUAL(cache.stats().diskHits, 1);
+      CHECK_EQUAL(r1->scalar("conv"), 1.0);
+      CHECK_EQUAL(r1->scalar("iterations"), r0->scalar("iterations"));
+      bool same = true;
+      const NDArray<double>& a0 = r0->realArray("result");
+      const NDArray<double>& a1 = r1->realArray("result");
+      for (Index i(a0.sizes()); !i.end(); ++i)
+        same = same && a0[i] == a1[i];
+      CHECK(same);
+
+      // an entry written by another version (the word after the magic) is a miss, and is overwritten
+      DIR* d = opendir(dir);
+      size_t files = 0, temporaries = 0;
+      while (dirent* e = readdir(d))
+      {
+        if (e->d_name[0] == '.')
+          continue;
+        ++files;
+        temporaries += std::string(e->d_name).find(".tmp") != std::string::npos;
+        std::fstream f(std::string(dir) + "/" + e->d_name, std::ios::in | std::ios::out | std::ios::binary);
+        const uint64_t version = 1;
+        f.seekp(8);
+        f.write(reinterpret_cast<const char*>(&version), sizeof(version));
+      }
+      closedir(d);
+      CHECK_EQUAL(files, 1);
+      CHECK_EQUAL(temporaries, 0);
+      cache.clear();
+      std::shared_ptr<const Solution> r2 = cached::ipf(indices, mr, seed);
+      CHECK_EQUAL(cache.stats().diskHits, 0);
+      CHECK_EQUAL(cache.stats().misses, 1);
+      CHECK_EQUAL(r2->scalar("iterations"), r0->scalar("iterations"));
+      cache.clear();
+      cached::ipf(indices, mr, seed);
+      CHECK_EQUAL(cache.stats().diskHits, 1);
+
+      cache.configure(0);
+      // remove cache file(s) and directory
+      d = opendir(dir);
+      while (dirent* e = readdir(d))
+      {
+        if (e->d_name[0] != '.')
+          std::remove((std::string(dir) + "/" + e->d_name).c_str());
+      }
+      closedir(d);
+      CHECK(rmdir(dir) == 0);
+    }
+    CHECK_THROWS(cache.configure(100, "/nonexistent/directory"), std::runtime_error);
+#endif
+
+    // disable again
+    cache.configure(0);
+    cache.clear();
+    CHECK(!cache.enabled());
+  }
+}
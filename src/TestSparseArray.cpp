@@ -0,0 +1,113 @@
+
+#include "UnitTester.h"
+#include "SparseArray.h"
+#include "NDArrayUtils.h"
+#include "StatFuncs.h"
+#include "QIS.h"
+
+#include <cmath>
+
+void unittest::testSparseArray()
+{
+  {
+    SparseArray<int64_t> a({4,3,5});
+    CHECK(a.dim() == 3);
+    CHECK(a.states() == 60);
+    CHECK(a.nonzeros() == 0);
+    CHECK((a.offset({1,2,3}) == 28));
+    CHECK((a.index(28) == std::vector<int64_t>{1,2,3}));
+    CHECK((a[{1,2,3}] == 0));
+    // reading does not insert
+    CHECK(a.nonzeros() == 0);
+
+    a.at({3,0,1}) = 2;
+    a.at({0,1,4}) = 5;
+    a.at({1,2,3}) += 1;
+    CHECK(a.nonzeros() == 3);
+    CHECK((a[{3,0,1}] == 2));
+
+    // coordinates are in row-major order
+    NDArray<int64_t> coords;
+    NDArray<int64_t> values;
+    a.coordinates(coords, values);
+    CHECK(coords.size(0) == 3);
+    CHECK(coords.size(1) == 3);
+    CHECK(coords.rawData()[2] == 4);
+    CHECK(coords.rawData()[3] == 1);
+    CHECK(coords.rawData()[6] == 3);
+    CHECK(values.rawData()[0] == 5);
+    CHECK(values.rawData()[1] == 1);
+    CHECK(values.rawData()[2] == 2);
+
+    NDArray<int64_t> dense;
+    a.toDense(dense);
+    CHECK(sum(dense) == 8);
+    CHECK(dense.rawData()[46] == 2);
+
+    // same list as from the dense equivalent
+    CHECK(listify(8, a) == listify(8, dense));
+    CHECK(listify(8, a, 1)[0][0] == 1);
+
+    a.clear();
+    CHECK(a.nonzeros() == 0);
+  }
+
+  // far larger than any dense array
+  {
+    SparseArray<double> a(std::vector<int64_t>(6, 1000));
+    CHECK(a.states() == 1000000000000000000ll);
+    std::vector<int64_t> idx(6, 999);
+    a.at(idx) = 1.0;
+    CHECK(a.offset(idx) == a.states() - 1);
+    CHECK(a.index(a.states() - 1) == idx);
+    NDArray<double> dense;
+    CHECK_THROWS(a.toDense(dense), std::runtime_error);
+    CHECK_THROWS(SparseArray<double>(std::vector<int64_t>(7, 1000)), std::runtime_error);
+    CHECK_THROWS(SparseArray<double>(std::vector<int64_t>{2, 0}), std::runtime_error);
+  }
+
+  // QIS sparse and dense solutions agree, including the statistics
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+    std::vector<NDArray<int64_t>> marginals;
+    std::vector<NDArray<int64_t>> smarginals;
+    int64_t m[] = {10,20,10, 10,10,20, 20,10,10};
+    for (size_t k = 0; k < 2; ++k)
+    {
+      marginals.push_back(NDArray<int64_t>({3,3}));
+      std::copy(m, m + 9, marginals.back().begin());
+      smarginals.push_back(NDArray<int64_t>({3,3}));
+      std::copy(m, m + 9, smarginals.back().begin());
+    }
+
+    QIS qis(indices, marginals);
+    QIS sqis(indices, smarginals, 0, true);
+    CHECK(!qis.sparse());
+    CHECK(sqis.sparse());
+    CHECK_THROWS(qis.solveSparse(), std::runtime_error);
+    CHECK_THROWS(sqis.solve(), std::runtime_error);
+
+    const NDArray<int64_t>& d = qis.solve();
+    const SparseArray<int64_t>& s = sqis.solveSparse();
+    bool same = true;
+    for (Index i(d.sizes()); !i.end(); ++i)
+    {
+      same = same && d[i] == s[i];
+      if (d[i])
+        same = same && std::fabs(qis.expectation()[i] - sqis.sparseExpectation()[i]) < 1e-10;
+    }
+    CHECK(same);
+    CHECK(sqis.conv() == qis.conv());
+    CHECK(std::fabs(sqis.chiSq() - qis.chiSq()) < 1e-10);
+    CHECK(std::fabs(sqis.pValue() - qis.pValue()) < 1e-10);
+    CHECK(std::fabs(sqis.degeneracy() / qis.degeneracy() - 1.0) < 1e-10);
+
+    // chi-squared is the same whether or not the expectation has been computed before solving
+    for (size_t k = 0; k < 2; ++k)
+      std::copy(m, m + 9, marginals[k].begin());
+    QIS eqis(indices, marginals);
+    CHECK(eqis.expectation().storageSize() == 27);
+    eqis.solve();
+    CHECK(std::fabs(eqis.chiSq() - qis.chiSq()) < 1e-10);
+  }
+}
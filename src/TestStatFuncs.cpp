@@ -106,3 +106,39 @@ void unittest::testPValue()
 
   CHECK(withinTolerance(pValue(255, 290.285192).first, 0.0636423, 1e-6));
 }
+
+void unittest::testDegeneracy()
+{
+  bool logFactorials = true;
+  for (int64_t n = 0; n < 300; n += 7)
+    logFactorials = logFactorials && std::fabs(logFactorial(n) - std::lgamma(n + 1.0)) <= 1e-14 * (1.0 + std::lgamma(n + 1.0));
+  CHECK(logFactorials);
+
+  int64_t values[] = {1, 0, 2, 1, 3, 0};
+  NDArray<int64_t> a({2, 3}, values);
+  // S!/(prod_k(a_k+1)!) directly
+  double direct = 1.0;
+  for (size_t i = 0; i < 6; ++i)
+    direct *= (6.0 - i) / std::tgamma(values[i] + 2.0);
+  CHECK(withinTolerance(degeneracy(a), direct, 1e-12));
+  SparseArray<int64_t> s({2, 3});
+  for (Index i(a.sizes()); !i.end(); ++i)
+    if (a[i])
+      s.at(i) = a[i];
+  CHECK(withinTolerance(logDegeneracy(s), logDegeneracy(a), 1e-12));
+
+  // the statistics agree with the individual functions
+  NDArray<double> e({2, 3});
+  e.assign(7.0 / 6.0);
+  const Statistics stats = statistics(a, e);
+  CHECK(withinTolerance(stats.chiSq, chiSq(a, e), 1e-12));
+  CHECK(stats.pValue == pValue(dof(a.sizes()), stats.chiSq).first);
+  CHECK(stats.logDegeneracy == logDegeneracy(a));
+
+  // large counts: factorials overflow, the log degeneracy doesn't
+  NDArray<int64_t> large({10, 50});
+  large.assign(1000ll);
+  CHECK(std::isfinite(logDegeneracy(large)));
+  CHECK(logDegeneracy(large) < 0.0);
+  CHECK(degeneracy(large) == 0.0);
+}
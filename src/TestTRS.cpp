@@ -0,0 +1,101 @@
+
+#include "UnitTester.h"
+#include "TRS.h"
+#include "QISI.h"
+#include "NDArrayUtils.h"
+#include "TestFixtures.h"
+
+#include <vector>
+#include <cmath>
+
+namespace {
+
+// true if the population has the marginals exactly
+bool matches(const NDArray<int64_t>& population, const std::vector<std::vector<int64_t>>& indices,
+             const std::vector<NDArray<int64_t>>& marginals)
+{
+  bool ok = true;
+  for (size_t k = 0; k < indices.size(); ++k)
+  {
+    NDArray<int64_t> r = reduce<int64_t>(population, indices[k]);
+    for (size_t i = 0; i < r.storageSize(); ++i)
+      ok = ok && r.rawData()[i] == marginals[k].rawData()[i];
+  }
+  return ok;
+}
+
+}
+
+void unittest::testTRS()
+{
+  // 2-d, with a structural zero in the seed
+  {
+    std::vector<std::vector<int64_t>> indices{{0}, {1}};
+    std::vector<NDArray<int64_t>> m;
+    m.push_back(NDArray<int64_t>(std::vector<int64_t>{3}));
+    m.push_back(NDArray<int64_t>(std::vector<int64_t>{4}));
+    const int64_t m0[] = {17, 29, 31};
+    const int64_t m1[] = {11, 23, 19, 24};
+    std::copy(m0, m0 + 3, m[0].begin());
+    std::copy(m1, m1 + 4, m[1].begin());
+    NDArray<double> seed(std::vector<int64_t>{3, 4});
+    seed.assign(1.0);
+    seed[std::vector<int64_t>{1, 2}] = 0.0;
+
+    TRS trs(indices, m);
+    CHECK_THROWS(trs.chiSq(), std::runtime_error);
+    const NDArray<int64_t>& result = trs.solve(seed);
+    CHECK(trs.conv());
+    CHECK(sum(result) == 77);
+    CHECK(matches(result, indices, m));
+    CHECK((result[std::vector<int64_t>{1, 2}] == 0));
+    // every state is its expectation rounded up or down
+    bool rounded = true;
+    for (size_t i = 0; i < result.storageSize(); ++i)
+      rounded = rounded && std::fabs(result.rawData()[i] - trs.expectation().rawData()[i]) < 1.0;
+    CHECK(rounded);
+    CHECK(trs.pValue() > 0.9);
+    CHECK(!Profile::enabled() || trs.profile().counters().at("shortfall") == 0);
+  }
+
+  // 3-d with 2-d marginals: statistics as for QISI, and at least as close to the expectation
+  {
+    std::vector<std::vector<int64_t>> indices{{0,1}, {1,2}};
+    NDArray<int64_t> population(std::vector<int64_t>{4, 5, 3});
+    for (int64_t* p = population.begin(); p != population.end(); ++p)
+      *p = 1 + ((p - population.begin()) * 7) % 9;
+    std::vector<NDArray<int64_t>> m;
+    for (const std::vector<int64_t>& index: indices)
+    {
+      m.push_back(NDArray<int64_t>());
+      NDArray<int64_t>::copy(reduce<int64_t>(population, index), m.back());
+    }
+    NDArray<double> seed(std::vector<int64_t>{4, 5, 3});
+    for (double* p = seed.begin(); p != seed.end(); ++p)
+      *p = 1.0 + (p - seed.begin()) % 4;
+
+    TRS trs(indices, m);
+    const NDArray<int64_t>& result = trs.solve(seed);
+    CHECK(trs.conv());
+    CHECK(matches(result, indices, m));
+    CHECK(trs.pValue() >= 0.0 && trs.pValue() <= 1.0);
+    CHECK(std::isfinite(trs.logDegeneracy()));
+
+    std::vector<NDArray<int64_t>> mq;
+    for (const NDArray<int64_t>& a: m)
+    {
+      mq.push_back(NDArray<int64_t>());
+      NDArray<int64_t>::copy(a, mq.back());
+    }
+    QISI qisi(indices, mq);
+    qisi.solve(seed);
+    CHECK(trs.chiSq() <= qisi.chiSq());
+
+    // column-major marginals (e.g. Fortran-ordered numpy arrays) give the same population
+    std::vector<NDArray<int64_t>> cm = fixtures::columnMajor(m);
+    TRS trsc(indices, cm);
+    const NDArray<int64_t>& resultc = trsc.solve(seed);
+    CHECK(trsc.conv());
+    CHECK(std::equal(resultc.begin(), resultc.end(), result.begin()));
+  }
+}
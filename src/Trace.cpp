@@ -0,0 +1,92 @@
+
+#include "Trace.h"
+#include "Global.h"
+
+#include <iomanip>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// small sequential ids are easier to read on the timeline than native thread ids
+int64_t threadId()
+{
+  static std::atomic<int64_t> next(1);
+  static thread_local int64_t id = next++;
+  return id;
+}
+
+}
+
+Trace::Trace() : m_enabled(false), m_events(0), m_pid(getpid())
+{
+  const char* filename = std::getenv("HUMANLEAGUE_TRACE");
+  if (filename && *filename)
+    open(filename);
+}
+
+Trace::~Trace()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  close();
+}
+
+Trace& Trace::instance()
+{
+  return Global::instance<Trace>();
+}
+
+void Trace::open(const std::string& filename)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  close();
+  if (filename.empty())
+    return;
+
+  m_file.open(filename, std::ios::out | std::ios::trunc);
+  // tracing is diagnostic, so failure to open the file is not an error
+  if (!m_file)
+    return;
+  // microsecond timestamps, to the nearest ns
+  m_file << std::fixed << std::setprecision(3) << "[";
+  m_events = 0;
+  m_enabled = true;
+}
+
+void Trace::complete(const char* name, clock_t::time_point start, clock_t::time_point end)
+{
+  typedef std::chrono::duration<double, std::micro> us;
+  // steady clock epoch (typically boot time), so timestamps from different processes are comparable
+  const double ts = std::chrono::duration_cast<us>(start.time_since_epoch()).count();
+  const double dur = std::chrono::duration_cast<us>(end - start).count();
+  const int64_t tid = threadId();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_enabled)
+    return;
+  m_file << (m_events++ ? ",\n" : "\n") << "{\"name\":\"" << name << "\",\"cat\":\"humanleague\",\"ph\":\"X\",\"ts\":"
+         << ts << ",\"dur\":" << dur << ",\"pid\":" << m_pid << ",\"tid\":" << tid << "}";
+}
+
+void Trace::flush()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_enabled)
+    m_file.flush();
+}
+
+// requires the lock to be held
+void Trace::close()
+{
+  if (!m_enabled)
+    return;
+  m_enabled = false;
+  m_file << "\n]\n";
+  m_file.close();
+}
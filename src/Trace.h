@@ -0,0 +1,84 @@
+// Trace.h
+// Timeline of solver events in Chrome trace event format, viewable in chrome://tracing or https://ui.perfetto.dev
+// Tracing is enabled by setting the environment variable HUMANLEAGUE_TRACE to an output filename before the first
+// solve. Every profiled phase (see Profile.h) and each IPF iteration is recorded as a complete event with its thread
+// id, so load imbalance and serial sections are visible. Events are appended as they complete: the closing bracket is
+// optional in the format, so the file is readable even if the process does not exit cleanly.
+// Compiled out, along with the profiling, by HUMANLEAGUE_NO_PROFILE
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class Trace
+{
+public:
+  typedef std::chrono::steady_clock clock_t;
+
+  // Opens the file named by HUMANLEAGUE_TRACE, if set
+  Trace();
+
+  ~Trace();
+
+  Trace(const Trace&) = delete;
+  Trace& operator=(const Trace&) = delete;
+
+  static Trace& instance();
+
+  bool enabled() const { return m_enabled; }
+
+  // (re)directs output to a new file, an empty filename disables tracing. Any current file is closed
+  void open(const std::string& filename);
+
+  // records an event that ran (on the calling thread) from start to end
+  void complete(const char* name, clock_t::time_point start, clock_t::time_point end);
+
+  void flush();
+
+  // Records the enclosing block as an event, if tracing is enabled
+  class Scope
+  {
+  public:
+    explicit Scope(const char* name) : m_name(name), m_enabled(instance().enabled())
+    {
+      if (m_enabled)
+        m_start = clock_t::now();
+    }
+
+    ~Scope()
+    {
+      if (m_enabled)
+        instance().complete(m_name, m_start, clock_t::now());
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* m_name;
+    bool m_enabled;
+    clock_t::time_point m_start;
+  };
+
+private:
+  void close();
+
+  std::mutex m_mutex;
+  std::ofstream m_file;
+  std::atomic<bool> m_enabled;
+  size_t m_events;
+  int64_t m_pid;
+};
+
+#ifndef HUMANLEAGUE_NO_PROFILE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
@@ -47,11 +47,27 @@ const unittest::Logger& unittest::run()
   testCumNorm();
   testCholesky();
   testPValue();
+  testDegeneracy();
   testQIWS();
 
   testIndex();
   testSlice();
   testReduce();
 
+  testSolutionCache();
+  testProfile();
+  testSparseArray();
+  testMappedArray();
+  testSimd();
+  testReplicates();
+  testComponents();
+  testJunctionTree();
+  testRaking();
+  testRecordQISI();
+  testTRS();
+  testHierarchy();
+  testAdjust();
+  testMask();
+
   return Global::instance<Logger>();
 }
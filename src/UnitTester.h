@@ -86,11 +86,26 @@ void testSobol();
 void testCumNorm();
 void testCholesky();
 void testPValue();
+void testDegeneracy();
 void testQIWS();
 //void testConstrainedSampling();
 void testSlice();
 void testReduce();
 void testIndex();
+void testSolutionCache();
+void testProfile();
+void testSparseArray();
+void testMappedArray();
+void testSimd();
+void testReplicates();
+void testComponents();
+void testJunctionTree();
+void testRaking();
+void testRecordQISI();
+void testTRS();
+void testHierarchy();
+void testAdjust();
+void testMask();
 
 const Logger& run();
 
@@ -10,7 +10,11 @@ extern SEXP _humanleague_sobolSequence(SEXP, SEXP, SEXP);
 extern SEXP _humanleague_ipf(SEXP, SEXP);
 extern SEXP _humanleague_qis(SEXP, SEXP);
 extern SEXP _humanleague_qisi(SEXP, SEXP);
+extern SEXP _humanleague_qisReplicates(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 //extern SEXP _humanleague_correlatedSobol2Sequence(SEXP, SEXP, SEXP);
+extern SEXP _humanleague_cacheConfig(SEXP, SEXP);
+extern SEXP _humanleague_cacheStats();
+extern SEXP _humanleague_cacheClear();
 extern SEXP _humanleague_unitTest();
 
 // legacy
@@ -24,6 +28,10 @@ static const R_CallMethodDef CallEntries[] = {
   {"humanleague_ipf",           (DL_FUNC) &_humanleague_ipf,           2},
   {"humanleague_qis",           (DL_FUNC) &_humanleague_qis,           2},
   {"humanleague_qisi",          (DL_FUNC) &_humanleague_qisi,          2},
+  {"humanleague_qisReplicates", (DL_FUNC) &_humanleague_qisReplicates, 6},
+  {"humanleague_cacheConfig",   (DL_FUNC) &_humanleague_cacheConfig,   2},
+  {"humanleague_cacheStats",    (DL_FUNC) &_humanleague_cacheStats,    0},
+  {"humanleague_cacheClear",    (DL_FUNC) &_humanleague_cacheClear,    0},
   {"humanleague_unitTest",      (DL_FUNC) &_humanleague_unitTest,      0},
   // legacy functions (v1.0 compat)
   {"humanleague_synthPop",      (DL_FUNC) &_humanleague_synthPop,      1},
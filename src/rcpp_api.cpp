@@ -4,9 +4,11 @@
 #include "IPF.h"
 #include "QIS.h"
 #include "QISI.h"
+#include "Replicates.h"
 #include "Integerise.h"
 #include "StatFuncs.h"
 #include "Sobol.h"
+#include "SolutionCache.h"
 
 #include "QIWS.h" // TODO deprecate
 #include "GQIWS.h" // TODO deprecate
@@ -35,11 +37,10 @@ using namespace Rcpp;
 
 namespace Rhelpers {
 
-template<typename T, typename R>
-NDArray<T> convertArray(R rArray)
+template<typename R>
+std::vector<int64_t> getSizes(const R& rArray)
 {
   // workaround for 1-d arrays (which don't have "dim" attribute)
-  //Dimension colMajorSizes(rArray.hasAttribute("dim") ? Dimension(rArray.attr("dim")) : Dimension((size_t)rArray.size()));
   std::vector<int64_t> colMajorSizes;
   if (rArray.hasAttribute("dim"))
   {
@@ -49,21 +50,24 @@ NDArray<T> convertArray(R rArray)
   {
     colMajorSizes.push_back(rArray.size());
   }
-  const size_t dim = colMajorSizes.size();
-
-  // This is column major data - reverse the dimensions but copy the data as-is for efficiency
-  NDArray<T> array(colMajorSizes);
-
-  // This makes IPF work correctly
-  size_t i = 0;
-  for (TransposedIndex idx(colMajorSizes); !idx.end(); ++idx, ++i)
-  {
-    array[idx] = rArray[i];
-  }
+  return colMajorSizes;
+}
 
+template<typename T, typename R>
+NDArray<T> convertArray(R rArray)
+{
+  // R data is column major, so is stored as such and the data can be copied as-is
+  NDArray<T> array(getSizes(rArray), StorageOrder::ColumnMajor);
+  std::copy(rArray.begin(), rArray.end(), const_cast<T*>(array.rawData()));
   return array;
 }
 
+// Read-only shallow copy of R (double) data. The caller must ensure the R object outlives the returned array
+inline NDArray<double> wrapArray(NumericVector rArray)
+{
+  return NDArray<double>(getSizes(rArray), &rArray[0], StorageOrder::ColumnMajor);
+}
+
 // Helper to get overall dimension and sizes before constructing QIS
 std::vector<int64_t> getDimension(List indices, List marginals)
 {
@@ -94,6 +98,26 @@ std::vector<int64_t> getDimension(List indices, List marginals)
   return ret;
 }
 
+// Adds the solver instrumentation (see Profile.h), unless compiled out
+void insertProfile(List& result, const Profile& profile)
+{
+  if (!Profile::enabled())
+    return;
+
+  List phases;
+  for (const auto& p: profile.phases())
+  {
+    phases[p.first] = List::create(Named("time") = p.second.time,
+                                   Named("calls") = (double)p.second.calls,
+                                   Named("allocations") = (double)p.second.allocations);
+  }
+  List counters;
+  for (const auto& c: profile.counters())
+    counters[c.first] = (double)c.second;
+
+  result["profile"] = List::create(Named("phases") = phases, Named("counters") = counters);
+}
+
 void checkSeed(NumericVector seed, const std::vector<int64_t>& impliedDim)
 {
   const Dimension& seedDim = seed.attr("dim");
@@ -156,16 +180,16 @@ List synthPop(List marginals)
 
   IntegerVector values(t.storageSize());
   NumericVector probs(t.storageSize());
-  size_t i = 0;
-  for (TransposedIndex idx(t.sizes()); !idx.end(); ++idx, ++i)
-  {
-    values[i] = t[idx];
-    probs[i] = p[idx];
-  }
+  // write directly into the (column-major) R arrays
+  NDArray<int> vwrapper(t.sizes(), &values[0], StorageOrder::ColumnMajor);
+  NDArray<double> pwrapper(p.sizes(), &probs[0], StorageOrder::ColumnMajor);
+  transposeStorage(t, vwrapper);
+  transposeStorage(p, pwrapper);
   values.attr("dim") = sizes;
   probs.attr("dim") = sizes;
   result["p.hat"] = probs;
   result["x.hat"] = values;
+  Rhelpers::insertProfile(result, solver.profile());
 
   return result;
 }
@@ -202,16 +226,9 @@ List synthPopG(List marginals, NumericMatrix exoProbsIn)
   if (exoProbsIn.rows() != dims[0] || exoProbsIn.cols() != dims[1])
     throw std::runtime_error("GQIWS invalid permittedStates matrix size");
 
+  // Read-only shallow copy of (column-major) probabilities
   std::vector<int64_t> d{ dims[0], dims[1] };
-  NDArray<double> exoProbs(d);
-
-  for (d[0] = 0; d[0] < dims[0]; ++d[0])
-  {
-    for (d[1] = 0; d[1] < dims[1]; ++d[1])
-    {
-      exoProbs[d] = exoProbsIn(d[0],d[1]);
-    }
-  }
+  const NDArray<double> exoProbs(d, &exoProbsIn[0], StorageOrder::ColumnMajor);
 
   List result;
   GQIWS solver(m, exoProbs);
@@ -222,13 +239,11 @@ List synthPopG(List marginals, NumericMatrix exoProbsIn)
 
   // insert transposed result
   IntegerVector values(t.storageSize());
-  size_t i = 0;
-  for (TransposedIndex idx(t.sizes()); !idx.end(); ++idx, ++i)
-  {
-    values[i] = t[idx];
-  }
+  NDArray<int> vwrapper(t.sizes(), &values[0], StorageOrder::ColumnMajor);
+  transposeStorage(t, vwrapper);
   values.attr("dim") = dims;
   result["x.hat"] = values;
+  Rhelpers::insertProfile(result, solver.profile());
 
   return result;
 }
@@ -247,6 +262,7 @@ List synthPopG(List marginals, NumericMatrix exoProbsIn)
 //'   \item{the total population}
 //'   \item{the number of iterations required}
 //'   \item{the maximum error between the generated population and the marginals}
+//'   \item{a profile of the solve (time, calls and allocations per phase, and counters such as iterations)}
 //' }
 //' @examples
 //' ageByGender = array(c(1,2,5,3,4,3,4,5,1,2), dim=c(5,2))
@@ -272,6 +288,9 @@ List ipf(NumericVector seed, List indices, List marginals)
 
   std::vector<NDArray<double>> m;
   m.reserve(k);
+  // keeps alive any marginals coerced to double, which are then referenced (not copied) by m
+  std::vector<NumericVector> rm;
+  rm.reserve(k);
   std::vector<std::vector<int64_t>> idx;
   idx.reserve(k);
   std::vector<int64_t> s;
@@ -288,32 +307,33 @@ List ipf(NumericVector seed, List indices, List marginals)
   for (int64_t i = k-1; i >= 0; --i)
   {
     const IntegerVector& iv = indices[i];
-    const NumericVector& nv = marginals[i];
+    rm.push_back(marginals[i]);
     idx.push_back(std::vector<int64_t>(iv.size()));
     // also need to reverse dimension indices
     for (size_t j = 0; j < iv.size(); ++j)
       idx.back()[j] = dim - iv[j];
     //std::copy(iv.begin(), iv.end(), idx.back().begin());
-    // convert to NDArray
-    m.push_back(std::move(Rhelpers::convertArray<double, NumericVector>(nv)));
+    // wrap as column-major NDArray
+    m.push_back(Rhelpers::wrapArray(rm.back()));
   }
 
   // Storage for result
   List result;
   // Read-only shallow copy of seed
   const NDArray<double> seedwrapper(s, (double*)&seed[0]);
-  // Do IPF (could provide another ctor that takes preallocated memory for result)
-  IPF<double> ipf(idx, m);
+  // Do IPF (or retrieve from cache)
+  std::shared_ptr<const Solution> ipf = cached::ipf(idx, m, seedwrapper);
   NumericVector r(rSizes);
   // Copy result data into R array
-  const NDArray<double>& tmp = ipf.solve(seedwrapper);
+  const NDArray<double>& tmp = ipf->realArray("result");
   std::copy(tmp.rawData(), tmp.rawData() + tmp.storageSize(), r.begin());
-  result["conv"] = ipf.conv();
+  result["conv"] = (bool)ipf->scalar("conv");
   result["result"] = r;
-  result["pop"] = ipf.population();
-  result["iterations"] = ipf.iters();
+  result["pop"] = ipf->scalar("pop");
+  result["iterations"] = (int)ipf->scalar("iterations");
   //  result["errors"] = ipf.errors();
-  result["maxError"] = ipf.maxError();
+  result["maxError"] = ipf->scalar("maxError");
+  Rhelpers::insertProfile(result, ipf->profile());
   return result;
 }
 
@@ -324,13 +344,15 @@ List ipf(NumericVector seed, List indices, List marginals)
 //' @param indices a List of 1-d arrays specifying the dimension indices of each marginal
 //' @param marginals a List of arrays containing marginal data. The sum of elements in each array must be identical
 //' @param skips (optional, default 0) number of Sobol points to skip before sampling
+//' @param statistics (optional, default TRUE) whether to compute the chi-square, p-value and degeneracy of the population. Omitting them saves a pass over the state space
 //' @return an object containing:
 //' \itemize{
 //'   \item{a flag indicating if the solution converged}
 //'   \item{the population matrix}
 //'   \item{the exepected state occupancy matrix}
 //'   \item{the total population}
-//'   \item{chi-square and p-value}
+//'   \item{chi-square and p-value (unless statistics is FALSE)}
+//'   \item{a profile of the solve (time, calls and allocations per phase, and counters such as iterations)}
 //' }
 //' @examples
 //' ageByGender = array(c(1,2,5,3,4,3,4,5,1,2), dim=c(5,2))
@@ -338,7 +360,7 @@ List ipf(NumericVector seed, List indices, List marginals)
 //' result = qis(list(c(1,2), c(3,2)), list(ageByGender, ageByEthnicity))
 //' @export
 // [[Rcpp::export]]
-List qis(List indices, List marginals, int skips = 0)
+List qis(List indices, List marginals, int skips = 0, bool statistics = true)
 {
   if (indices.size() != marginals.size())
   {
@@ -375,8 +397,8 @@ List qis(List indices, List marginals, int skips = 0)
 
   // Storage for result
   List result;
-  // Do QIS (could provide another ctor that takes preallocated memory for result)
-  QIS qis(idx, m, skips);
+  // Do QIS (or retrieve from cache)
+  std::shared_ptr<const Solution> qis = cached::qis(idx, m, skips, statistics);
 
   // How painful can it be to initialise a multidimensional array?
   int64_t size = std::accumulate(rSizes.begin(), rSizes.end(), 1ll, std::multiplies<int64_t>());
@@ -385,18 +407,113 @@ List qis(List indices, List marginals, int skips = 0)
   r.attr("dim") = rSizes;
   e.attr("dim") = rSizes;
   // Copy result data into R array
-  const NDArray<int64_t>& tmp = qis.solve();
+  const NDArray<int64_t>& tmp = qis->intArray("result");
   std::copy(tmp.rawData(), tmp.rawData() + tmp.storageSize(), r.begin());
 
-  const NDArray<double>& tmpe = qis.expectation();
+  const NDArray<double>& tmpe = qis->realArray("expectation");
   std::copy(tmpe.rawData(), tmpe.rawData() + tmpe.storageSize(), e.begin());
-  result["conv"] = qis.conv();
+  result["conv"] = (bool)qis->scalar("conv");
   result["result"] = r;
   result["expectation"] = e;
-  result["pop"] = qis.population();
-  result["chiSq"] = qis.chiSq();
-  result["pValue"] = qis.pValue();
-  result["degeneracy"] = qis.degeneracy();
+  result["pop"] = qis->scalar("pop");
+  if (statistics)
+  {
+    result["chiSq"] = qis->scalar("chiSq");
+    result["pValue"] = qis->scalar("pValue");
+    result["degeneracy"] = qis->scalar("degeneracy");
+  }
+  Rhelpers::insertProfile(result, qis->profile());
+
+  return result;
+}
+
+//' QIS replicates
+//'
+//' Runs independent replicates of QIS concurrently, for uncertainty quantification. Each replicate samples with a different (Owen) scrambling of the Sobol sequence, determined by the seed and the replicate number, so results are reproducible and do not depend on the number of threads
+//' @param indices a List of 1-d arrays specifying the dimension indices of each marginal
+//' @param marginals a List of arrays containing marginal data. The sum of elements in each array must be identical
+//' @param replicates the number of replicates
+//' @param threads (optional, default 0) number of threads to run the replicates on, 0 for one per hardware thread
+//' @param seed (optional, default 0) seed for the scrambling of each replicate's Sobol sequence
+//' @param populations (optional, default FALSE) whether to return the population of each replicate
+//' @return an object containing:
+//' \itemize{
+//'   \item{the per-state mean and variance of the population over the replicates}
+//'   \item{the exepected state occupancy matrix}
+//'   \item{per-replicate convergence flags, chi-square and p-values}
+//'   \item{the population matrix of each replicate, if requested}
+//'   \item{a profile of the solve, summed over the replicates}
+//' }
+//' @examples
+//' ageByGender = array(c(1,2,5,3,4,3,4,5,1,2), dim=c(5,2))
+//' ageByEthnicity = array(c(4,6,5,6,4,5), dim=c(3,2))
+//' result = qisReplicates(list(c(1,2), c(3,2)), list(ageByGender, ageByEthnicity), 10)
+//' @export
+// [[Rcpp::export]]
+List qisReplicates(List indices, List marginals, int replicates, int threads = 0, int seed = 0, bool populations = false)
+{
+  if (indices.size() != marginals.size())
+    throw std::runtime_error("index and marginal lists are different lengths");
+  if (replicates < 1 || threads < 0)
+    throw std::runtime_error("replicates must be positive and threads non-negative");
+
+  std::vector<int64_t> rSizes = Rhelpers::getDimension(indices, marginals);
+
+  const int64_t k = marginals.size();
+  const int64_t dim = rSizes.size();
+
+  std::vector<NDArray<int64_t>> m;
+  m.reserve(k);
+  std::vector<std::vector<int64_t>> idx;
+  idx.reserve(k);
+
+  // insert indices and marginals in reverse order (R being column-major)
+  for (int64_t i = k-1; i >= 0; --i)
+  {
+    const IntegerVector& iv = indices[i];
+    const IntegerVector& nv = marginals[i];
+    idx.push_back(std::vector<int64_t>(iv.size()));
+    for (size_t j = 0; j < iv.size(); ++j)
+      idx.back()[j] = dim - iv[j];
+    m.push_back(std::move(Rhelpers::convertArray<int64_t, IntegerVector>(nv)));
+  }
+
+  // not cached: the replicates are typically run once each
+  QISReplicates qis(idx, m, replicates, static_cast<uint32_t>(seed), populations);
+  qis.solve(threads);
+
+  const int64_t size = std::accumulate(rSizes.begin(), rSizes.end(), 1ll, std::multiplies<int64_t>());
+  NumericVector mean(size);
+  NumericVector variance(size);
+  NumericVector e(size);
+  mean.attr("dim") = rSizes;
+  variance.attr("dim") = rSizes;
+  e.attr("dim") = rSizes;
+  std::copy(qis.mean().rawData(), qis.mean().rawData() + qis.mean().storageSize(), mean.begin());
+  std::copy(qis.variance().rawData(), qis.variance().rawData() + qis.variance().storageSize(), variance.begin());
+  std::copy(qis.expectation().rawData(), qis.expectation().rawData() + qis.expectation().storageSize(), e.begin());
+
+  List result;
+  result["mean"] = mean;
+  result["variance"] = variance;
+  result["expectation"] = e;
+  result["conv"] = LogicalVector(qis.conv().begin(), qis.conv().end());
+  result["chiSq"] = NumericVector(qis.chiSq().begin(), qis.chiSq().end());
+  result["pValue"] = NumericVector(qis.pValue().begin(), qis.pValue().end());
+  if (populations)
+  {
+    List pops(qis.replicates());
+    for (size_t r = 0; r < qis.replicates(); ++r)
+    {
+      IntegerVector p(size);
+      p.attr("dim") = rSizes;
+      const NDArray<int64_t>& tmp = qis.populations()[r];
+      std::copy(tmp.rawData(), tmp.rawData() + tmp.storageSize(), p.begin());
+      pops[r] = p;
+    }
+    result["populations"] = pops;
+  }
+  Rhelpers::insertProfile(result, qis.profile());
 
   return result;
 }
@@ -408,13 +525,15 @@ List qis(List indices, List marginals, int skips = 0)
 //' @param indices a List of 1-d arrays specifying the dimension indices of each marginal
 //' @param marginals a List of arrays containing marginal data. The sum of elements in each array must be identical
 //' @param skips (optional, default 0) number of Sobol points to skip before sampling
+//' @param statistics (optional, default TRUE) whether to compute the chi-square, p-value and degeneracy of the population. Omitting them saves a pass over the state space
 //' @return an object containing:
 //' \itemize{
 //'   \item{a flag indicating if the solution converged}
 //'   \item{the population matrix}
 //'   \item{the exepected state occupancy matrix}
 //'   \item{the total population}
-//'   \item{chi-square and p-value}
+//'   \item{chi-square and p-value (unless statistics is FALSE)}
+//'   \item{a profile of the solve (time, calls and allocations per phase, and counters such as iterations)}
 //' }
 //' @examples
 //' ageByGender = array(c(1,2,5,3,4,3,4,5,1,2), dim=c(5,2))
@@ -423,7 +542,7 @@ List qis(List indices, List marginals, int skips = 0)
 //' result = qisi(seed, list(c(1,2), c(3,2)), list(ageByGender, ageByEthnicity))
 //' @export
 // [[Rcpp::export]]
-List qisi(NumericVector seed, List indices, List marginals, int skips = 0)
+List qisi(NumericVector seed, List indices, List marginals, int skips = 0, bool statistics = true)
 {
   if (indices.size() != marginals.size())
   {
@@ -472,23 +591,27 @@ List qisi(NumericVector seed, List indices, List marginals, int skips = 0)
 
   // Read-only shallow copy of seed
   const NDArray<double> seedwrapper(s, (double*)&seed[0]);
-  // Do QIS-IPF
-  QISI qisipf(idx, m, skips);
+  // Do QIS-IPF (or retrieve from cache)
+  std::shared_ptr<const Solution> qisipf = cached::qisi(idx, m, seedwrapper, skips, statistics);
 
   // Copy result data into R array
-  const NDArray<int64_t>& tmp = qisipf.solve(seedwrapper);
+  const NDArray<int64_t>& tmp = qisipf->intArray("result");
   std::copy(tmp.rawData(), tmp.rawData() + tmp.storageSize(), r.begin());
   result["result"] = r;
 
   // Copy result data into R array
-  const NDArray<double>& tmpe = qisipf.expectation();
+  const NDArray<double>& tmpe = qisipf->realArray("ipf");
   std::copy(tmpe.rawData(), tmpe.rawData() + tmpe.storageSize(), e.begin());
   result["expectation"] = e;
 
-  result["conv"] = qisipf.conv();
-  result["pop"] = qisipf.population();
-  result["chiSq"] = qisipf.chiSq();
-  result["pValue"] = qisipf.pValue();
+  result["conv"] = (bool)qisipf->scalar("conv");
+  result["pop"] = qisipf->scalar("pop");
+  if (statistics)
+  {
+    result["chiSq"] = qisipf->scalar("chiSq");
+    result["pValue"] = qisipf->scalar("pValue");
+  }
+  Rhelpers::insertProfile(result, qisipf->profile());
 
   return result;
 }
@@ -615,6 +738,59 @@ DataFrame flatten(IntegerVector stateOccupancies, StringVector categoryNames)
   return DataFrame(proxyDf);
 }
 
+//' Solution cache statistics
+//'
+//' @return a List containing the number of hits (total and from disk), misses, cached entries and their total size
+//' in bytes
+//' @examples
+//' cacheStats()
+//' @export
+// [[Rcpp::export]]
+List cacheStats()
+{
+  SolutionCache::Stats stats = Global::instance<SolutionCache>().stats();
+  List result;
+  result["hits"] = (double)stats.hits;
+  result["diskHits"] = (double)stats.diskHits;
+  result["misses"] = (double)stats.misses;
+  result["entries"] = (double)stats.entries;
+  result["bytes"] = (double)stats.bytes;
+  return result;
+}
+
+//' Configure the solution cache
+//'
+//' Identical ipf, qis and qisi problems (same indices, marginals, seed and skips) return a stored solution rather
+//' than being solved again. The cache is disabled by default.
+//' @param maxBytes the maximum (approximate) memory used by cached solutions. Zero disables the in-memory cache.
+//' @param directory an (existing) directory in which solutions are also stored, so that they persist between sessions.
+//' Empty (the default) disables the on-disk cache. Not supported on Windows.
+//' @return a List containing the cache statistics (see cacheStats)
+//' @examples
+//' cacheConfig(64*1024*1024)
+//' cacheConfig(0)
+//' @export
+// [[Rcpp::export]]
+List cacheConfig(double maxBytes, std::string directory = "")
+{
+  if (maxBytes < 0)
+    throw std::runtime_error("maxBytes must be non-negative");
+  Global::instance<SolutionCache>().configure((size_t)maxBytes, directory);
+  return cacheStats();
+}
+
+//' Empty the in-memory solution cache and reset its statistics
+//'
+//' Solutions stored on disk are not removed.
+//' @examples
+//' cacheClear()
+//' @export
+// [[Rcpp::export]]
+void cacheClear()
+{
+  Global::instance<SolutionCache>().clear();
+}
+
 //' Entry point to enable running unit tests within R (e.g. in testthat)
 //'
 //' @return a List containing, number of tests run, number of failures, and any error messages.
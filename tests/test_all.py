@@ -2,6 +2,8 @@
 
 import humanleague as hl
 import numpy as np
+import os
+import tempfile
 
 from unittest import TestCase
 
@@ -95,6 +97,21 @@ class Test(TestCase):
     self.assertTrue(np.allclose(np.sum(p["result"], 0), m1))
     self.assertTrue(np.allclose(np.sum(p["result"], 1), m0))
 
+    # fortran-ordered seed gives the same result
+    m1a = np.array([60.0, 30.0, 10.0])
+    s = np.array([[1.0, 0.5, 0.2], [0.3, 1.0, 0.8]])
+    p = hl.ipf(s, i, [m0, m1a])
+    pf = hl.ipf(np.asfortranarray(s), i, [m0, m1a])
+    self.assertTrue(pf["conv"])
+    self.assertTrue(np.allclose(p["result"], pf["result"]))
+    self.assertTrue(np.allclose(np.sum(pf["result"], 1), m0))
+
+    # single precision population, result widened to float64
+    ps = hl.ipf(s, i, [m0, m1a], True)
+    self.assertTrue(ps["conv"])
+    self.assertEqual(ps["result"].dtype, np.float64)
+    self.assertTrue(np.allclose(p["result"], ps["result"], rtol=1e-5))
+
     i = [np.array([0]),np.array([1]),np.array([2])]
     s = np.array([[[1.0, 1.0], [1.0, 1.0]], [[1.0, 1.0], [1.0, 1.0]]])
     p = hl.ipf(s, i, [m0, m1, m2])
@@ -159,6 +176,156 @@ class Test(TestCase):
     self.assertTrue(p["conv"] == True)
     self.assertTrue(p["pop"] == 4096)
 
+  def test_IPF_junction_tree(self):
+    # a 4-cycle, triangulated into two cliques
+    m = np.array([[10.,20.,10.],[10.,10.,20.],[20.,10.,10.]])
+    idx = [np.array([0,1]), np.array([1,2]), np.array([2,3]), np.array([3,0])]
+    p = hl.junctionTree(idx, [m, m, m, m])
+    self.assertTrue(p["conv"])
+    self.assertFalse(p["decomposable"])
+    self.assertEqual(len(p["cliques"]), 2)
+    self.assertEqual(len(p["separators"]), 1)
+    self.assertFalse("result" in p)
+    # the same solution as dense IPF
+    d = hl.ipf(np.ones([3, 3, 3, 3]), idx, [m, m, m, m])["result"]
+    c0 = p["cliques"][0]
+    c1 = p["cliques"][1]
+    s = p["separators"][0]
+    self.assertTrue(np.allclose(np.sum(d, tuple(set(range(4)) - set(c0["dims"]))), c0["table"]))
+    self.assertTrue(np.allclose(np.sum(d, tuple(set(range(4)) - set(s["dims"]))), s["table"]))
+
+    # 20 dimensions (3^20 states) along a chain
+    idx = [np.array([k, k+1]) for k in range(19)]
+    p = hl.junctionTree(idx, [m] * 19, True)
+    self.assertTrue(p["conv"])
+    self.assertTrue(p["decomposable"])
+    self.assertTrue(p["sampleConv"])
+    r = p["result"]
+    self.assertEqual(np.sum(r["counts"]), 120)
+    for k in range(19):
+      a = np.zeros([3, 3])
+      np.add.at(a, (r["coords"][:,k], r["coords"][:,k+1]), r["counts"])
+      self.assertTrue(np.array_equal(a, m))
+
+  def test_rake(self):
+    # 1000 records over a 3x3x3 state space
+    np.random.seed(1)
+    c = np.random.randint(0, 3, size=(1000, 3)).astype(np.int64)
+    w = np.ones(1000)
+    m = np.array([[10.,20.,10.],[10.,10.,20.],[20.,10.,10.]])
+    i = [np.array([0,1]), np.array([1,2])]
+    p = hl.rake(c, w, i, [m, m])
+    self.assertTrue(p["conv"])
+    self.assertEqual(p["pop"], 120.0)
+    self.assertEqual(p["weights"].shape, (1000,))
+    # the weights' sums are the marginals
+    a = np.zeros([3, 3])
+    np.add.at(a, (c[:,0], c[:,1]), p["weights"])
+    self.assertTrue(np.allclose(a, m))
+    # the same as IPF seeded with the aggregated records, whatever the number of threads
+    s = np.zeros([3, 3, 3])
+    np.add.at(s, (c[:,0], c[:,1], c[:,2]), w)
+    d = np.zeros([3, 3, 3])
+    np.add.at(d, (c[:,0], c[:,1], c[:,2]), p["weights"])
+    self.assertTrue(np.allclose(hl.ipf(s, i, [m, m])["result"], d))
+    self.assertTrue(np.array_equal(hl.rake(c, w, i, [m, m], 4)["weights"], p["weights"]))
+    # Fortran-ordered marginals give the same fit
+    f = np.asfortranarray(m)
+    self.assertTrue(np.allclose(hl.rake(c, w, i, [f, f])["weights"], p["weights"]))
+
+    self.assertEqual(hl.rake(c, w[:10], i, [m, m]), "number of weights (10) differs from the number of records (1000)")
+
+  def test_QISI_records(self):
+    # 1000 records over a 3x3x3 state space, with an extra unconstrained attribute
+    np.random.seed(2)
+    c = np.random.randint(0, 3, size=(1000, 3)).astype(np.int64)
+    w = np.random.uniform(0.5, 2.0, 1000)
+    m = np.array([[10,20,10],[10,10,20],[20,10,10]])
+    i = [np.array([0,1]), np.array([1,2])]
+    p = hl.qisiRecords(c, w, i, [m, m])
+    self.assertTrue(p["conv"])
+    self.assertEqual(p["pop"], 120.0)
+    r = p["result"]
+    self.assertEqual(len(r), 120)
+    self.assertTrue(np.all((r >= 0) & (r < 1000)))
+    # the records drawn have the marginals exactly
+    a = np.zeros([3, 3])
+    np.add.at(a, (c[r,0], c[r,1]), 1)
+    self.assertTrue(np.array_equal(a, m))
+    a = np.zeros([3, 3])
+    np.add.at(a, (c[r,1], c[r,2]), 1)
+    self.assertTrue(np.array_equal(a, m))
+    # reproducible
+    self.assertTrue(np.array_equal(hl.qisiRecords(c, w, i, [m, m], 0, 1)["result"], r))
+    # Fortran-ordered marginals give the same result
+    f = np.asfortranarray(m)
+    self.assertTrue(np.array_equal(hl.qisiRecords(c, w, i, [f, f])["result"], r))
+
+  def test_hierarchy(self):
+    # a region, 2 districts and 5 output areas
+    parents = np.array([-1, 0, 0, 1, 1, 2, 2, 2])
+    i = [np.array([0]), np.array([1])]
+    m = [[np.array([30, 40, 50]), np.array([20, 30, 40, 30])]]
+    for a in range(1, 8):
+      m.append([np.array([a, 2, 3]), np.array([1, a, 2, 2])])
+    p = hl.hierarchy(i, parents, m)
+    self.assertTrue(p["conv"])
+    self.assertTrue(np.array_equal(p["leaves"], [3, 4, 5, 6, 7]))
+    self.assertEqual(p["result"].shape, (5, 3, 4))
+    self.assertEqual(p["expectation"].shape, (5, 3, 4))
+    # the output areas add up to the region
+    self.assertTrue(np.array_equal(np.sum(p["result"], (0, 2)), m[0][0]))
+    self.assertTrue(np.array_equal(np.sum(p["result"], (0, 1)), m[0][1]))
+    # the same with an explicit seed and a single thread
+    self.assertTrue(np.array_equal(hl.hierarchy(i, parents, m, np.ones([3, 4]), 1)["result"], p["result"]))
+
+    # Fortran-ordered marginals that sum exactly to their parents' are met exactly by every area
+    np.random.seed(3)
+    t = [None] * 8
+    for a in range(3, 8):
+      t[a] = np.random.randint(0, 5, size=(3, 4, 2))
+    t[1] = t[3] + t[4]
+    t[2] = t[5] + t[6] + t[7]
+    t[0] = t[1] + t[2]
+    i2 = [np.array([0, 1]), np.array([1, 2])]
+    p = hl.hierarchy(i2, parents, [[np.asfortranarray(np.sum(x, 2)), np.asfortranarray(np.sum(x, 0))] for x in t])
+    self.assertTrue(p["conv"])
+    for l in range(5):
+      self.assertTrue(np.array_equal(np.sum(p["result"][l], 2), np.sum(t[l + 3], 2)))
+      self.assertTrue(np.array_equal(np.sum(p["result"][l], 0), np.sum(t[l + 3], 0)))
+
+    self.assertEqual(hl.hierarchy(i, np.array([-1, 2, 1]), m[:3]), "area 1 is in a cycle")
+
+  def test_IPF_file(self):
+    m = np.array([[10.,20.,10.],[10.,10.,20.],[20.,10.,10.]])
+    i = [np.array([0,1]), np.array([1,2])]
+    s = np.arange(1.0, 28.0).reshape([3,3,3])
+    p = hl.ipf(s, i, [m, m])
+
+    d = tempfile.mkdtemp()
+    seedFile = os.path.join(d, "seed.hla")
+    resultFile = os.path.join(d, "result.hla")
+    hl.saveArray(s, seedFile)
+    self.assertTrue(np.array_equal(hl.loadArray(seedFile), s))
+    self.assertEqual(os.path.getsize(seedFile), 4096 + 27 * 8)
+
+    f = hl.ipfFile(seedFile, i, [m, m], resultFile, d)
+    self.assertEqual(f["conv"], p["conv"])
+    self.assertEqual(f["iterations"], p["iterations"])
+    self.assertTrue(np.array_equal(hl.loadArray(resultFile), p["result"]))
+    # no temporary files left behind
+    self.assertEqual(sorted(os.listdir(d)), ["result.hla", "seed.hla"])
+
+    # errors are reported as strings, like the other functions
+    self.assertTrue(isinstance(hl.ipfFile(seedFile, [np.array([0,1])], [m, m], resultFile), str))
+    self.assertTrue(isinstance(hl.loadArray(os.path.join(d, "missing.hla")), str))
+    hl.saveArray(np.array([1, 2, 3]), seedFile)
+    self.assertTrue(np.array_equal(hl.loadArray(seedFile), [1, 2, 3]))
+    self.assertTrue(isinstance(hl.ipfFile(seedFile, i, [m, m], resultFile), str))
+    for f in os.listdir(d):
+      os.remove(os.path.join(d, f))
+    os.rmdir(d)
+
   def test_QIS(self):
 
     # m = np.array([[10,20,10],[10,10,20],[20,10,10]])
@@ -245,6 +412,90 @@ class Test(TestCase):
     self.assertTrue(np.allclose(np.sum(p["result"], 2), m))
     self.assertTrue(np.allclose(np.sum(p["result"], 0), m))
 
+  def test_QIS_sparse(self):
+    m = np.array([[10,20,10],[10,10,20],[20,10,10]])
+    idx = [np.array([0,1]), np.array([1,2])]
+    d = hl.qis(idx, [m, m])
+    s = hl.qis(idx, [m, m], 0, True)
+    r = s["result"]
+    self.assertTrue(np.array_equal(r["shape"], [3, 3, 3]))
+    self.assertEqual(r["coords"].shape, (len(r["counts"]), 3))
+    # same population as the dense solution
+    self.assertTrue(np.array_equal(r["counts"], d["result"][tuple(r["coords"].T)]))
+    self.assertEqual(np.count_nonzero(d["result"]), len(r["counts"]))
+    self.assertTrue(np.allclose(s["expectation"], d["expectation"][tuple(r["coords"].T)]))
+    self.assertAlmostEqual(s["chiSq"], d["chiSq"])
+    self.assertAlmostEqual(s["pValue"], d["pValue"])
+    self.assertEqual(s["conv"], d["conv"])
+    self.assertEqual(hl.flatten(r["coords"], r["counts"]), hl.flatten(d["result"]))
+
+    # statistics can be omitted, without changing the population
+    n = hl.qis(idx, [m, m], 0, False, False)
+    self.assertTrue(np.array_equal(n["result"], d["result"]))
+    self.assertFalse("chiSq" in n)
+    self.assertFalse("statistics" in n["profile"]["phases"])
+    self.assertTrue("statistics" in d["profile"]["phases"])
+
+    # ~4e13 states, far too many to store densely
+    m = np.array([125, 125, 250, 500] + [0] * 46)
+    s = hl.qis([np.array([k]) for k in range(8)], [m] * 8, 0, True)
+    self.assertTrue(s["conv"])
+    self.assertEqual(s["pop"], 1000)
+    r = s["result"]
+    self.assertEqual(np.sum(r["counts"]), 1000)
+    for k in range(8):
+      self.assertTrue(np.array_equal(np.bincount(r["coords"][:,k], r["counts"], 50), m))
+    table = hl.flatten(r["coords"], r["counts"])
+    self.assertEqual(len(table), 8)
+    self.assertEqual(len(table[0]), 1000)
+
+  def test_QIS_replicates(self):
+    m = np.array([[10,20,10],[10,10,20],[20,10,10]])
+    idx = [np.array([0,1]), np.array([1,2])]
+    r = hl.qisReplicates(idx, [m, m], 8, 1, 3, True)
+    self.assertEqual(r["mean"].shape, (3, 3, 3))
+    self.assertEqual(len(r["chiSq"]), 8)
+    self.assertEqual(len(r["populations"]), 8)
+    self.assertTrue(all(r["conv"]))
+    self.assertAlmostEqual(np.sum(r["mean"]), 120.0)
+    pops = np.array(r["populations"])
+    self.assertTrue(np.allclose(r["mean"], pops.mean(axis=0)))
+    self.assertTrue(np.allclose(r["variance"], pops.var(axis=0, ddof=1)))
+    for p in r["populations"]:
+      self.assertTrue(np.array_equal(np.sum(p, 2), m))
+    # independent of the number of threads
+    s = hl.qisReplicates(idx, [m, m], 8, 4, 3)
+    self.assertTrue(np.array_equal(r["variance"], s["variance"]))
+    self.assertTrue(np.array_equal(r["chiSq"], s["chiSq"]))
+    self.assertFalse("populations" in s)
+
+  def test_QIS_components(self):
+    # {0,1,2} and {3,4} are independent
+    m = np.array([[10,20,10],[10,10,20],[20,10,10]])
+    n = np.array([[30,20],[40,30]])
+    idx = [np.array([0,1]), np.array([1,2]), np.array([4,3])]
+    p = hl.qisComponents(idx, [m, m, n])
+    self.assertTrue(p["conv"])
+    self.assertEqual(p["pop"], 120)
+    self.assertEqual(len(p["components"]), 2)
+    self.assertTrue(np.array_equal(p["components"][0]["dims"], [0, 1, 2]))
+    self.assertTrue(np.array_equal(p["components"][1]["dims"], [3, 4]))
+    # a lone marginal is its own population, over ascending dimensions
+    self.assertTrue(np.array_equal(p["components"][1]["result"], n.T))
+    # the first component is solved as its own problem
+    self.assertTrue(np.array_equal(p["components"][0]["result"], hl.qis(idx[:2], [m, m])["result"]))
+    r = p["result"]
+    self.assertTrue(np.array_equal(r["shape"], [3, 3, 3, 2, 2]))
+    self.assertEqual(np.sum(r["counts"]), 120)
+    joint = np.zeros(r["shape"], dtype=int)
+    joint[tuple(r["coords"].T)] = r["counts"]
+    self.assertTrue(np.array_equal(np.sum(joint, (2, 3, 4)), m))
+    self.assertTrue(np.array_equal(np.sum(joint, (0, 3, 4)), m))
+    self.assertTrue(np.array_equal(np.sum(joint, (0, 1, 2)).T, n))
+    # the joint expectation is the product of the components'
+    e = np.multiply.outer(p["components"][0]["expectation"], p["components"][1]["expectation"]) / 120
+    self.assertTrue(np.allclose(p["expectation"], e[tuple(r["coords"].T)]))
+
   def test_QIS_dim_indexing(self):
 
     # tricky array indexing - 1st dimension of d0 already sampled, remaining dimension
@@ -263,6 +514,58 @@ class Test(TestCase):
     self.assertTrue(ms["conv"])
 
 
+  def test_TRS(self):
+    m0 = np.array([52, 48])
+    m1 = np.array([10, 77, 13])
+    i0 = np.array([0])
+    i1 = np.array([1])
+    s = np.ones([len(m0), len(m1)])
+
+    p = hl.trs(s, [i0, i1], [m0, m1])
+    self.assertTrue(p["conv"])
+    self.assertEqual(p["pop"], 100.0)
+    self.assertTrue(np.array_equal(np.sum(p["result"], 0), m1))
+    self.assertTrue(np.array_equal(np.sum(p["result"], 1), m0))
+    # the expectation rounded up or down
+    self.assertTrue(np.all(np.abs(p["result"] - p["ipf"]) < 1.0))
+    # no less likely than qisi
+    self.assertGreaterEqual(p["pValue"], hl.qisi(s, [i0, i1], [m0, m1])["pValue"])
+    self.assertFalse("chiSq" in hl.trs(s, [i0, i1], [m0, m1], False))
+
+    # 3-d with 2-d marginals
+    m = np.array([[10, 20, 10], [10, 10, 20], [20, 10, 10]])
+    i = [np.array([0, 1]), np.array([1, 2])]
+    p = hl.trs(np.ones([3, 3, 3]), i, [m, m])
+    self.assertTrue(p["conv"])
+    self.assertTrue(np.array_equal(np.sum(p["result"], 2), m))
+    self.assertTrue(np.array_equal(np.sum(p["result"], 0), m))
+    # Fortran-ordered marginals give the same result
+    f = np.asfortranarray(m)
+    self.assertTrue(np.array_equal(hl.trs(np.ones([3, 3, 3]), i, [f, f])["result"], p["result"]))
+
+  def test_mask(self):
+    m0 = np.array([20, 55, 45])
+    m1 = np.array([50, 30, 40])
+    i0 = np.array([0])
+    i1 = np.array([1])
+    # the youngest can't be in the last two categories
+    mask = np.ones([3, 3], dtype=int)
+    mask[0, 1:] = 0
+
+    p = hl.qis([i0, i1], [m0, m1], 0, False, True, mask)
+    self.assertTrue(np.all(p["result"][0, 1:] == 0))
+    self.assertTrue(np.all(p["expectation"][0, 1:] == 0.0))
+    self.assertTrue(np.isfinite(p["chiSq"]))
+    self.assertTrue(np.array_equal(np.sum(p["result"], 1), m0))
+
+    p = hl.qisi(np.ones([3, 3]), [i0, i1], [m0, m1], 0, True, mask)
+    self.assertTrue(p["conv"])
+    self.assertTrue(np.all(p["result"][0, 1:] == 0))
+    self.assertTrue(np.array_equal(np.sum(p["result"], 0), m1))
+    self.assertTrue(np.isfinite(p["chiSq"]))
+
+    self.assertEqual(hl.qis([i0, i1], [m0, m1], 0, True, True, mask), "a mask requires a dense result")
+
   def test_QISI(self):
     m0 = np.array([52, 48]) 
     m1 = np.array([10, 77, 13])
@@ -317,3 +620,55 @@ class Test(TestCase):
     self.assertTrue(np.allclose(np.sum(p["result"], (1, 2, 3)), m0))
     self.assertTrue(np.allclose(np.sum(p["result"], (2, 3, 0)), m1))
     self.assertTrue(np.allclose(np.sum(p["result"], (3, 0, 1)), m2))
+
+  def test_cache(self):
+    m0 = np.array([52, 48])
+    m1 = np.array([10, 77, 13])
+    i = [np.array([0]), np.array([1])]
+
+    self.assertTrue(hl.cacheConfig(1000000) is None)
+    hl.cacheClear()
+    p = hl.qis(i, [m0, m1])
+    self.assertEqual(hl.cacheStats()["misses"], 1)
+    # marginals are unchanged by the (cached) solve
+    self.assertTrue(np.array_equal(m0, np.array([52, 48])))
+    q = hl.qis(i, [m0, m1])
+    stats = hl.cacheStats()
+    self.assertEqual(stats["hits"], 1)
+    self.assertEqual(stats["entries"], 1)
+    self.assertTrue(np.array_equal(p["result"], q["result"]))
+    self.assertTrue(np.array_equal(p["expectation"], q["expectation"]))
+    self.assertEqual(p["chiSq"], q["chiSq"])
+
+    # different problem
+    q = hl.qis(i, [m0, m1], 4)
+    self.assertEqual(hl.cacheStats()["misses"], 2)
+
+    s = np.ones([2, 3])
+    p = hl.ipf(s, i, [m0.astype(float), m1.astype(float)])
+    q = hl.ipf(s, i, [m0.astype(float), m1.astype(float)])
+    self.assertEqual(hl.cacheStats()["hits"], 2)
+    self.assertTrue(np.array_equal(p["result"], q["result"]))
+
+    self.assertEqual(hl.cacheConfig(1000, "/nonexistent/dir"), "cache directory /nonexistent/dir does not exist")
+    hl.cacheConfig(0)
+    hl.cacheClear()
+    self.assertEqual(hl.cacheStats()["entries"], 0)
+
+  def test_profile(self):
+    m0 = np.array([52, 48])
+    m1 = np.array([10, 77, 13])
+    i = [np.array([0]), np.array([1])]
+    s = np.ones([2, 3])
+
+    p = hl.qisi(s, i, [m0, m1])["profile"]
+    for phase in ["validation", "sampling", "recomputeIPF", "ipf", "statistics"]:
+      self.assertTrue(phase in p["phases"])
+      self.assertGreaterEqual(p["phases"][phase]["time"], 0.0)
+    self.assertEqual(p["counters"]["samples"], 100)
+    self.assertEqual(p["phases"]["recomputeIPF"]["calls"], p["counters"]["ipfRecomputes"])
+    self.assertGreater(p["counters"]["iterations"], 0)
+
+    p = hl.ipf(s, i, [m0.astype(float), m1.astype(float)])
+    self.assertEqual(p["profile"]["counters"]["iterations"], p["iterations"])
+    self.assertEqual(p["profile"]["phases"]["rScale"]["calls"], p["iterations"])